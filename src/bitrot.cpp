@@ -0,0 +1,431 @@
+#include "include/bitrot.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <immintrin.h>
+
+using namespace cppio;
+
+namespace {
+
+// magicHighwayHash256Key is the magic key used by MinIO to compute
+// HighwayHash-256 bitrot checksums.
+const uint8_t magicHighwayHash256Key[32] = {
+    0x4b, 0xe7, 0x34, 0xfa, 0x8e, 0x23, 0x8a, 0xcd, 0x26, 0x3e, 0x83, 0xe6, 0xbb, 0x96, 0x85, 0x52,
+    0x04, 0x0f, 0x93, 0x5d, 0xa3, 0x9f, 0x44, 0x14, 0x97, 0xe0, 0x9d, 0x13, 0x22, 0xde, 0x36, 0xa0,
+};
+
+uint64_t load64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void store32be(uint32_t v, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(v >> 24);
+    out[1] = static_cast<uint8_t>(v >> 16);
+    out[2] = static_cast<uint8_t>(v >> 8);
+    out[3] = static_cast<uint8_t>(v);
+}
+
+// Slicing-by-8 tables of a reflected CRC-32 polynomial.
+using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+CrcTables makeCrcTables(uint32_t poly) {
+    CrcTables t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc >> 1) ^ ((crc & 1) ? poly : 0);
+        }
+        t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int s = 1; s < 8; ++s) {
+            t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+        }
+    }
+    return t;
+}
+
+const CrcTables ieeeTables = makeCrcTables(0xedb88320);
+const CrcTables castagnoliTables = makeCrcTables(0x82f63b78);
+
+uint32_t crc32Update(const CrcTables& t, uint32_t crc, const uint8_t* p, size_t len) {
+    crc = ~crc;
+    while (len >= 8) {
+        auto v = load64(p) ^ crc;
+        crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff] ^
+              t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t len) {
+    uint64_t c = ~crc;
+    while (len >= 8) {
+        c = _mm_crc32_u64(c, load64(p));
+        p += 8;
+        len -= 8;
+    }
+    auto c32 = static_cast<uint32_t>(c);
+    while (len-- > 0) {
+        c32 = _mm_crc32_u8(c32, *p++);
+    }
+    return ~c32;
+}
+
+const bool hasSse42 = __builtin_cpu_supports("sse4.2");
+const bool hasAvx2 = __builtin_cpu_supports("avx2");
+
+// Crc32Hash - CRC-32 (IEEE) or CRC-32C (Castagnoli), big endian sum like
+// Go's hash/crc32.
+class Crc32Hash : public BitrotHash {
+
+public:
+    explicit Crc32Hash(bool castagnoli) : castagnoli(castagnoli) {}
+
+    using BitrotHash::sum;
+
+    void reset() override { crc = 0; }
+
+    void update(const uint8_t* data, size_t len) override {
+        if (!castagnoli) {
+            crc = crc32Update(ieeeTables, crc, data, len);
+        } else if (hasSse42) {
+            crc = crc32cHardware(crc, data, len);
+        } else {
+            crc = crc32Update(castagnoliTables, crc, data, len);
+        }
+    }
+
+    void sum(uint8_t* out) override { store32be(crc, out); }
+    size_t size() const override { return 4; }
+
+private:
+    bool        castagnoli;
+    uint32_t    crc = 0;
+};
+
+// HighwayHash, a port of the portable reference implementation of
+// github.com/google/highwayhash with an AVX2 path for full packets.
+struct HighwayHashState {
+    uint64_t v0[4];
+    uint64_t v1[4];
+    uint64_t mul0[4];
+    uint64_t mul1[4];
+};
+
+void hhReset(const uint64_t key[4], HighwayHashState& s) {
+    s.mul0[0] = 0xdbe6d5d5fe4cce2full;
+    s.mul0[1] = 0xa4093822299f31d0ull;
+    s.mul0[2] = 0x13198a2e03707344ull;
+    s.mul0[3] = 0x243f6a8885a308d3ull;
+    s.mul1[0] = 0x3bd39e10cb0ef593ull;
+    s.mul1[1] = 0xc0acf169b5f18a8cull;
+    s.mul1[2] = 0xbe5466cf34e90c6cull;
+    s.mul1[3] = 0x452821e638d01377ull;
+    for (int i = 0; i < 4; ++i) {
+        s.v0[i] = s.mul0[i] ^ key[i];
+        s.v1[i] = s.mul1[i] ^ ((key[i] >> 32) | (key[i] << 32));
+    }
+}
+
+void hhZipperMergeAndAdd(uint64_t v1, uint64_t v0, uint64_t& add1, uint64_t& add0) {
+    add0 += (((v0 & 0xff000000ull) | (v1 & 0xff00000000ull)) >> 24) |
+            (((v0 & 0xff0000000000ull) | (v1 & 0xff000000000000ull)) >> 16) |
+            (v0 & 0xff0000ull) | ((v0 & 0xff00ull) << 32) |
+            ((v1 & 0xff00000000000000ull) >> 8) | (v0 << 56);
+    add1 += (((v1 & 0xff000000ull) | (v0 & 0xff00000000ull)) >> 24) |
+            (v1 & 0xff0000ull) | ((v1 & 0xff0000000000ull) >> 16) |
+            ((v1 & 0xff00ull) << 24) | ((v0 & 0xff000000000000ull) >> 8) |
+            ((v1 & 0xffull) << 48) | (v0 & 0xff00000000000000ull);
+}
+
+void hhUpdate(const uint64_t lanes[4], HighwayHashState& s) {
+    for (int i = 0; i < 4; ++i) {
+        s.v1[i] += s.mul0[i] + lanes[i];
+        s.mul0[i] ^= (s.v1[i] & 0xffffffff) * (s.v0[i] >> 32);
+        s.v0[i] += s.mul1[i];
+        s.mul1[i] ^= (s.v0[i] & 0xffffffff) * (s.v1[i] >> 32);
+    }
+    hhZipperMergeAndAdd(s.v1[1], s.v1[0], s.v0[1], s.v0[0]);
+    hhZipperMergeAndAdd(s.v1[3], s.v1[2], s.v0[3], s.v0[2]);
+    hhZipperMergeAndAdd(s.v0[1], s.v0[0], s.v1[1], s.v1[0]);
+    hhZipperMergeAndAdd(s.v0[3], s.v0[2], s.v1[3], s.v1[2]);
+}
+
+void hhUpdatePackets(const uint8_t* p, size_t packets, HighwayHashState& s) {
+    for (size_t n = 0; n < packets; ++n, p += 32) {
+        uint64_t lanes[4] = {load64(p), load64(p + 8), load64(p + 16), load64(p + 24)};
+        hhUpdate(lanes, s);
+    }
+}
+
+__attribute__((target("avx2")))
+void hhUpdatePacketsAvx2(const uint8_t* p, size_t packets, HighwayHashState& s) {
+    // Byte shuffle equivalent to hhZipperMergeAndAdd on each 128-bit half.
+    const __m256i zipper = _mm256_set_epi64x(0x070806090d0a040bll, 0x000f010e05020c03ll,
+                                             0x070806090d0a040bll, 0x000f010e05020c03ll);
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.v0));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.v1));
+    __m256i mul0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.mul0));
+    __m256i mul1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s.mul1));
+    for (size_t n = 0; n < packets; ++n, p += 32) {
+        __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        v1 = _mm256_add_epi64(v1, _mm256_add_epi64(mul0, lanes));
+        mul0 = _mm256_xor_si256(mul0, _mm256_mul_epu32(v1, _mm256_srli_epi64(v0, 32)));
+        v0 = _mm256_add_epi64(v0, mul1);
+        mul1 = _mm256_xor_si256(mul1, _mm256_mul_epu32(v0, _mm256_srli_epi64(v1, 32)));
+        v0 = _mm256_add_epi64(v0, _mm256_shuffle_epi8(v1, zipper));
+        v1 = _mm256_add_epi64(v1, _mm256_shuffle_epi8(v0, zipper));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.v0), v0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.v1), v1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.mul0), mul0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s.mul1), mul1);
+}
+
+void hhRotate32By(uint64_t count, uint64_t lanes[4]) {
+    for (int i = 0; i < 4; ++i) {
+        auto half0 = static_cast<uint32_t>(lanes[i]);
+        auto half1 = static_cast<uint32_t>(lanes[i] >> 32);
+        lanes[i] = (half0 << count) | (half0 >> (32 - count));
+        lanes[i] |= static_cast<uint64_t>((half1 << count) | (half1 >> (32 - count))) << 32;
+    }
+}
+
+void hhUpdateRemainder(const uint8_t* bytes, size_t sizeMod32, HighwayHashState& s) {
+    auto sizeMod4 = sizeMod32 & 3;
+    auto remainder = bytes + (sizeMod32 & ~static_cast<size_t>(3));
+    uint8_t packet[32] = {0};
+    for (int i = 0; i < 4; ++i) {
+        s.v0[i] += (static_cast<uint64_t>(sizeMod32) << 32) + sizeMod32;
+    }
+    hhRotate32By(sizeMod32, s.v1);
+    std::memcpy(packet, bytes, remainder - bytes);
+    if (sizeMod32 & 16) {
+        for (int i = 0; i < 4; ++i) {
+            packet[28 + i] = remainder[i + sizeMod4 - 4];
+        }
+    } else if (sizeMod4) {
+        packet[16 + 0] = remainder[0];
+        packet[16 + 1] = remainder[sizeMod4 >> 1];
+        packet[16 + 2] = remainder[sizeMod4 - 1];
+    }
+    hhUpdatePackets(packet, 1, s);
+}
+
+void hhPermuteAndUpdate(HighwayHashState& s) {
+    uint64_t permuted[4] = {
+        (s.v0[2] >> 32) | (s.v0[2] << 32),
+        (s.v0[3] >> 32) | (s.v0[3] << 32),
+        (s.v0[0] >> 32) | (s.v0[0] << 32),
+        (s.v0[1] >> 32) | (s.v0[1] << 32),
+    };
+    hhUpdate(permuted, s);
+}
+
+void hhModularReduction(uint64_t a3Unmasked, uint64_t a2, uint64_t a1, uint64_t a0, uint64_t& m1, uint64_t& m0) {
+    auto a3 = a3Unmasked & 0x3fffffffffffffffull;
+    m1 = a1 ^ ((a3 << 1) | (a2 >> 63)) ^ ((a3 << 2) | (a2 >> 62));
+    m0 = a0 ^ (a2 << 1) ^ (a2 << 2);
+}
+
+void hhFinalize256(HighwayHashState& s, uint64_t hash[4]) {
+    for (int i = 0; i < 10; ++i) {
+        hhPermuteAndUpdate(s);
+    }
+    hhModularReduction(s.v1[1] + s.mul1[1], s.v1[0] + s.mul1[0], s.v0[1] + s.mul0[1], s.v0[0] + s.mul0[0],
+                       hash[1], hash[0]);
+    hhModularReduction(s.v1[3] + s.mul1[3], s.v1[2] + s.mul1[2], s.v0[3] + s.mul0[3], s.v0[2] + s.mul0[2],
+                       hash[3], hash[2]);
+}
+
+// HighwayHash256 - streaming HighwayHash-256 keyed with MinIO's bitrot key,
+// sums are little endian like github.com/minio/highwayhash.
+class HighwayHash256 : public BitrotHash {
+
+public:
+    explicit HighwayHash256(const uint8_t keyBytes[32]) {
+        for (int i = 0; i < 4; ++i) {
+            key[i] = load64(keyBytes + 8 * i);
+        }
+        reset();
+    }
+
+    using BitrotHash::sum;
+
+    void reset() override {
+        hhReset(key, state);
+        buffered = 0;
+    }
+
+    void update(const uint8_t* data, size_t len) override {
+        if (buffered > 0) {
+            auto n = std::min(len, sizeof(buffer) - buffered);
+            std::memcpy(buffer + buffered, data, n);
+            buffered += n;
+            data += n;
+            len -= n;
+            if (buffered < sizeof(buffer)) {
+                return;
+            }
+            updatePackets(buffer, 1);
+            buffered = 0;
+        }
+        auto packets = len / 32;
+        updatePackets(data, packets);
+        data += packets * 32;
+        len -= packets * 32;
+        std::memcpy(buffer, data, len);
+        buffered = len;
+    }
+
+    void sum(uint8_t* out) override {
+        auto s = state;
+        if (buffered > 0) {
+            hhUpdateRemainder(buffer, buffered, s);
+        }
+        uint64_t hash[4];
+        hhFinalize256(s, hash);
+        std::memcpy(out, hash, sizeof(hash));
+    }
+
+    size_t size() const override { return 32; }
+
+private:
+    void updatePackets(const uint8_t* p, size_t packets) {
+        if (hasAvx2) {
+            hhUpdatePacketsAvx2(p, packets, state);
+        } else {
+            hhUpdatePackets(p, packets, state);
+        }
+    }
+
+private:
+    uint64_t            key[4];
+    HighwayHashState    state;
+    uint8_t             buffer[32];
+    size_t              buffered = 0;
+};
+
+}
+
+bool cppio::bitrotAvailable(BitrotAlgorithm algo) {
+    switch (algo) {
+    case BitrotAlgorithm::CRC32:
+    case BitrotAlgorithm::CRC32C:
+    case BitrotAlgorithm::HighwayHash256S:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::unique_ptr<BitrotHash> cppio::newBitrotHash(BitrotAlgorithm algo) {
+    switch (algo) {
+    case BitrotAlgorithm::CRC32:
+        return std::make_unique<Crc32Hash>(false);
+    case BitrotAlgorithm::CRC32C:
+        return std::make_unique<Crc32Hash>(true);
+    case BitrotAlgorithm::HighwayHash256S:
+        return std::make_unique<HighwayHash256>(magicHighwayHash256Key);
+    default:
+        return nullptr;
+    }
+}
+
+size_t cppio::bitrotHashSize(BitrotAlgorithm algo) {
+    switch (algo) {
+    case BitrotAlgorithm::CRC32:
+    case BitrotAlgorithm::CRC32C:
+        return 4;
+    case BitrotAlgorithm::HighwayHash256S:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+std::string cppio::bitrotAlgorithmString(BitrotAlgorithm algo) {
+    switch (algo) {
+    case BitrotAlgorithm::CRC32:
+        return "crc32";
+    case BitrotAlgorithm::CRC64:
+        return "crc64";
+    case BitrotAlgorithm::SHA256:
+        return "sha256";
+    case BitrotAlgorithm::CRC32C:
+        return "crc32c";
+    case BitrotAlgorithm::HighwayHash256S:
+        return "highwayhash256S";
+    }
+    return "unknown";
+}
+
+uint32_t cppio::crc32c(uint32_t crc, const uint8_t* data, size_t len) {
+    return hasSse42 ? crc32cHardware(crc, data, len) : crc32Update(castagnoliTables, crc, data, len);
+}
+
+int64_t cppio::bitrotShardFileSize(int64_t size, int64_t shardSize, BitrotAlgorithm algo) {
+    if (size < 0 || shardSize <= 0) {
+        return size;
+    }
+    auto chunks = (size + shardSize - 1) / shardSize;
+    return chunks * static_cast<int64_t>(bitrotHashSize(algo)) + size;
+}
+
+int64_t cppio::bitrotShardFileOffset(int64_t offset, int64_t shardSize, BitrotAlgorithm algo) {
+    return offset / shardSize * (shardSize + static_cast<int64_t>(bitrotHashSize(algo))) + offset % shardSize;
+}
+
+void cppio::bitrotAppendShard(BitrotAlgorithm algo, int64_t shardSize, const uint8_t* data, size_t len,
+                              std::vector<uint8_t>& out) {
+    auto hash = newBitrotHash(algo);
+    auto chunk = static_cast<size_t>(shardSize);
+    out.reserve(out.size() + static_cast<size_t>(bitrotShardFileSize(static_cast<int64_t>(len), shardSize, algo)));
+    for (size_t off = 0; off < len; off += chunk) {
+        auto n = std::min(chunk, len - off);
+        hash->reset();
+        hash->update(data + off, n);
+        auto at = out.size();
+        out.resize(at + hash->size());
+        hash->sum(out.data() + at);
+        out.insert(out.end(), data + off, data + off + n);
+    }
+}
+
+Error cppio::bitrotVerifyShard(BitrotAlgorithm algo, int64_t shardSize, std::span<const uint8_t> in,
+                               std::vector<uint8_t>& out) {
+    auto hash = newBitrotHash(algo);
+    if (!hash || shardSize <= 0) {
+        return errInvalidArgument;
+    }
+    auto chunk = static_cast<size_t>(shardSize);
+    std::array<uint8_t, 32> sum;
+    while (!in.empty()) {
+        if (in.size() <= hash->size()) {
+            return errFileCorrupt;
+        }
+        auto n = std::min(chunk, in.size() - hash->size());
+        auto data = in.subspan(hash->size(), n);
+        hash->reset();
+        hash->update(data.data(), data.size());
+        hash->sum(sum.data());
+        if (std::memcmp(sum.data(), in.data(), hash->size()) != 0) {
+            return errFileCorrupt;
+        }
+        out.insert(out.end(), data.begin(), data.end());
+        in = in.subspan(hash->size() + n);
+    }
+    return nullptr;
+}
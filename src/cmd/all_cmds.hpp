@@ -5,5 +5,6 @@ using namespace cppio;
 
 extern cli::Command helpCmd;
 extern cli::Command serverCmd;
+extern cli::Command lockBenchCmd;
 
 #endif // 
\ No newline at end of file
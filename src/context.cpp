@@ -0,0 +1,87 @@
+#include "include/context.hpp"
+
+#include <algorithm>
+
+using namespace cppio;
+
+const Error cppio::errContextCanceled = newError(errCodeContextCanceled, "context canceled");
+const Error cppio::errContextDeadlineExceeded = newError(errCodeContextDeadlineExceeded, "context deadline exceeded");
+
+Context::Context() : state(std::make_shared<State>()) {}
+
+Context::Context(const Context& parent, Clock::time_point deadline) : state(std::make_shared<State>()) {
+    auto& p = *parent.state;
+    state->deadline = std::min(deadline, p.deadline);
+
+    std::lock_guard<std::mutex> lock(p.mu);
+    if (p.canceled.load()) {
+        state->reason = p.reason;
+        state->canceled = true;
+        return;
+    }
+    // Children are dropped once canceled or destroyed, expired entries of
+    // a long lived parent go whenever the list doubled.
+    if (p.children.size() >= p.pruneAt) {
+        std::erase_if(p.children, [](const std::weak_ptr<State>& child) { return child.expired(); });
+        p.pruneAt = std::max<size_t>(16, p.children.size() * 2);
+    }
+    p.children.push_back(state);
+}
+
+Context Context::withCancel(const Context& parent) {
+    return Context(parent, Clock::time_point::max());
+}
+
+Context Context::withDeadline(const Context& parent, Clock::time_point deadline) {
+    return Context(parent, deadline);
+}
+
+Context Context::withTimeout(const Context& parent, Clock::duration timeout) {
+    auto now = Clock::now();
+    auto deadline = timeout >= Clock::time_point::max() - now ? Clock::time_point::max() : now + timeout;
+    return Context(parent, deadline);
+}
+
+void Context::cancel() {
+    state->cancel(errContextCanceled);
+}
+
+void Context::wait() {
+    std::unique_lock<std::mutex> lock(state->mu);
+    auto canceled = [this]() { return state->canceled.load(); };
+    if (state->deadline == Clock::time_point::max()) {
+        state->cv.wait(lock, canceled);
+    } else {
+        state->cv.wait_until(lock, state->deadline, canceled);
+    }
+}
+
+Error Context::State::err() {
+    if (canceled.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mu);
+        return reason;
+    }
+    return expired() ? errContextDeadlineExceeded : nullptr;
+}
+
+void Context::State::cancel(const Error& why) {
+    std::vector<std::shared_ptr<State>> cancel;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        if (canceled.load()) {
+            return;
+        }
+        reason = why;
+        canceled.store(true, std::memory_order_release);
+        for (auto& weak : children) {
+            if (auto child = weak.lock()) {
+                cancel.push_back(std::move(child));
+            }
+        }
+        children.clear();
+        cv.notify_all();
+    }
+    for (auto& child : cancel) {
+        child->cancel(why);
+    }
+}
@@ -0,0 +1,146 @@
+#include "include/disk_info_cache.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+
+using namespace cppio;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Reads the number in a sysfs attribute, false when there is none.
+bool readSysfsNumber(const fs::path& file, uint64_t& value) {
+    std::ifstream in(file);
+    return static_cast<bool>(in >> value);
+}
+
+// Adds a signed amount to 'v', stopping at 0.
+uint64_t addDelta(uint64_t v, int64_t n) {
+    if (n >= 0) {
+        return v + static_cast<uint64_t>(n);
+    }
+    auto m = static_cast<uint64_t>(-n);
+    return v > m ? v - m : 0;
+}
+
+}
+
+DiskInfoCache::DiskInfoCache(const std::string& drivePath, const DiskInfoCacheOptions& opts)
+    : drivePath(drivePath), opts(opts) {
+    readSysfs();
+    refresh();
+    if (opts.refreshInterval.count() > 0) {
+        refreshThread = std::thread([this]() { refresher(); });
+    }
+}
+
+DiskInfoCache::~DiskInfoCache() {
+    {
+        std::lock_guard<std::mutex> lock(stopMu);
+        stopping = true;
+    }
+    stopCv.notify_all();
+    if (refreshThread.joinable()) {
+        refreshThread.join();
+    }
+}
+
+void DiskInfoCache::readSysfs() {
+    struct stat st;
+    if (::stat(drivePath.c_str(), &st) < 0) {
+        return;
+    }
+    major = major(st.st_dev);
+    minor = minor(st.st_dev);
+
+    // A partition has no request queue of its own, its disk one level up
+    // has. Devices without a queue, like tmpfs or overlay, keep the
+    // defaults.
+    std::error_code ec;
+    auto dev = fs::canonical(fs::path("/sys/dev/block") / (std::to_string(major) + ":" + std::to_string(minor)), ec);
+    if (ec) {
+        return;
+    }
+    auto queue = dev / "queue";
+    if (!fs::is_directory(queue, ec)) {
+        queue = dev.parent_path() / "queue";
+    }
+    uint64_t value = 0;
+    if (readSysfsNumber(queue / "rotational", value)) {
+        rotational = value == 1;
+    }
+    readSysfsNumber(queue / "nr_requests", nrRequests);
+}
+
+void DiskInfoCache::refresh() {
+    // One at a time: a refresh takes off the pending counts it read, two
+    // overlapping ones would take them off twice.
+    std::lock_guard<std::mutex> refreshLock(refreshMu);
+
+    // Writes landing while statvfs runs stay pending, they may be in its
+    // numbers already, or not.
+    auto bytes = pendingBytes.load(std::memory_order_relaxed);
+    auto files = pendingFiles.load(std::memory_order_relaxed);
+
+    Capacity c;
+    struct statvfs st;
+    if (::statvfs(drivePath.c_str(), &st) < 0) {
+        c.err = errDiskNotFound;
+    } else {
+        c.total = st.f_blocks * st.f_frsize;
+        c.free = st.f_bavail * st.f_frsize;
+        c.used = (st.f_blocks - st.f_bfree) * st.f_frsize;
+        c.freeInodes = st.f_ffree;
+        c.usedInodes = st.f_files - st.f_ffree;
+    }
+
+    std::lock_guard<std::mutex> lock(mu);
+    capacity = c;
+    pendingBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    pendingFiles.fetch_sub(files, std::memory_order_relaxed);
+}
+
+Error DiskInfoCache::get(DiskInfo& info) {
+    if (opts.refreshInterval.count() <= 0) {
+        refresh();
+    }
+
+    Capacity c;
+    int64_t bytes = 0;
+    int64_t files = 0;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        c = capacity;
+        bytes = pendingBytes.load(std::memory_order_relaxed);
+        files = pendingFiles.load(std::memory_order_relaxed);
+    }
+    if (c.err) {
+        return c.err;
+    }
+
+    info.total = c.total;
+    info.free = addDelta(c.free, -bytes);
+    info.used = std::min(addDelta(c.used, bytes), c.total);
+    info.freeInodes = addDelta(c.freeInodes, -files);
+    info.usedInodes = addDelta(c.usedInodes, files);
+    info.major = major;
+    info.minor = minor;
+    info.rotational = rotational;
+    info.nrRequests = nrRequests;
+    return nullptr;
+}
+
+void DiskInfoCache::refresher() {
+    std::unique_lock<std::mutex> lock(stopMu);
+    while (!stopCv.wait_for(lock, opts.refreshInterval, [this]() { return stopping; })) {
+        lock.unlock();
+        refresh();
+        lock.lock();
+    }
+}
@@ -0,0 +1,316 @@
+#include "include/dsync.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <optional>
+#include <random>
+#include <thread>
+
+using namespace cppio;
+using namespace cppio::dsync;
+
+const Error cppio::errLockerOffline = newError(errCodeLockerOffline, "locker offline");
+
+namespace {
+
+std::string newLockUID() {
+    static const char digits[] = "0123456789abcdef";
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    std::string uid;
+    for (int i = 0; i < 2; ++i) {
+        auto v = rng();
+        for (int j = 0; j < 16; ++j, v >>= 4) {
+            uid.push_back(digits[v & 0xf]);
+        }
+    }
+    return uid;
+}
+
+// Lockers that have to grant a lock. With an even number of lockers a
+// write lock needs one more than half, two writers can not both win.
+int lockQuorum(int lockers, bool write) {
+    auto tolerance = lockers / 2;
+    auto quorum = lockers - tolerance;
+    return write && quorum == tolerance ? quorum + 1 : quorum;
+}
+
+}
+
+// State - one acquisition of a DRWMutex, shared with the calls to the
+// lockers, which may answer after the acquisition was decided.
+struct DRWMutex::State {
+    std::vector<std::shared_ptr<NetLocker>> lockers;
+    LockArgs                                args;
+    bool                                    write = false;
+    int                                     quorum = 0;
+    Timeouts                                timeouts;
+    std::function<void()>                   lost;
+    // Calls to the lockers run on this context, never the caller's, which
+    // may be gone before they return.
+    Context                                 ctx;
+    // The lock calls of tryLock, done with its wait or the caller's context.
+    std::optional<Context>                  acquireCtx;
+
+    std::mutex                              mu;
+    std::condition_variable                 cv;
+    std::vector<bool>                       granted;
+    int                                     answered = 0;
+    int                                     grants = 0;
+    // Set once the lock failed or got unlocked, grants arriving later are
+    // returned right away.
+    bool                                    released = false;
+
+    // Returns the grant of locker 'i'. Unreachable lockers are asked again
+    // after retryInterval, no thread waits in between.
+    static void releaseOne(const std::shared_ptr<State>& st, size_t i, int attempt = 0) {
+        bool ok = false;
+        auto& locker = *st->lockers[i];
+        auto err = st->write ? locker.unlock(st->ctx, st->args, ok) : locker.runlock(st->ctx, st->args, ok);
+        if (err && attempt < st->timeouts.unlockRetries) {
+            st->ctx.runAfter(st->timeouts.retryInterval, [st, i, attempt]() { releaseOne(st, i, attempt + 1); });
+        }
+    }
+
+    // Returns all grants in the background, once: unlocking a lock that
+    // was lost already sends nothing.
+    static void releaseAll(const std::shared_ptr<State>& st) {
+        std::vector<size_t> held;
+        {
+            std::lock_guard<std::mutex> lock(st->mu);
+            if (st->released) {
+                return;
+            }
+            st->released = true;
+            st->cv.notify_all();
+            for (size_t i = 0; i < st->granted.size(); ++i) {
+                if (st->granted[i]) {
+                    held.push_back(i);
+                }
+            }
+        }
+        for (auto i : held) {
+            st->ctx.runAsync([st, i]() { releaseOne(st, i); });
+        }
+    }
+
+    // Asks every locker for the lock, waits for quorum until the acquire
+    // timeout, 'deadline' or the deadline of 'ctx', whichever comes first.
+    // Returns true with the lock held. Lock calls still running after a
+    // failed attempt are canceled.
+    static bool tryLock(const std::shared_ptr<State>& st, Context& ctx, Context::Clock::time_point deadline) {
+        deadline = std::min({deadline, ctx.deadline(), Context::Clock::now() + st->timeouts.acquire});
+        st->acquireCtx.emplace(Context::withDeadline(ctx, deadline));
+        auto n = st->lockers.size();
+        for (size_t i = 0; i < n; ++i) {
+            if (!st->lockers[i]) {
+                std::lock_guard<std::mutex> lock(st->mu);
+                st->answered++;
+                continue;
+            }
+            st->ctx.runAsync([st, i]() {
+                bool granted = false;
+                auto& locker = *st->lockers[i];
+                auto& callCtx = *st->acquireCtx;
+                auto err = st->write ? locker.lock(callCtx, st->args, granted) : locker.rlock(callCtx, st->args, granted);
+                granted = granted && !err;
+                bool late;
+                {
+                    std::lock_guard<std::mutex> lock(st->mu);
+                    st->granted[i] = granted;
+                    st->answered++;
+                    st->grants += granted ? 1 : 0;
+                    late = granted && st->released;
+                    st->cv.notify_all();
+                }
+                if (late) {
+                    releaseOne(st, i);
+                }
+            });
+        }
+
+        auto lockers = static_cast<int>(n);
+        std::unique_lock<std::mutex> lock(st->mu);
+        while (st->grants < st->quorum && st->answered - st->grants <= lockers - st->quorum &&
+               !ctx.isCanceled() && Context::Clock::now() < deadline) {
+            st->cv.wait_until(lock, std::min(deadline, Context::Clock::now() + std::chrono::milliseconds(100)));
+        }
+        if (st->grants >= st->quorum) {
+            return true;
+        }
+        lock.unlock();
+        st->acquireCtx->cancel();
+        releaseAll(st);
+        return false;
+    }
+
+    // Round - the refreshes of one refreshInterval, their calls run on 'ctx'
+    // until the round is decided.
+    struct Round {
+        explicit Round(Context ctx) : ctx(std::move(ctx)) {}
+
+        Context     ctx;
+        std::mutex  mu;
+        int         asked = 0;
+        int         answered = 0;
+        int         refreshed = 0;
+        bool        decided = false;
+    };
+
+    // Renews the lease on all lockers every refreshInterval until released;
+    // less than quorum of them renewing loses the lock. Rounds are
+    // scheduled, a held lock keeps no thread waiting between them.
+    static void scheduleRefresh(const std::shared_ptr<State>& st) {
+        st->ctx.runAfter(st->timeouts.refreshInterval, [st]() { refresh(st); });
+    }
+
+    // One round of refreshes, decided by the answers: quorum of renewals
+    // schedules the next round, too many refusals lose the lock. Lockers
+    // slower than the acquire timeout count as refusals.
+    static void refresh(const std::shared_ptr<State>& st) {
+        {
+            std::lock_guard<std::mutex> lock(st->mu);
+            if (st->released) {
+                return;
+            }
+        }
+
+        auto r = std::make_shared<Round>(Context::withTimeout(st->ctx, st->timeouts.acquire));
+        for (auto& locker : st->lockers) {
+            r->asked += locker ? 1 : 0;
+        }
+
+        for (auto& locker : st->lockers) {
+            if (!locker) {
+                continue;
+            }
+            st->ctx.runAsync([st, r, locker]() {
+                bool ok = false;
+                auto err = locker->refresh(r->ctx, st->args, ok);
+                std::lock_guard<std::mutex> lock(r->mu);
+                r->answered++;
+                r->refreshed += ok && !err ? 1 : 0;
+                decide(st, *r, false);
+            });
+        }
+        // Does not keep the lock alive, a round decided by then is done.
+        st->ctx.runAfter(st->timeouts.acquire, [weak = std::weak_ptr<State>(st), r]() {
+            if (auto st = weak.lock()) {
+                std::lock_guard<std::mutex> lock(r->mu);
+                decide(st, *r, true);
+            }
+        });
+        std::lock_guard<std::mutex> lock(r->mu);
+        decide(st, *r, false);
+    }
+
+    // Decides a round of refreshes once it can be, under Round::mu.
+    static void decide(const std::shared_ptr<State>& st, Round& r, bool timedOut) {
+        if (r.decided) {
+            return;
+        }
+        if (r.refreshed >= st->quorum) {
+            r.decided = true;
+            r.ctx.cancel();
+            scheduleRefresh(st);
+        } else if (r.answered == r.asked || timedOut) {
+            r.decided = true;
+            r.ctx.cancel();
+            st->ctx.runAsync([st]() { lose(st); });
+        }
+    }
+
+    // Gives up a lock that lost quorum of lockers, unless unlocked already.
+    static void lose(const std::shared_ptr<State>& st) {
+        {
+            std::lock_guard<std::mutex> lock(st->mu);
+            if (st->released) {
+                return;
+            }
+        }
+        releaseAll(st);
+        if (st->lost) {
+            st->lost();
+        }
+    }
+};
+
+DRWMutex::DRWMutex(Dsync& ds, std::vector<std::string> names) : ds(ds), names(std::move(names)) {
+    std::sort(this->names.begin(), this->names.end());
+}
+
+DRWMutex::~DRWMutex() {
+    if (held) {
+        release(held->write);
+    }
+}
+
+bool DRWMutex::getLock(Context& ctx, const std::string& id, const std::string& source,
+                       std::chrono::milliseconds timeout, std::function<void()> lost) {
+    return acquire(ctx, id, source, timeout, true, std::move(lost));
+}
+
+bool DRWMutex::getRLock(Context& ctx, const std::string& id, const std::string& source,
+                        std::chrono::milliseconds timeout, std::function<void()> lost) {
+    return acquire(ctx, id, source, timeout, false, std::move(lost));
+}
+
+void DRWMutex::unlock() {
+    release(true);
+}
+
+void DRWMutex::runlock() {
+    release(false);
+}
+
+bool DRWMutex::acquire(Context& ctx, const std::string& id, const std::string& source,
+                       std::chrono::milliseconds timeout, bool write, std::function<void()> lost) {
+    if (held) {
+        return false;
+    }
+    auto [lockers, owner] = ds.getLockers();
+    if (lockers.empty()) {
+        return false;
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    thread_local std::mt19937 rng(std::random_device{}());
+
+    while (!ctx.isCanceled()) {
+        auto st = std::make_shared<State>();
+        st->lockers = lockers;
+        st->args.uid = id.empty() ? newLockUID() : id + "/" + newLockUID();
+        st->args.resources = names;
+        st->args.owner = owner;
+        st->args.source = source;
+        st->write = write;
+        st->quorum = lockQuorum(static_cast<int>(lockers.size()), write);
+        st->args.quorum = st->quorum;
+        st->timeouts = ds.timeouts;
+        st->lost = lost;
+        st->granted.resize(lockers.size());
+
+        if (State::tryLock(st, ctx, deadline)) {
+            held = st;
+            State::scheduleRefresh(st);
+            return true;
+        }
+
+        // Contending lockers back off for a random while.
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        auto retry = ds.timeouts.retryInterval.count();
+        auto backoff = std::chrono::milliseconds(std::uniform_int_distribution<long>(retry / 2, std::max<long>(retry, 1))(rng));
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(backoff, deadline - now));
+    }
+    return false;
+}
+
+void DRWMutex::release(bool write) {
+    if (!held || held->write != write) {
+        return;
+    }
+    State::releaseAll(held);
+    held = nullptr;
+}
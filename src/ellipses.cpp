@@ -0,0 +1,205 @@
+#include "include/ellipses.hpp"
+#include "include/storage_errors.hpp"
+
+#include <charconv>
+#include <cstdio>
+
+using namespace cppio;
+using namespace cppio::ellipses;
+
+namespace {
+
+constexpr std::string_view openBraces = "{";
+constexpr std::string_view closeBraces = "}";
+constexpr std::string_view ellipsesDots = "...";
+
+// Upper bound of the labels of one range, far above any drive count, so
+// a typo like {1...99999999999} is an error instead of an allocation.
+constexpr uint64_t maxEllipsesRange = 1 << 16;
+
+Error errInvalidEllipsesFormat(std::string_view arg) {
+    return newError(errCodeInvalidArgument,
+                    "Invalid ellipsis format in (" + std::string(arg) +
+                        "), Ellipsis range must be provided in format {N...M} where N and M are positive "
+                        "integers, M must be greater than N, with an allowed minimum range of 4");
+}
+
+bool isRangeChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z');
+}
+
+// Finds the last "{x...y}" of 'arg', x and y of [0-9a-z]. Returns false
+// for none, else its position and length.
+bool findLastEllipses(std::string_view arg, size_t& pos, size_t& len) {
+    auto dots = arg.rfind(ellipsesDots);
+    while (dots != std::string_view::npos) {
+        auto begin = dots;
+        while (begin > 0 && isRangeChar(arg[begin - 1])) {
+            begin--;
+        }
+        auto end = dots + ellipsesDots.size();
+        while (end < arg.size() && isRangeChar(arg[end])) {
+            end++;
+        }
+        if (begin > 0 && arg[begin - 1] == '{' && end < arg.size() && arg[end] == '}') {
+            pos = begin - 1;
+            len = end + 1 - pos;
+            return true;
+        }
+        if (dots == 0) {
+            break;
+        }
+        dots = arg.rfind(ellipsesDots, dots - 1);
+    }
+    return false;
+}
+
+bool parseUint(std::string_view s, int base, uint64_t& v) {
+    if (s.empty()) {
+        return false;
+    }
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v, base);
+    return ec == std::errc() && ptr == s.data() + s.size();
+}
+
+// Parses "{N...M}" into its labels.
+Error parseEllipsesRange(std::string_view pattern, std::vector<std::string>& seq) {
+    if (pattern.size() < 2 || pattern.front() != '{' || pattern.back() != '}') {
+        return errInvalidArgument;
+    }
+    pattern = pattern.substr(1, pattern.size() - 2);
+    auto dots = pattern.find(ellipsesDots);
+    if (dots == std::string_view::npos || pattern.find(ellipsesDots, dots + 1) != std::string_view::npos) {
+        return errInvalidArgument;
+    }
+    auto first = pattern.substr(0, dots);
+    auto last = pattern.substr(dots + ellipsesDots.size());
+
+    bool hexadecimal = false;
+    uint64_t start, end;
+    if (!parseUint(first, 10, start)) {
+        if (!parseUint(first, 16, start)) {
+            return newError(errCodeInvalidArgument, "Invalid range start " + std::string(first));
+        }
+        hexadecimal = true;
+    }
+    if (!parseUint(last, 10, end)) {
+        if (!parseUint(last, 16, end)) {
+            return newError(errCodeInvalidArgument, "Invalid range end " + std::string(last));
+        }
+        hexadecimal = true;
+    }
+    if (start > end) {
+        return newError(errCodeInvalidArgument, "Incorrect range start " + std::to_string(start) +
+                                                    " cannot be bigger than end " + std::to_string(end));
+    }
+
+    if (end - start >= maxEllipsesRange) {
+        return newError(errCodeInvalidArgument, "Range " + std::string(first) + "..." + std::string(last) +
+                                                    " exceeds " + std::to_string(maxEllipsesRange) + " labels");
+    }
+
+    auto padded = (first.size() > 1 && first[0] == '0') || last[0] == '0';
+    auto width = padded ? static_cast<int>(last.size()) : 0;
+    seq.clear();
+    seq.reserve(end - start + 1);
+    char label[32];
+    for (auto i = start;; ++i) {
+        std::snprintf(label, sizeof(label), hexadecimal ? "%0*llx" : "%0*llu", width, static_cast<unsigned long long>(i));
+        seq.emplace_back(label);
+        if (i == end) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+bool hasBraces(std::string_view s) {
+    return s.find(openBraces) != std::string_view::npos || s.find(closeBraces) != std::string_view::npos;
+}
+
+}
+
+std::vector<std::string> Pattern::expand() const {
+    std::vector<std::string> labels;
+    labels.reserve(seq.size());
+    for (const auto& label : seq) {
+        labels.push_back(prefix + label + suffix);
+    }
+    return labels;
+}
+
+std::vector<std::string> ArgPattern::expand() const {
+    if (patterns.empty()) {
+        return {};
+    }
+    // The first ellipses of the argument, patterns.back(), varies fastest.
+    auto out = patterns.back().expand();
+    for (auto i = patterns.size() - 1; i-- > 0;) {
+        auto labels = patterns[i].expand();
+        std::vector<std::string> next;
+        next.reserve(out.size() * labels.size());
+        for (const auto& label : labels) {
+            for (const auto& head : out) {
+                next.push_back(head + label);
+            }
+        }
+        out = std::move(next);
+    }
+    return out;
+}
+
+uint64_t ArgPattern::size() const {
+    uint64_t total = 1;
+    for (const auto& p : patterns) {
+        total *= p.seq.size();
+    }
+    return total;
+}
+
+bool cppio::ellipses::hasEllipses(std::string_view arg) {
+    return arg.find(ellipsesDots) != std::string_view::npos ||
+           (arg.find(openBraces) != std::string_view::npos && arg.find(closeBraces) != std::string_view::npos);
+}
+
+bool cppio::ellipses::hasEllipses(const std::vector<std::string>& args) {
+    for (const auto& arg : args) {
+        if (!hasEllipses(arg)) {
+            return false;
+        }
+    }
+    return !args.empty();
+}
+
+Error cppio::ellipses::findEllipsesPatterns(std::string_view arg, ArgPattern& out) {
+    out.patterns.clear();
+    size_t pos, len;
+    if (!findLastEllipses(arg, pos, len)) {
+        return errInvalidEllipsesFormat(arg);
+    }
+    // Peel the ellipses off from the end, what is left of the argument
+    // before the first one becomes its prefix.
+    auto rest = arg;
+    while (true) {
+        Pattern p;
+        p.suffix = std::string(rest.substr(pos + len));
+        if (auto err = parseEllipsesRange(rest.substr(pos, len), p.seq)) {
+            return err;
+        }
+        rest = rest.substr(0, pos);
+        if (!findLastEllipses(rest, pos, len)) {
+            p.prefix = std::string(rest);
+            out.patterns.push_back(std::move(p));
+            break;
+        }
+        out.patterns.push_back(std::move(p));
+    }
+    // Braces left over are most likely a typo.
+    for (const auto& p : out.patterns) {
+        if (hasBraces(p.prefix) || hasBraces(p.suffix)) {
+            out.patterns.clear();
+            return errInvalidEllipsesFormat(arg);
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,79 @@
+#include "include/erasure.hpp"
+#include "include/storage_errors.hpp"
+
+using namespace cppio;
+
+Error cppio::shuffleDisks(const std::vector<std::shared_ptr<StorageAPI>>& disks, const std::vector<int>& distribution,
+                          std::vector<std::shared_ptr<StorageAPI>>& shuffled) {
+    if (distribution.empty()) {
+        shuffled = disks;
+        return nullptr;
+    }
+    if (distribution.size() != disks.size()) {
+        return errInvalidArgument;
+    }
+    shuffled.assign(disks.size(), nullptr);
+    std::vector<bool> seen(disks.size());
+    for (size_t i = 0; i < disks.size(); ++i) {
+        auto blockIndex = distribution[i];
+        if (blockIndex < 1 || static_cast<size_t>(blockIndex) > disks.size() || seen[blockIndex - 1]) {
+            return errInvalidArgument;
+        }
+        seen[blockIndex - 1] = true;
+        shuffled[blockIndex - 1] = disks[i];
+    }
+    return nullptr;
+}
+
+int ErasureObjects::writeQuorum(const Erasure& erasure) {
+    auto quorum = erasure.dataBlocks();
+    if (erasure.dataBlocks() == erasure.parityBlocks()) {
+        quorum++;
+    }
+    return quorum;
+}
+
+Error ErasureObjects::writeShards(Context& ctx, const Erasure& erasure, const std::vector<int>& distribution,
+                                  const std::string& volume, const std::string& path,
+                                  std::istream& data, int64_t size, int64_t& total, std::vector<Error>& errs,
+                                  BitrotAlgorithm bitrotAlgo) {
+    auto disks = getDisks();
+    std::vector<std::shared_ptr<StorageAPI>> shuffled;
+    if (shuffleDisks(disks, distribution, shuffled)) {
+        // The distribution comes with the version's metadata.
+        errs.assign(disks.size(), errFileCorrupt);
+        return errFileCorrupt;
+    }
+
+    std::vector<Error> shardErrs;
+    auto err = erasure.encode(ctx, data, size, shuffled, volume, path, writeQuorum(erasure), total, shardErrs, bitrotAlgo);
+
+    // Report errors by drive rather than by shard.
+    errs.assign(disks.size(), nullptr);
+    for (size_t i = 0; i < disks.size(); ++i) {
+        auto shard = distribution.empty() ? i : static_cast<size_t>(distribution[i] - 1);
+        if (shard < shardErrs.size()) {
+            errs[i] = shardErrs[shard];
+        }
+    }
+    return err;
+}
+
+Error ErasureObjects::readShards(Context& ctx, const Erasure& erasure, const std::vector<int>& distribution,
+                                 const std::string& volume, const std::string& path,
+                                 int64_t offset, int64_t length, int64_t totalLength,
+                                 std::ostream& writer, int64_t& written, const ErasureReadOptions& opts,
+                                 BitrotAlgorithm bitrotAlgo) {
+    std::vector<std::shared_ptr<StorageAPI>> shuffled;
+    if (shuffleDisks(getDisks(), distribution, shuffled)) {
+        return errFileCorrupt;
+    }
+
+    std::vector<std::chrono::nanoseconds> latencies(shuffled.size());
+    for (size_t i = 0; i < shuffled.size(); ++i) {
+        if (shuffled[i]) {
+            latencies[i] = shuffled[i]->readLatency();
+        }
+    }
+    return erasure.decode(ctx, writer, shuffled, volume, path, offset, length, totalLength, latencies, opts, written, bitrotAlgo);
+}
@@ -0,0 +1,154 @@
+#include "include/erasure_coding.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <cstring>
+#include <stdexcept>
+
+using namespace cppio;
+
+namespace cppio {
+
+const Error errErasureReadQuorum = newError(errCodeErasureReadQuorum, "Read failed. Insufficient number of drives online");
+const Error errErasureWriteQuorum = newError(errCodeErasureWriteQuorum, "Write failed. Insufficient number of drives online");
+
+}
+
+namespace {
+
+// Codecs are shared by all objects of the same geometry, which also
+// shares their cache of decode matrices.
+std::shared_ptr<ReedSolomon> getCodec(int dataBlocks, int parityBlocks) {
+    static std::mutex mu;
+    static std::map<std::pair<int, int>, std::shared_ptr<ReedSolomon>> codecs;
+
+    std::lock_guard<std::mutex> lock(mu);
+    auto& codec = codecs[{dataBlocks, parityBlocks}];
+    if (!codec) {
+        codec = std::make_shared<ReedSolomon>(dataBlocks, parityBlocks);
+    }
+    return codec;
+}
+
+}
+
+Erasure::Erasure(int dataBlocks, int parityBlocks, int64_t blockSize)
+    : dataBlocksCount(dataBlocks), parityBlocksCount(parityBlocks), blockSizeValue(blockSize) {
+    // Check the parameters for sanity now.
+    if (dataBlocks <= 0 || parityBlocks < 0) {
+        throw std::invalid_argument(errInvShardNum->msg);
+    }
+    if (dataBlocks + parityBlocks > 256) {
+        throw std::invalid_argument("cannot create Encoder with more than 256 data+parity shards");
+    }
+    encoder = getCodec(dataBlocks, parityBlocks);
+}
+
+Erasure::Erasure(const ErasureInfo& info)
+    : Erasure(info.dataBlocks, info.parityBlocks, info.blockSize) {
+    if (!info.algorithm.empty() && info.algorithm != erasureAlgorithm) {
+        throw std::invalid_argument("unsupported erasure algorithm " + info.algorithm);
+    }
+}
+
+Error Erasure::encodeData(const uint8_t* data, size_t len, std::vector<std::vector<uint8_t>>& shards) const {
+    auto total = dataBlocksCount + parityBlocksCount;
+    shards.resize(total);
+    if (len == 0) {
+        for (auto& shard : shards) {
+            shard.clear();
+        }
+        return nullptr;
+    }
+
+    // Data is split over the data shards, the last one is zero padded.
+    auto perShard = static_cast<size_t>(ceilFrac(static_cast<int64_t>(len), dataBlocksCount));
+    std::vector<uint8_t*> ptrs(total);
+    for (int i = 0; i < total; ++i) {
+        shards[i].resize(perShard);
+        ptrs[i] = shards[i].data();
+        if (i < dataBlocksCount) {
+            auto off = std::min(len, i * perShard);
+            auto n = std::min(perShard, len - off);
+            std::memcpy(ptrs[i], data + off, n);
+            std::memset(ptrs[i] + n, 0, perShard - n);
+        }
+    }
+
+    encoder->encode(ptrs.data(), perShard);
+    return nullptr;
+}
+
+Error Erasure::decode(std::vector<std::vector<uint8_t>>& shards, bool dataOnly) const {
+    auto total = dataBlocksCount + parityBlocksCount;
+    if (static_cast<int>(shards.size()) != total) {
+        return errTooFewShards;
+    }
+
+    size_t size = 0;
+    bool needsReconstruction = false;
+    std::vector<bool> present(total);
+    for (int i = 0; i < total; ++i) {
+        present[i] = !shards[i].empty();
+        if (!present[i]) {
+            needsReconstruction = needsReconstruction || !dataOnly || i < dataBlocksCount;
+            continue;
+        }
+        if (size != 0 && shards[i].size() != size) {
+            return errShardSize;
+        }
+        size = shards[i].size();
+    }
+    if (!needsReconstruction) {
+        return nullptr;
+    }
+    if (size == 0) {
+        return errTooFewShards;
+    }
+
+    std::vector<uint8_t*> ptrs(total);
+    for (int i = 0; i < total; ++i) {
+        if (!present[i] && (!dataOnly || i < dataBlocksCount)) {
+            shards[i].resize(size);
+        }
+        ptrs[i] = shards[i].data();
+    }
+    return encoder->reconstruct(ptrs.data(), present, size, dataOnly);
+}
+
+Error Erasure::decodeDataBlocks(std::vector<std::vector<uint8_t>>& shards) const {
+    return decode(shards, true);
+}
+
+Error Erasure::decodeDataAndParityBlocks(std::vector<std::vector<uint8_t>>& shards) const {
+    return decode(shards, false);
+}
+
+int64_t Erasure::shardSize() const {
+    return ceilFrac(blockSizeValue, dataBlocksCount);
+}
+
+int64_t Erasure::shardFileSize(int64_t totalLength) const {
+    if (totalLength == 0) {
+        return 0;
+    }
+    if (totalLength == -1) {
+        return -1;
+    }
+    auto numShards = totalLength / blockSizeValue;
+    auto lastBlockSize = totalLength % blockSizeValue;
+    auto lastShardSize = ceilFrac(lastBlockSize, dataBlocksCount);
+    return numShards * shardSize() + lastShardSize;
+}
+
+int64_t Erasure::shardFileOffset(int64_t startOffset, int64_t length, int64_t totalLength) const {
+    auto shardSz = shardSize();
+    auto shardFileSz = shardFileSize(totalLength);
+    auto endShard = (startOffset + length) / blockSizeValue;
+    auto tillOffset = endShard * shardSz + shardSz;
+    if (tillOffset > shardFileSz) {
+        tillOffset = shardFileSz;
+    }
+    return tillOffset;
+}
@@ -0,0 +1,260 @@
+#include "include/erasure_coding.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+using namespace cppio;
+
+namespace {
+
+enum class ShardState : uint8_t {
+    Idle,
+    Pending,
+    Done,
+    Failed,
+};
+
+// DecodeState is shared with the shard reads. Reads hedged around keep
+// running after decode moved on or returned, their results are dropped.
+struct DecodeState {
+    std::mutex                          mu;
+    std::condition_variable             cv;
+    int64_t                             block = -1;     // block being read, -1 when none
+    std::vector<ShardState>             shards;         // state of each shard of 'block'
+    std::vector<std::vector<uint8_t>>   bufs;           // shard buffers, owned by a read while pending
+    std::vector<int>                    inflight;       // reads pending per drive, of any block
+    std::vector<bool>                   dead;           // drives which failed a read
+    int                                 done = 0;
+    int                                 pending = 0;
+};
+
+// referenceLatency returns the percentile of the known drive latencies.
+std::chrono::nanoseconds referenceLatency(const std::vector<std::chrono::nanoseconds>& latencies, double percentile) {
+    std::vector<std::chrono::nanoseconds> known;
+    for (auto l : latencies) {
+        if (l.count() > 0) {
+            known.push_back(l);
+        }
+    }
+    if (known.empty()) {
+        return std::chrono::nanoseconds::zero();
+    }
+    std::sort(known.begin(), known.end());
+    auto idx = static_cast<size_t>(std::clamp(percentile, 0.0, 1.0) * static_cast<double>(known.size() - 1) + 0.5);
+    return known[std::min(idx, known.size() - 1)];
+}
+
+}
+
+Error Erasure::decode(Context& ctx, std::ostream& writer,
+                      const std::vector<std::shared_ptr<StorageAPI>>& disks,
+                      const std::string& volume, const std::string& path,
+                      int64_t offset, int64_t length, int64_t totalLength,
+                      const std::vector<std::chrono::nanoseconds>& latencies,
+                      const ErasureReadOptions& opts, int64_t& written,
+                      BitrotAlgorithm bitrotAlgo) const {
+    written = 0;
+    auto k = dataBlocksCount;
+    auto shards = dataBlocksCount + parityBlocksCount;
+    if (static_cast<int>(disks.size()) != shards) {
+        return errInvalidArgument;
+    }
+    if (offset < 0 || length < 0 || offset + length > totalLength || !bitrotAvailable(bitrotAlgo)) {
+        return errInvalidArgument;
+    }
+    if (length == 0) {
+        return nullptr;
+    }
+
+    auto reference = referenceLatency(latencies, opts.hedgePercentile);
+    auto slowAfter = std::chrono::duration_cast<std::chrono::nanoseconds>(reference * opts.slowFactor);
+    auto hedgeDelay = std::max<std::chrono::nanoseconds>(opts.minHedgeDelay, slowAfter);
+
+    BitrotVerifier verifier{bitrotAlgo, shardSize()};
+    auto state = std::make_shared<DecodeState>();
+    state->shards.resize(shards);
+    state->bufs.resize(shards);
+    state->inflight.resize(shards);
+    state->dead.resize(shards);
+    std::vector<bool> slow(shards);
+    for (int i = 0; i < shards; ++i) {
+        state->dead[i] = !disks[i];
+        slow[i] = reference.count() > 0 && i < static_cast<int>(latencies.size()) && latencies[i] > slowAfter;
+    }
+
+    // next picks the shard to read next: data before parity, so nothing
+    // needs decoding when all goes well, and slow or busy drives last.
+    auto next = [&]() {
+        int best = -1;
+        int bestRank = 0;
+        for (int i = 0; i < shards; ++i) {
+            if (state->dead[i] || state->shards[i] != ShardState::Idle) {
+                continue;
+            }
+            auto rank = (i < k ? 0 : 1) + (slow[i] ? 2 : 0) + (state->inflight[i] > 0 ? 4 : 0);
+            if (best < 0 || rank < bestRank) {
+                best = i;
+                bestRank = rank;
+            }
+        }
+        return best;
+    };
+
+    std::vector<std::vector<uint8_t>> scratch(k);
+    std::vector<uint8_t*> ptrs(shards);
+    std::vector<bool> present(shards);
+
+    auto startBlock = offset / blockSizeValue;
+    auto endBlock = (offset + length) / blockSizeValue;
+    for (auto block = startBlock; block <= endBlock; ++block) {
+        int64_t blockOffset = 0;
+        int64_t blockLength = blockSizeValue;
+        if (startBlock == endBlock) {
+            blockOffset = offset % blockSizeValue;
+            blockLength = length;
+        } else if (block == startBlock) {
+            blockOffset = offset % blockSizeValue;
+            blockLength = blockSizeValue - blockOffset;
+        } else if (block == endBlock) {
+            blockLength = (offset + length) % blockSizeValue;
+        }
+        if (blockLength == 0) {
+            break;
+        }
+
+        auto curBlockSize = std::min(blockSizeValue, totalLength - block * blockSizeValue);
+        auto shardSz = static_cast<size_t>(ceilFrac(curBlockSize, k));
+        auto shardOffset = block * shardSize();
+
+        std::unique_lock<std::mutex> lock(state->mu);
+        state->block = block;
+        std::fill(state->shards.begin(), state->shards.end(), ShardState::Idle);
+        state->done = 0;
+        state->pending = 0;
+
+        auto launch = [&](int i) {
+            state->shards[i] = ShardState::Pending;
+            state->inflight[i]++;
+            state->pending++;
+            ctx.runAsync([state, disk = disks[i], i, block, shardOffset, shardSz, verifier,
+                          buf = std::move(state->bufs[i]), volume, path]() mutable {
+                Error err;
+                try {
+                    buf.resize(shardSz);
+                    if (disk->readFile(volume, path, shardOffset, buf, &verifier) != static_cast<int64_t>(shardSz)) {
+                        err = errLessData;
+                    }
+                } catch (const StorageError& e) {
+                    err = e.error();
+                } catch (const std::exception& e) {
+                    err = newError(errCodeUnexpected, e.what());
+                }
+
+                std::lock_guard<std::mutex> lock(state->mu);
+                state->inflight[i]--;
+                if (err) {
+                    // Not worth asking again for the rest of this read, a
+                    // shard failing verification is as good as missing.
+                    state->dead[i] = true;
+                }
+                if (state->block == block) {
+                    state->pending--;
+                    if (err) {
+                        state->shards[i] = ShardState::Failed;
+                    } else {
+                        state->shards[i] = ShardState::Done;
+                        state->bufs[i] = std::move(buf);
+                        state->done++;
+                    }
+                }
+                state->cv.notify_all();
+            });
+        };
+
+        for (int n = 0; n < k; ++n) {
+            auto i = next();
+            if (i < 0) {
+                break;
+            }
+            launch(i);
+        }
+
+        Error err;
+        auto deadline = std::chrono::steady_clock::now() + hedgeDelay;
+        while (state->done < k) {
+            if (ctx.isCanceled()) {
+                err = ctx.err();
+                break;
+            }
+            // Replace failed reads right away.
+            if (state->pending < k - state->done) {
+                auto i = next();
+                if (i >= 0) {
+                    launch(i);
+                    continue;
+                }
+                if (state->pending == 0) {
+                    err = errErasureReadQuorum;
+                    break;
+                }
+            }
+
+            auto wakeup = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+            if (state->cv.wait_until(lock, wakeup) == std::cv_status::timeout &&
+                std::chrono::steady_clock::now() >= deadline) {
+                // Some drive is taking too long, hedge with another shard.
+                auto i = next();
+                if (i >= 0) {
+                    launch(i);
+                }
+                deadline = std::chrono::steady_clock::now() + hedgeDelay;
+            }
+        }
+
+        // From here on reads still pending are late, the buffers of the
+        // shards read are ours.
+        state->block = -1;
+        for (int i = 0; i < shards; ++i) {
+            present[i] = state->shards[i] == ShardState::Done;
+        }
+        lock.unlock();
+        if (err) {
+            return err;
+        }
+
+        for (int i = 0; i < shards; ++i) {
+            ptrs[i] = nullptr;
+            if (present[i]) {
+                ptrs[i] = state->bufs[i].data();
+            } else if (i < k) {
+                scratch[i].resize(shardSz);
+                ptrs[i] = scratch[i].data();
+            }
+        }
+        if (auto rerr = encoder->reconstruct(ptrs.data(), present, shardSz, true)) {
+            return rerr;
+        }
+
+        // Write the requested part of the data blocks.
+        auto skip = blockOffset;
+        auto remaining = blockLength;
+        for (int i = 0; i < k && remaining > 0; ++i) {
+            auto size = static_cast<int64_t>(shardSz);
+            if (skip >= size) {
+                skip -= size;
+                continue;
+            }
+            auto n = std::min(size - skip, remaining);
+            writer.write(reinterpret_cast<const char*>(ptrs[i] + skip), static_cast<std::streamsize>(n));
+            if (!writer) {
+                return newError(errCodeUnexpected, "short write");
+            }
+            skip = 0;
+            remaining -= n;
+            written += n;
+        }
+    }
+    return nullptr;
+}
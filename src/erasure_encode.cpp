@@ -0,0 +1,338 @@
+#include "include/erasure_coding.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+using namespace cppio;
+
+namespace {
+
+// Stripe is one erasure coded block, shard i starts at i * shardSize.
+struct Stripe {
+    std::vector<uint8_t>    mem;
+    size_t                  shardSize = 0;
+
+    uint8_t* shard(int i) { return mem.data() + i * shardSize; }
+};
+
+// StripePool recycles stripe buffers once every drive wrote them, a PUT
+// only ever has a few stripes in flight.
+class StripePool : public std::enable_shared_from_this<StripePool> {
+
+public:
+    explicit StripePool(size_t stripeSize) : stripeSize(stripeSize) {}
+
+    std::shared_ptr<Stripe> get() {
+        std::unique_ptr<Stripe> s;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            if (!free.empty()) {
+                s = std::move(free.back());
+                free.pop_back();
+            }
+        }
+        if (!s) {
+            s = std::make_unique<Stripe>();
+            s->mem.resize(stripeSize);
+        }
+
+        std::weak_ptr<StripePool> pool = shared_from_this();
+        return std::shared_ptr<Stripe>(s.release(), [pool](Stripe* p) {
+            if (auto self = pool.lock()) {
+                std::lock_guard<std::mutex> lock(self->mu);
+                self->free.emplace_back(p);
+            } else {
+                delete p;
+            }
+        });
+    }
+
+private:
+    size_t                                  stripeSize;
+    std::mutex                              mu;
+    std::vector<std::unique_ptr<Stripe>>    free;
+};
+
+struct EncodeState;
+
+// ShardPipe feeds the shards of one drive to its createFile. The encoder
+// queues shards, the streambuf hands them out without copying, each one
+// led by its bitrot checksum which is computed on the writer's thread.
+class ShardPipe : public std::streambuf {
+
+public:
+    ShardPipe(EncodeState& state, BitrotAlgorithm algo) : state(state), hash(newBitrotHash(algo)) {}
+
+    // Under EncodeState::mu.
+    std::deque<std::pair<std::shared_ptr<Stripe>, size_t>>  queue;
+    bool                                                    closed = false;
+    bool                                                    aborted = false;
+    bool                                                    done = false;
+    Error                                                   err;
+    std::condition_variable                                 cv;
+
+protected:
+    int_type underflow() override;
+
+private:
+    EncodeState&                    state;
+    std::shared_ptr<Stripe>         current;
+    std::unique_ptr<BitrotHash>     hash;
+    std::vector<char>               sum;
+    char*                           pendingData = nullptr;  // shard following 'sum'
+};
+
+// EncodeState is shared by the encoder and the drive writers, writers
+// still running when encode returned keep it alive.
+struct EncodeState {
+    std::mutex                              mu;
+    std::condition_variable                 progress;   // a pipe drained a shard or a writer finished
+    std::vector<std::unique_ptr<ShardPipe>> pipes;
+    int                                     succeeded = 0;
+
+    // Pipes still taking shards, under mu.
+    bool live(const ShardPipe& p) const { return !p.aborted && !p.done; }
+
+    void abort(ShardPipe& p, const Error& err) {
+        if (p.done || p.aborted) {
+            return;
+        }
+        p.aborted = true;
+        p.err = err;
+        p.queue.clear();
+        p.cv.notify_all();
+    }
+};
+
+ShardPipe::int_type ShardPipe::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (pendingData) {
+        auto data = pendingData;
+        pendingData = nullptr;
+        setg(data, data, data + current->shardSize);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::unique_lock<std::mutex> lock(state.mu);
+    current.reset();
+    cv.wait(lock, [this]() { return aborted || closed || !queue.empty(); });
+    if (aborted || queue.empty()) {
+        // An aborted pipe ends short of the shard size, which fails the
+        // createFile on the drive.
+        return traits_type::eof();
+    }
+
+    auto [stripe, shard] = std::move(queue.front());
+    queue.pop_front();
+    current = std::move(stripe);
+    state.progress.notify_all();
+    lock.unlock();
+
+    auto data = reinterpret_cast<char*>(current->shard(static_cast<int>(shard)));
+    if (current->shardSize == 0) {
+        setg(data, data, data);
+        return underflow();
+    }
+    if (hash) {
+        sum.resize(hash->size());
+        hash->reset();
+        hash->update(reinterpret_cast<const uint8_t*>(data), current->shardSize);
+        hash->sum(reinterpret_cast<uint8_t*>(sum.data()));
+        pendingData = data;
+        data = sum.data();
+        setg(data, data, data + sum.size());
+    } else {
+        setg(data, data, data + current->shardSize);
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+// readFull reads up to 'len' bytes, short only at the end of the stream.
+size_t readFull(std::istream& src, uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (n < len && src) {
+        src.read(reinterpret_cast<char*>(buf + n), static_cast<std::streamsize>(len - n));
+        n += static_cast<size_t>(src.gcount());
+    }
+    return n;
+}
+
+}
+
+Error Erasure::encode(Context& ctx, std::istream& src, int64_t size,
+                      const std::vector<std::shared_ptr<StorageAPI>>& disks,
+                      const std::string& volume, const std::string& path,
+                      int writeQuorum, int64_t& total, std::vector<Error>& errs,
+                      BitrotAlgorithm bitrotAlgo) const {
+    auto shards = dataBlocksCount + parityBlocksCount;
+    total = 0;
+    errs.assign(shards, nullptr);
+    if (static_cast<int>(disks.size()) != shards || !bitrotAvailable(bitrotAlgo)) {
+        return errInvalidArgument;
+    }
+
+    auto state = std::make_shared<EncodeState>();
+    auto shardFileSz = size >= 0 ? bitrotShardFileSize(shardFileSize(size), shardSize(), bitrotAlgo) : -1;
+    for (int i = 0; i < shards; ++i) {
+        state->pipes.push_back(std::make_unique<ShardPipe>(*state, bitrotAlgo));
+        if (!disks[i]) {
+            state->pipes[i]->aborted = true;
+            state->pipes[i]->err = errDiskNotFound;
+            continue;
+        }
+
+        ctx.runAsync([state, disk = disks[i], pipe = state->pipes[i].get(), volume, path, shardFileSz]() {
+            Error err;
+            try {
+                std::istream in(pipe);
+                disk->createFile(volume, path, shardFileSz, in);
+            } catch (const StorageError& e) {
+                err = e.error();
+            } catch (const std::exception& e) {
+                err = newError(errCodeUnexpected, e.what());
+            }
+
+            std::lock_guard<std::mutex> lock(state->mu);
+            if (!pipe->aborted) {
+                pipe->err = err;
+            }
+            if (!err && !pipe->aborted) {
+                ++state->succeeded;
+            }
+            pipe->done = true;
+            pipe->queue.clear();
+            state->progress.notify_all();
+        });
+    }
+
+    auto pool = std::make_shared<StripePool>(static_cast<size_t>(shardSize()) * shards);
+    auto quorumLost = [&]() {
+        int usable = 0;
+        for (const auto& p : state->pipes) {
+            usable += (state->live(*p) || (p->done && !p->err)) ? 1 : 0;
+        }
+        return usable < writeQuorum;
+    };
+
+    Error err;
+    while (!err) {
+        auto want = static_cast<size_t>(blockSizeValue);
+        if (size >= 0) {
+            want = static_cast<size_t>(std::min<int64_t>(blockSizeValue, size - total));
+        }
+
+        // Data shards are contiguous in the stripe, the block is read right
+        // into them and parity is computed in place.
+        auto stripe = pool->get();
+        stripe->shardSize = static_cast<size_t>(ceilFrac(static_cast<int64_t>(want), dataBlocksCount));
+        auto n = readFull(src, stripe->shard(0), want);
+        if (n < want) {
+            if (size >= 0) {
+                err = errLessData;
+                break;
+            }
+            stripe->shardSize = static_cast<size_t>(ceilFrac(static_cast<int64_t>(n), dataBlocksCount));
+        }
+        if (n == 0 && total > 0) {
+            break;
+        }
+        std::memset(stripe->shard(0) + n, 0, stripe->shardSize * dataBlocksCount - n);
+
+        std::vector<uint8_t*> ptrs(shards);
+        for (int i = 0; i < shards; ++i) {
+            ptrs[i] = stripe->shard(i);
+        }
+        encoder->encode(ptrs.data(), stripe->shardSize);
+        total += static_cast<int64_t>(n);
+
+        // Wait until writeQuorum drives have room for this stripe and
+        // no drive lags too far behind, then hand it to all of them.
+        std::unique_lock<std::mutex> lock(state->mu);
+        while (true) {
+            if (quorumLost()) {
+                err = errErasureWriteQuorum;
+                break;
+            }
+            if (ctx.isCanceled()) {
+                err = ctx.err();
+                break;
+            }
+            int ready = 0;
+            int lagging = 0;
+            int keeping = 0;    // drives that can make quorum without the laggers
+            for (const auto& p : state->pipes) {
+                if (state->live(*p)) {
+                    auto queued = static_cast<int>(p->queue.size());
+                    ready += queued < erasureEncodeDepth ? 1 : 0;
+                    if (queued >= erasureMaxStragglerLag) {
+                        lagging++;
+                    } else {
+                        keeping++;
+                    }
+                } else if (p->done && !p->err) {
+                    keeping++;
+                }
+            }
+            // Laggers are only waited for while quorum needs them, a hung
+            // drive does not stall the PUT.
+            if (lagging > 0 && keeping >= writeQuorum) {
+                for (auto& p : state->pipes) {
+                    if (state->live(*p) && static_cast<int>(p->queue.size()) >= erasureMaxStragglerLag) {
+                        state->abort(*p, errDiskOngoingReq);
+                    }
+                }
+                lagging = 0;
+            }
+            if (ready >= writeQuorum && lagging == 0) {
+                break;
+            }
+            state->progress.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (err) {
+            break;
+        }
+        for (int i = 0; i < shards; ++i) {
+            auto& p = *state->pipes[i];
+            if (state->live(p)) {
+                p.queue.emplace_back(stripe, i);
+                p.cv.notify_all();
+            }
+        }
+        lock.unlock();
+
+        if (n < want || (size >= 0 && total >= size)) {
+            break;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(state->mu);
+    if (err) {
+        for (auto& p : state->pipes) {
+            state->abort(*p, err);
+        }
+    } else {
+        for (auto& p : state->pipes) {
+            p->closed = true;
+            p->cv.notify_all();
+        }
+        // Stragglers are left to finish on their own.
+        while (state->succeeded < writeQuorum && !quorumLost() && !ctx.isCanceled()) {
+            state->progress.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (state->succeeded < writeQuorum) {
+            err = errErasureWriteQuorum;
+        }
+    }
+
+    for (int i = 0; i < shards; ++i) {
+        const auto& p = *state->pipes[i];
+        errs[i] = p.done || p.aborted ? p.err : errDiskOngoingReq;
+    }
+    return err;
+}
@@ -0,0 +1,403 @@
+#include "include/erasure.hpp"
+#include "include/storage_errors.hpp"
+#include "include/xl_storage_format_v2.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+using namespace cppio;
+
+namespace {
+
+// DriveCalls collects the results of a call made on every drive of a set,
+// calls still running when the caller returned keep it alive.
+struct DriveCalls {
+    // The calls run on this context, never the caller's, which may be gone
+    // before they return.
+    Context                 ctx;
+    std::mutex              mu;
+    std::condition_variable cv;
+    std::vector<Error>      errs;
+    std::vector<FileInfo>   fis;
+    std::vector<bool>       done;
+    int                     answered = 0;
+    int                     succeeded = 0;
+
+    // Calls that finish whatever the caller does, on a root context.
+    explicit DriveCalls(size_t n) : errs(n), fis(n), done(n) {}
+    // Calls done with 'parent' at the latest.
+    DriveCalls(size_t n, const Context& parent) : ctx(Context::withCancel(parent)), errs(n), fis(n), done(n) {}
+
+    void finish(size_t i, Error err, FileInfo fi = {}) {
+        std::lock_guard<std::mutex> lock(mu);
+        errs[i] = std::move(err);
+        fis[i] = std::move(fi);
+        done[i] = true;
+        answered++;
+        succeeded += errs[i] ? 0 : 1;
+        cv.notify_all();
+    }
+};
+
+// Versions read from different drives are the same if these agree.
+bool sameVersion(const FileInfo& a, const FileInfo& b) {
+    return a.versionID == b.versionID && a.modTime == b.modTime &&
+           a.deleted == b.deleted && a.size == b.size && a.dataDir == b.dataDir;
+}
+
+// Reads the version of versionID from the xl.meta of 'disk', a single read
+// with the inline data included, decoding only that version.
+Error readDriveVersion(StorageAPI& disk, Context& ctx, const std::string& volume, const std::string& path,
+                       const std::string& versionID, bool readData, FileInfo& fi) {
+    try {
+        auto raw = disk.readXL(ctx, volume, path, readData);
+        if (isXL2(raw.buf)) {
+            XLMetaV2View view;
+            auto err = view.load(raw.buf);
+            return err ? err : view.toFileInfo(volume, path, versionID, fi, readData);
+        }
+        XLMetaV2 meta;
+        auto err = meta.load(raw.buf);
+        return err ? err : meta.toFileInfo(volume, path, versionID, fi, readData);
+    } catch (const StorageError& e) {
+        return e.error();
+    } catch (const std::exception& e) {
+        return newError(errCodeUnexpected, e.what());
+    }
+}
+
+// Cancels the calls of a DriveCalls not needed any more when the caller
+// returns.
+struct CancelOnReturn {
+    Context& ctx;
+    ~CancelOnReturn() { ctx.cancel(); }
+};
+
+// Reads the inline shards of 'fi' from the drives of 'disks' not in
+// 'metaArr' with one yet, handing the version of every drive to 'take'
+// until it returns true, enough shards being there. Returns
+// errErasureReadQuorum when the drives run out first.
+Error readMissingShards(Context& ctx, const std::vector<std::shared_ptr<StorageAPI>>& disks,
+                        const std::string& volume, const std::string& path, const FileInfo& fi,
+                        const std::vector<FileInfo>& metaArr, const std::function<bool(size_t, FileInfo&)>& take) {
+    auto calls = std::make_shared<DriveCalls>(disks.size(), ctx);
+    CancelOnReturn cancelOnReturn{calls->ctx};
+    for (size_t i = 0; i < disks.size(); ++i) {
+        // Drives in metaArr gave their shard already, good or not.
+        if (!disks[i] || (i < metaArr.size() && !metaArr[i].data.empty())) {
+            calls->finish(i, errDiskNotFound);
+            continue;
+        }
+        calls->ctx.runAsync([calls, disk = disks[i], i, volume, path, versionID = fi.versionID]() {
+            FileInfo dfi{};
+            auto err = readDriveVersion(*disk, calls->ctx, volume, path, versionID, true, dfi);
+            calls->finish(i, err, std::move(dfi));
+        });
+    }
+
+    auto n = static_cast<int>(disks.size());
+    std::vector<bool> seen(disks.size());
+    std::unique_lock<std::mutex> lock(calls->mu);
+    while (true) {
+        for (int i = 0; i < n; ++i) {
+            if (!calls->done[i] || seen[i]) {
+                continue;
+            }
+            seen[i] = true;
+            if (!calls->errs[i] && sameVersion(fi, calls->fis[i]) && take(i, calls->fis[i])) {
+                return nullptr;
+            }
+        }
+        if (calls->answered == n) {
+            return errErasureReadQuorum;
+        }
+        if (ctx.isCanceled()) {
+            return ctx.err();
+        }
+        calls->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+}
+
+BitrotAlgorithm inlineBitrotAlgorithm(const FileInfo& fi) {
+    return fi.erasure.checksums.empty() ? defaultBitrotAlgorithm : fi.erasure.checksums[0].Algorithm;
+}
+
+}
+
+int ErasureObjects::defaultReadQuorum(int drives) const {
+    if (defaultParityCount > 0 && defaultParityCount <= drives / 2) {
+        return drives - defaultParityCount;
+    }
+    return drives / 2;
+}
+
+Error ErasureObjects::writeInline(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi,
+                                  const uint8_t* data, size_t size, std::vector<Error>& errs,
+                                  BitrotAlgorithm bitrotAlgo) {
+    auto disks = getDisks();
+    errs.assign(disks.size(), nullptr);
+
+    std::unique_ptr<Erasure> erasure;
+    try {
+        erasure = std::make_unique<Erasure>(fi.erasure);
+    } catch (const std::invalid_argument&) {
+        return errInvalidArgument;
+    }
+    auto shards = erasure->dataBlocks() + erasure->parityBlocks();
+    if (static_cast<int>(disks.size()) != shards || static_cast<int>(fi.erasure.distribution.size()) != shards ||
+        !bitrotAvailable(bitrotAlgo)) {
+        return errInvalidArgument;
+    }
+
+    // Shard i of every stripe goes after shard i of the previous one, in
+    // the layout of a shard file.
+    std::vector<std::vector<uint8_t>> framed(shards);
+    std::vector<std::vector<uint8_t>> stripe;
+    for (size_t off = 0; off < size; off += static_cast<size_t>(erasure->blockSize())) {
+        auto len = std::min(size - off, static_cast<size_t>(erasure->blockSize()));
+        if (auto err = erasure->encodeData(data + off, len, stripe)) {
+            return err;
+        }
+        for (int i = 0; i < shards; ++i) {
+            bitrotAppendShard(bitrotAlgo, erasure->shardSize(), stripe[i].data(), stripe[i].size(), framed[i]);
+        }
+    }
+
+    // Writes still running after quorum outlive 'ctx' and are not canceled
+    // with it, every drive is to get the object.
+    auto calls = std::make_shared<DriveCalls>(disks.size());
+    for (size_t i = 0; i < disks.size(); ++i) {
+        auto shard = fi.erasure.distribution[i] - 1;
+        if (!disks[i] || shard < 0 || shard >= shards) {
+            calls->finish(i, disks[i] ? errInvalidArgument : errDiskNotFound);
+            continue;
+        }
+
+        FileInfo dfi = fi;
+        dfi.data = std::move(framed[shard]);
+        dfi.erasure.index = shard + 1;
+        dfi.erasure.checksums = {ChecksumInfo{1, bitrotAlgo, {}}};
+        dfi.metadata[xlMetaInlineData] = "true";
+        calls->ctx.runAsync([calls, disk = disks[i], i, volume, path, dfi = std::move(dfi)]() {
+            Error err;
+            try {
+                err = disk->writeMetadata(calls->ctx, "", volume, path, dfi);
+            } catch (const StorageError& e) {
+                err = e.error();
+            } catch (const std::exception& e) {
+                err = newError(errCodeUnexpected, e.what());
+            }
+            calls->finish(i, err);
+        });
+    }
+
+    auto quorum = writeQuorum(*erasure);
+    auto n = static_cast<int>(disks.size());
+    std::unique_lock<std::mutex> lock(calls->mu);
+    while (calls->succeeded < quorum && calls->answered - calls->succeeded <= n - quorum && !ctx.isCanceled()) {
+        calls->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    for (size_t i = 0; i < disks.size(); ++i) {
+        errs[i] = calls->done[i] ? calls->errs[i] : errDiskOngoingReq;
+    }
+    auto succeeded = calls->succeeded;
+    lock.unlock();
+
+    // Even a failed write may have changed what some drives list.
+    if (metacaches) {
+        metacaches->objectChanged(volume, path);
+    }
+    return succeeded >= quorum ? nullptr : errErasureWriteQuorum;
+}
+
+Error ErasureObjects::getObjectFileInfo(Context& ctx, const std::string& volume, const std::string& path,
+                                        const std::string& versionID, bool readData, FileInfo& fi,
+                                        std::vector<FileInfo>& metaArr, std::vector<Error>& errs) {
+    auto disks = getDisks();
+    auto n = static_cast<int>(disks.size());
+    metaArr.assign(disks.size(), FileInfo{});
+    errs.assign(disks.size(), nullptr);
+
+    // Reads of drives not needed for quorum are dropped once this returns.
+    auto calls = std::make_shared<DriveCalls>(disks.size(), ctx);
+    CancelOnReturn cancelOnReturn{calls->ctx};
+    for (size_t i = 0; i < disks.size(); ++i) {
+        if (!disks[i]) {
+            calls->finish(i, errDiskNotFound);
+            continue;
+        }
+        calls->ctx.runAsync([calls, disk = disks[i], i, volume, path, versionID, readData]() {
+            FileInfo dfi{};
+            auto err = readDriveVersion(*disk, calls->ctx, volume, path, versionID, readData, dfi);
+            calls->finish(i, err, std::move(dfi));
+        });
+    }
+
+    // Wait for the first version read quorum agrees on, the quorum of an
+    // object version is its data block count. With inline data that is
+    // enough shards to decode, readInline reads the other drives when some
+    // of them do not verify.
+    std::unique_lock<std::mutex> lock(calls->mu);
+    int agreed = -1;
+    while (true) {
+        for (int i = 0; i < n && agreed < 0; ++i) {
+            if (!calls->done[i] || calls->errs[i]) {
+                continue;
+            }
+            const auto& v = calls->fis[i];
+            auto quorum = v.erasure.dataBlocks > 0 ? v.erasure.dataBlocks : defaultReadQuorum(n);
+            int count = 0;
+            for (int j = 0; j < n; ++j) {
+                count += calls->done[j] && !calls->errs[j] && sameVersion(v, calls->fis[j]) ? 1 : 0;
+            }
+            agreed = count >= quorum ? i : -1;
+        }
+        if (agreed >= 0 || calls->answered == n) {
+            break;
+        }
+        agreed = -1;
+        if (ctx.isCanceled()) {
+            return ctx.err();
+        }
+        calls->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+
+    if (agreed < 0) {
+        // No version has quorum, report the error most drives agree on if
+        // that makes quorum, like the object not being there.
+        Error reduced;
+        int best = 0;
+        for (int i = 0; i < n; ++i) {
+            auto count = static_cast<int>(std::count(calls->errs.begin(), calls->errs.end(), calls->errs[i]));
+            if (calls->errs[i] && count > best) {
+                reduced = calls->errs[i];
+                best = count;
+            }
+        }
+        errs = calls->errs;
+        return reduced && best >= defaultReadQuorum(n) ? reduced : errErasureReadQuorum;
+    }
+
+    const auto& version = calls->fis[agreed];
+    for (int i = 0; i < n; ++i) {
+        if (!calls->done[i]) {
+            errs[i] = errDiskOngoingReq;
+        } else if (calls->errs[i]) {
+            errs[i] = calls->errs[i];
+        } else if (!sameVersion(version, calls->fis[i])) {
+            errs[i] = errFileVersionNotFound;
+        } else {
+            metaArr[i] = calls->fis[i];
+        }
+    }
+    fi = version;
+    fi.data.clear();
+    return nullptr;
+}
+
+Error ErasureObjects::readInline(Context& ctx, const std::string& volume, const std::string& path,
+                                 const FileInfo& fi, std::vector<FileInfo>& metaArr,
+                                 int64_t offset, int64_t length, std::ostream& writer, int64_t& written) {
+    written = 0;
+    if (!isInlineData(fi) || offset < 0 || length < 0 || offset + length > fi.size) {
+        return errInvalidArgument;
+    }
+    if (length == 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Erasure> erasure;
+    try {
+        erasure = std::make_unique<Erasure>(fi.erasure);
+    } catch (const std::invalid_argument&) {
+        return errInvalidArgument;
+    }
+    auto k = erasure->dataBlocks();
+    auto shards = k + erasure->parityBlocks();
+
+    // Verify shards, data before parity, until there are enough to decode.
+    std::vector<int> drive(shards, -1);
+    for (size_t i = 0; i < metaArr.size(); ++i) {
+        auto shard = metaArr[i].erasure.index - 1;
+        if (shard >= 0 && shard < shards && !metaArr[i].data.empty()) {
+            drive[shard] = static_cast<int>(i);
+        }
+    }
+    auto algo = inlineBitrotAlgorithm(fi);
+    std::vector<std::vector<uint8_t>> shardData(shards);
+    std::vector<bool> verifiedShard(shards);
+    int verified = 0;
+    auto verify = [&](int s, const std::vector<uint8_t>& data) {
+        if (bitrotVerifyShard(algo, erasure->shardSize(), data, shardData[s])) {
+            shardData[s].clear();
+            return;
+        }
+        verifiedShard[s] = true;
+        verified++;
+    };
+    for (int s = 0; s < shards && verified < k; ++s) {
+        if (drive[s] >= 0) {
+            verify(s, metaArr[drive[s]].data);
+        }
+    }
+    if (verified < k) {
+        // Read quorum of drives agreeing is not enough shards when some do
+        // not verify, the drives getObjectFileInfo did not wait for make up
+        // for them.
+        auto err = readMissingShards(ctx, getDisks(), volume, path, fi, metaArr, [&](size_t i, FileInfo& dfi) {
+            auto shard = dfi.erasure.index - 1;
+            if (shard < 0 || shard >= shards || verifiedShard[shard] || dfi.data.empty()) {
+                return false;
+            }
+            verify(shard, dfi.data);
+            if (verifiedShard[shard] && i < metaArr.size()) {
+                metaArr[i] = std::move(dfi);
+            }
+            return verified >= k;
+        });
+        if (err) {
+            return err;
+        }
+    }
+
+    auto blockSize = erasure->blockSize();
+    std::vector<std::vector<uint8_t>> stripe(shards);
+    for (auto block = offset / blockSize; block * blockSize < offset + length; ++block) {
+        auto blockStart = block * blockSize;
+        auto curBlockSize = std::min(blockSize, fi.size - blockStart);
+        auto shardSz = static_cast<size_t>(ceilFrac(curBlockSize, k));
+        auto shardOffset = static_cast<size_t>(block * erasure->shardSize());
+        for (int s = 0; s < shards; ++s) {
+            stripe[s].clear();
+            if (shardData[s].size() >= shardOffset + shardSz) {
+                stripe[s].assign(shardData[s].begin() + shardOffset, shardData[s].begin() + shardOffset + shardSz);
+            }
+        }
+        if (auto err = erasure->decodeDataBlocks(stripe)) {
+            return err;
+        }
+
+        // Write the requested part of the block.
+        auto skip = std::max(offset - blockStart, int64_t{0});
+        auto remaining = std::min(offset + length, blockStart + curBlockSize) - blockStart - skip;
+        for (int s = 0; s < k && remaining > 0; ++s) {
+            auto size = static_cast<int64_t>(shardSz);
+            if (skip >= size) {
+                skip -= size;
+                continue;
+            }
+            auto n = std::min(size - skip, remaining);
+            writer.write(reinterpret_cast<const char*>(stripe[s].data() + skip), static_cast<std::streamsize>(n));
+            if (!writer) {
+                return newError(errCodeUnexpected, "short write");
+            }
+            skip = 0;
+            remaining -= n;
+            written += n;
+        }
+    }
+    return nullptr;
+}
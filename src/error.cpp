@@ -1,6 +1,6 @@
 #include "include/error.hpp"
 
-using namespace cppio;
+namespace cppio {
 
 std::string ErrorObj::to_string() const {
     return "Error[" +  std::to_string(code) + "]: " + msg;
@@ -23,4 +23,6 @@ std::ostream& operator<<(std::ostream& os, const Error error) {
 
 Error newError(int code, const std::string& message) {
     return std::make_shared<ErrorObj>(ErrorObj{code, message});
-}
\ No newline at end of file
+}
+
+}
@@ -0,0 +1,264 @@
+#include "include/executor.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+using namespace cppio;
+
+thread_local Executor::Worker* Executor::current = nullptr;
+
+Executor::Executor(const ExecutorOptions& opts) : opts(opts) {
+    if (this->opts.coreThreads == 0) {
+        this->opts.coreThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    this->opts.maxThreads = std::max(this->opts.maxThreads, this->opts.coreThreads);
+
+    for (unsigned i = 0; i < this->opts.coreThreads; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->owner = this;
+        cores.push_back(std::move(worker));
+    }
+    running = this->opts.coreThreads;
+    for (auto& worker : cores) {
+        std::thread([this, local = worker.get()]() { work(local); }).detach();
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(timerMu);
+        timerStopping = true;
+        timerCv.notify_all();
+    }
+    if (timer.joinable()) {
+        timer.join();
+    }
+    delayed.clear();
+
+    std::unique_lock<std::mutex> lock(mu);
+    stopping = true;
+    cv.notify_all();
+    stoppedCv.wait(lock, [this]() { return running.load() == 0; });
+}
+
+Executor& Executor::global() {
+    // Workers outlive main, destroying it at exit would wait for them.
+    static auto* executor = new Executor();
+    return *executor;
+}
+
+void Executor::submit(Task task) {
+    // Counted first, a worker seeing nothing queued has nothing to find.
+    queued.fetch_add(1);
+    if (current != nullptr && current->owner == this) {
+        std::lock_guard<std::mutex> lock(current->mu);
+        current->tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(sharedMu);
+        shared.push_back(std::move(task));
+    }
+
+    std::chrono::steady_clock::time_point since;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        if (sleeping > 0) {
+            sleeping--;
+            wakeups++;
+            cv.notify_one();
+            return;
+        }
+        // Picked up by the next worker done with its task, unless the
+        // backlog lasts.
+        if (backlogSince != std::chrono::steady_clock::time_point{}) {
+            return;
+        }
+        backlogSince = since = std::chrono::steady_clock::now();
+        backlogTaken = taken.load();
+    }
+    armBacklogCheck(since);
+}
+
+void Executor::spawn() {
+    try {
+        std::thread([this]() { work(nullptr); }).detach();
+    } catch (const std::system_error&) {
+        std::lock_guard<std::mutex> lock(mu);
+        running--;
+        stoppedCv.notify_all();
+    }
+}
+
+void Executor::armBacklogCheck(std::chrono::steady_clock::time_point since) {
+    std::lock_guard<std::mutex> lock(timerMu);
+    if (timerStopping) {
+        return;
+    }
+    if (!timer.joinable()) {
+        timer = std::thread([this]() { timerLoop(); });
+    }
+    auto due = since + opts.backlogDelay;
+    if (due < backlogCheck) {
+        backlogCheck = due;
+        timerCv.notify_one();
+    }
+}
+
+void Executor::checkBacklog() {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point since;
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        if (backlogSince == std::chrono::steady_clock::time_point{} || stopping) {
+            return;
+        }
+        if (now - backlogSince < opts.backlogDelay) {
+            // A worker went idle since the check was armed, the backlog is
+            // a later one.
+            since = backlogSince;
+        } else if (queued.load() == 0 || running.load() >= opts.maxThreads) {
+            // Drained, or nothing to start, the next submission finding no
+            // idle worker arms again.
+            backlogSince = {};
+            return;
+        } else {
+            // Workers taking tasks are getting through the backlog, only
+            // when all are stuck another one is needed.
+            start = taken.load() == backlogTaken;
+            running += start ? 1 : 0;
+            backlogSince = since = now;
+            backlogTaken = taken.load();
+        }
+    }
+    if (start) {
+        spawn();
+    }
+    armBacklogCheck(since);
+}
+
+void Executor::submitAfter(std::chrono::steady_clock::duration delay, Task task) {
+    std::lock_guard<std::mutex> lock(timerMu);
+    if (timerStopping) {
+        return;
+    }
+    if (!timer.joinable()) {
+        timer = std::thread([this]() { timerLoop(); });
+    }
+    auto it = delayed.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+    if (it == delayed.begin()) {
+        timerCv.notify_one();
+    }
+}
+
+void Executor::timerLoop() {
+    std::unique_lock<std::mutex> lock(timerMu);
+    while (!timerStopping) {
+        auto now = std::chrono::steady_clock::now();
+        if (backlogCheck <= now) {
+            backlogCheck = std::chrono::steady_clock::time_point::max();
+            lock.unlock();
+            checkBacklog();
+            lock.lock();
+            continue;
+        }
+        auto due = delayed.empty() ? std::chrono::steady_clock::time_point::max() : delayed.begin()->first;
+        if (due <= now) {
+            auto task = std::move(delayed.extract(delayed.begin()).mapped());
+            lock.unlock();
+            submit(std::move(task));
+            lock.lock();
+            continue;
+        }
+        auto until = std::min(due, backlogCheck);
+        if (until == std::chrono::steady_clock::time_point::max()) {
+            timerCv.wait(lock);
+        } else {
+            timerCv.wait_until(lock, until);
+        }
+    }
+}
+
+bool Executor::take(Worker* local, Task& task) {
+    if (queued.load() == 0) {
+        return false;
+    }
+    auto pop = [&](std::mutex& m, std::deque<Task>& tasks, bool back) {
+        std::lock_guard<std::mutex> lock(m);
+        if (tasks.empty()) {
+            return false;
+        }
+        if (back) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        } else {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        queued.fetch_sub(1);
+        taken.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    };
+
+    if (local != nullptr && pop(local->mu, local->tasks, true)) {
+        return true;
+    }
+    if (pop(sharedMu, shared, false)) {
+        return true;
+    }
+    auto n = cores.size();
+    auto first = stealFrom.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+        auto& victim = *cores[(first + i) % n];
+        if (&victim != local && pop(victim.mu, victim.tasks, false)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Executor::work(Worker* local) {
+    current = local;
+    std::unique_lock<std::mutex> lock(mu, std::defer_lock);
+    for (;;) {
+        Task task;
+        while (take(local, task)) {
+            task();
+            task = Task();
+        }
+
+        lock.lock();
+        // A task queued after the scan either finds this worker counted
+        // as sleeping, or is seen here.
+        if (queued.load() > 0) {
+            lock.unlock();
+            continue;
+        }
+        if (stopping) {
+            break;
+        }
+        // An idle worker, the queues are not backed up.
+        backlogSince = {};
+        sleeping++;
+        auto woken = [this]() { return wakeups > 0 || stopping; };
+        if (local != nullptr) {
+            cv.wait(lock, woken);
+        } else {
+            cv.wait_for(lock, opts.idleTimeout, woken);
+        }
+        if (wakeups > 0) {
+            wakeups--;
+        } else {
+            sleeping--;
+            if (!stopping) {
+                // A spare worker idle for idleTimeout.
+                break;
+            }
+        }
+        lock.unlock();
+    }
+
+    // Still under mu, the destructor waits for running to drop under it.
+    running--;
+    stoppedCv.notify_all();
+}
@@ -0,0 +1,163 @@
+#include "include/file_range.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+using namespace cppio;
+
+namespace {
+
+// Largest amount handed to the kernel per call, keeps a single request
+// from hogging a socket for too long.
+const int64_t maxSendChunk = 4 * 1024 * 1024;  // 4 MiB
+
+std::error_code lastError() {
+    return std::error_code(errno, std::system_category());
+}
+
+// waitWritable blocks until a non-blocking socket can take more data, at
+// most 'timeout'.
+std::error_code waitWritable(int sockfd, std::chrono::milliseconds timeout) {
+    pollfd pfd{sockfd, POLLOUT, 0};
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        auto n = ::poll(&pfd, 1, static_cast<int>(std::max<int64_t>(left.count(), 0)));
+        if (n > 0) {
+            return {};
+        }
+        if (n == 0) {
+            return std::make_error_code(std::errc::timed_out);
+        }
+        if (errno != EINTR) {
+            return lastError();
+        }
+    }
+}
+
+std::error_code spliceFileRange(int sockfd, const FileRange& range, int64_t& sent,
+                                std::chrono::milliseconds idleTimeout) {
+    int pipefd[2];
+    if (::pipe2(pipefd, O_CLOEXEC) < 0) {
+        return lastError();
+    }
+
+    std::error_code ec;
+    loff_t off = range.offset + sent;
+    while (!ec && sent < range.length) {
+        auto want = static_cast<size_t>(std::min(range.length - sent, maxSendChunk));
+        auto n = ::splice(range.fd, &off, pipefd[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ec = n == 0 ? std::make_error_code(std::errc::io_error) : lastError();
+            break;
+        }
+
+        // Drain the pipe completely before filling it again.
+        while (n > 0) {
+            auto m = ::splice(pipefd[0], nullptr, sockfd, nullptr, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (m < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN) {
+                    ec = waitWritable(sockfd, idleTimeout);
+                    if (ec) {
+                        break;
+                    }
+                    continue;
+                }
+                ec = lastError();
+                break;
+            }
+            n -= m;
+            sent += m;
+        }
+    }
+
+    ::close(pipefd[0]);
+    ::close(pipefd[1]);
+    return ec;
+}
+
+}
+
+FileRange& FileRange::operator=(FileRange&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        offset = other.offset;
+        length = other.length;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+void FileRange::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+FileRangeStream::Buf::int_type FileRangeStream::Buf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    while (pos < range.length) {
+        auto want = static_cast<size_t>(std::min<int64_t>(sizeof(chunk), range.length - pos));
+        auto n = ::pread(range.fd, chunk, want, range.offset + pos);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        pos += n;
+        setg(chunk, chunk, chunk + n);
+        return traits_type::to_int_type(*gptr());
+    }
+    return traits_type::eof();
+}
+
+std::error_code cppio::sendFileRange(int sockfd, const FileRange& range, int64_t& sent,
+                                     std::chrono::milliseconds idleTimeout) {
+    sent = 0;
+    off_t off = range.offset;
+    while (sent < range.length) {
+        auto want = static_cast<size_t>(std::min(range.length - sent, maxSendChunk));
+        auto n = ::sendfile(sockfd, range.fd, &off, want);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+
+        if (n == 0) {
+            // File is shorter than the range announced in the header.
+            return std::make_error_code(std::errc::io_error);
+        }
+
+        switch (errno) {
+        case EINTR:
+            continue;
+        case EAGAIN:
+            if (auto ec = waitWritable(sockfd, idleTimeout)) {
+                return ec;
+            }
+            continue;
+        case EINVAL:
+        case ENOSYS:
+            return spliceFileRange(sockfd, range, sent, idleTimeout);
+        default:
+            return lastError();
+        }
+    }
+    return {};
+}
@@ -0,0 +1,387 @@
+#include "include/httpserver.hpp"
+#include "include/log.hpp"
+
+#include <unistd.h>
+
+using namespace cppio;
+
+// SO_REUSEPORT lets every io_context own an acceptor on the same port, the
+// kernel then spreads incoming connections across them.
+using reusePortOption = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+IoContextPool::IoContextPool(std::size_t poolSize) {
+    if (poolSize == 0) {
+        poolSize = 1;
+    }
+
+    for (std::size_t i = 0; i < poolSize; ++i) {
+        auto ioc = std::make_shared<net::io_context>(1);
+        workGuards.emplace_back(net::make_work_guard(*ioc));
+        ioContexts.push_back(ioc);
+    }
+}
+
+void IoContextPool::run() {
+    std::vector<std::thread> threads;
+    threads.reserve(ioContexts.size());
+    for (auto& ioc : ioContexts) {
+        threads.emplace_back([ioc]() { ioc->run(); });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void IoContextPool::stop() {
+    for (auto& guard : workGuards) {
+        guard.reset();
+    }
+
+    for (auto& ioc : ioContexts) {
+        ioc->stop();
+    }
+}
+
+net::io_context& IoContextPool::getIoContext() {
+    return *ioContexts[next.fetch_add(1, std::memory_order_relaxed) % ioContexts.size()];
+}
+
+boost::optional<std::pair<FileRangeBody::writer::const_buffers_type, bool>>
+FileRangeBody::writer::get(beast::error_code& ec) {
+    auto want = std::min<int64_t>(sizeof(buf), body.length - pos);
+    auto n = ::pread(body.fd, buf, static_cast<size_t>(want), body.offset + pos);
+    if (n <= 0) {
+        ec = n == 0 ? beast::error_code(net::error::eof)
+                    : beast::error_code(errno, beast::system_category());
+        return boost::none;
+    }
+
+    ec = {};
+    pos += n;
+    return {{const_buffers_type{buf, static_cast<std::size_t>(n)}, pos < body.length}};
+}
+
+HttpBodyReader::int_type HttpBodyReader::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    while (!ec && !parser.is_done()) {
+        auto& body = parser.get().body();
+        body.data = chunk.data();
+        body.size = chunk.size();
+
+        awaitStream(stream, ec, [&](auto handler) { http::async_read_some(stream, buffer, parser, std::move(handler)); });
+        if (ec == http::error::need_buffer) {
+            ec = {};
+        }
+
+        auto n = chunk.size() - body.size;
+        if (n > 0) {
+            setg(chunk.data(), chunk.data(), chunk.data() + n);
+            return traits_type::to_int_type(*gptr());
+        }
+    }
+
+    return traits_type::eof();
+}
+
+bool HttpBodyReader::drain(std::uint64_t limit) {
+    std::uint64_t drained = egptr() - gptr();
+    setg(chunk.data(), chunk.data(), chunk.data());
+
+    while (!ec && !parser.is_done()) {
+        if (drained > limit) {
+            return false;
+        }
+
+        if (underflow() != traits_type::eof()) {
+            drained += egptr() - gptr();
+            setg(chunk.data(), chunk.data(), chunk.data());
+        }
+    }
+
+    return !ec;
+}
+
+void HttpSession::run() {
+    // Start on the connection's own executor, accept handler may run on
+    // another io_context when sockets are handed off.
+    net::dispatch(stream.get_executor(),
+                  beast::bind_front_handler(&HttpSession::doReadHeader, shared_from_this()));
+}
+
+void HttpSession::doReadHeader() {
+    // A fresh parser per request, the buffer survives so that bytes of
+    // pipelined requests already received are not lost.
+    parser.emplace();
+    parser->header_limit(httpHeaderLimit);
+    parser->body_limit((std::numeric_limits<std::uint64_t>::max)());
+
+    stream.expires_after(httpIdleTimeout);
+
+    http::async_read_header(stream, buffer, *parser,
+                            beast::bind_front_handler(&HttpSession::onReadHeader, shared_from_this()));
+}
+
+void HttpSession::onReadHeader(beast::error_code ec, std::size_t bytesTransferred) {
+    boost::ignore_unused(bytesTransferred);
+
+    if (ec == http::error::end_of_stream) {
+        return doClose();
+    }
+
+    if (ec) {
+        if (ec != beast::error::timeout) {
+            gLogger->warn("http read: {}", ec.message());
+        }
+        return;
+    }
+
+    // Hand the connection to a worker, no async operation is pending on
+    // the stream until it posts back.
+    stream.expires_never();
+    ctx.runAsync([self = shared_from_this()]() {
+        auto keepAlive = self->serve();
+        net::post(self->stream.get_executor(), [self, keepAlive]() {
+            if (keepAlive) {
+                self->doReadHeader();
+            } else {
+                self->doClose();
+            }
+        });
+    });
+}
+
+bool HttpSession::serve() {
+    auto& req = parser->get();
+    beast::error_code ec;
+
+    if (chunk.empty()) {
+        chunk.resize(httpStreamChunkSize);
+    }
+
+    if (req[http::field::expect] == "100-continue") {
+        http::response<http::empty_body> res{http::status::continue_, req.version()};
+        awaitStream(stream, ec, [&](auto handler) { http::async_write(stream, res, std::move(handler)); });
+        if (ec) {
+            return false;
+        }
+    }
+
+    HttpBodyReader reader(stream, buffer, *parser, chunk);
+    std::istream body(&reader);
+
+    HttpResponse res;
+    try {
+        res = handler(req, body);
+    } catch (const std::exception& e) {
+        gLogger->error("http handler: {}", e.what());
+        res = HttpResponse{};
+        res.header.result(http::status::internal_server_error);
+        res.header.keep_alive(false);
+    }
+
+    // The next request can only be parsed once this payload is consumed.
+    auto keepAlive = req.keep_alive() && res.header.keep_alive();
+    if (!reader.drain(httpDrainLimit)) {
+        keepAlive = false;
+    }
+
+    res.header.version(req.version());
+    res.header.keep_alive(keepAlive);
+
+    ec = writeResponse(res);
+    if (ec) {
+        gLogger->warn("http write: {}", ec.message());
+        return false;
+    }
+
+    return keepAlive;
+}
+
+beast::error_code HttpSession::writeResponse(HttpResponse& res) {
+    beast::error_code ec;
+
+    if (res.bodyFile.valid()) {
+        return writeFileResponse(res);
+    }
+
+    if (res.bodyStream == nullptr) {
+        http::response<http::string_body> msg{std::move(res.header.base())};
+        msg.body() = std::move(res.body);
+        msg.prepare_payload();
+        awaitStream(stream, ec, [&](auto handler) { http::async_write(stream, msg, std::move(handler)); });
+        return ec;
+    }
+
+    // Object payloads go out one chunk at a time, read from the stream
+    // only when the serializer asks for more.
+    http::response<http::buffer_body> msg{std::move(res.header.base())};
+    if (res.contentLength >= 0) {
+        msg.content_length(res.contentLength);
+    } else {
+        msg.chunked(true);
+    }
+    msg.body().data = nullptr;
+    msg.body().more = true;
+
+    http::response_serializer<http::buffer_body> sr{msg};
+    awaitStream(stream, ec, [&](auto handler) { http::async_write_header(stream, sr, std::move(handler)); });
+    if (ec) {
+        return ec;
+    }
+
+    auto& in = *res.bodyStream;
+    int64_t sent = 0;
+    do {
+        auto want = static_cast<std::streamsize>(chunk.size());
+        if (res.contentLength >= 0) {
+            want = std::min<std::streamsize>(want, res.contentLength - sent);
+        }
+        std::streamsize n = 0;
+        if (want > 0) {
+            in.read(chunk.data(), want);
+            n = in.gcount();
+        }
+        sent += n;
+
+        // Finishing the message would hand the client a truncated payload
+        // as complete, and a short one leaves the framing off for the next
+        // response on the connection.
+        if (in.bad() || (res.contentLength >= 0 && sent < res.contentLength && !in.good())) {
+            return http::error::partial_message;
+        }
+
+        if (n > 0) {
+            msg.body().data = chunk.data();
+            msg.body().size = static_cast<std::size_t>(n);
+        } else {
+            msg.body().data = nullptr;
+            msg.body().size = 0;
+        }
+        msg.body().more = res.contentLength >= 0 ? sent < res.contentLength : in.good();
+
+        awaitStream(stream, ec, [&](auto handler) { http::async_write(stream, sr, std::move(handler)); });
+        if (ec == http::error::need_buffer) {
+            ec = {};
+        }
+    } while (!ec && !sr.is_done());
+
+    return ec;
+}
+
+beast::error_code HttpSession::writeFileResponse(HttpResponse& res) {
+    beast::error_code ec;
+
+    http::response<FileRangeBody> msg{std::move(res.header.base()), std::move(res.bodyFile)};
+    msg.prepare_payload();
+
+    // Only the header goes through the serializer, the payload is moved
+    // from the page cache to the socket by the kernel.
+    http::response_serializer<FileRangeBody> sr{msg};
+    awaitStream(stream, ec, [&](auto handler) { http::async_write_header(stream, sr, std::move(handler)); });
+    if (ec) {
+        return ec;
+    }
+
+    int64_t sent = 0;
+    auto err = sendFileRange(stream.socket().native_handle(), msg.body(), sent, httpIdleTimeout);
+    if (err) {
+        return beast::error_code(err.value(), beast::system_category());
+    }
+    return ec;
+}
+
+void HttpSession::doClose() {
+    beast::error_code ec;
+    stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+}
+
+HttpListener::HttpListener(net::io_context& ioc, IoContextPool* handoff,
+                           const tcp::endpoint& endpoint, bool reusePort,
+                           const HttpHandler& handler, Context& ctx)
+    : ioc(ioc), handoff(handoff), acceptor(ioc), handler(handler), ctx(ctx) {
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(net::socket_base::reuse_address(true));
+    if (reusePort) {
+        acceptor.set_option(reusePortOption(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen(net::socket_base::max_listen_connections);
+}
+
+void HttpListener::close() {
+    net::post(ioc, [self = shared_from_this()]() {
+        beast::error_code ec;
+        self->acceptor.close(ec);
+    });
+}
+
+void HttpListener::doAccept() {
+    auto& target = handoff ? handoff->getIoContext() : ioc;
+    acceptor.async_accept(target.get_executor(),
+                          beast::bind_front_handler(&HttpListener::onAccept, shared_from_this()));
+}
+
+void HttpListener::onAccept(beast::error_code ec, tcp::socket socket) {
+    if (ec) {
+        if (ec == net::error::operation_aborted) {
+            return;
+        }
+        gLogger->warn("http accept: {}", ec.message());
+    } else {
+        socket.set_option(tcp::no_delay(true), ec);
+        std::make_shared<HttpSession>(std::move(socket), handler, ctx)->run();
+    }
+
+    doAccept();
+}
+
+HttpServer::HttpServer(const std::string& address, unsigned short port, std::size_t threads)
+    : endpoint(net::ip::make_address(address), port), pool(threads), handler(handleRequest) {}
+
+void HttpServer::start() {
+    try {
+        // One acceptor per io_context, each core accepts its own connections.
+        for (std::size_t i = 0; i < pool.size(); ++i) {
+            listeners.push_back(std::make_shared<HttpListener>(
+                pool.getIoContext(i), nullptr, endpoint, true, handler, ctx));
+        }
+    } catch (const boost::system::system_error& e) {
+        // SO_REUSEPORT is unavailable, use a single acceptor handing off
+        // accepted sockets to the pool in round-robin order.
+        gLogger->warn("SO_REUSEPORT unavailable ({}), fallback to socket handoff", e.what());
+        listeners.clear();
+        listeners.push_back(std::make_shared<HttpListener>(
+            pool.getIoContext(0), &pool, endpoint, false, handler, ctx));
+    }
+
+    for (auto& listener : listeners) {
+        listener->run();
+    }
+
+    gLogger->info("Server started on {}:{} with {} io_contexts",
+                  endpoint.address().to_string(), endpoint.port(), pool.size());
+    pool.run();
+}
+
+void HttpServer::stop() {
+    for (auto& listener : listeners) {
+        listener->close();
+    }
+    pool.stop();
+}
+
+HttpResponse HttpServer::handleRequest(const HttpRequest& req, std::istream& body) {
+    boost::ignore_unused(body);
+
+    HttpResponse res;
+    res.header.result(http::status::ok);
+    res.header.set(http::field::server, "Boost Beast Async Server");
+    res.header.set(http::field::content_type, "text/html");
+    res.header.keep_alive(req.keep_alive());
+    res.body = "-------Hello, Boost.Beast Async!\n\n";
+    return res;
+}
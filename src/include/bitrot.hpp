@@ -0,0 +1,74 @@
+#ifndef CPPIO_BITROT_HPP
+#define CPPIO_BITROT_HPP
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "error.hpp"
+#include "xl_storage_format_v1.hpp"
+
+namespace cppio {
+
+// DefaultBitrotAlgorithm is the default algorithm used for bitrot protection.
+const BitrotAlgorithm defaultBitrotAlgorithm = BitrotAlgorithm::HighwayHash256S;
+
+// BitrotHash computes a checksum over data fed in any number of pieces.
+class BitrotHash {
+
+public:
+    virtual ~BitrotHash() = default;
+
+    virtual void reset() = 0;
+    virtual void update(const uint8_t* data, size_t len) = 0;
+    // Writes size() bytes of checksum to 'out'.
+    virtual void sum(uint8_t* out) = 0;
+    virtual size_t size() const = 0;
+
+    std::vector<uint8_t> sum() {
+        std::vector<uint8_t> out(size());
+        sum(out.data());
+        return out;
+    }
+};
+
+// Returns true if the algorithm is implemented.
+bool bitrotAvailable(BitrotAlgorithm algo);
+
+// Creates a hash of the algorithm, nullptr when not available.
+std::unique_ptr<BitrotHash> newBitrotHash(BitrotAlgorithm algo);
+
+// Size of the checksums of the algorithm, 0 when not available.
+size_t bitrotHashSize(BitrotAlgorithm algo);
+
+std::string bitrotAlgorithmString(BitrotAlgorithm algo);
+
+// Updates a CRC-32C (Castagnoli) checksum, hardware accelerated when the
+// CPU has SSE4.2.
+uint32_t crc32c(uint32_t crc, const uint8_t* data, size_t len);
+
+// Returns the size of a streaming bitrot protected shard file holding
+// 'size' bytes of shard data, a checksum leads every shardSize chunk.
+int64_t bitrotShardFileSize(int64_t size, int64_t shardSize, BitrotAlgorithm algo);
+
+// Returns the offset in a streaming bitrot protected shard file of the
+// chunk starting at 'offset' of the shard data.
+int64_t bitrotShardFileOffset(int64_t offset, int64_t shardSize, BitrotAlgorithm algo);
+
+// Appends 'data' to 'out' in the layout of streaming bitrot protected
+// shard files. Appending shard after shard gives the layout of the whole,
+// as long as only the last one is shorter than shardSize. 'algo' has to
+// be available.
+void bitrotAppendShard(BitrotAlgorithm algo, int64_t shardSize, const uint8_t* data, size_t len,
+                       std::vector<uint8_t>& out);
+
+// Verifies a buffer in streaming bitrot layout and appends its data to
+// 'out', errFileCorrupt when a chunk does not match its checksum.
+Error bitrotVerifyShard(BitrotAlgorithm algo, int64_t shardSize, std::span<const uint8_t> in,
+                        std::vector<uint8_t>& out);
+
+}
+
+#endif // CPPIO_BITROT_HPP
@@ -28,9 +28,9 @@ using OnUsageErrorFunc = std::function<void(const std::string&)>;
 
 struct Flags {
     bool isParsed = false;
-    boost::program_options::variables_map optionSet;
-    boost::program_options::positional_options_description positionalSet;
-    std::shared_ptr<boost::program_options::options_description> optionsDescription;
+    boost::program_options::variables_map optionSet{};
+    boost::program_options::positional_options_description positionalSet{};
+    std::shared_ptr<boost::program_options::options_description> optionsDescription{};
 
     void parse(int argc, char** argv) {
         positionalSet.add("positional", -1);
@@ -169,35 +169,35 @@ public:
 class Command {
 
 public:
-    std::string name;                       // The name of the command
-    std::string shortName;                  // short name of the command. Typically one character (deprecated, use `Aliases`)
-    std::vector<std::string> aliases;       // A list of aliases for the command
-    std::string usage;                      // A short description of the usage of this command
-    std::string usageText;                  // Custom text to show on USAGE section of help
-    std::string description;                // A longer explanation of how the command works
-    std::string argsUsage;                  // A short description of the arguments of this command
-    std::string category;                   // The category the command is part of
-    BashCompleteFunc bashComplete;          // The function to call when checking for bash command completions
-    BeforeFunc before;                      // An action to execute before any sub-subcommands are run, but after the context is ready
-    AfterFunc after;                        // An action to execute after any subcommands are run, but after the subcommand has finished
-    ActionFunc action;                      // The function to call when this command is invoked
-    OnUsageErrorFunc onUsageError;          // Execute this function if a usage error occurs
-    Commands subcommands;                   // List of child commands
-    Flags flags;                            // List of options to parse
-    bool skipFlagParsing;                   // Treat all flags as normal arguments if true
-    bool skipArgReorder;                    // Skip argument reordering which attempts to move flags before arguments
-    bool hideHelp;                          // Boolean to hide built-in help flag
-    bool hideHelpCommand;                   // Boolean to hide built-in help command
-    bool hidden;                            // Boolean to hide this command from help or completion
-    bool hiddenAliases;                     // Boolean to hide aliases for this command from help or completion
-    std::string helpName;                   // Full name of command for help, defaults to full command name, including parent commands
-    std::vector<std::string> commandNamePath; // Path to the command
-    std::string prompt;                     // Default prompt, specific to OS
-    std::string envVarSetCommand;           // Command to set the environment variable, specific to OS
-    std::string assignmentOperator;         // Assignment operator to set the environment variable, specific to OS
-    std::string disableHistory;             // Disable history for security reasons
-    std::string enableHistory;              // Enable history
-    std::string customHelpTemplate;         // Custom help template for the command
+    std::string name{};                     // The name of the command
+    std::string shortName{};                // short name of the command. Typically one character (deprecated, use `Aliases`)
+    std::vector<std::string> aliases{};     // A list of aliases for the command
+    std::string usage{};                    // A short description of the usage of this command
+    std::string usageText{};                // Custom text to show on USAGE section of help
+    std::string description{};              // A longer explanation of how the command works
+    std::string argsUsage{};                // A short description of the arguments of this command
+    std::string category{};                 // The category the command is part of
+    BashCompleteFunc bashComplete{};        // The function to call when checking for bash command completions
+    BeforeFunc before{};                    // An action to execute before any sub-subcommands are run, but after the context is ready
+    AfterFunc after{};                      // An action to execute after any subcommands are run, but after the subcommand has finished
+    ActionFunc action{};                    // The function to call when this command is invoked
+    OnUsageErrorFunc onUsageError{};        // Execute this function if a usage error occurs
+    Commands subcommands{};                 // List of child commands
+    Flags flags{};                          // List of options to parse
+    bool skipFlagParsing = false;           // Treat all flags as normal arguments if true
+    bool skipArgReorder = false;            // Skip argument reordering which attempts to move flags before arguments
+    bool hideHelp = false;                  // Boolean to hide built-in help flag
+    bool hideHelpCommand = false;           // Boolean to hide built-in help command
+    bool hidden = false;                    // Boolean to hide this command from help or completion
+    bool hiddenAliases = false;             // Boolean to hide aliases for this command from help or completion
+    std::string helpName{};                 // Full name of command for help, defaults to full command name, including parent commands
+    std::vector<std::string> commandNamePath{}; // Path to the command
+    std::string prompt{};                   // Default prompt, specific to OS
+    std::string envVarSetCommand{};         // Command to set the environment variable, specific to OS
+    std::string assignmentOperator{};       // Assignment operator to set the environment variable, specific to OS
+    std::string disableHistory{};           // Disable history for security reasons
+    std::string enableHistory{};            // Enable history
+    std::string customHelpTemplate{};       // Custom help template for the command
 
 public:
     Error run(Context* ctx);
@@ -1,96 +1,187 @@
 #ifndef CPPIO_CONTEXT_HPP
 #define CPPIO_CONTEXT_HPP
 
-#include <iostream>
 #include <chrono>
 #include <future>
-#include <thread>
 #include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "error.hpp"
+#include "executor.hpp"
 
 namespace cppio {
 
-// Context class to handle cancellation
-class Context {
+// Error codes of contexts.
+enum ContextErrorCode {
+    errCodeContextCanceled = 1500,
+    errCodeContextDeadlineExceeded,
+};
+
+extern const Error errContextCanceled;
+extern const Error errContextDeadlineExceeded;
+
+// ContextError - the exception of a future whose task did not run, its
+// context being done.
+class ContextError : public std::runtime_error {
+
+public:
+    explicit ContextError(Error err) : std::runtime_error(err->msg), err(std::move(err)) {}
+
+    const Error& error() const { return err; }
+
 private:
-    std::atomic<bool> canceled { false };
-    std::mutex mutex;
-    std::condition_variable cv;
+    Error err;
+};
+
+// Context - cancellation and deadline of a request, and the work it fans
+// out.
+//
+// Contexts form a tree: canceling one cancels all contexts derived from
+// it, and a derived context has the earlier of its own deadline and the
+// one of its parent. A context is done once canceled or past its
+// deadline, no timer is involved. Only cancel() and deadlines end a
+// context, it outlives its owner in the work it handed out.
+//
+// runAsync, runAfter and runAsyncWithFuture hand work to
+// Executor::global(). Work
+// whose context is done by the time a worker picks it up is dropped
+// unrun, its future fails with a ContextError. Tasks share the state of
+// the context, not the context itself.
+class Context {
 
 public:
-    void cancel() {
-        std::unique_lock<std::mutex> lock(mutex);
-        canceled = true;
-        cv.notify_all();
-    }
+    using Clock = std::chrono::steady_clock;
+
+    // A context without deadline, done once canceled.
+    Context();
+    // Does not cancel the context, work it handed out runs on. Owners
+    // done with that work cancel it explicitly.
+    ~Context() = default;
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    // A moved from context can only be destroyed.
+    Context(Context&&) noexcept = default;
+
+    // Derived contexts, done with 'parent' at the latest.
+    static Context withCancel(const Context& parent);
+    static Context withDeadline(const Context& parent, Clock::time_point deadline);
+    static Context withTimeout(const Context& parent, Clock::duration timeout);
+
+    // Cancels this context and all derived from it.
+    void cancel();
 
     bool isCanceled() const {
-        return canceled;
+        return state->canceled.load(std::memory_order_acquire) || state->expired();
     }
 
+    // Returns why the context is done, errContextCanceled or
+    // errContextDeadlineExceeded, null while it is not.
+    Error err() const { return state->err(); }
+
+    // Clock::time_point::max() without deadline.
+    Clock::time_point deadline() const { return state->deadline; }
+
+    // Waits until the context is done.
+    void wait();
+
     template<typename F>
     void runAsync(F&& func) {
-        std::thread([this, func = std::forward<F>(func)]() mutable {
-            if (!isCanceled()) {
+        Executor::global().submit([state = state, func = std::forward<F>(func)]() mutable {
+            if (!state->err()) {
                 func();
             }
-        }).detach();
+        });
+    }
+
+    // Runs 'func' like runAsync once 'delay' passed, nothing waits in
+    // between.
+    template<typename F>
+    void runAfter(Clock::duration delay, F&& func) {
+        Executor::global().submitAfter(delay, [state = state, func = std::forward<F>(func)]() mutable {
+            if (!state->err()) {
+                func();
+            }
+        });
     }
 
     template<typename R, typename F>
     std::future<R> runAsyncWithFuture(F&& func) {
-        std::promise<R> promise;
-        auto future = promise.get_future();
-
-        std::thread([this, func = std::forward<F>(func), promise = std::move(promise)]() mutable {
-            if (!isCanceled()) {
-                try {
-                    promise.set_value(func());
-                } catch (...) {
-                    promise.set_exception(std::current_exception());
+        Completion<R> completion;
+        auto future = completion.promise.get_future();
+
+        Executor::global().submit([state = state, func = std::forward<F>(func), completion = std::move(completion)]() mutable {
+            if (auto err = state->err()) {
+                completion.fail(err);
+                return;
+            }
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    func();
+                    completion.promise.set_value();
+                } else {
+                    completion.promise.set_value(func());
                 }
+            } catch (...) {
+                completion.promise.set_exception(std::current_exception());
             }
-        }).detach();
+            completion.done = true;
+        });
 
         return future;
     }
 
-    void wait() {
-        std::unique_lock<std::mutex> lock(mutex);
-        cv.wait(lock, [this]() { return canceled; });
-    }
-};
-
-}
-
-// // Example function to simulate async work
-// int asyncWork() {
-//     std::this_thread::sleep_for(std::chrono::seconds(3));
-//     return 42;
-// }
-
-// int main() {
-//     Context ctx;
-
-//     // Run async function with cancellation check
-//     ctx.runAsync([ctx]() {
-//         if (!ctx.isCanceled()) {
-//             std::cout << "Async operation started..." << std::endl;
-//             asyncWork();
-//             std::cout << "Async operation completed." << std::endl;
-//         }
-//     });
+private:
+    struct State {
+        std::atomic<bool>                   canceled{false};
+        Clock::time_point                   deadline = Clock::time_point::max();
+        std::mutex                          mu;
+        std::condition_variable             cv;
+        Error                               reason;
+        std::vector<std::weak_ptr<State>>   children;
+        size_t                              pruneAt = 16;
+
+        bool expired() const {
+            return deadline != Clock::time_point::max() && Clock::now() >= deadline;
+        }
+        Error err();
+        void cancel(const Error& why);
+    };
+
+    // The promise of runAsyncWithFuture, failed with errContextCanceled
+    // when dropped unset so that its future never hangs.
+    template<typename R>
+    struct Completion {
+        std::promise<R> promise;
+        bool            done = false;
+
+        Completion() = default;
+        Completion(Completion&& other) noexcept : promise(std::move(other.promise)), done(other.done) {
+            other.done = true;
+        }
+        ~Completion() {
+            if (!done) {
+                fail(errContextCanceled);
+            }
+        }
 
-//     // Simulate cancellation after 2 seconds
-//     std::this_thread::sleep_for(std::chrono::seconds(2));
-//     ctx.cancel();
+        void fail(const Error& err) {
+            promise.set_exception(std::make_exception_ptr(ContextError(err)));
+            done = true;
+        }
+    };
 
-//     // Wait for async operation to finish
-//     ctx.wait();
+    Context(const Context& parent, Clock::time_point deadline);
 
-//     std::cout << "Main thread: Context canceled." << std::endl;
+    std::shared_ptr<State> state;
+};
 
-//     return 0;
-// }
+}
 
-#endif // CPPIO_CONTEXT_HPP
\ No newline at end of file
+#endif // CPPIO_CONTEXT_HPP
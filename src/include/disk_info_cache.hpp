@@ -0,0 +1,96 @@
+#ifndef CPPIO_DISK_INFO_CACHE_HPP
+#define CPPIO_DISK_INFO_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "error.hpp"
+#include "storage_datatypes.hpp"
+
+namespace cppio {
+
+struct DiskInfoCacheOptions {
+    // statvfs of the drive runs this often in the background. 0 runs it on
+    // every get() instead, without a thread.
+    std::chrono::milliseconds   refreshInterval = std::chrono::seconds(1);
+};
+
+// DiskInfoCache - the capacity and inode counts of a drive, refreshed by a
+// background thread so that fill checks on the write path never wait for
+// statvfs.
+//
+// Bytes and files written between two refreshes are added on top of the
+// last statvfs, a drive filling up quickly is seen right away. Space freed
+// by deletes shows up with the next refresh, which errs on the side of a
+// fuller drive.
+//
+// The block device of the drive, whether it is rotational and its request
+// queue depth come from sysfs once, at construction.
+class DiskInfoCache {
+
+public:
+    // Runs the first statvfs, the cache holds its error if it fails.
+    explicit DiskInfoCache(const std::string& drivePath, const DiskInfoCacheOptions& opts = DiskInfoCacheOptions{});
+    ~DiskInfoCache();
+
+    DiskInfoCache(const DiskInfoCache&) = delete;
+    DiskInfoCache& operator=(const DiskInfoCache&) = delete;
+
+    // Fills the capacity and device fields of 'info'. Returns
+    // errDiskNotFound when the last refresh failed.
+    Error get(DiskInfo& info);
+
+    // Accounts 'bytes' and 'files' written to the drive since the last
+    // refresh.
+    void written(int64_t bytes, int64_t files = 0) {
+        pendingBytes.fetch_add(bytes, std::memory_order_relaxed);
+        pendingFiles.fetch_add(files, std::memory_order_relaxed);
+    }
+
+    // Runs statvfs now, after a refresh already running.
+    void refresh();
+
+private:
+    // What statvfs says.
+    struct Capacity {
+        uint64_t    total = 0;
+        uint64_t    free = 0;
+        uint64_t    used = 0;
+        uint64_t    freeInodes = 0;
+        uint64_t    usedInodes = 0;
+        Error       err;
+    };
+
+    void readSysfs();
+    void refresher();
+
+    std::string                 drivePath;
+    DiskInfoCacheOptions        opts;
+
+    // Set once by readSysfs.
+    uint32_t                    major = 0;
+    uint32_t                    minor = 0;
+    bool                        rotational = false;
+    uint64_t                    nrRequests = 0;
+
+    // Held through a whole refresh, taken before 'mu'.
+    std::mutex                  refreshMu;
+    std::mutex                  mu;
+    Capacity                    capacity;
+    std::atomic<int64_t>        pendingBytes{0};
+    std::atomic<int64_t>        pendingFiles{0};
+
+    std::mutex                  stopMu;
+    std::condition_variable     stopCv;
+    bool                        stopping = false;
+    std::thread                 refreshThread;
+};
+
+}
+
+#endif // CPPIO_DISK_INFO_CACHE_HPP
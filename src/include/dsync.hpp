@@ -0,0 +1,119 @@
+#ifndef CPPIO_DSYNC_HPP
+#define CPPIO_DSYNC_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "context.hpp"
+
+namespace cppio {
+
+// Error codes of distributed locking.
+enum DsyncErrorCode {
+    errCodeLockerOffline = 1400,
+};
+
+// errLockerOffline - a locker could not be reached.
+extern const Error errLockerOffline;
+
+namespace dsync {
+
+// LockArgs - a lock request as sent to every locker.
+struct LockArgs {
+    std::string                 uid;        // identifies the lock across lockers
+    std::vector<std::string>    resources;
+    std::string                 owner;      // the node taking the lock
+    std::string                 source;     // the caller, for debugging
+    int                         quorum = 0;
+};
+
+// NetLocker - one server's lock table as seen by a locking node, local or
+// remote. Calls return whether the locker granted the request, errors
+// count as a refusal.
+struct NetLocker {
+    virtual ~NetLocker() = default;
+
+    virtual std::string string() const = 0;
+    virtual bool isOnline() const = 0;
+    virtual bool isLocal() const = 0;
+
+    virtual Error lock(Context& ctx, const LockArgs& args, bool& granted) = 0;
+    virtual Error rlock(Context& ctx, const LockArgs& args, bool& granted) = 0;
+    virtual Error unlock(Context& ctx, const LockArgs& args, bool& released) = 0;
+    virtual Error runlock(Context& ctx, const LockArgs& args, bool& released) = 0;
+    // Renews the lease of 'args.uid', false if the locker no longer has it.
+    virtual Error refresh(Context& ctx, const LockArgs& args, bool& refreshed) = 0;
+    // Drops all locks of args.resources, whoever holds them.
+    virtual Error forceUnlock(Context& ctx, const LockArgs& args, bool& released) = 0;
+
+    virtual void close() = 0;
+};
+
+struct Timeouts {
+    // A locker answering slower counts as a refusal.
+    std::chrono::milliseconds   acquire         = std::chrono::seconds(1);
+    // Held locks are renewed this often, lockers drop locks not renewed
+    // for a few intervals, see LocalLocker::expire.
+    std::chrono::milliseconds   refreshInterval = std::chrono::seconds(10);
+    // Failed attempts are retried after up to this long, jittered.
+    std::chrono::milliseconds   retryInterval   = std::chrono::milliseconds(50);
+    // Releases of unreachable lockers are retried this many times.
+    int                         unlockRetries   = 3;
+};
+
+// Dsync - the lockers a distributed lock is taken from and how.
+struct Dsync {
+    // Returns the lockers and the owner name of this node.
+    std::function<std::pair<std::vector<std::shared_ptr<NetLocker>>, std::string>()> getLockers;
+    Timeouts timeouts;
+};
+
+// DRWMutex - a read/write lock of several resources held by a quorum of
+// lockers. Requests go to all lockers in parallel, a lock needs more than
+// half of them to grant it, a read lock half of them. While held the lock
+// is refreshed in the background; once less than quorum of lockers still
+// know it, the lock is lost and 'lost' is called. Unlocking does not wait
+// for the lockers.
+class DRWMutex {
+
+public:
+    DRWMutex(Dsync& ds, std::vector<std::string> names);
+    ~DRWMutex();
+
+    DRWMutex(const DRWMutex&) = delete;
+    DRWMutex& operator=(const DRWMutex&) = delete;
+
+    // Tries to lock until 'timeout', returns false if it did not get it or
+    // 'ctx' got canceled.
+    bool getLock(Context& ctx, const std::string& id, const std::string& source,
+                 std::chrono::milliseconds timeout, std::function<void()> lost = nullptr);
+    bool getRLock(Context& ctx, const std::string& id, const std::string& source,
+                  std::chrono::milliseconds timeout, std::function<void()> lost = nullptr);
+
+    void unlock();
+    void runlock();
+
+private:
+    struct State;
+
+    bool acquire(Context& ctx, const std::string& id, const std::string& source,
+                 std::chrono::milliseconds timeout, bool write, std::function<void()> lost);
+    void release(bool write);
+
+    Dsync&                      ds;
+    std::vector<std::string>    names;
+    std::shared_ptr<State>      held;
+};
+
+}
+
+}
+
+#endif // CPPIO_DSYNC_HPP
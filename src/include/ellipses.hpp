@@ -0,0 +1,49 @@
+#ifndef CPPIO_ELLIPSES_HPP
+#define CPPIO_ELLIPSES_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.hpp"
+
+namespace cppio {
+namespace ellipses {
+
+// Pattern - one ellipses of an argument, "{1...4}", with the text up to
+// the previous ellipses and after it.
+struct Pattern {
+    std::string                 prefix;
+    std::string                 suffix;
+    std::vector<std::string>    seq;
+
+    // Returns prefix + label + suffix for every label of seq.
+    std::vector<std::string> expand() const;
+};
+
+// ArgPattern - all ellipses of an argument, the last one first.
+struct ArgPattern {
+    std::vector<Pattern>        patterns;
+
+    // Returns every combination of the labels, the first ellipses of the
+    // argument varying fastest: "http://node{1...2}/d{1...2}" expands to
+    // node1/d1, node2/d1, node1/d2, node2/d2, so consecutive drives are
+    // on different nodes.
+    std::vector<std::string> expand() const;
+
+    // Returns the number of arguments expand gives.
+    uint64_t size() const;
+};
+
+// Returns whether all of 'args' have an ellipses, "{N...M}".
+bool hasEllipses(const std::vector<std::string>& args);
+bool hasEllipses(std::string_view arg);
+
+// Parses the ellipses of 'arg'. Ranges are decimal or hexadecimal, a
+// leading zero pads every label to the width of the range's end.
+Error findEllipsesPatterns(std::string_view arg, ArgPattern& out);
+
+}
+}
+
+#endif // CPPIO_ELLIPSES_HPP
@@ -36,18 +36,17 @@ class Endpoint {
 public:
     Endpoint() = default;
     Endpoint(std::string uri) {
-        // if (arg.empty()) {
-        //     throw std::invalid_argument("Empty URI");
-        // }
-        // boost::system::result< url > ru = boost::urls::parse_uri_reference(uri);
-        // if (ru) {
-        //     url = *ru;
-        //     isLocal = false;
-        // } else {
-        //     // Not an URI, try on Path
-        //     path = uri;
-        //     isLocal = true;
-        // }
+        // Remote drives of a distributed setup are http(s) URIs, the rest
+        // are paths of local drives.
+        auto scheme = uri.find("://");
+        if (scheme != std::string::npos && (uri.compare(0, scheme, "http") == 0 || uri.compare(0, scheme, "https") == 0)) {
+            auto slash = uri.find('/', scheme + 3);
+            host = uri.substr(scheme + 3, slash == std::string::npos ? std::string::npos : slash - scheme - 3);
+            path = slash == std::string::npos ? "/" : uri.substr(slash);
+            isLocal = false;
+            return;
+        }
+        path = uri;
     }
 
 public:
@@ -70,6 +69,7 @@ public:
 
 public:
     // boost::urls::url        url;
+    std::string             host;       // host:port of a remote drive
     std::filesystem::path   path;
     bool                    isLocal     = true;
     int                     poolIndex   = -1;
@@ -81,14 +81,15 @@ class PoolEndpoints {
 
 public:
     PoolEndpoints() = default;
-    PoolEndpoints(std::string& serverAddr, PoolDisksLayout& pdsl) {
-
-        if (pdsl.isSingleDriveLayout()) {
-            endpoints.push_back(Endpoint(pdsl.layout[0][0]));
-            assert(endpoints.size() == 1);
-            endpoints[0].poolIndex  = 0;
-            endpoints[0].setIndex   = 0;
-            endpoints[0].diskIndex  = 0;
+    PoolEndpoints(std::string& serverAddr, PoolDisksLayout& pdsl, int poolIndex) {
+
+        for (size_t i = 0; i < pdsl.layout.size(); ++i) {
+            for (size_t j = 0; j < pdsl.layout[i].size(); ++j) {
+                endpoints.push_back(Endpoint(pdsl.layout[i][j]));
+                endpoints.back().poolIndex  = poolIndex;
+                endpoints.back().setIndex   = static_cast<int>(i);
+                endpoints.back().diskIndex  = static_cast<int>(j);
+            }
         }
 
         setCount        = pdsl.layout.size();
@@ -115,8 +116,8 @@ public:
             throw std::invalid_argument("EndpointServerPools: No PoolDisksLayout");
         }
 
-        for (auto& pool : poolArgs) {
-            poolEndpoints.push_back(PoolEndpoints(serverAddr, pool));
+        for (size_t i = 0; i < poolArgs.size(); ++i) {
+            poolEndpoints.push_back(PoolEndpoints(serverAddr, poolArgs[i], static_cast<int>(i)));
         }
     }
 
@@ -2,30 +2,125 @@
 #define CPPIO_ERASURE_HPP
 
 #include <vector>
+#include <memory>
 #include <functional>
 #include <string>
 
 #include "endpoint.hpp"
+#include "erasure_coding.hpp"
+#include "storage_interface.hpp"
+#include "metacache_manager.hpp"
+#include "namespace_lock.hpp"
 
 namespace cppio {
 
+// smallFileThreshold - objects up to this size are stored inline in
+// xl.meta by default.
+const int64_t smallFileThreshold = 128 * 1024;  // 128 KiB
+
 // erasureObjects - Implements ER object layer.
 struct ErasureObjects {
-    int setDriveCount;
-    int defaultParityCount;
-    int setIndex;
-    int poolIndex;
+    int setDriveCount = 0;
+    int defaultParityCount = 0;
+    int setIndex = 0;
+    int poolIndex = 0;
+
+    // Objects up to this size are stored inline in xl.meta.
+    int64_t inlineThreshold = smallFileThreshold;
 
     // Function pointers to return lists
-    std::function<std::vector<StorageAPI>()> getDisks;
-    std::function<std::pair<std::vector<dsync::NetLocker>, std::string>()> getLockers;
+    std::function<std::vector<std::shared_ptr<StorageAPI>>()> getDisks;
+    std::function<std::pair<std::vector<std::shared_ptr<dsync::NetLocker>>, std::string>()> getLockers;
     std::function<std::vector<Endpoint>()> getEndpoints;
     std::function<std::vector<std::string>()> getEndpointStrings;
 
     // Pointer to mutex map
-    nsLockMap* nsMutex;
+    nsLockMap* nsMutex = nullptr;
+
+    // Listings being paged through, listPathPage walks every page without.
+    // Writes made through the set drop the listings they change.
+    std::shared_ptr<Metacaches> metacaches;
+
+    // newNSLock returns a lock of 'objects' of 'bucket' in the namespace
+    // of the set.
+    NsLock newNSLock(const std::string& bucket, std::vector<std::string> objects) const {
+        return NsLock(*nsMutex, bucket, std::move(objects));
+    }
+
+    // writeQuorum - returns the write quorum for the given erasure geometry.
+    static int writeQuorum(const Erasure& erasure);
+
+    // defaultReadQuorum - read quorum of metadata without erasure info,
+    // like delete markers.
+    int defaultReadQuorum(int drives) const;
+
+    // shouldInline - returns true if an object of 'size' bytes is stored
+    // inline in xl.meta.
+    bool shouldInline(int64_t size) const { return size >= 0 && size <= inlineThreshold; }
+
+    // writeInline erasure codes 'data' in memory and stores every shard
+    // inline in the version 'fi' of the xl.meta of its drive, which is a
+    // single writeAll per drive when 'fi' is fresh. fi.erasure gives the
+    // geometry and distribution. Returns once write quorum is met, like
+    // writeShards, the other drive writes finish on their own.
+    Error writeInline(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi,
+                      const uint8_t* data, size_t size, std::vector<Error>& errs,
+                      BitrotAlgorithm bitrotAlgo = defaultBitrotAlgorithm);
+
+    // getObjectFileInfo reads xl.meta from all drives in parallel and
+    // returns the version of versionID, the latest for an empty one, as
+    // soon as read quorum of drives agree on it. 'metaArr' holds the
+    // version of every agreeing drive, with its inline shard if 'readData'
+    // is set; the entries of other drives are empty and their 'errs' set.
+    Error getObjectFileInfo(Context& ctx, const std::string& volume, const std::string& path,
+                            const std::string& versionID, bool readData, FileInfo& fi,
+                            std::vector<FileInfo>& metaArr, std::vector<Error>& errs);
+
+    // readInline writes [offset, offset+length) of the inline object 'fi'
+    // at volume/path to 'writer', decoding the shards of 'metaArr' from
+    // getObjectFileInfo. Shards missing or not verifying are read from the
+    // drives getObjectFileInfo did not wait for, into 'metaArr'.
+    Error readInline(Context& ctx, const std::string& volume, const std::string& path,
+                     const FileInfo& fi, std::vector<FileInfo>& metaArr,
+                     int64_t offset, int64_t length, std::ostream& writer, int64_t& written);
+
+    // writeShards streams 'data' erasure coded to the drives of the set as
+    // volume/path, shard i going to the drive at distribution[i]. See
+    // Erasure::encode, 'errs' is indexed like getDisks(). A distribution
+    // shuffleDisks refuses is errFileCorrupt.
+    Error writeShards(Context& ctx, const Erasure& erasure, const std::vector<int>& distribution,
+                      const std::string& volume, const std::string& path,
+                      std::istream& data, int64_t size, int64_t& total, std::vector<Error>& errs,
+                      BitrotAlgorithm bitrotAlgo = defaultBitrotAlgorithm);
+
+    // readShards writes [offset, offset+length) of the object erasure coded
+    // at volume/path to 'writer', see Erasure::decode. The recent ReadFile
+    // latency of the drives' DiskMetrics decides which drives to avoid.
+    // A distribution shuffleDisks refuses is errFileCorrupt.
+    Error readShards(Context& ctx, const Erasure& erasure, const std::vector<int>& distribution,
+                     const std::string& volume, const std::string& path,
+                     int64_t offset, int64_t length, int64_t totalLength,
+                     std::ostream& writer, int64_t& written,
+                     const ErasureReadOptions& opts = ErasureReadOptions{},
+                     BitrotAlgorithm bitrotAlgo = defaultBitrotAlgorithm);
+
+    // listPath walks opts.baseDir on all drives of the set and streams the
+    // merged entries to 'fn', see listPathRaw. An entry needs half of the
+    // drives to agree on it, the walk fails with less than read quorum of
+    // drives.
+    Error listPath(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn);
+
+    // listPathPage returns a page of the listing 'opts' asks for, from
+    // metacaches if set, see Metacaches::listPath.
+    Error listPathPage(Context& ctx, const ListPathOptions& opts, ListPathResult& result);
 };
 
+// shuffleDisks - shuffle input disks slice depending on the
+// erasure distribution. Return shuffled slice of disks with
+// their expected distribution, errInvalidArgument unless the
+// distribution orders all of the disks, each once.
+Error shuffleDisks(const std::vector<std::shared_ptr<StorageAPI>>& disks, const std::vector<int>& distribution,
+                   std::vector<std::shared_ptr<StorageAPI>>& shuffled);
 
 }
 
@@ -0,0 +1,150 @@
+#ifndef CPPIO_ERASURE_CODING_HPP
+#define CPPIO_ERASURE_CODING_HPP
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "error.hpp"
+#include "context.hpp"
+#include "reedsolomon.hpp"
+#include "storage_interface.hpp"
+#include "xl_storage_format_v1.hpp"
+
+namespace cppio {
+
+// Error codes of erasure coded object operations.
+enum ErasureErrorCode {
+    errCodeErasureReadQuorum = 1200,
+    errCodeErasureWriteQuorum,
+};
+
+// errErasureReadQuorum - did not meet read quorum.
+extern const Error errErasureReadQuorum;
+// errErasureWriteQuorum - did not meet write quorum.
+extern const Error errErasureWriteQuorum;
+
+// Stripes queued per drive while the next one is encoded.
+const int erasureEncodeDepth = 2;
+// Stripes a drive may fall behind the write quorum before the encoder
+// drops it, or waits for it when write quorum needs the drive.
+const int erasureMaxStragglerLag = 8;
+
+// Erasure algorithm recorded in ErasureInfo.algorithm.
+const std::string erasureAlgorithm = "rs-vandermonde";
+
+// ErasureReadOptions - hedging of erasure coded reads.
+struct ErasureReadOptions {
+    // The reference latency of a set is this percentile of the recent
+    // ReadFile latency of its drives.
+    double                      hedgePercentile = 0.5;
+    // Drives slower than slowFactor times the reference are read around
+    // from the start, reads pending for longer than that are hedged with
+    // a read of another shard.
+    double                      slowFactor      = 3.0;
+    // Lower bound of the hedge delay, also used without metrics.
+    std::chrono::microseconds   minHedgeDelay   = std::chrono::milliseconds(20);
+};
+
+// Erasure - erasure encoding details.
+class Erasure {
+
+public:
+    // Throws std::invalid_argument for invalid block counts.
+    Erasure(int dataBlocks, int parityBlocks, int64_t blockSize);
+    explicit Erasure(const ErasureInfo& info);
+
+    int dataBlocks() const { return dataBlocksCount; }
+    int parityBlocks() const { return parityBlocksCount; }
+    int64_t blockSize() const { return blockSizeValue; }
+    const ReedSolomon& codec() const { return *encoder; }
+
+    // encodeData encodes the given data and returns the erasure-coded data.
+    // It returns an error if the erasure coding failed. 'shards' buffers
+    // are reused across calls.
+    Error encodeData(const uint8_t* data, size_t len, std::vector<std::vector<uint8_t>>& shards) const;
+
+    // decodeDataBlocks decodes the given erasure-coded data. It only
+    // decodes the data blocks but does not verify them. Empty entries of
+    // 'shards' are missing.
+    Error decodeDataBlocks(std::vector<std::vector<uint8_t>>& shards) const;
+
+    // decodeDataAndParityBlocks decodes the given erasure-coded data,
+    // rebuilding missing parity blocks as well.
+    Error decodeDataAndParityBlocks(std::vector<std::vector<uint8_t>>& shards) const;
+
+    // encode reads 'src' in blockSize stripes, erasure codes every stripe
+    // and streams shard i to disks[i] through createFile(volume, path),
+    // writing to all drives in parallel. The next stripe is encoded while
+    // the drives write the previous one. Every shard written is led by its
+    // 'bitrotAlgo' checksum.
+    //
+    // Returns once all of 'src' is encoded and writeQuorum drives stored
+    // their whole shard, drives still writing finish in the background and
+    // report errDiskOngoingReq in 'errs'. 'ctx' runs the drive writers and
+    // has to outlive them.
+    Error encode(Context& ctx, std::istream& src, int64_t size,
+                 const std::vector<std::shared_ptr<StorageAPI>>& disks,
+                 const std::string& volume, const std::string& path,
+                 int writeQuorum, int64_t& total, std::vector<Error>& errs,
+                 BitrotAlgorithm bitrotAlgo = defaultBitrotAlgorithm) const;
+
+    // decode reads the blocks of [offset, offset+length) of an object of
+    // totalLength bytes from the shards on 'disks' and writes them to
+    // 'writer'. Every stripe is read from dataBlocks drives in parallel;
+    // drives whose 'latencies' (by shard, zero when unknown) make them
+    // slow are avoided, reads pending past the hedge delay get a read of
+    // another shard, and the first dataBlocks shards in are decoded.
+    // Shards failing 'bitrotAlgo' verification are read around as well.
+    Error decode(Context& ctx, std::ostream& writer,
+                 const std::vector<std::shared_ptr<StorageAPI>>& disks,
+                 const std::string& volume, const std::string& path,
+                 int64_t offset, int64_t length, int64_t totalLength,
+                 const std::vector<std::chrono::nanoseconds>& latencies,
+                 const ErasureReadOptions& opts, int64_t& written,
+                 BitrotAlgorithm bitrotAlgo = defaultBitrotAlgorithm) const;
+
+    // shardSize - returns actual shared size from erasure blockSize.
+    int64_t shardSize() const;
+
+    // shardFileSize - returns final erasure size from original size.
+    int64_t shardFileSize(int64_t totalLength) const;
+
+    // shardFileOffset - returns the effective offset where erasure reading
+    // begins.
+    int64_t shardFileOffset(int64_t startOffset, int64_t length, int64_t totalLength) const;
+
+private:
+    Error decode(std::vector<std::vector<uint8_t>>& shards, bool dataOnly) const;
+
+private:
+    std::shared_ptr<ReedSolomon>    encoder;
+    int                             dataBlocksCount;
+    int                             parityBlocksCount;
+    int64_t                         blockSizeValue;
+};
+
+// ceilFrac takes a numerator and denominator representing a fraction
+// and returns its ceiling.
+inline int64_t ceilFrac(int64_t numerator, int64_t denominator) {
+    if (denominator == 0) {
+        // do nothing on invalid input
+        return 0;
+    }
+    // Make denominator positive
+    if (denominator < 0) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+    auto ceil = numerator / denominator;
+    if (numerator > 0 && numerator % denominator != 0) {
+        ceil++;
+    }
+    return ceil;
+}
+
+}
+
+#endif // CPPIO_ERASURE_CODING_HPP
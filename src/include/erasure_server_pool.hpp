@@ -12,6 +12,13 @@
 namespace cppio {
 
 struct ErasureServerPools {
+    // Takes the pools of a deployment, the routing table of every pool is
+    // the one its sets were built with.
+    ErasureServerPools(const std::array<uint8_t, 16>& deploymentID, std::string distributionAlgo,
+                       std::vector<std::unique_ptr<ErasureSets>> pools)
+        : deploymentID(deploymentID), distributionAlgo(std::move(distributionAlgo)),
+          serverPools(std::move(pools)), placement(placementOf(serverPools)), s3Peer(nullptr) {}
+
     std::mutex poolMetaMutex;
     PoolMeta poolMetaInstance;
 
@@ -22,10 +29,22 @@ struct ErasureServerPools {
     std::string distributionAlgo;
 
     std::vector<std::unique_ptr<ErasureSets>> serverPools; // Using unique_ptr for dynamic memory management
+    // Routing tables of all pools, and the pool choice of new objects by
+    // the free space of their sets.
+    PoolPlacement placement;
 
     std::vector<std::function<void()>> decommissionCancelers;
 
     S3PeerSys* s3Peer; // Using raw pointer assuming ownership is managed elsewhere
+
+    static PoolPlacement placementOf(const std::vector<std::unique_ptr<ErasureSets>>& pools) {
+        std::vector<SetPlacement> tables;
+        tables.reserve(pools.size());
+        for (const auto& pool : pools) {
+            tables.push_back(pool->placement);
+        }
+        return PoolPlacement(std::move(tables));
+    }
 };
 
 }
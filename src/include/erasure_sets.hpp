@@ -10,16 +10,26 @@
 
 #include "format_erasure.hpp"
 #include "endpoint.hpp"
+#include "placement.hpp"
 
 namespace cppio {
 
 // setsDsyncLockers is encapsulated type for Close()
-using SetsDsyncLockers = std::vector<std::vector<dsync::NetLocker>>;
+using SetsDsyncLockers = std::vector<std::vector<std::shared_ptr<dsync::NetLocker>>>;
 
 // erasureSets implements ObjectLayer combining a static list of erasure coded
 // object sets. NOTE: There is no dynamic scaling allowed or intended in
 // current design.
 struct ErasureSets {
+    // Builds the routing table of the sets from the distribution algorithm
+    // and deployment ID of the format, getHashedSetIndex is ready to use.
+    ErasureSets(std::string distributionAlgo, const std::array<uint8_t, 16>& deploymentID, int setCount,
+                int setDriveCount, int defaultParityCount, int poolIndex)
+        : format(nullptr), setCount(setCount), setDriveCount(setDriveCount),
+          defaultParityCount(defaultParityCount), poolIndex(poolIndex),
+          distributionAlgo(std::move(distributionAlgo)), deploymentID(deploymentID),
+          placement(this->distributionAlgo, deploymentID, setCount) {}
+
     std::vector<std::unique_ptr<ErasureObjects>> sets; // Using unique_ptr for dynamic memory management
     FormatErasureV3* format; // Using raw pointer assuming ownership is managed elsewhere
     std::mutex erasureDisksMu;
@@ -37,6 +47,11 @@ struct ErasureSets {
     std::function<void(int)> setReconnectEvent;
     std::string distributionAlgo;
     std::array<uint8_t, 16> deploymentID;
+    // Routing table of distributionAlgo and deploymentID, built with the sets.
+    SetPlacement placement;
+
+    // Returns the index of the set 'input' hashes to.
+    int getHashedSetIndex(std::string_view input) const { return placement.setIndex(input); }
 };
 
 
@@ -0,0 +1,150 @@
+#ifndef CPPIO_EXECUTOR_HPP
+#define CPPIO_EXECUTOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cppio {
+
+// Task - a move-only callable run once by an Executor.
+class Task {
+
+public:
+    Task() = default;
+
+    template<typename F>
+        requires (!std::same_as<std::decay_t<F>, Task>)
+    Task(F&& f) : impl(std::make_unique<Impl<std::decay_t<F>>>(std::forward<F>(f))) {}
+
+    explicit operator bool() const { return impl != nullptr; }
+    void operator()() { impl->run(); }
+
+private:
+    struct Base {
+        virtual ~Base() = default;
+        virtual void run() = 0;
+    };
+
+    template<typename F>
+    struct Impl : Base {
+        explicit Impl(F&& f) : f(std::move(f)) {}
+        explicit Impl(const F& f) : f(f) {}
+        void run() override { f(); }
+        F f;
+    };
+
+    std::unique_ptr<Base> impl;
+};
+
+struct ExecutorOptions {
+    // Workers kept for good, each with a queue of its own. 0 is one per
+    // hardware thread.
+    unsigned                    coreThreads     = 0;
+    // Workers in total. Beyond coreThreads they are started while tasks
+    // stay queued for backlogDelay without any worker taking one, and stop
+    // after idling for idleTimeout.
+    unsigned                    maxThreads      = 4096;
+    std::chrono::microseconds   backlogDelay    = std::chrono::milliseconds(1);
+    std::chrono::milliseconds   idleTimeout     = std::chrono::seconds(30);
+};
+
+// Executor - runs tasks on a pool of worker threads.
+//
+// A task submitted by a core worker goes to the back of its own queue,
+// other tasks to a shared queue. Workers take from the back of their own
+// queue, then from the shared queue, then steal from the front of the
+// queues of other core workers.
+//
+// Every submission wakes one sleeping worker, which costs microseconds.
+// When none sleeps the task waits for a worker done with its own. Should
+// tasks stay queued for backlogDelay without any worker taking one, all of
+// them being blocked, a spare worker is started, and another one every
+// backlogDelay while that lasts. Tasks blocked on each other, like the
+// shard writers of a PUT feeding from pipes, so still make progress as
+// long as maxThreads is not reached, while a burst of short tasks is
+// worked off by the workers there are.
+//
+// Tasks submitted with a delay, and the backlog checks, wait on a single
+// timer thread started on first use. No task runs on that thread.
+class Executor {
+
+public:
+    explicit Executor(const ExecutorOptions& opts = ExecutorOptions{});
+    // Runs the tasks still queued, then waits for all workers to stop.
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void submit(Task task);
+    // Submits 'task' once 'delay' passed. Dropped unrun when the executor
+    // is destroyed first.
+    void submitAfter(std::chrono::steady_clock::duration delay, Task task);
+
+    // The executor of Context::runAsync, never destroyed.
+    static Executor& global();
+
+    unsigned threads() const { return running.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        Executor*           owner = nullptr;
+        std::mutex          mu;
+        std::deque<Task>    tasks;
+    };
+
+    // The core worker running on this thread, if any.
+    static thread_local Worker* current;
+
+    // Takes the next task for a worker with the queue 'local', null for
+    // workers without one.
+    bool take(Worker* local, Task& task);
+    void work(Worker* local);
+    void spawn();
+    void timerLoop();
+    // Starts a spare worker if no task was taken for backlogDelay.
+    void checkBacklog();
+    // Has the timer call checkBacklog once backlogDelay passed.
+    void armBacklogCheck(std::chrono::steady_clock::time_point since);
+
+    ExecutorOptions                         opts;
+    std::vector<std::unique_ptr<Worker>>    cores;
+
+    std::mutex                              sharedMu;
+    std::deque<Task>                        shared;
+    std::atomic<size_t>                     queued{0};      // in all queues
+    std::atomic<uint64_t>                   taken{0};       // ever, tells workers make progress
+    std::atomic<size_t>                     stealFrom{0};   // where the next steal starts
+
+    std::mutex                              mu;
+    std::condition_variable                 cv;             // wakeups handed out, stopping
+    std::condition_variable                 stoppedCv;
+    unsigned                                sleeping = 0;   // not counting those handed a wakeup
+    unsigned                                wakeups = 0;
+    bool                                    stopping = false;
+    // Since when tasks are queued with no worker idle, unset once one is,
+    // and 'taken' at that time.
+    std::chrono::steady_clock::time_point   backlogSince;
+    uint64_t                                backlogTaken = 0;
+    std::atomic<unsigned>                   running{0};
+
+    std::mutex                                                  timerMu;
+    std::condition_variable                                     timerCv;
+    std::multimap<std::chrono::steady_clock::time_point, Task>  delayed;
+    std::chrono::steady_clock::time_point                       backlogCheck = std::chrono::steady_clock::time_point::max();
+    std::thread                                                 timer;
+    bool                                                        timerStopping = false;
+};
+
+}
+
+#endif // CPPIO_EXECUTOR_HPP
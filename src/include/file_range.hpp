@@ -0,0 +1,74 @@
+#ifndef CPPIO_FILE_RANGE_HPP
+#define CPPIO_FILE_RANGE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <streambuf>
+#include <system_error>
+#include <utility>
+
+namespace cppio {
+
+// FileRange is an open file descriptor along with the byte range of a
+// part to be served from it. It owns the descriptor and closes it.
+class FileRange {
+
+public:
+    FileRange() = default;
+    FileRange(int fd, int64_t offset, int64_t length)
+        : fd(fd), offset(offset), length(length) {}
+
+    FileRange(const FileRange&) = delete;
+    FileRange& operator=(const FileRange&) = delete;
+    FileRange(FileRange&& other) noexcept { *this = std::move(other); }
+    FileRange& operator=(FileRange&& other) noexcept;
+    ~FileRange() { close(); }
+
+    bool valid() const { return fd >= 0; }
+    void close();
+
+public:
+    int         fd      = -1;
+    int64_t     offset  = 0;
+    int64_t     length  = 0;
+};
+
+// FileRangeStream reads a FileRange through a small buffer, it is the
+// copying counterpart of sendFileRange for callers that need a stream.
+class FileRangeStream : public std::istream {
+
+public:
+    explicit FileRangeStream(FileRange&& range)
+        : std::istream(nullptr), buf(std::move(range)) { rdbuf(&buf); }
+
+private:
+    class Buf : public std::streambuf {
+
+    public:
+        explicit Buf(FileRange&& range) : range(std::move(range)) {}
+
+    protected:
+        int_type underflow() override;
+
+    private:
+        FileRange   range;
+        int64_t     pos = 0;
+        char        chunk[64 * 1024];
+    };
+
+    Buf buf;
+};
+
+// sendFileRange copies the whole range to a connected socket without
+// going through user space, with sendfile(2) or, when the descriptor does
+// not support it, with splice(2) through a pipe. 'sent' carries the bytes
+// written so far, also on error. Non-blocking sockets are waited on for
+// up to 'idleTimeout' at a time, a peer not reading for longer fails the
+// send with std::errc::timed_out.
+std::error_code sendFileRange(int sockfd, const FileRange& range, int64_t& sent,
+                              std::chrono::milliseconds idleTimeout);
+
+}
+
+#endif // CPPIO_FILE_RANGE_HPP
@@ -3,101 +3,256 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <functional>
 #include <boost/beast.hpp>
 #include <boost/asio.hpp>
 #include <memory>
 
+#include "context.hpp"
+#include "file_range.hpp"
+
 namespace cppio {
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
-class HttpServer {
+using HttpRequestParser = http::request_parser<http::buffer_body>;
+using HttpRequest = HttpRequestParser::value_type;
 
-private:
-    boost::asio::io_context ioContext;
-    tcp::acceptor acceptor;
+// FileRangeBody is a Beast body serving a FileRange. The session sends it
+// with sendFileRange() on plain TCP connections; the writer below is the
+// buffered path used by any other stream.
+struct FileRangeBody {
+    using value_type = FileRange;
 
-public:
-    HttpServer() : ioContext{1}, acceptor(ioContext, tcp::endpoint(tcp::v4(), 9399)) {}
-
-    void start() {
-        std::cout << "Server started on port 9399" << std::endl;
-        // Start accepting connections asynchronously
-        start_accept();
-        // Run the io_context to handle asynchronous operations
-        ioContext.run();
+    static std::uint64_t size(const value_type& body) {
+        return static_cast<std::uint64_t>(body.length);
     }
 
-    void stop() {
-        // Stop accepting new connections
-        acceptor.close();
-        // Cancel any outstanding asynchronous operations
-        ioContext.stop();
-    }
+    class writer {
 
-private:
-    // This function handles an HTTP server request
-    void handle_request(const std::shared_ptr<tcp::socket> socket) {
-        try {
-            // Create a buffer to hold the incoming request
-            beast::flat_buffer buffer;
-
-            // Declare a container to hold the request
-            http::request<http::string_body> req;
-
-            std::cout << "To read request: " << req << std::endl;
-            // Read the request
-            http::read(*socket, buffer, req);
-            std::cout << "Received request: " << req << std::endl;
-
-            // Create a response message
-            http::response<http::string_body> res{http::status::ok, req.version()};
-            res.set(http::field::server, "Boost Beast Async Server");
-            res.set(http::field::content_type, "text/html");
-            res.keep_alive(req.keep_alive());
-            res.body() = "-------Hello, Boost.Beast Async!\n\n";
-            res.prepare_payload();
-
-            // Write the response
-            http::write(*socket, res);
-
-            // Perform clean shutdown to close the socket
-            socket->shutdown(tcp::socket::shutdown_send);
-        } catch (std::exception const& e) {
-            if (socket.get() == nullptr) {
-                std::cerr << "Socket Nullptr " << std::endl;
-            }
-            std::cerr << "Error: " << e.what() << std::endl;
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template<bool isRequest, class Fields>
+        writer(const http::header<isRequest, Fields>&, const value_type& body) : body(body) {}
+
+        void init(beast::error_code& ec) { ec = {}; }
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec);
+
+    private:
+        const value_type&   body;
+        int64_t             pos = 0;
+        char                buf[16 * 1024];
+    };
+};
+
+// HttpResponse is produced by a handler. A payload is either kept in
+// 'body', pulled in chunks from 'bodyStream' (e.g. the stream returned by
+// StorageAPI::readfileStream) while being written out, or, for objects
+// served as stored from a local drive, sent straight from 'bodyFile'
+// (see StorageAPI::openFileRange) without being copied to user space.
+// A 'bodyStream' ending before 'contentLength' bytes, or failing, closes
+// the connection instead of completing the response.
+struct HttpResponse {
+    http::response<http::empty_body>    header;
+    std::string                         body;
+    std::istream*                       bodyStream = nullptr;
+    int64_t                             contentLength = -1;    // -1 sends the stream chunked
+    FileRange                           bodyFile;
+};
+
+// HttpHandler serves one request, the body of 'req' must not be touched.
+// The request payload is exposed as an std::istream which reads the socket
+// one chunk at a time, so it can be handed straight to
+// StorageAPI::createFile. Handlers run off the io_context threads and are
+// free to block.
+using HttpHandler = std::function<HttpResponse(const HttpRequest& req, std::istream& body)>;
+
+// Limits and deadlines applied to every connection.
+const std::chrono::seconds httpIdleTimeout(30);
+const std::uint32_t httpHeaderLimit = 64 * 1024;        // 64 KiB
+const std::size_t httpStreamChunkSize = 256 * 1024;     // 256 KiB
+const std::uint64_t httpDrainLimit = 1024 * 1024;       // 1 MiB
+// How often a worker waiting on the socket checks for a stopped pool.
+const std::chrono::milliseconds httpStopPoll(100);
+
+// awaitStream runs an asynchronous operation on 'stream' for a worker and
+// waits for it. 'start' initiates it on the io_context of the stream with
+// the completion handler it is given. Each operation gets httpIdleTimeout,
+// a peer that stops reading or writing fails it with beast::error::timeout
+// instead of pinning the worker. Once the io_context is stopped, which
+// keeps the handler queued, it fails with net::error::operation_aborted.
+template<typename Start>
+std::size_t awaitStream(beast::tcp_stream& stream, beast::error_code& ec, Start&& start) {
+    // Shared with the handler, a destroyed io_context dropping it breaks
+    // the promise rather than leaving the worker waiting.
+    auto done = std::make_shared<std::promise<std::pair<beast::error_code, std::size_t>>>();
+    auto result = done->get_future();
+    net::dispatch(stream.get_executor(), [&stream, &start, done]() {
+        stream.expires_after(httpIdleTimeout);
+        start([done](beast::error_code e, std::size_t n) { done->set_value({e, n}); });
+    });
+    auto ioc = stream.get_executor().template target<net::io_context::executor_type>();
+    while (result.wait_for(httpStopPoll) != std::future_status::ready) {
+        if (ioc != nullptr && ioc->context().stopped()) {
+            ec = net::error::operation_aborted;
+            return 0;
         }
     }
-
-    // This function handles accepting new connections asynchronously
-    void start_accept() {
-        // Create a socket for the next incoming connection
-        auto socket = std::make_shared<tcp::socket>(ioContext);
-
-        // Start asynchronous accept operation
-        acceptor.async_accept(*socket, [&, socket](const beast::error_code& ec) {
-            if (!ec) {
-                std::cout << "Accepted new connection" << std::endl;
-                tcp::endpoint remoteEndpoint = socket->remote_endpoint();
-                std::cout << "Remote IP address: " << remoteEndpoint.address() << std::endl;
-                std::cout << "Remote port      : " << remoteEndpoint.port() << std::endl;
-                // Successfully accepted a connection, handle it
-                handle_request(socket);
-
-                // Continue accepting new connections
-                start_accept();
-            } else {
-                std::cerr << "Accept error: " << ec.message() << std::endl;
-            }
-        });
+    try {
+        auto [e, n] = result.get();
+        ec = e;
+        return n;
+    } catch (const std::future_error&) {
+        ec = net::error::operation_aborted;
+        return 0;
     }
+}
+
+// HttpBodyReader is a streambuf over the payload of the request being
+// parsed. Every underflow reads at most one chunk from the socket into a
+// buffer owned by the connection, memory never depends on object size.
+class HttpBodyReader : public std::streambuf {
+
+public:
+    HttpBodyReader(beast::tcp_stream& stream, beast::flat_buffer& buffer,
+                   HttpRequestParser& parser, std::vector<char>& chunk)
+        : stream(stream), buffer(buffer), parser(parser), chunk(chunk) {}
+
+    beast::error_code error() const { return ec; }
+    // Reads and discards what is left of the payload, up to limit bytes.
+    // Returns false if the payload could not be drained.
+    bool drain(std::uint64_t limit);
+
+protected:
+    int_type underflow() override;
+
+private:
+    beast::tcp_stream&      stream;
+    beast::flat_buffer&     buffer;
+    HttpRequestParser&      parser;
+    std::vector<char>&      chunk;
+    beast::error_code       ec;
+};
+
+// IoContextPool runs one single-threaded io_context per thread, so that
+// every connection is served by exactly one core without any locking.
+class IoContextPool {
+
+public:
+    explicit IoContextPool(std::size_t poolSize);
+
+    IoContextPool(const IoContextPool&) = delete;
+    IoContextPool& operator=(const IoContextPool&) = delete;
+
+    // Runs all io_contexts, blocks until every one of them has stopped.
+    void run();
+    void stop();
+
+    // Returns the next io_context in round-robin order.
+    net::io_context& getIoContext();
+    net::io_context& getIoContext(std::size_t idx) { return *ioContexts[idx]; }
+    std::size_t size() const { return ioContexts.size(); }
 
+private:
+    using WorkGuard = net::executor_work_guard<net::io_context::executor_type>;
+
+    std::vector<std::shared_ptr<net::io_context>>   ioContexts;
+    std::vector<WorkGuard>                          workGuards;
+    std::atomic<std::size_t>                        next { 0 };
+};
+
+// HttpSession serves one connection: it keeps reading requests and writing
+// responses in order until the peer closes or asks for no keep-alive.
+// Pipelined requests are picked up from the read buffer one after another.
+//
+// Only the request header is read by the io_context on its own. The
+// handler then runs on a worker, which reads the payload and writes the
+// response one operation at a time through awaitStream, while the
+// io_context keeps serving other connections.
+class HttpSession : public std::enable_shared_from_this<HttpSession> {
+
+public:
+    HttpSession(tcp::socket&& socket, const HttpHandler& handler, Context& ctx)
+        : stream(std::move(socket)), buffer(httpHeaderLimit), handler(handler), ctx(ctx) {}
+
+    void run();
+
+private:
+    void doReadHeader();
+    void onReadHeader(beast::error_code ec, std::size_t bytesTransferred);
+    // Runs on a worker, returns true if the connection can be kept alive.
+    bool serve();
+    beast::error_code writeResponse(HttpResponse& res);
+    beast::error_code writeFileResponse(HttpResponse& res);
+    void doClose();
+
+private:
+    beast::tcp_stream                   stream;
+    beast::flat_buffer                  buffer;
+    const HttpHandler&                  handler;
+    Context&                            ctx;
+    std::optional<HttpRequestParser>    parser;
+    std::vector<char>                   chunk;
+};
+
+// HttpListener accepts connections on one acceptor. Accepted sockets are
+// bound to the io_context returned by the pool, so a listener either keeps
+// its connections (SO_REUSEPORT, one listener per core) or hands them off
+// round-robin (single shared listener).
+class HttpListener : public std::enable_shared_from_this<HttpListener> {
+
+public:
+    HttpListener(net::io_context& ioc, IoContextPool* handoff,
+                 const tcp::endpoint& endpoint, bool reusePort,
+                 const HttpHandler& handler, Context& ctx);
+
+    void run() { doAccept(); }
+    void close();
+
+private:
+    void doAccept();
+    void onAccept(beast::error_code ec, tcp::socket socket);
+
+private:
+    net::io_context&        ioc;
+    IoContextPool*          handoff;
+    tcp::acceptor           acceptor;
+    const HttpHandler&      handler;
+    Context&                ctx;
+};
+
+class HttpServer {
+
+public:
+    HttpServer(const std::string& address = "0.0.0.0", unsigned short port = 9399,
+               std::size_t threads = std::thread::hardware_concurrency());
+
+    void setHandler(HttpHandler h) { handler = std::move(h); }
+
+    void start();
+    void stop();
+
+private:
+    // Default handler, answers every request with a static page.
+    static HttpResponse handleRequest(const HttpRequest& req, std::istream& body);
+
+private:
+    Context                                     ctx;
+    tcp::endpoint                               endpoint;
+    IoContextPool                               pool;
+    HttpHandler                                 handler;
+    std::vector<std::shared_ptr<HttpListener>>  listeners;
 };
 
 }
 
-#endif // CPPIO_HTTPSERVER_HPP
\ No newline at end of file
+#endif // CPPIO_HTTPSERVER_HPP
@@ -0,0 +1,118 @@
+#ifndef CPPIO_IO_ENGINE_HPP
+#define CPPIO_IO_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace cppio {
+
+enum class IoOpcode : uint8_t {
+    Nop,
+    Openat,     // path, flags, mode; result is the fd, or 0 for a fixed slot
+    Read,       // fd, buf, len, offset
+    Write,      // fd, buf, len, offset (-1 writes at the file position)
+    Fsync,      // fd, data only
+    Close,      // fd
+    Renameat,   // path, path2
+    Statx,      // path, flags (AT_*), len (STATX_* mask), buf (struct statx)
+};
+
+// IoOp is one request of a batch. Once the batch completes 'result'
+// carries the transferred bytes (or fd for Openat) or -errno.
+//
+// With 'fixedFile' set, 'fd' is a slot of the engine's file table (see
+// IoEngine::allocFileSlot): Openat installs the file there and following
+// ops of the same chain use it without a file table lookup.
+// With 'link' set, the next op only runs if this one succeeded, otherwise
+// the rest of the chain completes with -ECANCELED. With 'hardlink' set the
+// next op runs once this one completed, whatever its result, which is how
+// a Close is chained behind a Read. Ops of a chain run in order, distinct
+// chains of a batch run in any order.
+struct IoOp {
+    IoOpcode        opcode      = IoOpcode::Nop;
+    int             fd          = -1;
+    bool            fixedFile   = false;
+    bool            link        = false;
+    bool            hardlink    = false;
+    const char*     path        = nullptr;
+    const char*     path2       = nullptr;
+    int             flags       = 0;
+    mode_t          mode        = 0;
+    void*           buf         = nullptr;
+    uint32_t        len         = 0;
+    int64_t         offset      = 0;
+    int             bufIndex    = -1;       // registered buffer backing 'buf'
+    int64_t         result      = 0;
+};
+
+// RegisteredBuffer is a page aligned buffer of the engine's pool. Engines
+// backed by io_uring pin the pool once at startup, reads and writes of
+// these buffers skip the per-request page mapping.
+struct RegisteredBuffer {
+    int         index   = -1;
+    uint8_t*    data    = nullptr;
+    size_t      size    = 0;
+
+    bool valid() const { return index >= 0; }
+};
+
+struct IoEngineOptions {
+    unsigned    queueDepth      = 256;          // submission queue entries
+    unsigned    fileSlots       = 1024;         // fixed file table size
+    unsigned    bufferCount     = 16;           // registered buffers
+    size_t      bufferSize      = 1 << 20;      // 1 MiB each
+    unsigned    fallbackThreads = 8;            // thread pool size without io_uring
+    bool        disableUring    = false;
+};
+
+// IoEngine executes batches of positional I/O for a single drive.
+class IoEngine {
+
+public:
+    explicit IoEngine(const IoEngineOptions& opts);
+    virtual ~IoEngine();
+
+    IoEngine(const IoEngine&) = delete;
+    IoEngine& operator=(const IoEngine&) = delete;
+
+    virtual std::string name() const = 0;
+
+    // Submits all ops as one batch, blocks until every op has completed.
+    virtual void submit(IoOp* ops, size_t n) = 0;
+    void submit(std::vector<IoOp>& ops) { submit(ops.data(), ops.size()); }
+
+    // Fixed file slots, -1 when none is left or unsupported.
+    int allocFileSlot();
+    void freeFileSlot(int slot);
+
+    // Registered buffers, an invalid buffer is returned when the pool is
+    // exhausted and callers must bring their own memory.
+    RegisteredBuffer acquireBuffer();
+    void releaseBuffer(const RegisteredBuffer& buf);
+    size_t bufferSize() const { return opts.bufferSize; }
+
+    // Creates an io_uring engine, or a thread pool engine when io_uring
+    // is disabled or not usable on this kernel.
+    static std::shared_ptr<IoEngine> create(const IoEngineOptions& opts);
+
+protected:
+    void setFileSlots(unsigned n);
+
+protected:
+    IoEngineOptions         opts;
+    uint8_t*                bufferArena = nullptr;
+
+private:
+    std::mutex              slotsMu;
+    std::vector<int>        freeSlots;
+    std::mutex              buffersMu;
+    std::vector<int>        freeBuffers;
+};
+
+}
+
+#endif // CPPIO_IO_ENGINE_HPP
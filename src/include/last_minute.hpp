@@ -1,7 +1,12 @@
 #ifndef CPPIO_LAST_MINUTE_HPP
 #define CPPIO_LAST_MINUTE_HPP
 
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
 #include <string>
 
 namespace cppio {
@@ -19,7 +24,7 @@ enum SizeTag {
 };
 
 // Function to convert size to tag
-SizeTag sizeToTag(int64_t size) {
+inline SizeTag sizeToTag(int64_t size) {
     if (size < 1024)
         return sizeLessThan1KiB;
     else if (size < 1024 * 1024)
@@ -35,7 +40,7 @@ SizeTag sizeToTag(int64_t size) {
 }
 
 // Function to convert tag to string
-std::string sizeTagToString(SizeTag tag) {
+inline std::string sizeTagToString(SizeTag tag) {
     switch (tag) {
         case sizeLessThan1KiB:
             return "LESS_THAN_1_KiB";
@@ -56,9 +61,112 @@ std::string sizeTagToString(SizeTag tag) {
 
 // AccElem holds information for calculating an average value
 struct AccElem {
-	uint64_t total;
-	uint64_t size;
-    uint64_t n;
+    uint64_t total = 0;     // nanoseconds
+    uint64_t size = 0;      // bytes
+    uint64_t n = 0;
+
+    void add(std::chrono::nanoseconds d, uint64_t bytes = 0) {
+        total += static_cast<uint64_t>(d.count());
+        size += bytes;
+        n++;
+    }
+
+    void merge(const AccElem& b) {
+        total += b.total;
+        size += b.size;
+        n += b.n;
+    }
+
+    std::chrono::nanoseconds avg() const {
+        return std::chrono::nanoseconds(n ? total / n : 0);
+    }
+};
+
+// lastMinuteLatency - latencies of the last minute, a slot per second of
+// a 60 second ring. A slot is tagged with its second, add resets a slot
+// left over from the previous minute before adding to it, total merges
+// the slots of the last 60 seconds.
+//
+// Slots are atomics, adding neither locks nor allocates. A sample racing
+// the reset of its slot at the turn of a second may get lost.
+class lastMinuteLatency {
+
+public:
+    void add(std::chrono::nanoseconds d, uint64_t size = 0) {
+        addAt(nowSec(), d, size);
+    }
+
+    void addAt(int64_t sec, std::chrono::nanoseconds d, uint64_t size) {
+        auto& slot = slots[static_cast<size_t>(sec % 60)];
+        auto tag = slot.sec.load(std::memory_order_acquire);
+        if (tag < sec && slot.sec.compare_exchange_strong(tag, sec, std::memory_order_acq_rel)) {
+            slot.total.store(0, std::memory_order_relaxed);
+            slot.size.store(0, std::memory_order_relaxed);
+            slot.n.store(0, std::memory_order_relaxed);
+        }
+        slot.total.fetch_add(static_cast<uint64_t>(std::max<int64_t>(d.count(), 0)), std::memory_order_relaxed);
+        slot.size.fetch_add(size, std::memory_order_relaxed);
+        slot.n.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns the latencies of the last 60 seconds.
+    AccElem total() const {
+        return totalAt(nowSec());
+    }
+
+    AccElem totalAt(int64_t sec) const {
+        AccElem res;
+        for (const auto& slot : slots) {
+            auto tag = slot.sec.load(std::memory_order_acquire);
+            if (tag > sec - 60 && tag <= sec) {
+                res.total += slot.total.load(std::memory_order_relaxed);
+                res.size += slot.size.load(std::memory_order_relaxed);
+                res.n += slot.n.load(std::memory_order_relaxed);
+            }
+        }
+        return res;
+    }
+
+    // Returns the current second of the coarse monotonic clock, cheaper
+    // to read than steady_clock on the hot path.
+    static int64_t nowSec() {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<int64_t>(ts.tv_sec);
+    }
+
+private:
+    struct Slot {
+        std::atomic<int64_t>    sec{-1};
+        std::atomic<uint64_t>   total{0};
+        std::atomic<uint64_t>   size{0};
+        std::atomic<uint64_t>   n{0};
+    };
+
+    std::array<Slot, 60> slots;
+};
+
+// lastMinuteHistogram - a lastMinuteLatency per SizeTag, so latencies of
+// small and large transfers are not averaged together.
+class lastMinuteHistogram {
+
+public:
+    void add(int64_t size, std::chrono::nanoseconds d) {
+        sizes[sizeToTag(size)].add(d, static_cast<uint64_t>(std::max<int64_t>(size, 0)));
+    }
+
+    // Returns the latencies of the last 60 seconds by SizeTag.
+    std::array<AccElem, sizeLastElemMarker> total() const {
+        std::array<AccElem, sizeLastElemMarker> res;
+        auto sec = lastMinuteLatency::nowSec();
+        for (size_t i = 0; i < sizeLastElemMarker; ++i) {
+            res[i] = sizes[i].totalAt(sec);
+        }
+        return res;
+    }
+
+private:
+    std::array<lastMinuteLatency, sizeLastElemMarker> sizes;
 };
 
 }
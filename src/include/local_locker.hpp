@@ -0,0 +1,62 @@
+#ifndef CPPIO_LOCAL_LOCKER_HPP
+#define CPPIO_LOCAL_LOCKER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dsync.hpp"
+
+namespace cppio {
+
+// LockRequesterInfo - a lock held on a resource of a LocalLocker.
+struct LockRequesterInfo {
+    std::string                             name;
+    bool                                    writer = false;
+    std::string                             uid;
+    std::chrono::steady_clock::time_point   timestamp;
+    std::chrono::steady_clock::time_point   timeLastRefresh;
+    std::string                             source;
+    std::string                             owner;
+    int                                     quorum = 0;
+};
+
+// LocalLocker - the lock table of this server, which the lockers of all
+// nodes take their share of distributed locks from. A write lock of
+// several resources is granted only if none of them is locked at all.
+class LocalLocker : public dsync::NetLocker {
+
+public:
+    explicit LocalLocker(std::string endpoint) : endpoint(std::move(endpoint)) {}
+
+    std::string string() const override { return endpoint; }
+    bool isOnline() const override { return true; }
+    bool isLocal() const override { return true; }
+
+    Error lock(Context& ctx, const dsync::LockArgs& args, bool& granted) override;
+    Error rlock(Context& ctx, const dsync::LockArgs& args, bool& granted) override;
+    Error unlock(Context& ctx, const dsync::LockArgs& args, bool& released) override;
+    Error runlock(Context& ctx, const dsync::LockArgs& args, bool& released) override;
+    Error refresh(Context& ctx, const dsync::LockArgs& args, bool& refreshed) override;
+    Error forceUnlock(Context& ctx, const dsync::LockArgs& args, bool& released) override;
+
+    void close() override {}
+
+    // Drops locks not refreshed for 'maxAge', their owners are gone.
+    // Returns how many were dropped.
+    size_t expire(std::chrono::milliseconds maxAge);
+
+    // Returns the number of resources locked.
+    size_t size() const;
+
+private:
+    mutable std::mutex                                                  mu;
+    std::unordered_map<std::string, std::vector<LockRequesterInfo>>     lockMap;
+    std::string                                                         endpoint;
+};
+
+}
+
+#endif // CPPIO_LOCAL_LOCKER_HPP
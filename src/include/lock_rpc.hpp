@@ -0,0 +1,121 @@
+#ifndef CPPIO_LOCK_RPC_HPP
+#define CPPIO_LOCK_RPC_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dsync.hpp"
+#include "local_locker.hpp"
+
+namespace cppio {
+
+struct LockServerOptions {
+    std::string                 address     = "127.0.0.1:0";   // host:port, port 0 picks one
+    // Locks not refreshed for this long are dropped, their owners are
+    // gone. A few refresh intervals of the lockers.
+    std::chrono::milliseconds   expireAfter = std::chrono::minutes(1);
+};
+
+// LockServer - serves a LocalLocker to the RemoteLockers of other nodes
+// over TCP, one thread per connection.
+//
+// A connection carries frames of a 4 byte big endian length and a
+// MessagePack array. A request frame is a batch of calls, each an array
+// of op, uid, resources, owner, source and quorum; the response frame
+// answers them in order, each with whether it was granted and an error
+// message, empty for none. A malformed request closes the connection.
+class LockServer {
+
+public:
+    LockServer(LocalLocker& locker, const LockServerOptions& opts = LockServerOptions{});
+    ~LockServer() { stop(); }
+
+    LockServer(const LockServer&) = delete;
+    LockServer& operator=(const LockServer&) = delete;
+
+    // Binds and starts serving in the background.
+    Error start();
+    // Closes the listener and all connections, waits for their threads.
+    void stop();
+
+    // Returns the port bound by start.
+    uint16_t port() const { return boundPort; }
+
+private:
+    void acceptLoop();
+    void serve(int fd);
+
+    LocalLocker&                locker;
+    LockServerOptions           opts;
+    int                         listenFd = -1;
+    uint16_t                    boundPort = 0;
+    std::atomic<bool>           stopping{false};
+    std::mutex                  mu;
+    std::condition_variable     cv;         // stopping, a connection closed
+    std::vector<int>            conns;      // each served by a detached thread
+    std::vector<std::thread>    threads;    // acceptor and expiry sweeper
+};
+
+// RemoteLocker - the LocalLocker of another node, over one TCP connection.
+// Calls are batched: while a batch is on the wire, calls made by other
+// threads queue up and go out together as the next one, so a burst of
+// lock traffic to a peer costs a round trip per batch, not per call.
+// Batches are sent from the executor, a call returns the error of its
+// context once that ends, whether the call went out or not.
+// A failed connection is redialed by the next call.
+class RemoteLocker : public dsync::NetLocker {
+
+public:
+    // 'address' is host:port of the peer's LockServer.
+    explicit RemoteLocker(std::string address, std::chrono::milliseconds timeout = std::chrono::seconds(5));
+    ~RemoteLocker() override { close(); }
+
+    std::string string() const override { return address; }
+    bool isOnline() const override { return online; }
+    bool isLocal() const override { return false; }
+
+    Error lock(Context& ctx, const dsync::LockArgs& args, bool& granted) override;
+    Error rlock(Context& ctx, const dsync::LockArgs& args, bool& granted) override;
+    Error unlock(Context& ctx, const dsync::LockArgs& args, bool& released) override;
+    Error runlock(Context& ctx, const dsync::LockArgs& args, bool& released) override;
+    Error refresh(Context& ctx, const dsync::LockArgs& args, bool& refreshed) override;
+    Error forceUnlock(Context& ctx, const dsync::LockArgs& args, bool& released) override;
+
+    void close() override;
+
+    // Returns the number of batches sent, the calls of all of them.
+    uint64_t batches() const { return batchCount; }
+    uint64_t calls() const { return callCount; }
+
+private:
+    struct Call;
+
+    Error call(Context& ctx, uint8_t op, const dsync::LockArgs& args, bool& result);
+    // Sends the queue batch by batch until it is empty, on the executor.
+    void send();
+    // Sends a frame and reads the answer, dialing first when needed.
+    Error roundTrip(std::vector<uint8_t>& frame, std::vector<uint8_t>& response);
+
+    std::string                         address;
+    std::chrono::milliseconds           timeout;
+    std::atomic<bool>                   online{true};
+    std::atomic<uint64_t>               batchCount{0};
+    std::atomic<uint64_t>               callCount{0};
+
+    std::mutex                          mu;
+    std::condition_variable             cv;
+    std::vector<std::shared_ptr<Call>>  queue;
+    bool                                sending = false;
+    int                                 fd = -1;        // used by the sender only
+};
+
+}
+
+#endif // CPPIO_LOCK_RPC_HPP
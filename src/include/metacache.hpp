@@ -0,0 +1,44 @@
+#ifndef CPPIO_METACACHE_HPP
+#define CPPIO_METACACHE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace cppio {
+
+// MetaCacheEntry - an entry of a listing. Objects carry their xl.meta
+// without inline data, directories (prefixes) end with a slash and have no
+// metadata.
+struct MetaCacheEntry {
+    std::string             name;
+    std::vector<uint8_t>    metadata;
+
+    bool isDir() const { return metadata.empty() && !name.empty() && name.back() == '/'; }
+    bool isObject() const { return !isDir(); }
+
+    // Returns true if both entries are the same directory, or the same
+    // object with the same versions.
+    bool matches(const MetaCacheEntry& other) const;
+};
+
+// Receives listing entries in lexical order, returns false to stop.
+using MetaCacheEntryFn = std::function<bool(MetaCacheEntry&&)>;
+
+// MetaCacheResolveParams - how many drives have to agree on an entry
+// listed from several drives.
+struct MetaCacheResolveParams {
+    int dirQuorum = 1;
+    int objQuorum = 1;
+};
+
+// Picks the entry of the same name found on several drives that enough
+// of them agree on, objects winning over directories. Returns false if
+// there is none.
+bool resolveMetaCacheEntries(const std::vector<const MetaCacheEntry*>& entries,
+                             const MetaCacheResolveParams& params, MetaCacheEntry& resolved);
+
+}
+
+#endif // CPPIO_METACACHE_HPP
@@ -0,0 +1,110 @@
+#ifndef CPPIO_METACACHE_MANAGER_HPP
+#define CPPIO_METACACHE_MANAGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "context.hpp"
+#include "metacache_stream.hpp"
+#include "storage_interface.hpp"
+
+namespace cppio {
+
+struct ErasureObjects;
+
+struct MetacacheOptions {
+    // A listing is served from its cache for this long after the walk
+    // started, which bounds how long changes the set did not see, made
+    // by other servers or behind the drives' back, go unnoticed.
+    std::chrono::milliseconds   ttl             = std::chrono::minutes(5);
+    uint32_t                    blockEntries    = 5000;     // entries per block
+    size_t                      maxCaches       = 256;      // oldest are dropped first
+};
+
+// ListPathOptions - one page of a listing of a bucket.
+struct ListPathOptions {
+    std::string bucket;
+    std::string prefix;             // names listed start with it
+    std::string marker;             // names listed sort after it
+    std::string continuationToken;  // of the previous page, supersedes marker
+    bool        recursive = true;   // false lists up to the next slash
+    int         limit = 1000;       // entries per page
+};
+
+// ListPathResult - a page of a listing. 'continuationToken' is set when
+// the listing goes on and asks for the next page.
+struct ListPathResult {
+    std::vector<MetaCacheEntry> entries;
+    bool                        truncated = false;
+    std::string                 continuationToken;
+};
+
+// Continuation tokens carry the id of the cache a page came from, empty
+// for uncached listings, and the last name returned, hex encoded.
+std::string encodeListContinuation(const std::string& id, const std::string& marker);
+// Returns false for a malformed token.
+bool decodeListContinuation(const std::string& token, std::string& id, std::string& marker);
+
+// Metacaches - the listings of an erasure set cached while they are being
+// paged through. The first page of a listing starts a walk of the set in
+// the background that stores the merged entries as compressed blocks on
+// one drive of the set, see MetacacheIndex; later pages seek into the
+// blocks by the name they continue after, paging costs O(page) whatever
+// the offset.
+//
+// A listing is cached per bucket, walked directory and recursion, listings
+// of different prefixes in the same directory share it. A write to an
+// object under the walked directory drops the cache, as does the TTL. The
+// continuation token names the cache and the last name returned; a token
+// whose cache is gone continues with a new one from that name.
+class Metacaches {
+
+public:
+    Metacaches(ErasureObjects& set, const MetacacheOptions& opts = MetacacheOptions{});
+    ~Metacaches();
+
+    Metacaches(const Metacaches&) = delete;
+    Metacaches& operator=(const Metacaches&) = delete;
+
+    // Returns the page of the listing 'opts' asks for.
+    Error listPath(Context& ctx, const ListPathOptions& opts, ListPathResult& result);
+
+    // Drops the cached listings that 'object' of 'bucket' is part of,
+    // writers call it once the object changed.
+    void objectChanged(const std::string& bucket, const std::string& object);
+
+    // Drops all cached listings of 'bucket'.
+    void bucketChanged(const std::string& bucket);
+
+private:
+    struct Cache;
+
+    std::shared_ptr<Cache> find(const std::string& id);
+    std::shared_ptr<Cache> findOrStart(const std::string& bucket, const std::string& root, bool recursive);
+    void build(const std::shared_ptr<Cache>& cache);
+    void drop(const std::shared_ptr<Cache>& cache);
+    void forget(const std::shared_ptr<Cache>& cache);
+    void expire();
+    Error readBlock(const Cache& cache, uint32_t n, std::vector<MetaCacheEntry>& entries);
+
+    ErasureObjects&                                         set;
+    MetacacheOptions                                        opts;
+    std::mutex                                              mu;
+    std::unordered_map<std::string, std::shared_ptr<Cache>> caches;     // by id
+    // Walks and removals run in the background on this context, the
+    // destructor waits for them.
+    Context                                                 bgCtx;
+    std::mutex                                              buildMu;
+    std::condition_variable                                 buildCv;
+    int                                                     building = 0;
+};
+
+}
+
+#endif // CPPIO_METACACHE_MANAGER_HPP
@@ -0,0 +1,32 @@
+#ifndef CPPIO_METACACHE_SET_HPP
+#define CPPIO_METACACHE_SET_HPP
+
+#include <memory>
+#include <vector>
+
+#include "storage_interface.hpp"
+#include "metacache.hpp"
+
+namespace cppio {
+
+// ListPathRawOptions - a walk of the same directory on several drives.
+struct ListPathRawOptions {
+    std::vector<std::shared_ptr<StorageAPI>>    disks;      // null drives are offline
+    WalkDirOptions                              walk;
+    // Drives that have to walk to the end, fewer fail the listing.
+    int                                         minDisks = 1;
+    MetaCacheResolveParams                      resolve;
+    // Entries buffered per drive ahead of the merge.
+    size_t                                      queueSize = 1024;
+};
+
+// Walks all drives in parallel and merges their entries into one stream
+// in lexical order. Every name is resolved across the drives listing it,
+// see resolveMetaCacheEntries, entries without quorum are left out.
+// Returns once 'fn' returned false or the walks are done, with an error if
+// fewer than minDisks drives completed them.
+Error listPathRaw(Context& ctx, const ListPathRawOptions& opts, const MetaCacheEntryFn& fn);
+
+}
+
+#endif // CPPIO_METACACHE_SET_HPP
@@ -0,0 +1,66 @@
+#ifndef CPPIO_METACACHE_STREAM_HPP
+#define CPPIO_METACACHE_STREAM_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "error.hpp"
+#include "metacache.hpp"
+
+namespace cppio {
+
+// cppioMetaBucket - the system volume of every drive, holding what the
+// server keeps for itself, like MinIO's .minio.sys.
+const std::string cppioMetaBucket = ".cppio.sys";
+
+// Listings cached for a bucket live in cppioMetaBucket under
+// buckets/<bucket>/.metacache/<id>, see metacacheDir.
+const std::string metacacheIndexFile = "index";
+
+// Returns the directory of the cached listing 'id' of 'bucket'.
+std::string metacacheDir(const std::string& bucket, const std::string& id);
+
+// Returns the path of block 'n' of the cached listing 'id' of 'bucket'.
+std::string metacacheBlockPath(const std::string& bucket, const std::string& id, uint32_t n);
+
+// MetacacheBlock - one block of a cached listing, a run of entries in
+// lexical order compressed on its own. The names it starts and ends with
+// are kept in the index, a reader seeking to a name reads only the block
+// holding it.
+struct MetacacheBlock {
+    std::string first;
+    std::string last;
+    uint32_t    entries = 0;
+};
+
+// MetacacheIndex - what a cached listing holds, stored next to its blocks
+// and rewritten as blocks are added.
+struct MetacacheIndex {
+    std::string                 id;
+    std::string                 bucket;
+    std::string                 root;       // the walked baseDir
+    bool                        recursive = false;
+    bool                        complete = false;
+    int64_t                     started = 0;    // unix nanoseconds
+    std::vector<MetacacheBlock> blocks;
+
+    void encode(std::vector<uint8_t>& out) const;
+    Error decode(std::span<const uint8_t> data);
+
+    // Returns the first block that may hold names after 'marker', at most
+    // blocks.size(). Blocks before it only hold names up to the marker.
+    size_t seek(const std::string& marker) const;
+};
+
+// Encodes 'entries' as a block: a MessagePack array of name and metadata
+// pairs, deflated.
+void encodeMetacacheBlock(std::span<const MetaCacheEntry> entries, std::vector<uint8_t>& out);
+
+// Decodes a block of encodeMetacacheBlock, appending to 'entries'.
+Error decodeMetacacheBlock(std::span<const uint8_t> data, std::vector<MetaCacheEntry>& entries);
+
+}
+
+#endif // CPPIO_METACACHE_STREAM_HPP
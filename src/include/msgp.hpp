@@ -0,0 +1,391 @@
+#ifndef CPPIO_MSGP_HPP
+#define CPPIO_MSGP_HPP
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "error.hpp"
+#include "storage_errors.hpp"
+
+namespace cppio {
+
+// MessagePack type markers, see github.com/msgpack/msgpack/blob/master/spec.md
+namespace msgp {
+const uint8_t nil       = 0xc0;
+const uint8_t falseTag  = 0xc2;
+const uint8_t trueTag   = 0xc3;
+const uint8_t bin8      = 0xc4;
+const uint8_t bin16     = 0xc5;
+const uint8_t bin32     = 0xc6;
+const uint8_t ext8      = 0xc7;
+const uint8_t ext16     = 0xc8;
+const uint8_t ext32     = 0xc9;
+const uint8_t float32   = 0xca;
+const uint8_t float64   = 0xcb;
+const uint8_t uint8     = 0xcc;
+const uint8_t uint16    = 0xcd;
+const uint8_t uint32    = 0xce;
+const uint8_t uint64    = 0xcf;
+const uint8_t int8      = 0xd0;
+const uint8_t int16     = 0xd1;
+const uint8_t int32     = 0xd2;
+const uint8_t int64     = 0xd3;
+const uint8_t fixext1   = 0xd4;
+const uint8_t fixext16  = 0xd8;
+const uint8_t str8      = 0xd9;
+const uint8_t str16     = 0xda;
+const uint8_t str32     = 0xdb;
+const uint8_t array16   = 0xdc;
+const uint8_t array32   = 0xdd;
+const uint8_t map16     = 0xde;
+const uint8_t map32     = 0xdf;
+}
+
+// MsgpWriter appends MessagePack values to a buffer, callers reuse the
+// buffer to encode without allocating.
+class MsgpWriter {
+
+public:
+    explicit MsgpWriter(std::vector<uint8_t>& buf) : buf(buf) {}
+
+    void appendNil() { buf.push_back(msgp::nil); }
+
+    void appendBool(bool v) { buf.push_back(v ? msgp::trueTag : msgp::falseTag); }
+
+    void appendUint(uint64_t v) {
+        if (v < 0x80) {
+            buf.push_back(static_cast<uint8_t>(v));
+        } else if (v <= 0xff) {
+            buf.push_back(msgp::uint8);
+            buf.push_back(static_cast<uint8_t>(v));
+        } else if (v <= 0xffff) {
+            putBE(msgp::uint16, v, 2);
+        } else if (v <= 0xffffffff) {
+            putBE(msgp::uint32, v, 4);
+        } else {
+            putBE(msgp::uint64, v, 8);
+        }
+    }
+
+    void appendInt(int64_t v) {
+        if (v >= 0) {
+            appendUint(static_cast<uint64_t>(v));
+        } else if (v >= -32) {
+            buf.push_back(static_cast<uint8_t>(v));
+        } else if (v >= INT8_MIN) {
+            putBE(msgp::int8, static_cast<uint64_t>(v), 1);
+        } else if (v >= INT16_MIN) {
+            putBE(msgp::int16, static_cast<uint64_t>(v), 2);
+        } else if (v >= INT32_MIN) {
+            putBE(msgp::int32, static_cast<uint64_t>(v), 4);
+        } else {
+            putBE(msgp::int64, static_cast<uint64_t>(v), 8);
+        }
+    }
+
+    void appendString(std::string_view s) {
+        auto n = s.size();
+        if (n < 32) {
+            buf.push_back(static_cast<uint8_t>(0xa0 | n));
+        } else if (n <= 0xff) {
+            putBE(msgp::str8, n, 1);
+        } else if (n <= 0xffff) {
+            putBE(msgp::str16, n, 2);
+        } else {
+            putBE(msgp::str32, n, 4);
+        }
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+
+    void appendBytes(std::span<const uint8_t> b) {
+        auto n = b.size();
+        if (n <= 0xff) {
+            putBE(msgp::bin8, n, 1);
+        } else if (n <= 0xffff) {
+            putBE(msgp::bin16, n, 2);
+        } else {
+            putBE(msgp::bin32, n, 4);
+        }
+        buf.insert(buf.end(), b.begin(), b.end());
+    }
+
+    void appendArrayHeader(uint32_t n) {
+        if (n < 16) {
+            buf.push_back(static_cast<uint8_t>(0x90 | n));
+        } else if (n <= 0xffff) {
+            putBE(msgp::array16, n, 2);
+        } else {
+            putBE(msgp::array32, n, 4);
+        }
+    }
+
+    void appendMapHeader(uint32_t n) {
+        if (n < 16) {
+            buf.push_back(static_cast<uint8_t>(0x80 | n));
+        } else if (n <= 0xffff) {
+            putBE(msgp::map16, n, 2);
+        } else {
+            putBE(msgp::map32, n, 4);
+        }
+    }
+
+    // Always 5 bytes, for values of a fixed position like checksums.
+    void appendUint32(uint32_t v) { putBE(msgp::uint32, v, 4); }
+
+    size_t size() const { return buf.size(); }
+
+private:
+    void putBE(uint8_t tag, uint64_t v, int bytes) {
+        buf.push_back(tag);
+        for (int i = bytes - 1; i >= 0; --i) {
+            buf.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+private:
+    std::vector<uint8_t>&   buf;
+};
+
+// MsgpReader decodes MessagePack values in place, strings and binaries
+// are views into the buffer. The first malformed or mistyped value sets
+// error() to errFileCorrupt, reads after that return zero values.
+class MsgpReader {
+
+public:
+    MsgpReader(const uint8_t* data, size_t len) : p(data), end(data + len) {}
+    explicit MsgpReader(std::span<const uint8_t> b) : MsgpReader(b.data(), b.size()) {}
+
+    const Error& error() const { return err; }
+    bool ok() const { return !err; }
+    const uint8_t* position() const { return p; }
+    size_t remaining() const { return static_cast<size_t>(end - p); }
+
+    // Consumes a nil if one is next.
+    bool readNil() {
+        if (!err && p < end && *p == msgp::nil) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    bool readBool() {
+        auto t = tag();
+        if (t == msgp::trueTag || t == msgp::falseTag) {
+            return t == msgp::trueTag;
+        }
+        return fail<bool>();
+    }
+
+    uint64_t readUint() {
+        auto t = tag();
+        if (t < 0x80) {
+            return t;
+        }
+        switch (t) {
+        case msgp::uint8:  return getBE(1);
+        case msgp::uint16: return getBE(2);
+        case msgp::uint32: return getBE(4);
+        case msgp::uint64: return getBE(8);
+        }
+        // Go encoders pick signed types for non-negative ints too.
+        auto v = signedValue(t);
+        return v >= 0 ? static_cast<uint64_t>(v) : fail<uint64_t>();
+    }
+
+    int64_t readInt() {
+        auto t = tag();
+        if (t < 0x80) {
+            return t;
+        }
+        switch (t) {
+        case msgp::uint8:  return static_cast<int64_t>(getBE(1));
+        case msgp::uint16: return static_cast<int64_t>(getBE(2));
+        case msgp::uint32: return static_cast<int64_t>(getBE(4));
+        case msgp::uint64: {
+            auto v = getBE(8);
+            return v <= INT64_MAX ? static_cast<int64_t>(v) : fail<int64_t>();
+        }
+        }
+        return signedValue(t);
+    }
+
+    std::string_view readString() {
+        auto t = tag();
+        size_t n = 0;
+        if ((t & 0xe0) == 0xa0) {
+            n = t & 0x1f;
+        } else if (t == msgp::str8) {
+            n = getBE(1);
+        } else if (t == msgp::str16) {
+            n = getBE(2);
+        } else if (t == msgp::str32) {
+            n = getBE(4);
+        } else if (t == msgp::nil) {
+            return {};
+        } else {
+            return fail<std::string_view>();
+        }
+        auto b = take(n);
+        return {reinterpret_cast<const char*>(b), b ? n : 0};
+    }
+
+    std::span<const uint8_t> readBytes() {
+        auto t = tag();
+        size_t n = 0;
+        if (t == msgp::bin8) {
+            n = getBE(1);
+        } else if (t == msgp::bin16) {
+            n = getBE(2);
+        } else if (t == msgp::bin32) {
+            n = getBE(4);
+        } else if (t == msgp::nil) {
+            return {};
+        } else {
+            return fail<std::span<const uint8_t>>();
+        }
+        auto b = take(n);
+        return {b, b ? n : 0};
+    }
+
+    // Array and map sizes are checked against the bytes left, callers
+    // may size containers by them.
+    uint32_t readArrayHeader() {
+        auto t = tag();
+        uint64_t n = 0;
+        if ((t & 0xf0) == 0x90) {
+            n = t & 0x0f;
+        } else if (t == msgp::array16) {
+            n = getBE(2);
+        } else if (t == msgp::array32) {
+            n = getBE(4);
+        } else if (t != msgp::nil) {
+            return fail<uint32_t>();
+        }
+        return n <= remaining() ? static_cast<uint32_t>(n) : fail<uint32_t>();
+    }
+
+    uint32_t readMapHeader() {
+        auto t = tag();
+        uint64_t n = 0;
+        if ((t & 0xf0) == 0x80) {
+            n = t & 0x0f;
+        } else if (t == msgp::map16) {
+            n = getBE(2);
+        } else if (t == msgp::map32) {
+            n = getBE(4);
+        } else if (t != msgp::nil) {
+            return fail<uint32_t>();
+        }
+        return 2 * n <= remaining() ? static_cast<uint32_t>(n) : fail<uint32_t>();
+    }
+
+    // Skips the next value, with everything nested in it.
+    void skip() {
+        size_t pending = 1;
+        while (pending > 0 && !err) {
+            --pending;
+            auto t = tag();
+            if (t < 0x80 || t >= 0xe0 || t == msgp::nil || t == msgp::falseTag || t == msgp::trueTag) {
+                continue;
+            }
+            if ((t & 0xf0) == 0x80) {
+                pending += 2 * static_cast<size_t>(t & 0x0f);
+            } else if ((t & 0xf0) == 0x90) {
+                pending += t & 0x0f;
+            } else if ((t & 0xe0) == 0xa0) {
+                take(t & 0x1f);
+            } else {
+                switch (t) {
+                case msgp::uint8: case msgp::int8:      take(1); break;
+                case msgp::uint16: case msgp::int16:    take(2); break;
+                case msgp::uint32: case msgp::int32:
+                case msgp::float32:                     take(4); break;
+                case msgp::uint64: case msgp::int64:
+                case msgp::float64:                     take(8); break;
+                case msgp::bin8: case msgp::str8:       take(getBE(1)); break;
+                case msgp::bin16: case msgp::str16:     take(getBE(2)); break;
+                case msgp::bin32: case msgp::str32:     take(getBE(4)); break;
+                case msgp::ext8:                        take(getBE(1) + 1); break;
+                case msgp::ext16:                       take(getBE(2) + 1); break;
+                case msgp::ext32:                       take(getBE(4) + 1); break;
+                case msgp::array16:                     pending += getBE(2); break;
+                case msgp::array32:                     pending += getBE(4); break;
+                case msgp::map16:                       pending += 2 * getBE(2); break;
+                case msgp::map32:                       pending += 2 * getBE(4); break;
+                default:
+                    if (t >= msgp::fixext1 && t <= msgp::fixext16) {
+                        take((size_t{1} << (t - msgp::fixext1)) + 1);
+                    } else {
+                        fail<int>();
+                    }
+                }
+            }
+            // A corrupt count must not keep us spinning.
+            if (pending > remaining()) {
+                fail<int>();
+            }
+        }
+    }
+
+private:
+    template <typename T>
+    T fail() {
+        if (!err) {
+            err = errFileCorrupt;
+        }
+        p = end;
+        return T{};
+    }
+
+    uint8_t tag() {
+        if (err || p >= end) {
+            return fail<uint8_t>();
+        }
+        return *p++;
+    }
+
+    const uint8_t* take(size_t n) {
+        if (err || n > remaining()) {
+            return fail<const uint8_t*>();
+        }
+        auto b = p;
+        p += n;
+        return b;
+    }
+
+    uint64_t getBE(int bytes) {
+        auto b = take(static_cast<size_t>(bytes));
+        uint64_t v = 0;
+        for (int i = 0; b && i < bytes; ++i) {
+            v = (v << 8) | b[i];
+        }
+        return v;
+    }
+
+    int64_t signedValue(uint8_t t) {
+        if (t >= 0xe0) {
+            return static_cast<int8_t>(t);
+        }
+        switch (t) {
+        case msgp::int8:  return static_cast<int8_t>(getBE(1));
+        case msgp::int16: return static_cast<int16_t>(getBE(2));
+        case msgp::int32: return static_cast<int32_t>(getBE(4));
+        case msgp::int64: return static_cast<int64_t>(getBE(8));
+        }
+        return fail<int64_t>();
+    }
+
+private:
+    const uint8_t*  p;
+    const uint8_t*  end;
+    Error           err;
+};
+
+}
+
+#endif // CPPIO_MSGP_HPP
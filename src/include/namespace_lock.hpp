@@ -0,0 +1,118 @@
+#ifndef CPPIO_NAMESPACE_LOCK_HPP
+#define CPPIO_NAMESPACE_LOCK_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.hpp"
+#include "context.hpp"
+
+namespace cppio {
+
+// Error codes of namespace locking.
+enum NsLockErrorCode {
+    errCodeOperationTimedOut = 1300,
+};
+
+// errOperationTimedOut - a lock was not granted in time.
+extern const Error errOperationTimedOut;
+
+struct NsLockMapOptions {
+    unsigned    shards      = 256;      // rounded up to a power of two
+};
+
+struct NsLockStats {
+    uint64_t    locks       = 0;        // write locks granted
+    uint64_t    rlocks      = 0;        // read locks granted
+    uint64_t    contended   = 0;        // grants that had to wait
+    uint64_t    timeouts    = 0;
+    uint64_t    canceled    = 0;
+    uint64_t    waitTime    = 0;        // nanoseconds waited by all grants
+    uint64_t    maxWaitTime = 0;        // nanoseconds, longest single wait
+    uint64_t    held        = 0;        // paths locked or waited for now
+};
+
+// nsLockMap - the local namespace lock, a read/write lock per volume and
+// path. Paths hash to one of many shards with a mutex each, locking
+// unrelated objects rarely touches the same mutex, let alone waits.
+//
+// Locks are fair: requests are granted in arrival order, a reader comes
+// after a writer that waits before it, so writers do not starve under a
+// stream of readers.
+//
+// A path only has an entry while it is locked or waited for. Entries are
+// recycled through a free list of their shard and waiters live on the
+// stack of the waiting call, taking a lock does not allocate once the
+// shards are warm.
+class nsLockMap {
+
+public:
+    explicit nsLockMap(const NsLockMapOptions& opts = NsLockMapOptions{});
+    ~nsLockMap();
+
+    nsLockMap(const nsLockMap&) = delete;
+    nsLockMap& operator=(const nsLockMap&) = delete;
+
+    // Takes the write lock of volume/path, waiting up to 'timeout'.
+    // Returns errOperationTimedOut, or an error once 'ctx' got canceled.
+    Error lock(Context& ctx, std::string_view volume, std::string_view path, std::chrono::milliseconds timeout);
+    // Takes a read lock of volume/path, like lock.
+    Error rlock(Context& ctx, std::string_view volume, std::string_view path, std::chrono::milliseconds timeout);
+
+    void unlock(std::string_view volume, std::string_view path);
+    void runlock(std::string_view volume, std::string_view path);
+
+    // Returns the counters of all shards, summed.
+    NsLockStats stats() const;
+
+private:
+    struct Entry;
+    struct Waiter;
+    struct Shard;
+
+    Error acquire(Context& ctx, std::string_view volume, std::string_view path, bool write,
+                  std::chrono::milliseconds timeout);
+    void release(std::string_view volume, std::string_view path, bool write);
+
+    std::unique_ptr<Shard[]>    shards;
+    size_t                      shardMask;
+};
+
+// NsLock - a lock of several paths of a volume, MinIO's RWLocker. Paths
+// are locked in lexical order, lockers of overlapping paths never
+// deadlock; what is held is released when the NsLock goes.
+class NsLock {
+
+public:
+    NsLock(nsLockMap& map, std::string volume, std::vector<std::string> paths);
+    ~NsLock() { unlock(); }
+
+    NsLock(const NsLock&) = delete;
+    NsLock& operator=(const NsLock&) = delete;
+
+    // Takes the write locks of all paths within 'timeout', or none.
+    Error getLock(Context& ctx, std::chrono::milliseconds timeout);
+    // Takes read locks of all paths within 'timeout', or none.
+    Error getRLock(Context& ctx, std::chrono::milliseconds timeout);
+    // Releases the locks taken, if any.
+    void unlock();
+
+private:
+    Error take(Context& ctx, std::chrono::milliseconds timeout, bool write);
+
+    nsLockMap&                  map;
+    std::string                 volume;
+    std::vector<std::string>    paths;
+    size_t                      held = 0;       // paths[0, held) are locked
+    bool                        write = false;
+};
+
+}
+
+#endif // CPPIO_NAMESPACE_LOCK_HPP
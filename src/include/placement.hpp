@@ -0,0 +1,93 @@
+#ifndef CPPIO_PLACEMENT_HPP
+#define CPPIO_PLACEMENT_HPP
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "storage_datatypes.hpp"
+
+namespace cppio {
+
+// Distribution algorithms of format.json, the hash picking the erasure
+// set of an object.
+constexpr std::string_view formatErasureVersionV2DistributionAlgoV1 = "CRCMOD";
+constexpr std::string_view formatErasureVersionV3DistributionAlgoV2 = "SIPMOD";
+constexpr std::string_view formatErasureVersionV3DistributionAlgoV3 = "SIPMOD+PARITY";
+
+// Returns SipHash-2-4 of 'data' under the key k0, k1.
+uint64_t sipHash24(uint64_t k0, uint64_t k1, std::string_view data);
+
+// Returns the set index of 'key' out of 'cardinality' sets, -1 for no sets.
+int crcHashMod(std::string_view key, int cardinality);
+int sipHashMod(std::string_view key, int cardinality, const std::array<uint8_t, 16>& id);
+
+// SetPlacement - the routing table of one pool, maps object names to
+// erasure sets the way its format.json says. The SipHash key schedule
+// of the deployment is computed once, placing an object hashes its
+// name and nothing else: no allocation, no locking.
+class SetPlacement {
+
+public:
+    SetPlacement() = default;
+    // Unknown algorithms fall back to CRCMOD, like formats predating
+    // the field.
+    SetPlacement(std::string_view distributionAlgo, const std::array<uint8_t, 16>& deploymentID, int setCount);
+
+    // Returns the set index of 'object', -1 for no sets.
+    int setIndex(std::string_view object) const;
+
+    int setCount() const { return static_cast<int>(sets); }
+
+private:
+    bool        crc = true;
+    uint64_t    sets = 0;
+    // SipHash state after keying.
+    uint64_t    v0 = 0;
+    uint64_t    v1 = 0;
+    uint64_t    v2 = 0;
+    uint64_t    v3 = 0;
+};
+
+// Returns the bytes a set can take for an object of 'size' bytes erasure
+// coded with 'dataBlocks' data shards, from the DiskInfo of its drives.
+// Every drive gets a size/dataBlocks shard: 0 when a drive has no room for
+// it, the shards would fill the set beyond diskFillFraction or a drive has
+// fewer than diskMinInodes free inodes. Offline drives, with total 0, do
+// not count.
+uint64_t setAvailableSpace(const std::vector<DiskInfo>& disks, uint64_t size, int dataBlocks);
+
+// Returns a pool index chosen at random, weighted by 'available', or -1
+// when no pool has space. 'random' is any uniformly distributed value.
+int choosePool(std::span<const uint64_t> available, uint64_t random);
+
+// PoolPlacement - the routing tables of all pools of a deployment, side
+// by side, and the pool choice for new objects.
+class PoolPlacement {
+
+public:
+    PoolPlacement() = default;
+    PoolPlacement(std::string_view distributionAlgo, const std::array<uint8_t, 16>& deploymentID,
+                  const std::vector<int>& setCounts);
+    // Pools with formats of their own, a table per pool.
+    explicit PoolPlacement(std::vector<SetPlacement> tables);
+
+    // Returns the set index of 'object' in 'pool'.
+    int setIndex(int pool, std::string_view object) const { return tables[static_cast<size_t>(pool)].setIndex(object); }
+
+    // Picks the pool of a new object, weighted by the space each pool
+    // has for it, -1 when none has.
+    int choosePool(std::span<const uint64_t> available) const;
+
+    int pools() const { return static_cast<int>(tables.size()); }
+    const SetPlacement& pool(int i) const { return tables[static_cast<size_t>(i)]; }
+
+private:
+    std::vector<SetPlacement> tables;
+};
+
+}
+
+#endif // CPPIO_PLACEMENT_HPP
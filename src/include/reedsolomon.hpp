@@ -0,0 +1,97 @@
+#ifndef CPPIO_REEDSOLOMON_HPP
+#define CPPIO_REEDSOLOMON_HPP
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "error.hpp"
+
+namespace cppio {
+
+// Error codes of the erasure codec.
+enum ReedSolomonErrorCode {
+    errCodeInvShardNum = 1100,
+    errCodeTooFewShards,
+    errCodeShortData,
+    errCodeShardSize,
+};
+
+extern const Error errInvShardNum;
+extern const Error errTooFewShards;
+extern const Error errShortData;
+extern const Error errShardSize;
+
+// GfCoeff is a coefficient of a coding matrix together with the lookup
+// tables of the multiply kernels: the products of its low and high nibbles
+// for the shuffle based kernels, and the 8x8 bit matrix for GFNI.
+struct GfCoeff {
+    uint8_t     lo[16];
+    uint8_t     hi[16];
+    uint64_t    affine  = 0;
+    uint8_t     value   = 0;
+};
+
+// GfMatrix is a rows x cols coding matrix, ready for the kernels.
+struct GfMatrix {
+    int                     rows = 0;
+    int                     cols = 0;
+    std::vector<GfCoeff>    coeffs;     // row major
+};
+
+// ReedSolomon is a systematic Reed-Solomon codec over GF(2^8), built from
+// a Vandermonde matrix exactly as github.com/klauspost/reedsolomon does,
+// so shards stay compatible with erasure coded data written by MinIO.
+//
+// The multiply kernels are picked at runtime from what the CPU supports:
+// GFNI (AVX-512 or AVX2), AVX-512BW, AVX2, SSSE3 or a scalar fallback.
+class ReedSolomon {
+
+public:
+    // 'kernel' forces one of kernels(), the fastest one is used when empty.
+    // Throws std::invalid_argument for shard counts the codec can not do.
+    ReedSolomon(int dataShards, int parityShards, const std::string& kernel = "");
+
+    ReedSolomon(const ReedSolomon&) = delete;
+    ReedSolomon& operator=(const ReedSolomon&) = delete;
+
+    int dataShards() const { return dataShardsCount; }
+    int parityShards() const { return parityShardsCount; }
+    int totalShards() const { return dataShardsCount + parityShardsCount; }
+    const char* kernel() const;
+
+    // Computes the parity shards from the data shards. 'shards' holds
+    // totalShards() buffers of shardSize bytes each, data shards first.
+    void encode(uint8_t* const* shards, size_t shardSize) const;
+
+    // Rebuilds the shards not marked in 'present' from any dataShards()
+    // present ones. With 'dataOnly' missing parity shards are left alone.
+    // Buffers of missing shards must be allocated, they are overwritten.
+    Error reconstruct(uint8_t* const* shards, const std::vector<bool>& present, size_t shardSize, bool dataOnly) const;
+
+    // Names of the kernels usable on this CPU, fastest first.
+    static std::vector<std::string> kernels();
+
+private:
+    // Decode matrix of the data shards from the given present rows.
+    std::shared_ptr<const GfMatrix> decodeMatrix(const std::vector<int>& rows) const;
+
+private:
+    int                     dataShardsCount;
+    int                     parityShardsCount;
+    int                     kernelIndex;
+    std::vector<uint8_t>    encodeMatrix;   // totalShards x dataShards
+    GfMatrix                parity;         // parity rows of encodeMatrix
+
+    // Degraded reads of a set keep hitting the same few patterns of
+    // missing drives, inverting the matrix once per pattern is enough.
+    mutable std::mutex                                                  cacheMu;
+    mutable std::map<std::vector<int>, std::shared_ptr<const GfMatrix>> decodeCache;
+};
+
+}
+
+#endif // CPPIO_REEDSOLOMON_HPP
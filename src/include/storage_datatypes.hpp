@@ -1,6 +1,7 @@
 #ifndef CPPIO_STORAGE_DATATYPES_HPP
 #define CPPIO_STORAGE_DATATYPES_HPP
 
+#include <array>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -12,6 +13,7 @@
 #include <boost/property_tree/json_parser.hpp>
 
 #include "last_minute.hpp"
+#include "storage_metrics.hpp"
 #include "xl_storage_format_v1.hpp"
 
 using namespace boost::property_tree;
@@ -19,18 +21,29 @@ using namespace boost::property_tree;
 namespace cppio {
 
 // DiskMetrics has the information about XL Storage APIs
-// the number of calls of each API and the moving average of
-// the duration of each API.
+// the number of calls of each API by size, the latency
+// histogram of each API and its latency of the last minute,
+// indexed by StorageMetric.
 struct DiskMetrics {
-    std::unordered_map<std::string, AccElem> lastMinute;
-    std::unordered_map<std::string, uint64_t> apiCalls;
+    std::array<AccElem, storageMetricLast> lastMinute{};
+    std::array<LatencyHistogram, storageMetricLast> apiLatencies{};
+    std::array<std::array<uint64_t, sizeLastElemMarker>, storageMetricLast> apiCalls{};
     uint32_t totalWaiting = 0;
     uint64_t totalErrorsAvailability = 0;
     uint64_t totalErrorsTimeout = 0;
     uint64_t totalWrites = 0;
     uint64_t totalDeletes = 0;
 
-    // Serialization to JSON
+    // Returns the calls of 'metric' of all sizes.
+    uint64_t calls(StorageMetric metric) const {
+        uint64_t n = 0;
+        for (auto c : apiCalls[metric]) {
+            n += c;
+        }
+        return n;
+    }
+
+    // Serialization to JSON, APIs without calls are left out.
     void toJson(std::ostream& out) const {
         ptree pt;
         pt.put("apiLatencies.totalWaiting", totalWaiting);
@@ -39,12 +52,32 @@ struct DiskMetrics {
         pt.put("apiLatencies.totalWrites", totalWrites);
         pt.put("apiLatencies.totalDeletes", totalDeletes);
 
-        for (const auto& elem : lastMinute) {
-            pt.put("apiLatencies." + elem.first, elem.second);
-        }
-
-        for (const auto& elem : apiCalls) {
-            pt.put("apiCalls." + elem.first, elem.second);
+        for (size_t m = 0; m < storageMetricLast; ++m) {
+            const auto& h = apiLatencies[m];
+            if (h.n == 0) {
+                continue;
+            }
+            std::string name = storageMetricName(static_cast<StorageMetric>(m));
+            if (lastMinute[m].n) {
+                pt.put("lastMinute." + name + ".total", lastMinute[m].total);
+                pt.put("lastMinute." + name + ".size", lastMinute[m].size);
+                pt.put("lastMinute." + name + ".n", lastMinute[m].n);
+            }
+            pt.put("apiLatencies." + name + ".total", h.total);
+            pt.put("apiLatencies." + name + ".n", h.n);
+            pt.put("apiLatencies." + name + ".p50", h.quantile(0.5).count());
+            pt.put("apiLatencies." + name + ".p99", h.quantile(0.99).count());
+            pt.put("apiLatencies." + name + ".p999", h.quantile(0.999).count());
+            for (size_t b = 0; b < latencyBuckets; ++b) {
+                if (h.counts[b]) {
+                    pt.put("apiLatencies." + name + ".histogram." + std::to_string(b), h.counts[b]);
+                }
+            }
+            for (size_t t = 0; t < sizeLastElemMarker; ++t) {
+                if (apiCalls[m][t]) {
+                    pt.put("apiCalls." + name + "." + sizeTagToString(static_cast<SizeTag>(t)), apiCalls[m][t]);
+                }
+            }
         }
 
         write_json(out, pt);
@@ -61,18 +94,33 @@ struct DiskMetrics {
         totalWrites = pt.get<uint64_t>("apiLatencies.totalWrites", 0);
         totalDeletes = pt.get<uint64_t>("apiLatencies.totalDeletes", 0);
 
-        for (const auto& kv : pt.get_child("apiLatencies")) {
-            if (kv.first != "totalWaiting" &&
-                kv.first != "totalErrsAvailability" &&
-                kv.first != "totalErrsTimeout" &&
-                kv.first != "totalWrites" &&
-                kv.first != "totalDeletes") {
-                lastMinute[kv.first] = kv.second.get_value<AccElem>();
+        lastMinute = {};
+        apiLatencies = {};
+        apiCalls = {};
+        for (size_t m = 0; m < storageMetricLast; ++m) {
+            std::string name = storageMetricName(static_cast<StorageMetric>(m));
+            if (auto api = pt.get_child_optional("lastMinute." + name)) {
+                lastMinute[m] = AccElem{api->get<uint64_t>("total", 0), api->get<uint64_t>("size", 0),
+                                        api->get<uint64_t>("n", 0)};
+            }
+            if (auto api = pt.get_child_optional("apiLatencies." + name)) {
+                auto& h = apiLatencies[m];
+                h.total = api->get<uint64_t>("total", 0);
+                h.n = api->get<uint64_t>("n", 0);
+                if (auto histogram = api->get_child_optional("histogram")) {
+                    for (const auto& kv : *histogram) {
+                        auto b = std::stoul(kv.first);
+                        if (b < latencyBuckets) {
+                            h.counts[b] = kv.second.get_value<uint64_t>();
+                        }
+                    }
+                }
+            }
+            if (auto calls = pt.get_child_optional("apiCalls." + name)) {
+                for (size_t t = 0; t < sizeLastElemMarker; ++t) {
+                    apiCalls[m][t] = calls->get<uint64_t>(sizeTagToString(static_cast<SizeTag>(t)), 0);
+                }
             }
-        }
-
-        for (const auto& kv : pt.get_child("apiCalls")) {
-            apiCalls[kv.first] = kv.second.get_value<uint64_t>();
         }
     }
 };
@@ -117,8 +165,7 @@ struct VolInfo {
 };
 
 // VolsInfo is a collection of volume(bucket) information
-typedef std::vector<VolInfo> VolsInfo
-
+typedef std::vector<VolInfo> VolsInfo;
 
 
 // RawFileInfo - represents raw file stat information as byte array.
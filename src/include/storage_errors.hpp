@@ -0,0 +1,85 @@
+#ifndef CPPIO_STORAGE_ERRORS_HPP
+#define CPPIO_STORAGE_ERRORS_HPP
+
+#include <stdexcept>
+
+#include "error.hpp"
+
+namespace cppio {
+
+// Error codes of storage layer errors.
+enum StorageErrorCode {
+    errCodeUnexpected = 1000,
+    errCodeNotImplemented,
+    errCodeInvalidArgument,
+    errCodeCorruptedFormat,
+    errCodeUnformattedDisk,
+    errCodeDiskNotFound,
+    errCodeFaultyDisk,
+    errCodeDiskFull,
+    errCodeDiskAccessDenied,
+    errCodeDiskNotDir,
+    errCodeVolumeNotFound,
+    errCodeVolumeExists,
+    errCodeVolumeNotEmpty,
+    errCodeVolumeAccessDenied,
+    errCodeFileNotFound,
+    errCodeFileNameTooLong,
+    errCodeFileAccessDenied,
+    errCodeIsNotRegular,
+    errCodePathNotFound,
+    errCodeLessData,
+    errCodeMoreData,
+    errCodeDiskOngoingReq,
+    errCodeFileCorrupt,
+    errCodeFileVersionNotFound,
+};
+
+// Storage errors are shared instances, compare them by identity like
+// sentinel errors: 'if (err == errFileNotFound)'.
+extern const Error errUnexpected;
+extern const Error errNotImplemented;
+extern const Error errInvalidArgument;
+extern const Error errCorruptedFormat;
+extern const Error errUnformattedDisk;
+extern const Error errDiskNotFound;
+extern const Error errFaultyDisk;
+extern const Error errDiskFull;
+extern const Error errDiskAccessDenied;
+extern const Error errDiskNotDir;
+extern const Error errVolumeNotFound;
+extern const Error errVolumeExists;
+extern const Error errVolumeNotEmpty;
+extern const Error errVolumeAccessDenied;
+extern const Error errFileNotFound;
+extern const Error errFileNameTooLong;
+extern const Error errFileAccessDenied;
+extern const Error errIsNotRegular;
+extern const Error errPathNotFound;
+extern const Error errLessData;
+extern const Error errMoreData;
+extern const Error errDiskOngoingReq;
+extern const Error errFileCorrupt;
+extern const Error errFileVersionNotFound;
+
+// StorageError is thrown by StorageAPI calls which do not return an Error.
+class StorageError : public std::runtime_error {
+
+public:
+    explicit StorageError(Error err) : std::runtime_error(err->msg), err(std::move(err)) {}
+
+    const Error& error() const { return err; }
+
+private:
+    Error err;
+};
+
+// Maps an errno of a file operation to its storage error.
+Error osErrToFileErr(int errnum);
+
+// Maps an errno of a volume (directory) operation to its storage error.
+Error osErrToVolErr(int errnum);
+
+}
+
+#endif // CPPIO_STORAGE_ERRORS_HPP
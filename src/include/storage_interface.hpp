@@ -7,9 +7,15 @@
 #include <iostream>
 #include <functional>
 #include <mutex>
+#include <memory>
 
+#include "error.hpp"
+#include "bitrot.hpp"
+#include "context.hpp"
 #include "endpoint.hpp"
-#include "goincpp/io/writer.hpp"
+#include "file_range.hpp"
+#include "metacache.hpp"
+#include "storage_datatypes.hpp"
 
 namespace cppio {
 
@@ -18,32 +24,53 @@ class nsLockMap;
 namespace dsync {
     struct NetLocker;
 }
+struct DataUsageCache;
+struct dataUsageEntry;
+namespace madmin {
+    enum HealScanMode : int;
+}
 
-// Define the healingTracker struct
-struct healingTracker {};
-
-// Define the DiskInfo and DiskInfoOptions structs
-struct DiskInfo {};
-struct DiskInfoOptions {};
+// Define the HealingTracker struct
+struct HealingTracker {};
 
-// Define the FileInfo and FileInfoVersions structs
-struct FileInfo {};
-struct FileInfoVersions {};
+// Define the DiskInfoOptions struct
+struct DiskInfoOptions {
+    bool metrics = false;   // fill DiskInfo::metrics
+};
 
-// Define the RawFileInfo struct
-struct RawFileInfo {};
+// FileInfoVersions - versions of one object deleted together by
+// deleteVersions.
+struct FileInfoVersions {
+    std::string volume;                 // Volume of the object
+    std::string name;                   // Name of the object
+    std::vector<FileInfo> versions;     // Versions to delete, delete markers to add
+};
 
-// Define the BitrotVerifier struct
-struct BitrotVerifier {};
+// BitrotVerifier - verifies shard files with streaming bitrot protection,
+// where a checksum precedes every shardSize bytes of shard data.
+struct BitrotVerifier {
+    BitrotAlgorithm algorithm = defaultBitrotAlgorithm;
+    int64_t shardSize = 0;
+};
 
-// Define the StatInfo struct
-struct StatInfo {};
+// StatInfo - carries stat information of the file.
+struct StatInfo {
+    std::string name;
+    int64_t size = 0;
+    std::chrono::system_clock::time_point modTime;
+    uint32_t mode = 0;
+    bool dir = false;
+};
 
-// Define the ReadOptions struct
-struct ReadOptions {};
+// ReadOptions - options for readVersion.
+struct ReadOptions {
+    bool readData = false;      // return the inline data of the version in FileInfo::data
+};
 
-// Define the DeleteOptions struct
-struct DeleteOptions {};
+// DeleteOptions - options for deletePath.
+struct DeleteOptions {
+    bool recursive = false;     // delete a directory with its contents
+};
 
 // Define the UpdateMetadataOpts struct
 struct UpdateMetadataOpts {};
@@ -51,12 +78,38 @@ struct UpdateMetadataOpts {};
 // Define the RenameOptions struct
 struct RenameOptions {};
 
-// Define the WalkDirOptions struct
-struct WalkDirOptions {};
+// WalkDirOptions - options for walkDir.
+struct WalkDirOptions {
+    std::string bucket;                 // volume to walk
+    std::string baseDir;                // directory to walk, empty or ending with a slash
+    bool recursive = false;             // walk below baseDir, otherwise its directories are entries
+    bool reportNotFound = false;        // errFileNotFound when baseDir does not exist
+    std::string filterPrefix;           // only entries of baseDir starting with this
+    std::string forwardTo;              // skip entries sorting before this full name
+    int limit = 0;                      // stop after this many objects, 0 is all
+};
+
+// ReadMultipleReq - files to read with a single readMultiple call.
+struct ReadMultipleReq {
+    std::string bucket;                 // empty if files start with their bucket
+    std::string prefix;                 // shared prefix, joined to every file name
+    std::vector<std::string> files;
+    int64_t maxSize = 0;                // files larger than this fail with errMoreData, 0 is no limit
+    bool metadataOnly = false;          // xl.meta files, truncate their inline data
+    bool abortOn404 = false;            // stop at the first file not found
+    int maxResults = 0;                 // stop after this many files read, 0 is all
+};
 
-// Define the ReadMultipleReq and ReadMultipleResp structs
-struct ReadMultipleReq {};
-struct ReadMultipleResp {};
+// ReadMultipleResp - a file of ReadMultipleReq, in request order.
+struct ReadMultipleResp {
+    std::string bucket;
+    std::string prefix;
+    std::string file;
+    bool exists = false;
+    Error error;                        // set when the file could not be read
+    std::vector<uint8_t> data;
+    std::chrono::system_clock::time_point modTime;
+};
 
 // StorageAPI interface.
 class StorageAPI {
@@ -93,6 +146,11 @@ public:
 	// has never been replaced.
     virtual const HealingTracker* healing() const = 0;
     virtual DiskInfo diskInfo(const DiskInfoOptions& opts) = 0;
+    // Average ReadFile latency of the last minute, zero when unknown.
+    // Cheap enough to ask on every read.
+    virtual std::chrono::nanoseconds readLatency() const = 0;
+    // Scans the drive for data usage. DataUsageCache has no definition in
+    // this tree yet, drives throw errNotImplemented.
     virtual void nsScanner(DataUsageCache& cache, std::vector<dataUsageEntry>& updates, madmin::HealScanMode scanMode, std::function<bool()> shouldSleep) = 0;
 
     // Volume operations
@@ -102,29 +160,55 @@ public:
     virtual VolInfo statVol(const std::string& volume) = 0;
     virtual void deleteVol(const std::string& volume, bool forcedelete) = 0;
 
-    Error walkDir(WalkDirOptions opts, goincpp::io::Writer wr);
+    // Streams the objects and directories below opts.baseDir to 'fn' in
+    // lexical order, objects with their xl.meta. Returns once 'fn' returns
+    // false, the walk is done or failed.
+    virtual Error walkDir(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn) = 0;
 
     // Metadata operations
     virtual Error deleteVersion(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, bool forceDelMarker, const DeleteOptions& opts) = 0;
+    // deleteVersion of every entry of 'versions', xl.meta of an object is
+    // read and written once. Errors are indexed like 'versions'.
     virtual std::vector<Error> deleteVersions(Context& ctx, const std::string& volume, const std::vector<FileInfoVersions>& versions, const DeleteOptions& opts) = 0;
     virtual Error writeMetadata(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const FileInfo& fi) = 0;
     virtual Error updateMetadata(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, const UpdateMetadataOpts& opts) = 0;
     virtual FileInfo readVersion(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const std::string& versionID, const ReadOptions& opts) = 0;
     virtual RawFileInfo readXL(Context& ctx, const std::string& volume, const std::string& path, bool readData) = 0;
+    // Moves the data dir of 'fi' from srcVolume/srcPath to the object at
+    // dstVolume/dstPath and adds 'fi' to its xl.meta, replacing a version
+    // of the same versionID. Returns a signature of the version written,
+    // equal on drives that wrote the same version.
     virtual uint64_t renameData(Context& ctx, const std::string& srcVolume, const std::string& srcPath, const FileInfo& fi, const std::string& dstVolume, const std::string& dstPath, const RenameOptions& opts) = 0;
 
     // File operations
     virtual std::vector<std::string> listDir(const std::string& volume, const std::string& dirpath, int count) = 0;
+    // Reads buf.size() bytes at offset, short only at end of file. With a
+    // verifier offset and sizes count shard data without the checksums,
+    // offset starts a chunk and every chunk read is verified, a mismatch
+    // throws errFileCorrupt.
     virtual int64_t readFile(const std::string& volume, const std::string& path, int64_t offset, std::vector<uint8_t>& buf, const BitrotVerifier* verifier) = 0;
     virtual void appendFile(const std::string& volume, const std::string& path, const std::vector<uint8_t>& buf) = 0;
     virtual void createFile(const std::string& volume, const std::string& path, int64_t size, std::istream& reader) = 0;
-    virtual std::istream& readfileStream(const std::string& volume, const std::string& path, int64_t offset, int64_t length) = 0;
+    virtual std::unique_ptr<std::istream> readfileStream(const std::string& volume, const std::string& path, int64_t offset, int64_t length) = 0;
+    // Opens a range of a file for zero-copy transfer (sendfile/splice), only
+    // local drives can serve it, others return an error and callers must
+    // fall back to readfileStream.
+    virtual Error openFileRange(const std::string& volume, const std::string& path, int64_t offset, int64_t length, FileRange& range) = 0;
     virtual void renameFile(const std::string& srcvolume, const std::string& srcpath, const std::string& dstvolume, const std::string& dstpath) = 0;
+    // Throws errFileNotFound for a part of 'fi' missing from the drive and
+    // errFileCorrupt for one shorter than its shard file.
     virtual void checkParts(const std::string& volume, const std::string& path, const FileInfo& fi) = 0;
-    virtual void delete(const std::string& volume, const std::string& path, const DeleteOptions& opts) = 0;
+    virtual void deletePath(const std::string& volume, const std::string& path, const DeleteOptions& opts) = 0;
+    // Reads every part of 'fi' verifying its bitrot checksums, throws
+    // errFileCorrupt on a mismatch.
     virtual void verifyFile(const std::string& volume, const std::string& path, const FileInfo& fi) = 0;
     virtual std::vector<StatInfo> statInfoFile(const std::string& volume, const std::string& path, bool glob) = 0;
+    // Reads many small files, failures are reported per file in 'resp'.
+    // Responses follow the request order, up to where abortOn404 or
+    // maxResults stopped reading.
     virtual void readMultiple(const ReadMultipleReq& req, std::vector<ReadMultipleResp>& resp) = 0;
+    // Removes the data dirs of the object at volume/path that no version
+    // of its xl.meta refers to.
     virtual void cleanAbandonedData(const std::string& volume, const std::string& path) = 0;
 
     // Write all data, syncs the data to disk.
@@ -133,11 +217,11 @@ public:
     // Read all.
     virtual std::vector<uint8_t> readAll(const std::string& volume, const std::string& path) = 0;
     // Retrieve location indexes.
-    void getDiskLoc(int& poolIdx, int& setIdx, int& diskIdx) = 0;
+    virtual void getDiskLoc(int& poolIdx, int& setIdx, int& diskIdx) = 0;
     // Set location indexes.
-    void setDiskLoc(int poolIdx, int setIdx, int diskIdx) = 0;
+    virtual void setDiskLoc(int poolIdx, int setIdx, int diskIdx) = 0;
     // Set formatData cached value
-    void setFormatData(std::vector<uint8_t> b);
+    virtual void setFormatData(std::vector<uint8_t> b) = 0;
 };
 
 }
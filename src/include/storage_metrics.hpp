@@ -0,0 +1,153 @@
+#ifndef CPPIO_STORAGE_METRICS_HPP
+#define CPPIO_STORAGE_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "last_minute.hpp"
+
+namespace cppio {
+
+struct DiskMetrics;
+
+// StorageMetric - the StorageAPI calls measured per drive.
+enum StorageMetric {
+    storageMetricMakeVolBulk,
+    storageMetricMakeVol,
+    storageMetricListVols,
+    storageMetricStatVol,
+    storageMetricDeleteVol,
+    storageMetricWalkDir,
+    storageMetricListDir,
+    storageMetricReadFile,
+    storageMetricAppendFile,
+    storageMetricCreateFile,
+    storageMetricReadFileStream,
+    storageMetricOpenFileRange,
+    storageMetricRenameFile,
+    storageMetricRenameData,
+    storageMetricCheckParts,
+    storageMetricDelete,
+    storageMetricDeleteVersions,
+    storageMetricVerifyFile,
+    storageMetricWriteAll,
+    storageMetricDeleteVersion,
+    storageMetricWriteMetadata,
+    storageMetricUpdateMetadata,
+    storageMetricReadVersion,
+    storageMetricReadXL,
+    storageMetricReadAll,
+    storageMetricStatInfoFile,
+    storageMetricReadMultiple,
+    storageMetricDeleteAbandonedParts,
+    storageMetricDiskInfo,
+
+    storageMetricLast
+};
+
+// Returns the name of a metric as exported, "ReadFile" for storageMetricReadFile.
+const char* storageMetricName(StorageMetric metric);
+
+// Buckets of a LatencyHistogram: below 1us, then 4 per power of two up
+// to about 137s, the last one open ended.
+constexpr size_t latencyBuckets = 112;
+
+// LatencyHistogram - log-linear histogram of latencies, in the manner of
+// HDR histograms: a bucket is at most a quarter of its lower bound wide,
+// quantiles are within 25% of the exact value.
+struct LatencyHistogram {
+    std::array<uint64_t, latencyBuckets>    counts{};
+    uint64_t                                n = 0;
+    uint64_t                                total = 0;      // nanoseconds of all samples
+
+    // Returns the bucket of a latency.
+    static size_t bucket(uint64_t nanos) {
+        if (nanos < 1024) {
+            return 0;
+        }
+        auto msb = 63 - __builtin_clzll(nanos);
+        auto i = 1 + static_cast<size_t>(msb - 10) * 4 + ((nanos >> (msb - 2)) & 3);
+        return i < latencyBuckets ? i : latencyBuckets - 1;
+    }
+    // Returns the highest latency of a bucket, nanoseconds.
+    static uint64_t bucketUpperBound(size_t i);
+
+    void add(std::chrono::nanoseconds latency);
+    void merge(const LatencyHistogram& other);
+
+    // Returns the latency 'q' of the samples are at or below, 0.99 for
+    // p99; zero without samples.
+    std::chrono::nanoseconds quantile(double q) const;
+    std::chrono::nanoseconds mean() const {
+        return std::chrono::nanoseconds(n ? total / n : 0);
+    }
+};
+
+struct DriveMetricsOptions {
+    unsigned    shards      = 8;        // rounded up to a power of two
+};
+
+// DriveMetrics - the live counters of one drive: the calls of every API
+// by size, their latency histograms and their latencies of the last
+// minute.
+//
+// Recording takes no lock and hashes no string. Counters are relaxed
+// atomics in cache line aligned shards, every thread records into the
+// shard it was assigned on first use, so threads of a busy drive do not
+// bounce the same cache lines. The last minute rings of the APIs are
+// kept per shard as well. snapshot merges the shards.
+class DriveMetrics {
+
+public:
+    explicit DriveMetrics(const DriveMetricsOptions& opts = DriveMetricsOptions{});
+    ~DriveMetrics();
+
+    DriveMetrics(const DriveMetrics&) = delete;
+    DriveMetrics& operator=(const DriveMetrics&) = delete;
+
+    // Records a call of 'metric' moving 'size' bytes.
+    void record(StorageMetric metric, int64_t size, std::chrono::nanoseconds latency);
+
+    // Fills the calls and latencies of 'out'.
+    void snapshot(DiskMetrics& out) const;
+
+    // Latencies of the last minute of 'metric', merged over the shards.
+    AccElem lastMinuteOf(StorageMetric metric) const;
+
+    // Tracker - records a call when it goes out of scope. Calls of
+    // unknown size set it once known.
+    class Tracker {
+
+    public:
+        Tracker(DriveMetrics& metrics, StorageMetric metric, int64_t size)
+            : metrics(metrics), metric(metric), size(size), start(std::chrono::steady_clock::now()) {}
+        ~Tracker() { metrics.record(metric, size, std::chrono::steady_clock::now() - start); }
+
+        Tracker(const Tracker&) = delete;
+        Tracker& operator=(const Tracker&) = delete;
+
+        void setSize(int64_t n) { size = n; }
+
+    private:
+        DriveMetrics&                           metrics;
+        StorageMetric                           metric;
+        int64_t                                 size;
+        std::chrono::steady_clock::time_point   start;
+    };
+
+    Tracker track(StorageMetric metric, int64_t size = 0) { return Tracker(*this, metric, size); }
+
+private:
+    struct Shard;
+
+    std::unique_ptr<Shard[]>                shards;
+    unsigned                                mask = 0;
+};
+
+}
+
+#endif // CPPIO_STORAGE_METRICS_HPP
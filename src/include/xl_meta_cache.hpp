@@ -0,0 +1,131 @@
+#ifndef CPPIO_XL_META_CACHE_HPP
+#define CPPIO_XL_META_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cppio {
+
+struct XLMetaCacheOptions {
+    size_t                      capacity    = 64 * 1024 * 1024;    // bytes, 0 disables the cache
+    unsigned                    shards      = 16;
+    // Entries are dropped this long after being read from the drive, which
+    // bounds how long changes made behind the drive's back go unnoticed.
+    std::chrono::milliseconds   ttl         = std::chrono::seconds(30);
+};
+
+struct XLMetaCacheStats {
+    uint64_t    hits        = 0;
+    uint64_t    misses      = 0;
+    uint64_t    evictions   = 0;
+    uint64_t    invalidations = 0;
+    uint64_t    entries     = 0;
+    uint64_t    bytes       = 0;
+};
+
+// XLMetaCache - the xl.meta of recently read objects of a drive, as read
+// from disk, keyed by volume and object path. All versions of an object
+// live in one xl.meta, so an entry answers any versionID and a write to
+// the object invalidates all of them at once.
+//
+// Keys are hashed to one of several LRU shards with a lock each, the
+// capacity is split evenly between them. Buffers are shared, an entry
+// evicted while being decoded stays valid for the reader holding it.
+//
+// A reader missing the cache takes a ticket before reading the drive and
+// hands it back to put(). Invalidations in between void the ticket, so a
+// read racing a write never caches what the write replaced.
+//
+// Every shard also keeps its keys in order, so dropping a directory, as
+// renames and recursive deletes do, only visits the entries below it.
+// Such invalidations are logged instead of voiding every ticket: put()
+// only refuses keys below a directory dropped since its ticket.
+class XLMetaCache {
+
+public:
+    using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    struct Ticket {
+        uint64_t    generation = 0;     // of the shard
+        uint64_t    subtrees = 0;       // directory invalidations so far
+    };
+
+    explicit XLMetaCache(const XLMetaCacheOptions& opts = XLMetaCacheOptions{});
+
+    XLMetaCache(const XLMetaCache&) = delete;
+    XLMetaCache& operator=(const XLMetaCache&) = delete;
+
+    bool enabled() const { return !shards.empty(); }
+
+    // Returns the cached xl.meta of volume/path, null on a miss.
+    Buffer get(std::string_view volume, std::string_view path);
+
+    // Ticket for a put() of volume/path after a miss.
+    Ticket ticket(std::string_view volume, std::string_view path) const;
+
+    // Caches 'buf' for volume/path unless the ticket was voided.
+    void put(std::string_view volume, std::string_view path, const Ticket& ticket, Buffer buf);
+
+    // Drops the entry of volume/path, with 'subtree' also the entries of
+    // objects below it, which is what removing or renaming a directory
+    // needs. An empty path with 'subtree' drops the whole volume.
+    void invalidate(std::string_view volume, std::string_view path, bool subtree = false);
+
+    XLMetaCacheStats stats() const;
+
+private:
+    struct Entry {
+        Buffer                                      buf;
+        std::chrono::steady_clock::time_point       loaded;
+        std::list<std::string>::iterator            lru;
+    };
+
+    struct Shard {
+        mutable std::mutex                          mu;
+        std::unordered_map<std::string, Entry>      entries;
+        std::set<std::string_view>                  ordered;    // keys of 'entries'
+        std::list<std::string>                      lru;        // most recently used first
+        size_t                                      bytes = 0;
+        // Bumped by every invalidation of a key of the shard, tickets
+        // carry the value at the time of the miss.
+        std::atomic<uint64_t>                       generation{0};
+    };
+
+    static std::string key(std::string_view volume, std::string_view path);
+    Shard& shardOf(const std::string& key) const;
+    static size_t charge(const std::string& key, const Buffer& buf);
+    void erase(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+    // Whether a directory holding 'key' was dropped since 'ticket'.
+    bool subtreeInvalidated(const std::string& key, uint64_t ticket) const;
+
+    // Directory invalidations remembered for put(), tickets older than
+    // all of them are refused.
+    static constexpr size_t subtreeLogSize = 64;
+
+private:
+    std::vector<std::unique_ptr<Shard>>     shards;
+    size_t                                  shardCapacity = 0;
+    std::chrono::milliseconds               ttl;
+
+    std::atomic<uint64_t>                   hits{0};
+    std::atomic<uint64_t>                   misses{0};
+    std::atomic<uint64_t>                   evictions{0};
+    std::atomic<uint64_t>                   invalidations{0};
+
+    mutable std::mutex                      subtreeMu;
+    std::vector<std::string>                subtreeLog;     // key prefixes, by count % subtreeLogSize
+    std::atomic<uint64_t>                   subtreeCount{0};
+};
+
+}
+
+#endif // CPPIO_XL_META_CACHE_HPP
@@ -0,0 +1,163 @@
+#ifndef CPPIO_XL_STORAGE_HPP
+#define CPPIO_XL_STORAGE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+
+#include "storage_interface.hpp"
+#include "storage_errors.hpp"
+#include "disk_info_cache.hpp"
+#include "io_engine.hpp"
+#include "xl_meta_cache.hpp"
+#include "xl_storage_format_v2.hpp"
+
+namespace cppio {
+
+// XLStorageOptions - per drive settings.
+struct XLStorageOptions {
+    IoEngineOptions io;
+    // Write shards of at least odirectThreshold bytes (or of unknown size)
+    // with O_DIRECT, so that streaming large objects does not evict hot
+    // metadata from the page cache. Turned off on filesystems without
+    // O_DIRECT support.
+    bool            odirect             = true;
+    int64_t         odirectThreshold    = 8 * 1024 * 1024;  // 8 MiB
+    // Cache of recently read xl.meta, see XLMetaCache.
+    XLMetaCacheOptions  metaCache;
+    // Capacity reported by diskInfo, see DiskInfoCache.
+    DiskInfoCacheOptions    diskInfo;
+};
+
+// XLStorage - implements StorageAPI on a local drive. All file I/O is
+// handed to the drive's IoEngine: open, read or write and close of a file
+// are submitted as one batch, on io_uring with registered buffers and
+// fixed file slots when the kernel supports it.
+class XLStorage : public StorageAPI {
+
+public:
+    explicit XLStorage(const Endpoint& ep, const XLStorageOptions& opts = XLStorageOptions{});
+
+    std::string string() const override { return drivePath; }
+    bool isOnline() const override;
+    std::chrono::time_point<std::chrono::system_clock> lastConn() const override { return connectedAt; }
+    bool isLocal() const override { return true; }
+    std::string hostname() const override { return ""; }
+    Endpoint endpoint() const override { return ep; }
+    void close() override {}
+    std::string getDiskID() override;
+    void setDiskID(const std::string& id) override;
+    const HealingTracker* healing() const override { return nullptr; }
+    DiskInfo diskInfo(const DiskInfoOptions& opts) override;
+    std::chrono::nanoseconds readLatency() const override { return std::chrono::nanoseconds::zero(); }
+    void nsScanner(DataUsageCache& cache, std::vector<dataUsageEntry>& updates, madmin::HealScanMode scanMode, std::function<bool()> shouldSleep) override;
+
+    // Volume operations
+    void makeVol(const std::string& volume) override;
+    void makeVolBulk(const std::vector<std::string>& volumes) override;
+    std::vector<VolInfo> listVols() override;
+    VolInfo statVol(const std::string& volume) override;
+    void deleteVol(const std::string& volume, bool forcedelete) override;
+
+    Error walkDir(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn) override;
+
+    // Metadata operations
+    Error deleteVersion(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, bool forceDelMarker, const DeleteOptions& opts) override;
+    std::vector<Error> deleteVersions(Context& ctx, const std::string& volume, const std::vector<FileInfoVersions>& versions, const DeleteOptions& opts) override;
+    Error writeMetadata(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const FileInfo& fi) override;
+    Error updateMetadata(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, const UpdateMetadataOpts& opts) override;
+    FileInfo readVersion(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const std::string& versionID, const ReadOptions& opts) override;
+    RawFileInfo readXL(Context& ctx, const std::string& volume, const std::string& path, bool readData) override;
+    uint64_t renameData(Context& ctx, const std::string& srcVolume, const std::string& srcPath, const FileInfo& fi, const std::string& dstVolume, const std::string& dstPath, const RenameOptions& opts) override;
+
+    // File operations
+    std::vector<std::string> listDir(const std::string& volume, const std::string& dirpath, int count) override;
+    int64_t readFile(const std::string& volume, const std::string& path, int64_t offset, std::vector<uint8_t>& buf, const BitrotVerifier* verifier) override;
+    void appendFile(const std::string& volume, const std::string& path, const std::vector<uint8_t>& buf) override;
+    void createFile(const std::string& volume, const std::string& path, int64_t size, std::istream& reader) override;
+    std::unique_ptr<std::istream> readfileStream(const std::string& volume, const std::string& path, int64_t offset, int64_t length) override;
+    Error openFileRange(const std::string& volume, const std::string& path, int64_t offset, int64_t length, FileRange& range) override;
+    void renameFile(const std::string& srcvolume, const std::string& srcpath, const std::string& dstvolume, const std::string& dstpath) override;
+    void checkParts(const std::string& volume, const std::string& path, const FileInfo& fi) override;
+    void deletePath(const std::string& volume, const std::string& path, const DeleteOptions& opts) override;
+    void verifyFile(const std::string& volume, const std::string& path, const FileInfo& fi) override;
+    std::vector<StatInfo> statInfoFile(const std::string& volume, const std::string& path, bool glob) override;
+    void readMultiple(const ReadMultipleReq& req, std::vector<ReadMultipleResp>& resp) override;
+    void cleanAbandonedData(const std::string& volume, const std::string& path) override;
+    void writeAll(const std::string& volume, const std::string& path, const std::vector<uint8_t>& data) override;
+    std::vector<uint8_t> readAll(const std::string& volume, const std::string& path) override;
+    void getDiskLoc(int& poolIdx, int& setIdx, int& diskIdx) override;
+    void setDiskLoc(int poolIdx, int setIdx, int diskIdx) override;
+    void setFormatData(std::vector<uint8_t> b) override;
+
+    const std::shared_ptr<IoEngine>& ioEngine() const { return engine; }
+    bool odirectEnabled() const { return odirect; }
+    XLMetaCacheStats metaCacheStats() const { return metaCache.stats(); }
+
+protected:
+    // Resolves a volume, throws errInvalidArgument for malformed names.
+    std::filesystem::path volumeDir(const std::string& volume) const;
+    // Resolves a file of a volume, throws for names escaping the volume.
+    std::filesystem::path filePath(const std::string& volume, const std::string& path) const;
+
+    // Opens 'path' and runs 'ops' on it, closing the file behind them.
+    // With a free fixed slot all of it is a single submission. The fd of
+    // every op is filled in, results are left in 'ops'.
+    Error runOnFile(const std::filesystem::path& path, int flags, IoOp* ops, size_t n);
+    // Maps a failed open to a file or volume error.
+    Error openError(int errnum, const std::string& volume) const;
+    // Writes what 'fill' produces to an open file starting at 'offset',
+    // a chunk per submission. With 'direct' the file was opened with
+    // O_DIRECT: chunks are page aligned and an unaligned tail is written
+    // after O_DIRECT is cleared from the descriptor. 'written' counts the
+    // bytes that reached the file, also when an error stops the writes.
+    Error writeChunks(int fd, bool fixedFile, bool direct, int64_t offset, int64_t limit,
+                      const std::function<size_t(uint8_t*, size_t)>& fill, int64_t& written);
+    // Reads and decodes, or encodes and writes, the xl.meta of an object.
+    Error loadXLMeta(const std::string& volume, const std::string& path, XLMetaV2& meta);
+    Error saveXLMeta(const std::string& volume, const std::string& path, const XLMetaV2& meta);
+    // Deletes 'versions' of the object at volume/path, adding those that
+    // are delete markers, with one read and write of its xl.meta. A version
+    // not found does not stop the others, errFileVersionNotFound is
+    // returned once the rest are applied.
+    Error deleteVersionsOf(const std::string& volume, const std::string& path,
+                           const std::vector<FileInfo>& versions, bool forceDelMarker);
+    // Returns the xl.meta of an object through the metadata cache.
+    XLMetaCache::Buffer readXLMeta(const std::string& volume, const std::string& path);
+
+    // readFile of streaming bitrot protected shard files.
+    int64_t readFileVerified(const std::string& volume, const std::string& path, int64_t offset,
+                             std::vector<uint8_t>& buf, const BitrotVerifier& verifier);
+    // Checks the drive accepts O_DIRECT writes.
+    bool probeODirect() const;
+
+private:
+    Endpoint                                            ep;
+    std::string                                         drivePath;
+    std::shared_ptr<IoEngine>                           engine;
+    bool                                                odirect = false;
+    int64_t                                             odirectThreshold = 0;
+    std::chrono::time_point<std::chrono::system_clock>  connectedAt;
+    // Every write of this drive's xl.meta files goes through writeAll,
+    // createFile, appendFile, deletePath, renameFile, renameData or
+    // deleteVol, which invalidate the entries they touch.
+    XLMetaCache                                         metaCache;
+    // Writes through appendFile, createFile and writeAll are accounted
+    // to it as they happen.
+    DiskInfoCache                                       diskInfoCache;
+
+    mutable std::mutex                                  mu;
+    std::string                                         diskID;
+    std::vector<uint8_t>                                formatData;
+    int                                                 poolIndex = -1;
+    int                                                 setIndex = -1;
+    int                                                 diskIndex = -1;
+};
+
+}
+
+#endif // CPPIO_XL_STORAGE_HPP
@@ -0,0 +1,155 @@
+#ifndef CPPIO_XL_STORAGE_DISK_ID_CHECK_HPP
+#define CPPIO_XL_STORAGE_DISK_ID_CHECK_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "storage_interface.hpp"
+#include "storage_metrics.hpp"
+
+namespace cppio {
+
+struct XLStorageDiskIDCheckOptions {
+    DriveMetricsOptions         metrics;
+    unsigned                    maxConcurrent   = 32;   // calls in flight on the drive, more queue up
+    // Calls queued longer fail with errDiskOngoingReq.
+    std::chrono::milliseconds   maxWait         = std::chrono::seconds(10);
+    // Calls in flight without any of them completing for this long mean
+    // the drive hangs, it goes offline.
+    std::chrono::milliseconds   maxCallTime     = std::chrono::seconds(30);
+    int                         maxTimeouts     = 3;    // timeouts in a row taking the drive offline
+    // An offline drive is probed this often, back online once a probe
+    // writes, reads and deletes a file within maxCallTime.
+    std::chrono::milliseconds   probeInterval   = std::chrono::seconds(5);
+};
+
+// XLStorageDiskIDCheck - wraps the StorageAPI of a drive, measures every
+// call made to it and keeps a hung drive from taking the server down.
+//
+// Metrics are calls by size, latency histograms and latencies of the
+// last minute per API, writes and deletes, reported by diskInfo with
+// DiskInfoOptions::metrics. Calls the drive makes to itself are not
+// counted.
+//
+// At most maxConcurrent calls are in flight on the drive, the others wait
+// up to maxWait for their turn. A call blocked in the kernel can not be
+// abandoned, so a hung drive is detected instead: calls queued too long,
+// or in flight without progress for maxCallTime, are timeouts, and a run
+// of maxTimeouts of them, or no progress at all, takes the drive offline.
+// Calls to an offline drive fail right away with errFaultyDisk until a
+// background probe finds it working again. A stuck drive pins at most
+// maxConcurrent threads, the rest of the server moves on. Walks and
+// creates, paced by their callers, only fail fast.
+class XLStorageDiskIDCheck : public StorageAPI {
+
+public:
+    explicit XLStorageDiskIDCheck(std::shared_ptr<StorageAPI> storage,
+                                  const XLStorageDiskIDCheckOptions& opts = XLStorageDiskIDCheckOptions{});
+    ~XLStorageDiskIDCheck() override;
+
+    XLStorageDiskIDCheck(const XLStorageDiskIDCheck&) = delete;
+    XLStorageDiskIDCheck& operator=(const XLStorageDiskIDCheck&) = delete;
+
+    std::string string() const override { return storage->string(); }
+    bool isOnline() const override { return !offline && storage->isOnline(); }
+    std::chrono::time_point<std::chrono::system_clock> lastConn() const override { return storage->lastConn(); }
+    bool isLocal() const override { return storage->isLocal(); }
+    std::string hostname() const override { return storage->hostname(); }
+    Endpoint endpoint() const override { return storage->endpoint(); }
+    void close() override { storage->close(); }
+    std::string getDiskID() override { return storage->getDiskID(); }
+    void setDiskID(const std::string& id) override { storage->setDiskID(id); }
+    const HealingTracker* healing() const override { return storage->healing(); }
+    DiskInfo diskInfo(const DiskInfoOptions& opts) override;
+    std::chrono::nanoseconds readLatency() const override { return metrics.lastMinuteOf(storageMetricReadFile).avg(); }
+    void nsScanner(DataUsageCache& cache, std::vector<dataUsageEntry>& updates, madmin::HealScanMode scanMode, std::function<bool()> shouldSleep) override;
+
+    // Volume operations
+    void makeVol(const std::string& volume) override;
+    void makeVolBulk(const std::vector<std::string>& volumes) override;
+    std::vector<VolInfo> listVols() override;
+    VolInfo statVol(const std::string& volume) override;
+    void deleteVol(const std::string& volume, bool forcedelete) override;
+
+    Error walkDir(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn) override;
+
+    // Metadata operations
+    Error deleteVersion(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, bool forceDelMarker, const DeleteOptions& opts) override;
+    std::vector<Error> deleteVersions(Context& ctx, const std::string& volume, const std::vector<FileInfoVersions>& versions, const DeleteOptions& opts) override;
+    Error writeMetadata(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const FileInfo& fi) override;
+    Error updateMetadata(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, const UpdateMetadataOpts& opts) override;
+    FileInfo readVersion(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const std::string& versionID, const ReadOptions& opts) override;
+    RawFileInfo readXL(Context& ctx, const std::string& volume, const std::string& path, bool readData) override;
+    uint64_t renameData(Context& ctx, const std::string& srcVolume, const std::string& srcPath, const FileInfo& fi, const std::string& dstVolume, const std::string& dstPath, const RenameOptions& opts) override;
+
+    // File operations
+    std::vector<std::string> listDir(const std::string& volume, const std::string& dirpath, int count) override;
+    int64_t readFile(const std::string& volume, const std::string& path, int64_t offset, std::vector<uint8_t>& buf, const BitrotVerifier* verifier) override;
+    void appendFile(const std::string& volume, const std::string& path, const std::vector<uint8_t>& buf) override;
+    void createFile(const std::string& volume, const std::string& path, int64_t size, std::istream& reader) override;
+    std::unique_ptr<std::istream> readfileStream(const std::string& volume, const std::string& path, int64_t offset, int64_t length) override;
+    Error openFileRange(const std::string& volume, const std::string& path, int64_t offset, int64_t length, FileRange& range) override;
+    void renameFile(const std::string& srcvolume, const std::string& srcpath, const std::string& dstvolume, const std::string& dstpath) override;
+    void checkParts(const std::string& volume, const std::string& path, const FileInfo& fi) override;
+    void deletePath(const std::string& volume, const std::string& path, const DeleteOptions& opts) override;
+    void verifyFile(const std::string& volume, const std::string& path, const FileInfo& fi) override;
+    std::vector<StatInfo> statInfoFile(const std::string& volume, const std::string& path, bool glob) override;
+    void readMultiple(const ReadMultipleReq& req, std::vector<ReadMultipleResp>& resp) override;
+    void cleanAbandonedData(const std::string& volume, const std::string& path) override;
+    void writeAll(const std::string& volume, const std::string& path, const std::vector<uint8_t>& data) override;
+    std::vector<uint8_t> readAll(const std::string& volume, const std::string& path) override;
+    void getDiskLoc(int& poolIdx, int& setIdx, int& diskIdx) override { storage->getDiskLoc(poolIdx, setIdx, diskIdx); }
+    void setDiskLoc(int poolIdx, int setIdx, int diskIdx) override { storage->setDiskLoc(poolIdx, setIdx, diskIdx); }
+    void setFormatData(std::vector<uint8_t> b) override { storage->setFormatData(std::move(b)); }
+
+    // Returns the wrapped drive.
+    const std::shared_ptr<StorageAPI>& unwrap() const { return storage; }
+
+private:
+    class Call;
+    struct Probe;
+
+    // Admits a call to the drive, waiting for a free slot. Returns
+    // errFaultyDisk while offline, errDiskOngoingReq after maxWait.
+    Error enter();
+    // Frees the slot of a call that took 'elapsed', failed with 'err'.
+    void leave(std::chrono::nanoseconds elapsed, const Error& err);
+    // Runs 'f' as an admitted call of 'metric'.
+    template<typename F>
+    auto run(StorageMetric metric, int64_t size, F&& f) -> decltype(f());
+
+    void timedOut();
+    void setOffline(const char* reason);
+    void monitor();
+    bool probe();
+
+    static int64_t now();
+
+    std::shared_ptr<StorageAPI>     storage;
+    XLStorageDiskIDCheckOptions     opts;
+    DriveMetrics                    metrics;
+    std::atomic<uint64_t>           totalWrites{0};
+    std::atomic<uint64_t>           totalDeletes{0};
+    std::atomic<uint64_t>           totalErrorsTimeout{0};
+    std::atomic<uint64_t>           totalErrorsAvailability{0};
+
+    std::atomic<unsigned>           inFlight{0};
+    std::atomic<unsigned>           waiting{0};
+    std::atomic<int>                timeouts{0};        // in a row
+    std::atomic<bool>               offline{false};
+    std::atomic<int64_t>            lastProgress{0};    // steady clock nanoseconds
+    std::shared_ptr<Probe>          probing;            // of the last probe, may outlive this
+
+    std::mutex                      mu;
+    std::condition_variable         cv;                 // slots freed, drive offline
+    std::condition_variable         stopCv;
+    bool                            stopping = false;
+    std::thread                     monitorThread;
+};
+
+}
+
+#endif // CPPIO_XL_STORAGE_DISK_ID_CHECK_HPP
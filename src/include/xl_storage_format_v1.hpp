@@ -2,6 +2,8 @@
 #define CPPIO_XL_STORAGE_FROMAT_V1_HPP
 
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <vector>
 #include <unordered_map>
 #include <chrono>
@@ -18,9 +20,43 @@ enum class BitrotAlgorithm : uint32_t {
     CRC32 = 1,
     CRC64,
     SHA256,
+    CRC32C,             // CRC-32 Castagnoli, hardware accelerated
+    HighwayHash256S,    // streaming HighwayHash-256, MinIO's default
     // Add more algorithms here as needed
 };
 
+inline std::string toHex(const std::vector<uint8_t>& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * bytes.size(), '0');
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0x0f];
+    }
+    return hex;
+}
+
+// Decodes a hex string, stops at the first character which is not a hex
+// digit.
+inline std::vector<uint8_t> fromHex(const std::string& hex) {
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    std::vector<uint8_t> bytes;
+    bytes.reserve(hex.size() / 2);
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        auto hi = nibble(hex[i]);
+        auto lo = nibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) {
+            break;
+        }
+        bytes.push_back(static_cast<uint8_t>(hi << 4 | lo));
+    }
+    return bytes;
+}
+
 // ChecksumInfo - carries checksums of individual scattered parts per disk.
 struct ChecksumInfo {
     int PartNumber;
@@ -49,8 +85,10 @@ struct ErasureInfo {
         
         // Serialize distribution
         pt::ptree distributionTree;
-        for (size_t i = 0; i < distribution.size(); ++i) {
-            distributionTree.put("", distribution[i]);
+        for (auto d : distribution) {
+            pt::ptree value;
+            value.put_value(d);
+            distributionTree.push_back(std::make_pair("", value));
         }
         tree.add_child("distribution", distributionTree);
 
@@ -58,8 +96,9 @@ struct ErasureInfo {
         pt::ptree checksumsTree;
         for (const auto& checksum : checksums) {
             pt::ptree checksumTree;
-            checksumTree.put("type", checksum.type);
-            checksumTree.put("value", checksum.value);
+            checksumTree.put("part", checksum.PartNumber);
+            checksumTree.put("algorithm", static_cast<uint32_t>(checksum.Algorithm));
+            checksumTree.put("hash", toHex(checksum.Hash));
             checksumsTree.push_back(std::make_pair("", checksumTree));
         }
         tree.add_child("checksum", checksumsTree);
@@ -74,7 +113,7 @@ struct ErasureInfo {
         erasureInfo.dataBlocks = tree.get<int>("data");
         erasureInfo.parityBlocks = tree.get<int>("parity");
         erasureInfo.blockSize = tree.get<int64_t>("blockSize");
-        erasureInfo.index = tree.get<int>("index");
+        erasureInfo.index = tree.get<int>("index", 0);
 
         // Deserialize distribution
         erasureInfo.distribution.clear();
@@ -84,10 +123,11 @@ struct ErasureInfo {
 
         // Deserialize checksums
         erasureInfo.checksums.clear();
-        for (const auto& pair : tree.get_child("checksum")) {
+        for (const auto& pair : tree.get_child("checksum", pt::ptree())) {
             ChecksumInfo checksum;
-            checksum.type = pair.second.get<std::string>("type");
-            checksum.value = pair.second.get<std::string>("value");
+            checksum.PartNumber = pair.second.get<int>("part");
+            checksum.Algorithm = static_cast<BitrotAlgorithm>(pair.second.get<uint32_t>("algorithm"));
+            checksum.Hash = fromHex(pair.second.get<std::string>("hash"));
             erasureInfo.checksums.push_back(checksum);
         }
 
@@ -115,12 +155,8 @@ struct ObjectPartInfo {
         tree.put("actualSize", actualSize);
         tree.put("modTime", std::chrono::system_clock::to_time_t(modTime));
         
-        // Serialize index as base64 string
-        std::ostringstream oss;
-        for (auto byte : index) {
-            oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        tree.put("index", oss.str());
+        // Serialize index as hex string
+        tree.put("index", toHex(index));
 
         // Serialize checksums
         pt::ptree checksumsTree;
@@ -135,24 +171,21 @@ struct ObjectPartInfo {
     // Method to deserialize from JSON
     static ObjectPartInfo from_ptree(const pt::ptree& tree) {
         ObjectPartInfo partInfo;
-        partInfo.etag = tree.get<std::string>("etag");
+        partInfo.etag = tree.get<std::string>("etag", "");
         partInfo.number = tree.get<int>("number");
         partInfo.size = tree.get<int64_t>("size");
-        partInfo.actualSize = tree.get<int64_t>("actualSize");
-        partInfo.modTime = std::chrono::system_clock::from_time_t(tree.get<std::time_t>("modTime"));
-
-        // Deserialize index from base64 string
-        std::string indexHexStr = tree.get<std::string>("index");
-        partInfo.index.clear();
-        for (size_t i = 0; i < indexHexStr.size(); i += 2) {
-            std::string byteString = indexHexStr.substr(i, 2);
-            uint8_t byte = static_cast<uint8_t>(std::stoul(byteString, nullptr, 16));
-            partInfo.index.push_back(byte);
-        }
+        // Parts of older xl.meta carry no more than the above.
+        partInfo.actualSize = tree.get<int64_t>("actualSize", partInfo.size);
+        partInfo.modTime = std::chrono::system_clock::from_time_t(tree.get<std::time_t>("modTime", 0));
+
+        // Deserialize index from hex string
+        partInfo.index = fromHex(tree.get<std::string>("index", ""));
 
         // Deserialize checksums
-        for (const auto& pair : tree.get_child("checksums")) {
-            partInfo.checksums[pair.first] = pair.second.get_value<std::string>();
+        if (auto checksums = tree.get_child_optional("checksums")) {
+            for (const auto& pair : *checksums) {
+                partInfo.checksums[pair.first] = pair.second.get_value<std::string>();
+            }
         }
 
         return partInfo;
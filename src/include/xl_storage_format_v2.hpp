@@ -0,0 +1,220 @@
+#ifndef CPPIO_XL_STORAGE_FORMAT_V2_HPP
+#define CPPIO_XL_STORAGE_FORMAT_V2_HPP
+
+#include <array>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "error.hpp"
+#include "msgp.hpp"
+#include "storage_datatypes.hpp"
+
+namespace cppio {
+
+// xl.meta of format v2 is laid out as
+//
+//   "XL2 " | major (uint16 LE) | minor (uint16 LE) | versions | crc | data
+//
+// versions is a msgp array of version tuples, newest first, and crc a msgp
+// uint32 holding the CRC-32C of everything before it. Tuples only ever get
+// fields appended, decoders skip the fields they do not know.
+//
+// data, since minor 1, holds the shards of objects small enough to be
+// stored inline: a msgp map of versionID to the shard of this drive in
+// streaming bitrot layout, which protects it instead of the crc.
+const std::string xlStorageFormatFile = "xl.meta";
+const char xlHeader[4] = {'X', 'L', '2', ' '};
+const uint16_t xlVersionMajor = 1;
+const uint16_t xlVersionMinor = 1;
+
+// Metadata key marking versions with their data inline.
+const std::string xlMetaInlineData = "x-cppio-internal-inline-data";
+
+inline bool isInlineData(const FileInfo& fi) {
+    auto it = fi.metadata.find(xlMetaInlineData);
+    return it != fi.metadata.end() && it->second == "true";
+}
+
+// XLVersionType - type of a version in xl.meta.
+enum class XLVersionType : uint8_t {
+    Object = 1,
+    DeleteMarker = 2,
+};
+
+// Field positions of the tuples in xl.meta.
+//msgp:tuple xlMetaV2Version
+enum XLVersionField {
+    xlFieldType = 0,
+    xlFieldVersionID,
+    xlFieldDataDir,
+    xlFieldModTime,             // unix nanoseconds
+    xlFieldSize,
+    xlFieldMode,
+    xlFieldWrittenByVersion,
+    xlFieldMetadata,            // map of strings
+    xlFieldParts,               // array of ObjectPartInfo tuples
+    xlFieldErasure,             // ErasureInfo tuple
+    xlFieldChecksum,
+    xlFieldTransitionStatus,
+    xlFieldTransitionedObjName,
+    xlFieldTransitionTier,
+    xlFieldTransitionVersionID,
+    xlFieldReplicationState,
+    xlVersionFields,
+};
+
+// Appends the object level fields of 'fi' as a version tuple.
+void encodeXLVersion(MsgpWriter& w, const FileInfo& fi);
+
+// Decodes a version tuple into 'fi', errors are left in the reader.
+void decodeXLVersion(MsgpReader& r, FileInfo& fi);
+
+void encodeErasureInfo(MsgpWriter& w, const ErasureInfo& e);
+void decodeErasureInfo(MsgpReader& r, ErasureInfo& e);
+void encodeObjectPartInfo(MsgpWriter& w, const ObjectPartInfo& part);
+void decodeObjectPartInfo(MsgpReader& r, ObjectPartInfo& part);
+
+// Returns true if 'buf' starts with the xl.meta v2 header.
+bool isXL2(std::span<const uint8_t> buf);
+
+// Checks the header and checksum of xl.meta v2 and returns the versions
+// array within it, and the inline data section if asked for.
+Error xlMetaV2Versions(std::span<const uint8_t> buf, std::span<const uint8_t>& versions,
+                       std::span<const uint8_t>* data = nullptr);
+
+// Returns the inline data of versionID in a data section, empty if none.
+std::span<const uint8_t> xlMetaV2InlineData(std::span<const uint8_t> data, std::string_view versionID);
+
+// XLMetaV2 - decoded xl.meta, the versions of an object newest first.
+class XLMetaV2 {
+
+public:
+    // Decodes xl.meta, the JSON xl.meta of format v1 included. Fails with
+    // errFileCorrupt for anything else.
+    Error load(std::span<const uint8_t> buf);
+
+    // Appends the xl.meta v2 encoding of all versions to 'buf', with their
+    // FileInfo::data in the data section.
+    void appendTo(std::vector<uint8_t>& buf) const;
+    std::vector<uint8_t> marshal() const;
+
+    // Adds a version, replacing the one with the same versionID. Its data
+    // is stored inline when not empty.
+    void addVersion(const FileInfo& fi);
+
+    // Removes the version with fi.versionID, errFileVersionNotFound if
+    // there is none.
+    Error deleteVersion(const FileInfo& fi);
+
+    // Returns the version of versionID, the latest for an empty versionID,
+    // with its inline data if 'readData' is set.
+    Error toFileInfo(const std::string& volume, const std::string& path,
+                     const std::string& versionID, FileInfo& fi, bool readData = false) const;
+
+    const std::vector<FileInfo>& versions() const { return versionList; }
+
+    // Returns true if another version than 'fi' shares its data dir.
+    bool sharedDataDir(const FileInfo& fi) const;
+
+private:
+    Error loadJSON(std::span<const uint8_t> buf);
+
+private:
+    std::vector<FileInfo>   versionList;
+};
+
+// FileInfoView - a version tuple of xl.meta read in place. Fields are
+// located on first use and returned as views into the buffer, which has
+// to outlive the view; nothing is allocated before toFileInfo. Fields a
+// tuple does not have read as zero values.
+class FileInfoView {
+
+public:
+    FileInfoView() = default;
+    explicit FileInfoView(std::span<const uint8_t> tuple);
+
+    bool deleted() const;
+    std::string_view versionID() const;
+    std::string_view dataDir() const;
+    std::chrono::system_clock::time_point modTime() const;
+    int64_t size() const;
+    uint32_t mode() const;
+
+    // Returns the metadata value of 'key', empty when not set.
+    std::string_view metadata(std::string_view key) const;
+
+    // Calls fn(key, value) for every metadata entry until it returns false.
+    template <typename Fn>
+    void forEachMetadata(Fn&& fn) const {
+        auto r = field(xlFieldMetadata);
+        auto n = r.readMapHeader();
+        for (uint32_t i = 0; i < n && r.ok(); ++i) {
+            auto k = r.readString();
+            auto v = r.readString();
+            if (!r.ok() || !fn(k, v)) {
+                break;
+            }
+        }
+    }
+
+    size_t numParts() const;
+
+    // Decodes the whole version.
+    Error toFileInfo(FileInfo& fi) const;
+
+    std::span<const uint8_t> bytes() const { return tuple; }
+
+private:
+    // Returns a reader at field i, one failing every read if the tuple
+    // has no such field.
+    MsgpReader field(int i) const;
+
+private:
+    std::span<const uint8_t>                                tuple;
+    int                                                     fields = 0;
+    // Offsets of the fields located so far, the first 'located' + 1.
+    mutable std::array<uint32_t, xlVersionFields + 1>       offsets{};
+    mutable int                                             located = 0;
+};
+
+// XLMetaV2View - the versions of an xl.meta v2 buffer read in place, see
+// FileInfoView. The JSON xl.meta of format v1 is not supported, XLMetaV2
+// reads it.
+class XLMetaV2View {
+
+public:
+    // Checks header and checksum, the buffer has to outlive the view.
+    Error load(std::span<const uint8_t> buf);
+
+    size_t numVersions() const { return count; }
+
+    // Returns version i, newest first.
+    FileInfoView version(size_t i) const;
+
+    // Finds the version of versionID, the latest for an empty versionID.
+    Error find(std::string_view versionID, FileInfoView& view, size_t& idx) const;
+
+    // Same as XLMetaV2::toFileInfo, only the version returned is decoded.
+    // Its inline data is copied to fi.data if 'readData' is set.
+    Error toFileInfo(const std::string& volume, const std::string& path,
+                     const std::string& versionID, FileInfo& fi, bool readData = false) const;
+
+    // Returns the inline data of versionID, empty if none.
+    std::span<const uint8_t> inlineData(std::string_view versionID) const;
+
+    // Size of the buffer without the data section.
+    size_t metadataSize() const { return metaSize; }
+
+private:
+    std::span<const uint8_t>    versions;   // the tuples, after the array header
+    std::span<const uint8_t>    data;
+    size_t                      count = 0;
+    size_t                      metaSize = 0;
+};
+
+}
+
+#endif // CPPIO_XL_STORAGE_FORMAT_V2_HPP
@@ -0,0 +1,698 @@
+#include "include/io_engine.hpp"
+#include "include/log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+using namespace cppio;
+
+namespace {
+
+// Batch tracks the completion of all ops submitted by one caller.
+struct Batch {
+    std::mutex              mu;
+    std::condition_variable cv;
+    size_t                  remaining = 0;
+
+    void done(size_t n = 1) {
+        std::lock_guard<std::mutex> lock(mu);
+        remaining -= n;
+        if (remaining == 0) {
+            cv.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [this]() { return remaining == 0; });
+    }
+};
+
+// Ops linked to their successor form a chain, returns its length.
+size_t chainLength(const IoOp* ops, size_t n) {
+    size_t len = 1;
+    while (len < n && (ops[len - 1].link || ops[len - 1].hardlink)) {
+        ++len;
+    }
+    return len;
+}
+
+// An op breaks its chain when it fails, or transfers less than asked.
+bool breaksChain(const IoOp& op) {
+    if (op.result < 0) {
+        return true;
+    }
+    if (op.opcode == IoOpcode::Read || op.opcode == IoOpcode::Write) {
+        return op.result < op.len;
+    }
+    return false;
+}
+
+//
+// ThreadPoolIoEngine - runs every chain with plain syscalls on a worker.
+//
+class ThreadPoolIoEngine : public IoEngine {
+
+public:
+    explicit ThreadPoolIoEngine(const IoEngineOptions& opts)
+        : IoEngine(opts), fixedFds(opts.fileSlots, -1) {
+        setFileSlots(opts.fileSlots);
+        auto n = opts.fallbackThreads == 0 ? 1 : opts.fallbackThreads;
+        for (unsigned i = 0; i < n; ++i) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPoolIoEngine() override {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+
+    std::string name() const override { return "threadpool"; }
+
+    void submit(IoOp* ops, size_t n) override {
+        if (n == 0) {
+            return;
+        }
+
+        Batch batch;
+        batch.remaining = n;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (size_t i = 0; i < n;) {
+                auto len = chainLength(ops + i, n - i);
+                queue.push_back(Chain{ops + i, len, &batch});
+                i += len;
+            }
+        }
+        cv.notify_all();
+        batch.wait();
+    }
+
+private:
+    struct Chain {
+        IoOp*   ops;
+        size_t  n;
+        Batch*  batch;
+    };
+
+    void work() {
+        while (true) {
+            Chain chain;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                chain = queue.front();
+                queue.pop_front();
+            }
+
+            bool canceled = false;
+            for (size_t i = 0; i < chain.n; ++i) {
+                auto& op = chain.ops[i];
+                if (canceled) {
+                    op.result = -ECANCELED;
+                    continue;
+                }
+                execute(op);
+                canceled = op.link && breaksChain(op);
+            }
+            chain.batch->done(chain.n);
+        }
+    }
+
+    int resolve(const IoOp& op) const {
+        return op.fixedFile ? fixedFds[op.fd] : op.fd;
+    }
+
+    void execute(IoOp& op) {
+        int64_t res = 0;
+        switch (op.opcode) {
+        case IoOpcode::Nop:
+            break;
+        case IoOpcode::Openat:
+            res = ::open(op.path, op.flags | O_CLOEXEC, op.mode);
+            if (res >= 0 && op.fixedFile) {
+                fixedFds[op.fd] = static_cast<int>(res);
+                res = 0;
+            }
+            break;
+        case IoOpcode::Read:
+            res = op.offset < 0 ? ::read(resolve(op), op.buf, op.len)
+                                : ::pread(resolve(op), op.buf, op.len, op.offset);
+            break;
+        case IoOpcode::Write:
+            res = op.offset < 0 ? ::write(resolve(op), op.buf, op.len)
+                                : ::pwrite(resolve(op), op.buf, op.len, op.offset);
+            break;
+        case IoOpcode::Fsync:
+            res = ::fdatasync(resolve(op));
+            break;
+        case IoOpcode::Close:
+            res = ::close(resolve(op));
+            if (op.fixedFile) {
+                fixedFds[op.fd] = -1;
+            }
+            break;
+        case IoOpcode::Renameat:
+            res = ::rename(op.path, op.path2);
+            break;
+        case IoOpcode::Statx:
+            res = ::statx(AT_FDCWD, op.path, op.flags, op.len, static_cast<struct statx*>(op.buf));
+            break;
+        }
+        op.result = res < 0 ? -errno : res;
+    }
+
+private:
+    std::vector<int>            fixedFds;
+    std::mutex                  mu;
+    std::condition_variable     cv;
+    std::deque<Chain>           queue;
+    bool                        stopping = false;
+    std::vector<std::thread>    workers;
+};
+
+//
+// UringIoEngine - one io_uring per drive. Callers fill the submission
+// queue under a mutex and wait for their batch, a reaper thread consumes
+// completions for all of them, so batches of many callers are in flight
+// at the same time.
+//
+int uringSetup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int uringRegister(int fd, unsigned opcode, const void* arg, unsigned nrArgs) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+class UringIoEngine : public IoEngine {
+
+public:
+    explicit UringIoEngine(const IoEngineOptions& opts) : IoEngine(opts) {}
+
+    ~UringIoEngine() override {
+        if (reaper.joinable()) {
+            stopping = true;
+            IoOp nop;
+            Pending wakeup{&nop, nullptr};
+            std::unique_lock<std::mutex> lock(submitMu);
+            queueSqe(nop, &wakeup);
+            flush();
+            lock.unlock();
+            reaper.join();
+        }
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            ::munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            ::munmap(sqRing, sqRingSize);
+        }
+        if (ringFd >= 0) {
+            ::close(ringFd);
+        }
+    }
+
+    // Sets the ring up, returns false if io_uring is not usable.
+    bool init() {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        ringFd = uringSetup(opts.queueDepth, &p);
+        if (ringFd < 0) {
+            return false;
+        }
+
+        if (!(p.features & IORING_FEAT_NODROP) || !probe()) {
+            return false;
+        }
+
+        sqEntries = p.sq_entries;
+        sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        cqRing = sqRing;
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                return false;
+            }
+        }
+        sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        auto sq = static_cast<uint8_t*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        auto cq = static_cast<uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        reaper = std::thread([this]() { reap(); });
+
+        registerBuffers();
+        registerFiles();
+        return true;
+    }
+
+    std::string name() const override { return "io_uring"; }
+
+    void submit(IoOp* ops, size_t n) override {
+        if (n == 0) {
+            return;
+        }
+
+        Batch batch;
+        batch.remaining = n;
+        std::vector<Pending> pending(n);
+        std::vector<std::pair<IoOp*, size_t>> split;
+        {
+            std::lock_guard<std::mutex> lock(submitMu);
+            for (size_t i = 0; i < n;) {
+                auto len = chainLength(ops + i, n - i);
+                if (std::any_of(ops + i, ops + i + len, [this](const IoOp& op) { return !supported(op); })) {
+                    split.emplace_back(ops + i, len);
+                    batch.done(len);
+                    i += len;
+                    continue;
+                }
+                // A chain must not be split over two submissions.
+                if (len > sqEntries) {
+                    for (size_t j = 0; j < len; ++j) {
+                        ops[i + j].result = -EINVAL;
+                    }
+                    batch.done(len);
+                    i += len;
+                    continue;
+                }
+                if (sqEntries - queued() < len) {
+                    flush();
+                }
+                for (size_t j = 0; j < len; ++j, ++i) {
+                    pending[i] = Pending{ops + i, &batch};
+                    queueSqe(ops[i], &pending[i]);
+                }
+            }
+            flush();
+        }
+        for (const auto& [chain, len] : split) {
+            runSplit(chain, len);
+        }
+        batch.wait();
+    }
+
+private:
+    struct Pending {
+        IoOp*       op = nullptr;
+        Batch*      batch = nullptr;
+    };
+
+    // False for ops this kernel's io_uring lacks, which run on 'fallback'.
+    bool supported(const IoOp& op) const {
+        return (renameSupported || op.opcode != IoOpcode::Renameat) &&
+               (statxSupported || op.opcode != IoOpcode::Statx);
+    }
+
+    // Runs a chain holding ops the ring does not support, one piece after
+    // the other: runs of supported ops go to the ring, each other op to
+    // the thread pool. A piece breaking the chain cancels the rest, like
+    // the kernel would.
+    void runSplit(IoOp* ops, size_t n) {
+        bool canceled = false;
+        for (size_t i = 0; i < n;) {
+            if (canceled) {
+                ops[i++].result = -ECANCELED;
+                continue;
+            }
+            auto end = i + 1;
+            if (supported(ops[i])) {
+                while (end < n && supported(ops[end])) {
+                    ++end;
+                }
+            }
+            // The last op of a piece must not link to whatever the ring
+            // gets next.
+            auto& last = ops[end - 1];
+            auto link = last.link;
+            auto hardlink = last.hardlink;
+            last.link = last.hardlink = false;
+            if (supported(ops[i])) {
+                submit(ops + i, end - i);
+            } else {
+                fallback->submit(ops + i, 1);
+            }
+            last.link = link;
+            last.hardlink = hardlink;
+            canceled = std::any_of(ops + i, ops + end,
+                                   [](const IoOp& op) { return op.link && breaksChain(op); });
+            i = end;
+        }
+    }
+
+    bool probe() {
+        const unsigned nrOps = 256;
+        std::vector<uint8_t> mem(sizeof(io_uring_probe) + nrOps * sizeof(io_uring_probe_op), 0);
+        auto pr = reinterpret_cast<io_uring_probe*>(mem.data());
+        if (uringRegister(ringFd, IORING_REGISTER_PROBE, pr, nrOps) < 0) {
+            return false;
+        }
+
+        auto supported = [pr](unsigned op) {
+            return op <= pr->last_op && (pr->ops[op].flags & IO_URING_OP_SUPPORTED);
+        };
+        renameSupported = supported(IORING_OP_RENAMEAT);
+        statxSupported = supported(IORING_OP_STATX);
+        if (!renameSupported || !statxSupported) {
+            IoEngineOptions fallbackOpts = opts;
+            fallbackOpts.fileSlots = 0;
+            fallbackOpts.bufferCount = 0;
+            fallback = std::make_unique<ThreadPoolIoEngine>(fallbackOpts);
+        }
+        return supported(IORING_OP_READ) && supported(IORING_OP_WRITE) &&
+               supported(IORING_OP_READ_FIXED) && supported(IORING_OP_WRITE_FIXED) &&
+               supported(IORING_OP_FSYNC) && supported(IORING_OP_OPENAT) &&
+               supported(IORING_OP_CLOSE);
+    }
+
+    void registerBuffers() {
+        std::vector<iovec> iovs(opts.bufferCount);
+        for (unsigned i = 0; i < opts.bufferCount; ++i) {
+            iovs[i].iov_base = bufferArena + i * opts.bufferSize;
+            iovs[i].iov_len = opts.bufferSize;
+        }
+        buffersRegistered =
+            uringRegister(ringFd, IORING_REGISTER_BUFFERS, iovs.data(), opts.bufferCount) == 0;
+        if (!buffersRegistered) {
+            gLogger->warn("io_uring: registering buffers failed: {}", std::strerror(errno));
+        }
+    }
+
+    void registerFiles() {
+        std::vector<int> fds(opts.fileSlots, -1);
+        if (opts.fileSlots == 0 ||
+            uringRegister(ringFd, IORING_REGISTER_FILES, fds.data(), opts.fileSlots) < 0) {
+            return;
+        }
+
+        // Direct descriptors need Linux 5.15, check the kernel installs a
+        // file into a slot before handing out any.
+        IoOp check[2];
+        check[0].opcode = IoOpcode::Openat;
+        check[0].fd = 0;
+        check[0].fixedFile = true;
+        check[0].path = "/dev/null";
+        check[0].flags = O_RDONLY;
+        check[0].link = true;
+        check[1].opcode = IoOpcode::Close;
+        check[1].fd = 0;
+        check[1].fixedFile = true;
+        submit(check, 2);
+        if (check[0].result == 0 && check[1].result == 0) {
+            setFileSlots(opts.fileSlots);
+        }
+    }
+
+    unsigned queued() const {
+        return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    }
+
+    void queueSqe(const IoOp& op, Pending* pending) {
+        auto tail = *sqTail;
+        auto idx = tail & sqMask;
+        auto sqe = static_cast<io_uring_sqe*>(sqes) + idx;
+        std::memset(sqe, 0, sizeof(*sqe));
+
+        auto fd = op.fd;
+        unsigned flags = 0;
+        if (op.fixedFile && op.opcode != IoOpcode::Openat && op.opcode != IoOpcode::Close) {
+            flags |= IOSQE_FIXED_FILE;
+        }
+        if (op.hardlink) {
+            flags |= IOSQE_IO_HARDLINK;
+        } else if (op.link) {
+            flags |= IOSQE_IO_LINK;
+        }
+
+        switch (op.opcode) {
+        case IoOpcode::Nop:
+            sqe->opcode = IORING_OP_NOP;
+            break;
+        case IoOpcode::Openat:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(op.path);
+            sqe->len = op.mode;
+            if (op.fixedFile) {
+                // Direct descriptors are never inherited, O_CLOEXEC is refused.
+                sqe->open_flags = static_cast<uint32_t>(op.flags);
+                sqe->file_index = static_cast<uint32_t>(op.fd) + 1;
+            } else {
+                sqe->open_flags = static_cast<uint32_t>(op.flags | O_CLOEXEC);
+            }
+            break;
+        case IoOpcode::Read:
+        case IoOpcode::Write: {
+            auto isRead = op.opcode == IoOpcode::Read;
+            if (op.bufIndex >= 0 && buffersRegistered) {
+                sqe->opcode = isRead ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                sqe->buf_index = static_cast<uint16_t>(op.bufIndex);
+            } else {
+                sqe->opcode = isRead ? IORING_OP_READ : IORING_OP_WRITE;
+            }
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(op.buf);
+            sqe->len = op.len;
+            sqe->off = static_cast<uint64_t>(op.offset);
+            break;
+        }
+        case IoOpcode::Fsync:
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = fd;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            break;
+        case IoOpcode::Close:
+            sqe->opcode = IORING_OP_CLOSE;
+            if (op.fixedFile) {
+                sqe->file_index = static_cast<uint32_t>(op.fd) + 1;
+            } else {
+                sqe->fd = fd;
+            }
+            break;
+        case IoOpcode::Renameat:
+            sqe->opcode = IORING_OP_RENAMEAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(op.path);
+            sqe->len = static_cast<uint32_t>(AT_FDCWD);
+            sqe->addr2 = reinterpret_cast<uint64_t>(op.path2);
+            break;
+        case IoOpcode::Statx:
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(op.path);
+            sqe->len = op.len;
+            sqe->addr2 = reinterpret_cast<uint64_t>(op.buf);
+            sqe->statx_flags = static_cast<uint32_t>(op.flags);
+            break;
+        }
+        sqe->flags = static_cast<uint8_t>(flags);
+        sqe->user_data = reinterpret_cast<uint64_t>(pending);
+
+        sqArray[idx] = idx;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++toSubmit;
+    }
+
+    // Hands queued entries to the kernel, called with submitMu held.
+    void flush() {
+        while (toSubmit > 0) {
+            auto ret = uringEnter(ringFd, toSubmit, 0, 0);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EBUSY || errno == EAGAIN) {
+                    // Completion queue is backed up, let the reaper drain it.
+                    std::this_thread::yield();
+                    continue;
+                }
+                gLogger->error("io_uring_enter: {}", std::strerror(errno));
+                std::abort();
+            }
+            toSubmit -= static_cast<unsigned>(ret);
+        }
+    }
+
+    void reap() {
+        while (true) {
+            auto head = *cqHead;
+            auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                if (stopping) {
+                    return;
+                }
+                uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+                continue;
+            }
+
+            for (; head != tail; ++head) {
+                auto& cqe = cqes[head & cqMask];
+                auto pending = reinterpret_cast<Pending*>(cqe.user_data);
+                if (pending->batch == nullptr) {
+                    continue;
+                }
+                pending->op->result = cqe.res;
+                pending->batch->done();
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+private:
+    int                     ringFd = -1;
+    unsigned                sqEntries = 0;
+    size_t                  sqRingSize = 0;
+    size_t                  cqRingSize = 0;
+    size_t                  sqesSize = 0;
+    void*                   sqRing = MAP_FAILED;
+    void*                   cqRing = MAP_FAILED;
+    void*                   sqes = MAP_FAILED;
+    unsigned*               sqHead = nullptr;
+    unsigned*               sqTail = nullptr;
+    unsigned                sqMask = 0;
+    unsigned*               sqArray = nullptr;
+    unsigned*               cqHead = nullptr;
+    unsigned*               cqTail = nullptr;
+    unsigned                cqMask = 0;
+    io_uring_cqe*           cqes = nullptr;
+    unsigned                toSubmit = 0;
+    bool                    buffersRegistered = false;
+    bool                    renameSupported = false;
+    bool                    statxSupported = false;
+    // Runs Renameat and Statx on kernels without them in io_uring.
+    std::unique_ptr<ThreadPoolIoEngine> fallback;
+    std::atomic<bool>       stopping { false };
+    std::mutex              submitMu;
+    std::thread             reaper;
+};
+
+}
+
+IoEngine::IoEngine(const IoEngineOptions& opts) : opts(opts) {
+    // Page aligned, so registered buffers also serve O_DIRECT.
+    const size_t align = 4096;
+    this->opts.bufferSize = (opts.bufferSize + align - 1) / align * align;
+    if (this->opts.bufferCount > 0) {
+        bufferArena = static_cast<uint8_t*>(
+            std::aligned_alloc(align, this->opts.bufferCount * this->opts.bufferSize));
+    }
+    if (bufferArena == nullptr) {
+        this->opts.bufferCount = 0;
+    }
+    for (int i = static_cast<int>(this->opts.bufferCount) - 1; i >= 0; --i) {
+        freeBuffers.push_back(i);
+    }
+}
+
+IoEngine::~IoEngine() {
+    std::free(bufferArena);
+}
+
+void IoEngine::setFileSlots(unsigned n) {
+    std::lock_guard<std::mutex> lock(slotsMu);
+    freeSlots.clear();
+    for (int i = static_cast<int>(n) - 1; i >= 0; --i) {
+        freeSlots.push_back(i);
+    }
+}
+
+int IoEngine::allocFileSlot() {
+    std::lock_guard<std::mutex> lock(slotsMu);
+    if (freeSlots.empty()) {
+        return -1;
+    }
+    auto slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+void IoEngine::freeFileSlot(int slot) {
+    if (slot < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(slotsMu);
+    freeSlots.push_back(slot);
+}
+
+RegisteredBuffer IoEngine::acquireBuffer() {
+    std::lock_guard<std::mutex> lock(buffersMu);
+    if (freeBuffers.empty()) {
+        return RegisteredBuffer{};
+    }
+    auto idx = freeBuffers.back();
+    freeBuffers.pop_back();
+    return RegisteredBuffer{idx, bufferArena + idx * opts.bufferSize, opts.bufferSize};
+}
+
+void IoEngine::releaseBuffer(const RegisteredBuffer& buf) {
+    if (!buf.valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(buffersMu);
+    freeBuffers.push_back(buf.index);
+}
+
+std::shared_ptr<IoEngine> IoEngine::create(const IoEngineOptions& opts) {
+    if (!opts.disableUring) {
+        auto engine = std::make_shared<UringIoEngine>(opts);
+        if (engine->init()) {
+            return engine;
+        }
+        gLogger->warn("io_uring is not available, fallback to thread pool I/O");
+    }
+    return std::make_shared<ThreadPoolIoEngine>(opts);
+}
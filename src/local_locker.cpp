@@ -0,0 +1,124 @@
+#include "include/local_locker.hpp"
+
+#include <algorithm>
+
+using namespace cppio;
+
+Error LocalLocker::lock(Context&, const dsync::LockArgs& args, bool& granted) {
+    std::lock_guard<std::mutex> lock(mu);
+    granted = std::none_of(args.resources.begin(), args.resources.end(),
+                           [this](const std::string& r) { return lockMap.count(r) != 0; });
+    if (!granted) {
+        return nullptr;
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& resource : args.resources) {
+        lockMap[resource].push_back(
+            LockRequesterInfo{resource, true, args.uid, now, now, args.source, args.owner, args.quorum});
+    }
+    return nullptr;
+}
+
+Error LocalLocker::rlock(Context&, const dsync::LockArgs& args, bool& granted) {
+    std::lock_guard<std::mutex> lock(mu);
+    granted = false;
+    if (args.resources.empty()) {
+        return nullptr;
+    }
+    // Read locks are of one resource.
+    const auto& resource = args.resources[0];
+    auto& holders = lockMap[resource];
+    if (!holders.empty() && holders[0].writer) {
+        return nullptr;
+    }
+    auto now = std::chrono::steady_clock::now();
+    holders.push_back(LockRequesterInfo{resource, false, args.uid, now, now, args.source, args.owner, args.quorum});
+    granted = true;
+    return nullptr;
+}
+
+Error LocalLocker::unlock(Context&, const dsync::LockArgs& args, bool& released) {
+    std::lock_guard<std::mutex> lock(mu);
+    released = false;
+    for (const auto& resource : args.resources) {
+        auto it = lockMap.find(resource);
+        if (it == lockMap.end() || it->second.empty() || !it->second[0].writer) {
+            continue;
+        }
+        auto& holders = it->second;
+        auto n = holders.size();
+        std::erase_if(holders, [&](const LockRequesterInfo& l) { return l.uid == args.uid; });
+        released = released || holders.size() != n;
+        if (holders.empty()) {
+            lockMap.erase(it);
+        }
+    }
+    return nullptr;
+}
+
+Error LocalLocker::runlock(Context&, const dsync::LockArgs& args, bool& released) {
+    std::lock_guard<std::mutex> lock(mu);
+    released = false;
+    if (args.resources.empty()) {
+        return nullptr;
+    }
+    auto it = lockMap.find(args.resources[0]);
+    if (it == lockMap.end() || it->second.empty() || it->second[0].writer) {
+        return nullptr;
+    }
+    auto& holders = it->second;
+    auto holder = std::find_if(holders.begin(), holders.end(),
+                               [&](const LockRequesterInfo& l) { return l.uid == args.uid; });
+    if (holder != holders.end()) {
+        holders.erase(holder);
+        released = true;
+    }
+    if (holders.empty()) {
+        lockMap.erase(it);
+    }
+    return nullptr;
+}
+
+Error LocalLocker::refresh(Context&, const dsync::LockArgs& args, bool& refreshed) {
+    std::lock_guard<std::mutex> lock(mu);
+    refreshed = false;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& resource : args.resources) {
+        auto it = lockMap.find(resource);
+        if (it == lockMap.end()) {
+            continue;
+        }
+        for (auto& holder : it->second) {
+            if (holder.uid == args.uid) {
+                holder.timeLastRefresh = now;
+                refreshed = true;
+            }
+        }
+    }
+    return nullptr;
+}
+
+Error LocalLocker::forceUnlock(Context&, const dsync::LockArgs& args, bool& released) {
+    std::lock_guard<std::mutex> lock(mu);
+    released = false;
+    for (const auto& resource : args.resources) {
+        released = lockMap.erase(resource) != 0 || released;
+    }
+    return nullptr;
+}
+
+size_t LocalLocker::expire(std::chrono::milliseconds maxAge) {
+    std::lock_guard<std::mutex> lock(mu);
+    auto oldest = std::chrono::steady_clock::now() - maxAge;
+    size_t dropped = 0;
+    for (auto it = lockMap.begin(); it != lockMap.end();) {
+        dropped += std::erase_if(it->second, [&](const LockRequesterInfo& l) { return l.timeLastRefresh < oldest; });
+        it = it->second.empty() ? lockMap.erase(it) : std::next(it);
+    }
+    return dropped;
+}
+
+size_t LocalLocker::size() const {
+    std::lock_guard<std::mutex> lock(mu);
+    return lockMap.size();
+}
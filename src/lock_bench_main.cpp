@@ -0,0 +1,212 @@
+#include "include/cli.hpp"
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include "include/log.hpp"
+#include "include/dsync.hpp"
+#include "include/lock_rpc.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace cppio;
+
+Error lockBenchMain(cli::Context* ctx);
+
+// lock-bench runs the lock servers of a distributed setup as processes on
+// this machine and takes dsync locks from them, to measure the latency and
+// throughput of distributed locking under contention.
+cli::Command lockBenchCmd {
+    .name = "lock-bench",
+    .usage = "benchmark distributed locking on this machine",
+    .action = cli::ActionFunc(lockBenchMain),
+    .flags = { .optionsDescription = std::make_shared<boost::program_options::options_description>("Command Lock Bench Options") },
+    .hidden = true,
+    .customHelpTemplate = R"(NAME:
+  {{.HelpName}} - {{.Usage}}
+
+USAGE:
+  {{.HelpName}} --serve ADDRESS
+  {{.HelpName}} [FLAGS] --spawn N
+  {{.HelpName}} [FLAGS] --lockers ADDRESS1,ADDRESS2,...
+{{if .VisibleFlags}}
+FLAGS:
+  {{range .VisibleFlags}}{{.}}
+  {{end}}{{end}}
+EXAMPLES:
+  1. Start 4 lock servers as child processes and lock 16 objects from 32 clients.
+     {{.Prompt}} {{.HelpName}} --spawn 4 --clients 32 --resources 16
+)",
+};
+
+namespace {
+
+// Serves a lock table until SIGINT or SIGTERM.
+Error serveLocks(const std::string& address) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    LocalLocker locker(address);
+    LockServerOptions opts;
+    opts.address = address;
+    LockServer server(locker, opts);
+    if (auto err = server.start()) {
+        return err;
+    }
+    std::cout << "lock server listening on port " << server.port() << std::endl;
+    int sig = 0;
+    sigwait(&signals, &sig);
+    server.stop();
+    return nullptr;
+}
+
+// Starts 'n' lock servers as child processes on consecutive ports.
+std::vector<pid_t> spawnLockServers(int n, int basePort, std::vector<std::string>& addresses) {
+    std::vector<pid_t> pids;
+    for (int i = 0; i < n; ++i) {
+        auto address = "127.0.0.1:" + std::to_string(basePort + i);
+        auto pid = ::fork();
+        if (pid == 0) {
+            ::execl("/proc/self/exe", "cppio", "lock-bench", "--serve", address.c_str(), nullptr);
+            ::_exit(127);
+        }
+        if (pid > 0) {
+            pids.push_back(pid);
+            addresses.push_back(address);
+        }
+    }
+    return pids;
+}
+
+double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto i = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[i];
+}
+
+}
+
+Error lockBenchMain(cli::Context* ctx) {
+    namespace po = boost::program_options;
+    lockBenchCmd.flags.optionsDescription->add_options()
+        ("serve", po::value<std::string>(), "serve a lock table on ADDRESS:PORT, used by --spawn")
+        ("spawn", po::value<int>()->default_value(0), "start N lock servers on this machine")
+        ("base-port", po::value<int>()->default_value(9100), "first port of the spawned lock servers")
+        ("lockers", po::value<std::string>(), "comma separated ADDRESS:PORT of running lock servers")
+        ("clients", po::value<int>()->default_value(16), "concurrent lockers")
+        ("resources", po::value<int>()->default_value(64), "distinct resources locked, fewer contend more")
+        ("read-ratio", po::value<double>()->default_value(0.0), "fraction of read locks")
+        ("duration", po::value<int>()->default_value(10), "seconds to run")
+        ("positional", po::value<std::vector<std::string>>());
+    lockBenchCmd.flags.parse(ctx->argc, ctx->argv);
+    auto& flags = lockBenchCmd.flags;
+
+    if (flags.count("serve")) {
+        return serveLocks(flags["serve"].as<std::string>());
+    }
+
+    std::vector<std::string> addresses;
+    if (flags.count("lockers")) {
+        boost::split(addresses, flags["lockers"].as<std::string>(), boost::is_any_of(","));
+    }
+    auto pids = spawnLockServers(flags["spawn"].as<int>(), flags["base-port"].as<int>(), addresses);
+    if (addresses.empty()) {
+        std::cout << "Pls. provide --lockers or --spawn" << std::endl;
+        return nullptr;
+    }
+
+    std::vector<std::shared_ptr<RemoteLocker>> remotes;
+    std::vector<std::shared_ptr<dsync::NetLocker>> lockers;
+    for (const auto& address : addresses) {
+        remotes.push_back(std::make_shared<RemoteLocker>(address));
+        lockers.push_back(remotes.back());
+    }
+    dsync::Dsync ds;
+    ds.getLockers = [&]() { return std::make_pair(lockers, "lock-bench-" + std::to_string(::getpid())); };
+
+    // Spawned servers take a moment to listen.
+    {
+        Context c;
+        dsync::LockArgs probe;
+        probe.uid = "probe";
+        probe.resources = {"probe"};
+        for (auto& remote : remotes) {
+            bool ok;
+            for (int i = 0; i < 50 && remote->refresh(c, probe, ok); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+
+    auto clients = std::max(flags["clients"].as<int>(), 1);
+    auto resources = std::max(flags["resources"].as<int>(), 1);
+    auto readRatio = flags["read-ratio"].as<double>();
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(flags["duration"].as<int>());
+
+    std::mutex mu;
+    std::vector<double> latencies;
+    uint64_t failed = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.emplace_back([&, i]() {
+            Context c;
+            std::mt19937 rng(static_cast<unsigned>(i));
+            std::vector<double> mine;
+            uint64_t misses = 0;
+            while (std::chrono::steady_clock::now() < until) {
+                auto name = "bench/object-" + std::to_string(rng() % static_cast<unsigned>(resources));
+                auto read = std::uniform_real_distribution<double>(0, 1)(rng) < readRatio;
+                dsync::DRWMutex m(ds, {name});
+                auto start = std::chrono::steady_clock::now();
+                auto ok = read ? m.getRLock(c, "", "lock-bench", std::chrono::seconds(5))
+                               : m.getLock(c, "", "lock-bench", std::chrono::seconds(5));
+                if (!ok) {
+                    misses++;
+                    continue;
+                }
+                mine.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+                if (read) {
+                    m.runlock();
+                } else {
+                    m.unlock();
+                }
+            }
+            std::lock_guard<std::mutex> lock(mu);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+            failed += misses;
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t batches = 0, calls = 0;
+    for (auto& remote : remotes) {
+        batches += remote->batches();
+        calls += remote->calls();
+    }
+    auto seconds = std::max(flags["duration"].as<int>(), 1);
+    std::cout << "lockers " << addresses.size() << ", clients " << clients << ", resources " << resources << std::endl
+              << "locks " << latencies.size() << " (" << latencies.size() / static_cast<size_t>(seconds) << "/s), failed "
+              << failed << std::endl
+              << "latency us p50 " << percentile(latencies, 0.5) << " p99 " << percentile(latencies, 0.99)
+              << " p999 " << percentile(latencies, 0.999) << std::endl
+              << "calls per batch " << (batches ? static_cast<double>(calls) / static_cast<double>(batches) : 0)
+              << std::endl;
+
+    // Releases still in flight finish before the servers go.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for (auto pid : pids) {
+        ::kill(pid, SIGTERM);
+        ::waitpid(pid, nullptr, 0);
+    }
+    return nullptr;
+}
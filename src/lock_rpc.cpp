@@ -0,0 +1,471 @@
+#include "include/lock_rpc.hpp"
+#include "include/msgp.hpp"
+#include "include/storage_errors.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace cppio;
+
+namespace {
+
+enum LockOp : uint8_t {
+    opLock = 0,
+    opRLock,
+    opUnlock,
+    opRUnlock,
+    opRefresh,
+    opForceUnlock,
+};
+
+// Frames beyond this are a broken peer.
+const uint32_t lockMaxFrame = 64 * 1024 * 1024;
+// The server sweeps expired locks this often.
+const auto lockExpireSweep = std::chrono::seconds(1);
+// Callers waiting for a RemoteLocker answer check their context this often.
+const auto remoteLockerCancelPoll = std::chrono::milliseconds(10);
+
+bool splitHostPort(const std::string& address, std::string& host, std::string& port) {
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    return !port.empty();
+}
+
+bool writeFull(int fd, const uint8_t* p, size_t n) {
+    while (n > 0) {
+        auto w = ::send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return false;
+        }
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+bool readFull(int fd, uint8_t* p, size_t n) {
+    while (n > 0) {
+        auto r = ::recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        p += r;
+        n -= static_cast<size_t>(r);
+    }
+    return true;
+}
+
+bool writeFrame(int fd, std::vector<uint8_t>& frame) {
+    auto n = static_cast<uint32_t>(frame.size() - 4);
+    frame[0] = static_cast<uint8_t>(n >> 24);
+    frame[1] = static_cast<uint8_t>(n >> 16);
+    frame[2] = static_cast<uint8_t>(n >> 8);
+    frame[3] = static_cast<uint8_t>(n);
+    return writeFull(fd, frame.data(), frame.size());
+}
+
+bool readFrame(int fd, std::vector<uint8_t>& frame) {
+    uint8_t header[4];
+    if (!readFull(fd, header, sizeof(header))) {
+        return false;
+    }
+    auto n = uint32_t(header[0]) << 24 | uint32_t(header[1]) << 16 | uint32_t(header[2]) << 8 | header[3];
+    if (n > lockMaxFrame) {
+        return false;
+    }
+    frame.resize(n);
+    return readFull(fd, frame.data(), n);
+}
+
+void setTimeouts(int fd, std::chrono::milliseconds timeout) {
+    timeval tv{};
+    tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+void setNoDelay(int fd) {
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+}
+
+LockServer::LockServer(LocalLocker& locker, const LockServerOptions& opts) : locker(locker), opts(opts) {}
+
+Error LockServer::start() {
+    std::string host, port;
+    if (!splitHostPort(opts.address, host, port)) {
+        return errInvalidArgument;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* res = nullptr;
+    if (::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0 || !res) {
+        return errInvalidArgument;
+    }
+
+    int err = 0;
+    for (auto ai = res; ai && listenFd < 0; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            err = errno;
+            continue;
+        }
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || ::listen(fd, 128) < 0) {
+            err = errno;
+            ::close(fd);
+            continue;
+        }
+        listenFd = fd;
+    }
+    ::freeaddrinfo(res);
+    if (listenFd < 0) {
+        return newError(errCodeUnexpected, std::string("lock server: ") + std::strerror(err));
+    }
+
+    sockaddr_storage addr{};
+    socklen_t len = sizeof(addr);
+    ::getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+    boundPort = ntohs(addr.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port
+                                                 : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+
+    threads.emplace_back([this]() { acceptLoop(); });
+    // Locks of owners that stopped refreshing them are swept out.
+    threads.emplace_back([this]() {
+        std::unique_lock<std::mutex> lock(mu);
+        while (!cv.wait_for(lock, lockExpireSweep, [this]() { return stopping.load(); })) {
+            lock.unlock();
+            locker.expire(opts.expireAfter);
+            lock.lock();
+        }
+    });
+    return nullptr;
+}
+
+void LockServer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+        cv.notify_all();
+        if (listenFd >= 0) {
+            ::shutdown(listenFd, SHUT_RDWR);
+        }
+        for (auto fd : conns) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    // No connection is accepted past this point, the ones still served
+    // see their socket shut down.
+    {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [this]() { return conns.empty(); });
+    }
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        listenFd = -1;
+    }
+}
+
+void LockServer::acceptLoop() {
+    while (!stopping) {
+        pollfd pfd{listenFd, POLLIN, 0};
+        if (::poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        setNoDelay(fd);
+        std::lock_guard<std::mutex> lock(mu);
+        if (stopping) {
+            ::close(fd);
+            break;
+        }
+        // Detached, stop waits for 'conns' to drain instead of joining, so
+        // closed connections leave nothing behind.
+        conns.push_back(fd);
+        try {
+            std::thread([this, fd]() { serve(fd); }).detach();
+        } catch (const std::system_error&) {
+            std::erase(conns, fd);
+            ::close(fd);
+        }
+    }
+}
+
+void LockServer::serve(int fd) {
+    Context ctx;
+    std::vector<uint8_t> request, response;
+    dsync::LockArgs args;
+    while (readFrame(fd, request)) {
+        MsgpReader r(request);
+        auto n = r.readArrayHeader();
+        response.assign(4, 0);
+        MsgpWriter w(response);
+        w.appendArrayHeader(n);
+        // A malformed call fails the whole frame, answering fewer calls
+        // than the header says would desync the peer.
+        bool valid = true;
+        for (uint32_t i = 0; i < n && valid; ++i) {
+            if (r.readArrayHeader() != 6) {
+                valid = false;
+                break;
+            }
+            auto op = r.readUint();
+            args.uid = r.readString();
+            args.resources.resize(r.readArrayHeader());
+            for (auto& resource : args.resources) {
+                resource = r.readString();
+            }
+            args.owner = r.readString();
+            args.source = r.readString();
+            args.quorum = static_cast<int>(r.readInt());
+            if (!r.ok()) {
+                valid = false;
+                break;
+            }
+
+            bool result = false;
+            Error err;
+            switch (op) {
+            case opLock:        err = locker.lock(ctx, args, result); break;
+            case opRLock:       err = locker.rlock(ctx, args, result); break;
+            case opUnlock:      err = locker.unlock(ctx, args, result); break;
+            case opRUnlock:     err = locker.runlock(ctx, args, result); break;
+            case opRefresh:     err = locker.refresh(ctx, args, result); break;
+            case opForceUnlock: err = locker.forceUnlock(ctx, args, result); break;
+            default:            err = errInvalidArgument; break;
+            }
+            w.appendArrayHeader(2);
+            w.appendBool(result);
+            w.appendString(err ? err->msg : "");
+        }
+        if (!valid || !r.ok() || !writeFrame(fd, response)) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mu);
+    std::erase(conns, fd);
+    ::close(fd);
+    cv.notify_all();
+}
+
+// Call - a call of a RemoteLocker, shared by its caller and the sender.
+// A caller whose context ends first abandons it: not sent yet, it is
+// dropped, on the wire, its answer is.
+struct RemoteLocker::Call {
+    uint8_t                 op;
+    const dsync::LockArgs*  args;       // valid until sent or abandoned
+    bool                    result = false;
+    Error                   err;
+    bool                    done = false;
+    bool                    abandoned = false;
+};
+
+RemoteLocker::RemoteLocker(std::string address, std::chrono::milliseconds timeout)
+    : address(std::move(address)), timeout(timeout) {}
+
+Error RemoteLocker::lock(Context& ctx, const dsync::LockArgs& args, bool& granted) {
+    return call(ctx, opLock, args, granted);
+}
+
+Error RemoteLocker::rlock(Context& ctx, const dsync::LockArgs& args, bool& granted) {
+    return call(ctx, opRLock, args, granted);
+}
+
+Error RemoteLocker::unlock(Context& ctx, const dsync::LockArgs& args, bool& released) {
+    return call(ctx, opUnlock, args, released);
+}
+
+Error RemoteLocker::runlock(Context& ctx, const dsync::LockArgs& args, bool& released) {
+    return call(ctx, opRUnlock, args, released);
+}
+
+Error RemoteLocker::refresh(Context& ctx, const dsync::LockArgs& args, bool& refreshed) {
+    return call(ctx, opRefresh, args, refreshed);
+}
+
+Error RemoteLocker::forceUnlock(Context& ctx, const dsync::LockArgs& args, bool& released) {
+    return call(ctx, opForceUnlock, args, released);
+}
+
+void RemoteLocker::close() {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [this]() { return !sending; });
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+Error RemoteLocker::call(Context& ctx, uint8_t op, const dsync::LockArgs& args, bool& result) {
+    if (auto err = ctx.err()) {
+        return err;
+    }
+    auto c = std::make_shared<Call>();
+    c->op = op;
+    c->args = &args;
+
+    std::unique_lock<std::mutex> lock(mu);
+    queue.push_back(c);
+    if (!sending) {
+        sending = true;
+        Executor::global().submit([this]() { send(); });
+    }
+    // Contexts do not notify, their end is polled for.
+    while (!c->done) {
+        if (auto err = ctx.err()) {
+            c->abandoned = true;
+            c->args = nullptr;
+            return err;
+        }
+        cv.wait_until(lock, std::min(ctx.deadline(), Context::Clock::now() + remoteLockerCancelPoll));
+    }
+    result = c->result;
+    return c->err;
+}
+
+void RemoteLocker::send() {
+    std::unique_lock<std::mutex> lock(mu);
+    while (true) {
+        std::vector<std::shared_ptr<Call>> batch;
+        for (auto& c : queue) {
+            if (!c->abandoned) {
+                batch.push_back(std::move(c));
+            }
+        }
+        queue.clear();
+        if (batch.empty()) {
+            sending = false;
+            cv.notify_all();
+            return;
+        }
+
+        // Arguments are read while their callers can not abandon them.
+        std::vector<uint8_t> frame(4);
+        MsgpWriter w(frame);
+        w.appendArrayHeader(static_cast<uint32_t>(batch.size()));
+        for (const auto& c : batch) {
+            w.appendArrayHeader(6);
+            w.appendUint(c->op);
+            w.appendString(c->args->uid);
+            w.appendArrayHeader(static_cast<uint32_t>(c->args->resources.size()));
+            for (const auto& resource : c->args->resources) {
+                w.appendString(resource);
+            }
+            w.appendString(c->args->owner);
+            w.appendString(c->args->source);
+            w.appendInt(c->args->quorum);
+        }
+
+        lock.unlock();
+        std::vector<uint8_t> response;
+        auto err = roundTrip(frame, response);
+        lock.lock();
+
+        MsgpReader r(response);
+        if (!err && r.readArrayHeader() != batch.size()) {
+            err = errLockerOffline;
+        }
+        for (size_t i = 0; !err && i < batch.size(); ++i) {
+            auto ok = r.readArrayHeader() == 2;
+            batch[i]->result = r.readBool();
+            auto msg = r.readString();
+            if (!msg.empty()) {
+                batch[i]->err = newError(errCodeUnexpected, std::string(msg));
+            }
+            if (!ok || !r.ok()) {
+                err = errLockerOffline;
+            }
+        }
+        if (err) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+            online = false;
+        } else {
+            online = true;
+            batchCount++;
+            callCount += batch.size();
+        }
+        for (const auto& c : batch) {
+            if (err) {
+                c->err = err;
+            }
+            c->done = true;
+        }
+        cv.notify_all();
+    }
+}
+
+Error RemoteLocker::roundTrip(std::vector<uint8_t>& frame, std::vector<uint8_t>& response) {
+    if (fd < 0) {
+        std::string host, port;
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (!splitHostPort(address, host, port) || ::getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+            return errLockerOffline;
+        }
+        for (auto ai = res; ai && fd < 0; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            // The send timeout bounds connect as well.
+            setTimeouts(fd, timeout);
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(res);
+        if (fd < 0) {
+            return errLockerOffline;
+        }
+        setNoDelay(fd);
+    }
+
+    if (!writeFrame(fd, frame) || !readFrame(fd, response)) {
+        return errLockerOffline;
+    }
+    return nullptr;
+}
@@ -34,6 +34,7 @@ VERSION:
 )";
 
 extern cli::Command serverCmd;
+extern cli::Command lockBenchCmd;
 
 void init_logging() {
     // Create a file logger
@@ -58,6 +59,7 @@ std::shared_ptr<cli::App> newApp(std::string& appName) {
     app->flags = { .optionsDescription = globalOptions },
     app->hideHelpCommand = true;
     app->commands.push_back(&serverCmd);
+    app->commands.push_back(&lockBenchCmd);
     app->customAppHelpTemplate = cppioHelpTemplate;
     return app;
 }
@@ -0,0 +1,64 @@
+#include "include/metacache.hpp"
+#include "include/xl_storage_format_v2.hpp"
+
+#include <algorithm>
+
+using namespace cppio;
+
+bool MetaCacheEntry::matches(const MetaCacheEntry& other) const {
+    if (name != other.name || isDir() != other.isDir()) {
+        return false;
+    }
+    if (isDir() || metadata == other.metadata) {
+        return true;
+    }
+
+    // Drives write the same versions with different inline shards and
+    // erasure indexes, what has to agree is the version list.
+    XLMetaV2View a, b;
+    if (!isXL2(metadata) || !isXL2(other.metadata) || a.load(metadata) || b.load(other.metadata) ||
+        a.numVersions() != b.numVersions()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.numVersions(); ++i) {
+        auto va = a.version(i);
+        auto vb = b.version(i);
+        if (va.versionID() != vb.versionID() || va.modTime() != vb.modTime() || va.deleted() != vb.deleted()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool cppio::resolveMetaCacheEntries(const std::vector<const MetaCacheEntry*>& entries,
+                                    const MetaCacheResolveParams& params, MetaCacheEntry& resolved) {
+    int dirs = 0;
+    const MetaCacheEntry* best = nullptr;
+    int bestCount = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i]->isDir()) {
+            dirs++;
+            continue;
+        }
+        // Few drives list an object, grouping them pairwise is cheap.
+        int count = 0;
+        for (size_t j = 0; j < entries.size(); ++j) {
+            count += entries[j]->isObject() && entries[i]->matches(*entries[j]) ? 1 : 0;
+        }
+        if (count > bestCount) {
+            best = entries[i];
+            bestCount = count;
+        }
+    }
+
+    if (best != nullptr && bestCount >= params.objQuorum) {
+        resolved = *best;
+        return true;
+    }
+    if (dirs > 0 && dirs >= params.dirQuorum) {
+        auto dir = std::find_if(entries.begin(), entries.end(), [](const MetaCacheEntry* e) { return e->isDir(); });
+        resolved = **dir;
+        return true;
+    }
+    return false;
+}
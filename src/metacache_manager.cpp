@@ -0,0 +1,476 @@
+#include "include/metacache_manager.hpp"
+#include "include/erasure.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+using namespace cppio;
+
+namespace {
+
+const char hexDigits[] = "0123456789abcdef";
+
+std::string newMetacacheID() {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    std::string id;
+    for (int i = 0; i < 2; ++i) {
+        auto v = rng();
+        for (int j = 0; j < 16; ++j, v >>= 4) {
+            id.push_back(hexDigits[v & 0xf]);
+        }
+    }
+    return id;
+}
+
+int64_t unixNanos(std::chrono::system_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+// The directory a listing of 'prefix' walks, up to its last slash.
+std::string listRoot(const std::string& prefix) {
+    auto slash = prefix.rfind('/');
+    return slash == std::string::npos ? std::string() : prefix.substr(0, slash + 1);
+}
+
+}
+
+std::string cppio::encodeListContinuation(const std::string& id, const std::string& marker) {
+    std::string token = id + ".";
+    for (unsigned char c : marker) {
+        token.push_back(hexDigits[c >> 4]);
+        token.push_back(hexDigits[c & 0xf]);
+    }
+    return token;
+}
+
+bool cppio::decodeListContinuation(const std::string& token, std::string& id, std::string& marker) {
+    auto dot = token.find('.');
+    if (dot == std::string::npos || (token.size() - dot - 1) % 2 != 0) {
+        return false;
+    }
+    id = token.substr(0, dot);
+    marker.clear();
+    auto nibble = [](char c) {
+        return c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1);
+    };
+    for (size_t i = dot + 1; i < token.size(); i += 2) {
+        auto hi = nibble(token[i]);
+        auto lo = nibble(token[i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        marker.push_back(static_cast<char>(hi << 4 | lo));
+    }
+    return std::all_of(id.begin(), id.end(), [&](char c) { return nibble(c) >= 0; });
+}
+
+// Cache - a cached listing. The walk appends blocks to the index while
+// readers page through the ones written so far.
+struct Metacaches::Cache {
+    MetacacheIndex                          index;      // blocks and complete under mu
+    std::chrono::steady_clock::time_point   started;
+    std::shared_ptr<StorageAPI>             disk;       // holding the blocks
+    std::mutex                              mu;
+    std::condition_variable                 cv;
+    Error                                   err;        // of the walk
+    bool                                    done = false;
+    // Set once the cache is dropped; the walk stops and removes the blocks.
+    std::atomic<bool>                       dropped{false};
+};
+
+Metacaches::Metacaches(ErasureObjects& set, const MetacacheOptions& opts) : set(set), opts(opts) {}
+
+Metacaches::~Metacaches() {
+    // Nothing knows of the listings afterwards, their blocks go with them.
+    decltype(caches) all;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        all.swap(caches);
+    }
+    for (const auto& [id, cache] : all) {
+        drop(cache);
+    }
+    std::unique_lock<std::mutex> lock(buildMu);
+    buildCv.wait(lock, [this]() { return building == 0; });
+    bgCtx.cancel();
+}
+
+std::shared_ptr<Metacaches::Cache> Metacaches::find(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mu);
+    auto it = caches.find(id);
+    return it == caches.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<Metacaches::Cache> Metacaches::findOrStart(const std::string& bucket, const std::string& root,
+                                                           bool recursive) {
+    std::unique_lock<std::mutex> lock(mu);
+    std::shared_ptr<Cache> newest;
+    for (const auto& [id, cache] : caches) {
+        const auto& index = cache->index;
+        if (index.bucket == bucket && index.root == root && index.recursive == recursive &&
+            (!newest || cache->started > newest->started)) {
+            newest = cache;
+        }
+    }
+    if (newest) {
+        return newest;
+    }
+
+    auto cache = std::make_shared<Cache>();
+    cache->index.id = newMetacacheID();
+    cache->index.bucket = bucket;
+    cache->index.root = root;
+    cache->index.recursive = recursive;
+    cache->index.started = unixNanos(std::chrono::system_clock::now());
+    cache->started = std::chrono::steady_clock::now();
+
+    // The drive holding the blocks follows from the id, listings spread
+    // over the drives of the set.
+    auto disks = set.getDisks();
+    auto start = std::hash<std::string>{}(cache->index.id);
+    for (size_t i = 0; i < disks.size() && !cache->disk; ++i) {
+        auto& disk = disks[(start + i) % disks.size()];
+        if (disk && disk->isOnline()) {
+            cache->disk = disk;
+        }
+    }
+    if (!cache->disk) {
+        return nullptr;
+    }
+
+    if (caches.size() >= opts.maxCaches) {
+        auto oldest = std::min_element(caches.begin(), caches.end(), [](const auto& a, const auto& b) {
+            return a.second->started < b.second->started;
+        });
+        auto victim = oldest->second;
+        caches.erase(oldest);
+        lock.unlock();
+        drop(victim);
+        lock.lock();
+    }
+    caches.emplace(cache->index.id, cache);
+    lock.unlock();
+
+    build(cache);
+    return cache;
+}
+
+void Metacaches::build(const std::shared_ptr<Cache>& cache) {
+    {
+        std::lock_guard<std::mutex> lock(buildMu);
+        building++;
+    }
+    // Released with the task, which runAsync drops unrun once bgCtx is
+    // canceled.
+    std::shared_ptr<void> running(nullptr, [this](void*) {
+        std::lock_guard<std::mutex> lock(buildMu);
+        building--;
+        buildCv.notify_all();
+    });
+
+    bgCtx.runAsync([this, cache, running]() {
+        const auto& index = cache->index;
+        auto dir = metacacheDir(index.bucket, index.id);
+        auto& disk = *cache->disk;
+
+        Error err;
+        try {
+            disk.makeVol(cppioMetaBucket);
+        } catch (const StorageError& e) {
+            err = e.error() == errVolumeExists ? nullptr : e.error();
+        }
+
+        std::vector<MetaCacheEntry> pending;
+        std::vector<uint8_t> encoded;
+        auto flush = [&]() {
+            encodeMetacacheBlock(pending, encoded);
+            uint32_t n;
+            {
+                std::lock_guard<std::mutex> lock(cache->mu);
+                n = static_cast<uint32_t>(cache->index.blocks.size());
+            }
+            try {
+                disk.writeAll(cppioMetaBucket, metacacheBlockPath(index.bucket, index.id, n), encoded);
+            } catch (const StorageError& e) {
+                return e.error();
+            }
+            std::lock_guard<std::mutex> lock(cache->mu);
+            cache->index.blocks.push_back(MetacacheBlock{pending.front().name, pending.back().name,
+                                                         static_cast<uint32_t>(pending.size())});
+            pending.clear();
+            cache->cv.notify_all();
+            return Error();
+        };
+
+        if (!err) {
+            WalkDirOptions walk;
+            walk.bucket = index.bucket;
+            walk.baseDir = index.root;
+            walk.recursive = index.recursive;
+            err = set.listPath(bgCtx, walk, [&](MetaCacheEntry&& entry) {
+                if (cache->dropped) {
+                    return false;
+                }
+                // Recursive listings return objects only.
+                if (index.recursive && entry.isDir()) {
+                    return true;
+                }
+                pending.push_back(std::move(entry));
+                if (pending.size() >= opts.blockEntries) {
+                    err = flush();
+                }
+                return !err;
+            });
+            if (!err && !pending.empty() && !cache->dropped) {
+                err = flush();
+            }
+        }
+        if (!err && cache->dropped) {
+            err = newError(errCodeUnexpected, "listing cache dropped");
+        }
+
+        // The index goes next to the blocks once the listing is complete,
+        // before the cache can be dropped and removed.
+        if (!err) {
+            MetacacheIndex complete;
+            {
+                std::lock_guard<std::mutex> lock(cache->mu);
+                complete = cache->index;
+            }
+            complete.complete = true;
+            encoded.clear();
+            complete.encode(encoded);
+            try {
+                disk.writeAll(cppioMetaBucket, dir + "/" + metacacheIndexFile, encoded);
+            } catch (const StorageError&) {
+                // Readers go by the index in memory.
+            }
+        }
+
+        bool dropped;
+        {
+            std::lock_guard<std::mutex> lock(cache->mu);
+            cache->err = err;
+            cache->done = true;
+            cache->index.complete = !err;
+            dropped = cache->dropped;
+            cache->cv.notify_all();
+        }
+        if (dropped) {
+            try {
+                DeleteOptions opts;
+                opts.recursive = true;
+                disk.deletePath(cppioMetaBucket, dir, opts);
+            } catch (const StorageError&) {
+                // Nothing was written.
+            }
+        }
+    });
+}
+
+void Metacaches::drop(const std::shared_ptr<Cache>& cache) {
+    bool done;
+    {
+        std::lock_guard<std::mutex> lock(cache->mu);
+        cache->dropped = true;
+        done = cache->done;
+        cache->cv.notify_all();
+    }
+    if (!done) {
+        return;     // the walk removes the blocks on its way out
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(buildMu);
+        building++;
+    }
+    std::shared_ptr<void> running(nullptr, [this](void*) {
+        std::lock_guard<std::mutex> lock(buildMu);
+        building--;
+        buildCv.notify_all();
+    });
+    bgCtx.runAsync([cache, running]() {
+        try {
+            DeleteOptions opts;
+            opts.recursive = true;
+            cache->disk->deletePath(cppioMetaBucket, metacacheDir(cache->index.bucket, cache->index.id), opts);
+        } catch (const StorageError&) {
+        }
+    });
+}
+
+void Metacaches::forget(const std::shared_ptr<Cache>& cache) {
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        auto it = caches.find(cache->index.id);
+        if (it == caches.end() || it->second != cache) {
+            return;     // dropped already
+        }
+        caches.erase(it);
+    }
+    drop(cache);
+}
+
+void Metacaches::expire() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Cache>> expired;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        for (auto it = caches.begin(); it != caches.end();) {
+            if (now - it->second->started >= opts.ttl) {
+                expired.push_back(std::move(it->second));
+                it = caches.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto& cache : expired) {
+        drop(cache);
+    }
+}
+
+void Metacaches::objectChanged(const std::string& bucket, const std::string& object) {
+    std::vector<std::shared_ptr<Cache>> changed;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        for (auto it = caches.begin(); it != caches.end();) {
+            const auto& index = it->second->index;
+            if (index.bucket == bucket && object.starts_with(index.root)) {
+                changed.push_back(std::move(it->second));
+                it = caches.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto& cache : changed) {
+        drop(cache);
+    }
+}
+
+void Metacaches::bucketChanged(const std::string& bucket) {
+    objectChanged(bucket, "");
+}
+
+Error Metacaches::readBlock(const Cache& cache, uint32_t n, std::vector<MetaCacheEntry>& entries) {
+    std::vector<uint8_t> data;
+    try {
+        data = cache.disk->readAll(cppioMetaBucket, metacacheBlockPath(cache.index.bucket, cache.index.id, n));
+    } catch (const StorageError& e) {
+        return e.error();
+    }
+    return decodeMetacacheBlock(data, entries);
+}
+
+Error Metacaches::listPath(Context& ctx, const ListPathOptions& opts, ListPathResult& result) {
+    expire();
+    result = ListPathResult{};
+    auto limit = std::max(opts.limit, 1);
+    auto root = listRoot(opts.prefix);
+
+    std::string id;
+    auto marker = opts.marker;
+    if (!opts.continuationToken.empty() && !decodeListContinuation(opts.continuationToken, id, marker)) {
+        return errInvalidArgument;
+    }
+    std::shared_ptr<Cache> cache;
+    if (!id.empty()) {
+        cache = find(id);
+        if (cache && (cache->index.bucket != opts.bucket || cache->index.root != root ||
+                      cache->index.recursive != opts.recursive)) {
+            return errInvalidArgument;
+        }
+    }
+
+    // A cache dropped, or whose drive failed, while its blocks are being
+    // read is replaced by a new one, continuing after the last name
+    // returned.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (!cache) {
+            cache = findOrStart(opts.bucket, root, opts.recursive);
+            if (!cache) {
+                return errErasureReadQuorum;
+            }
+        }
+
+        Error err;
+        std::vector<MetaCacheEntry> block;
+        size_t n;
+        {
+            std::lock_guard<std::mutex> lock(cache->mu);
+            n = cache->index.seek(marker);
+        }
+        bool end = false;
+        bool readFailed = false;
+        while (!end) {
+            MetacacheBlock info;
+            {
+                std::unique_lock<std::mutex> lock(cache->mu);
+                while (cache->index.blocks.size() <= n && !cache->done && !cache->dropped) {
+                    if (ctx.isCanceled()) {
+                        return ctx.err();
+                    }
+                    cache->cv.wait_for(lock, std::chrono::milliseconds(100));
+                }
+                if (cache->index.blocks.size() <= n) {
+                    if (cache->dropped) {
+                        err = errFileNotFound;
+                    } else {
+                        err = cache->err;
+                        end = !err;
+                    }
+                    break;
+                }
+                info = cache->index.blocks[n];
+            }
+
+            // Blocks before the prefix are skipped unread, a block past
+            // it ends the listing.
+            if (info.last < opts.prefix || info.last <= marker) {
+                n++;
+                continue;
+            }
+            if (info.first > opts.prefix && !info.first.starts_with(opts.prefix)) {
+                end = true;
+                break;
+            }
+
+            block.clear();
+            if ((err = readBlock(*cache, static_cast<uint32_t>(n), block))) {
+                readFailed = true;
+                break;
+            }
+            for (auto& entry : block) {
+                if (entry.name <= marker || entry.name < opts.prefix) {
+                    continue;
+                }
+                if (!entry.name.starts_with(opts.prefix)) {
+                    end = true;
+                    break;
+                }
+                if (static_cast<int>(result.entries.size()) == limit) {
+                    result.truncated = true;
+                    result.continuationToken = encodeListContinuation(cache->index.id, result.entries.back().name);
+                    return nullptr;
+                }
+                result.entries.push_back(std::move(entry));
+            }
+            n++;
+        }
+        if (!err) {
+            return nullptr;
+        }
+        if (!cache->dropped && !readFailed) {
+            return err;     // the walk failed
+        }
+        forget(cache);
+        if (!result.entries.empty()) {
+            marker = result.entries.back().name;
+        }
+        cache = nullptr;
+    }
+    return errErasureReadQuorum;
+}
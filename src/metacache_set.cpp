@@ -0,0 +1,234 @@
+#include "include/metacache_set.hpp"
+#include "include/erasure.hpp"
+#include "include/erasure_coding.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+using namespace cppio;
+
+namespace {
+
+// EntryPipe - entries of one drive's walk on their way to the merge. The
+// walk blocks while the pipe is full, so a drive listing faster than the
+// others does not buffer more than the capacity.
+class EntryPipe {
+
+public:
+    explicit EntryPipe(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // Returns false once the merge is gone.
+    bool push(MetaCacheEntry&& entry) {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [this]() { return queue.size() < capacity || abandoned; });
+        if (abandoned) {
+            return false;
+        }
+        queue.push_back(std::move(entry));
+        cv.notify_all();
+        return true;
+    }
+
+    // Ends the walk.
+    void close(Error err) {
+        std::lock_guard<std::mutex> lock(mu);
+        closed = true;
+        walkErr = std::move(err);
+        cv.notify_all();
+    }
+
+    // Ends the merge, a blocked walk returns.
+    void abandon() {
+        std::lock_guard<std::mutex> lock(mu);
+        abandoned = true;
+        queue.clear();
+        cv.notify_all();
+    }
+
+    // Waits for the next entry. Returns false at the end of the walk, with
+    // its error, or when 'ctx' got canceled.
+    bool pop(Context& ctx, MetaCacheEntry& entry, Error& err) {
+        std::unique_lock<std::mutex> lock(mu);
+        while (queue.empty() && !closed) {
+            if (ctx.isCanceled()) {
+                return false;
+            }
+            cv.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (queue.empty()) {
+            err = walkErr;
+            return false;
+        }
+        entry = std::move(queue.front());
+        queue.pop_front();
+        cv.notify_all();
+        return true;
+    }
+
+private:
+    std::mutex                  mu;
+    std::condition_variable     cv;
+    std::deque<MetaCacheEntry>  queue;
+    size_t                      capacity;
+    bool                        closed = false;
+    bool                        abandoned = false;
+    Error                       walkErr;
+};
+
+}
+
+Error cppio::listPathRaw(Context& ctx, const ListPathRawOptions& opts, const MetaCacheEntryFn& fn) {
+    auto n = opts.disks.size();
+    // Walks may outlive the call, they run under a context of their own.
+    auto walkCtx = std::make_shared<Context>(Context::withCancel(ctx));
+    std::vector<std::shared_ptr<EntryPipe>> pipes(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (!opts.disks[i]) {
+            continue;
+        }
+        auto pipe = std::make_shared<EntryPipe>(opts.queueSize);
+        pipes[i] = pipe;
+        walkCtx->runAsync([pipe, walkCtx, disk = opts.disks[i], walk = opts.walk]() {
+            Error err;
+            try {
+                err = disk->walkDir(*walkCtx, walk, [&pipe](MetaCacheEntry&& entry) { return pipe->push(std::move(entry)); });
+            } catch (const StorageError& e) {
+                err = e.error();
+            } catch (const std::exception& e) {
+                err = newError(errCodeUnexpected, e.what());
+            }
+            pipe->close(err);
+        });
+    }
+
+    // Walks still running when the merge returns stop at their next entry.
+    struct Abandon {
+        Context&                                    walkCtx;
+        std::vector<std::shared_ptr<EntryPipe>>&    pipes;
+        ~Abandon() {
+            walkCtx.cancel();
+            for (auto& pipe : pipes) {
+                if (pipe) {
+                    pipe->abandon();
+                }
+            }
+        }
+    } abandon{*walkCtx, pipes};
+
+    // Merge on the heads of all drives. Sets have a handful of drives, a
+    // linear scan for the least name beats a heap.
+    std::vector<MetaCacheEntry> heads(n);
+    std::vector<bool> have(n), done(n);
+    std::vector<Error> errs(n);
+    std::vector<const MetaCacheEntry*> group;
+    std::vector<size_t> members;
+    for (size_t i = 0; i < n; ++i) {
+        if (!pipes[i]) {
+            done[i] = true;
+            errs[i] = errDiskNotFound;
+        }
+    }
+    while (true) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!done[i] && !have[i]) {
+                have[i] = pipes[i]->pop(ctx, heads[i], errs[i]);
+                done[i] = !have[i];
+            }
+        }
+        if (ctx.isCanceled()) {
+            return ctx.err();
+        }
+
+        const std::string* least = nullptr;
+        for (size_t i = 0; i < n; ++i) {
+            if (have[i] && (least == nullptr || heads[i].name < *least)) {
+                least = &heads[i].name;
+            }
+        }
+        if (least == nullptr) {
+            break;
+        }
+
+        group.clear();
+        members.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (have[i] && heads[i].name == *least) {
+                group.push_back(&heads[i]);
+                members.push_back(i);
+            }
+        }
+        MetaCacheEntry resolved;
+        auto found = resolveMetaCacheEntries(group, opts.resolve, resolved);
+        for (auto i : members) {
+            have[i] = false;
+        }
+        if (found && !fn(std::move(resolved))) {
+            return nullptr;
+        }
+    }
+
+    auto completed = static_cast<int>(std::count(errs.begin(), errs.end(), nullptr));
+    if (completed >= opts.minDisks) {
+        return nullptr;
+    }
+    // Report what most drives failed with, like the volume not existing.
+    Error reduced = errErasureReadQuorum;
+    long best = 0;
+    for (const auto& err : errs) {
+        auto count = std::count(errs.begin(), errs.end(), err);
+        if (err && count > best) {
+            reduced = err;
+            best = count;
+        }
+    }
+    return reduced;
+}
+
+Error ErasureObjects::listPath(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn) {
+    ListPathRawOptions raw;
+    raw.disks = getDisks();
+    raw.walk = opts;
+    auto drives = static_cast<int>(raw.disks.size());
+    raw.minDisks = defaultReadQuorum(drives);
+    raw.resolve.dirQuorum = (drives + 1) / 2;
+    raw.resolve.objQuorum = (drives + 1) / 2;
+    return listPathRaw(ctx, raw, fn);
+}
+
+Error ErasureObjects::listPathPage(Context& ctx, const ListPathOptions& opts, ListPathResult& result) {
+    if (metacaches) {
+        return metacaches->listPath(ctx, opts, result);
+    }
+
+    result = ListPathResult{};
+    auto limit = std::max(opts.limit, 1);
+    std::string id;
+    auto marker = opts.marker;
+    if (!opts.continuationToken.empty() && !decodeListContinuation(opts.continuationToken, id, marker)) {
+        return errInvalidArgument;
+    }
+
+    // Without a cache every page walks again, from the marker on.
+    WalkDirOptions walk;
+    walk.bucket = opts.bucket;
+    walk.baseDir = opts.prefix.substr(0, opts.prefix.rfind('/') + 1);
+    walk.filterPrefix = opts.prefix.substr(walk.baseDir.size());
+    walk.recursive = opts.recursive;
+    walk.forwardTo = marker;
+    auto err = listPath(ctx, walk, [&](MetaCacheEntry&& entry) {
+        if (entry.name <= marker || !entry.name.starts_with(opts.prefix) || (opts.recursive && entry.isDir())) {
+            return true;
+        }
+        if (static_cast<int>(result.entries.size()) == limit) {
+            result.truncated = true;
+            result.continuationToken = encodeListContinuation("", result.entries.back().name);
+            return false;
+        }
+        result.entries.push_back(std::move(entry));
+        return true;
+    });
+    return err;
+}
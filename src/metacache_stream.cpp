@@ -0,0 +1,120 @@
+#include "include/metacache_stream.hpp"
+#include "include/msgp.hpp"
+
+#include <algorithm>
+#include <zlib.h>
+
+using namespace cppio;
+
+namespace {
+
+const uint64_t metacacheIndexVersion = 1;
+// Blocks are written once and read a few times while paging, the fastest
+// deflate level is the better trade.
+const int metacacheBlockLevel = Z_BEST_SPEED;
+// A block decompressing to more than this is corrupt.
+const uint64_t metacacheMaxBlockSize = 1ull << 30;
+
+}
+
+std::string cppio::metacacheDir(const std::string& bucket, const std::string& id) {
+    return "buckets/" + bucket + "/.metacache/" + id;
+}
+
+std::string cppio::metacacheBlockPath(const std::string& bucket, const std::string& id, uint32_t n) {
+    return metacacheDir(bucket, id) + "/block-" + std::to_string(n);
+}
+
+void MetacacheIndex::encode(std::vector<uint8_t>& out) const {
+    MsgpWriter w(out);
+    w.appendArrayHeader(8);
+    w.appendUint(metacacheIndexVersion);
+    w.appendString(id);
+    w.appendString(bucket);
+    w.appendString(root);
+    w.appendBool(recursive);
+    w.appendBool(complete);
+    w.appendInt(started);
+    w.appendArrayHeader(static_cast<uint32_t>(blocks.size()));
+    for (const auto& block : blocks) {
+        w.appendArrayHeader(3);
+        w.appendString(block.first);
+        w.appendString(block.last);
+        w.appendUint(block.entries);
+    }
+}
+
+Error MetacacheIndex::decode(std::span<const uint8_t> data) {
+    MsgpReader r(data);
+    if (r.readArrayHeader() != 8 || r.readUint() != metacacheIndexVersion) {
+        return errFileCorrupt;
+    }
+    id = r.readString();
+    bucket = r.readString();
+    root = r.readString();
+    recursive = r.readBool();
+    complete = r.readBool();
+    started = r.readInt();
+    auto n = r.readArrayHeader();
+    blocks.clear();
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        if (r.readArrayHeader() != 3) {
+            return errFileCorrupt;
+        }
+        auto& block = blocks.emplace_back();
+        block.first = r.readString();
+        block.last = r.readString();
+        block.entries = static_cast<uint32_t>(r.readUint());
+    }
+    return r.error();
+}
+
+size_t MetacacheIndex::seek(const std::string& marker) const {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), marker,
+                               [](const std::string& m, const MetacacheBlock& b) { return m < b.last; });
+    return static_cast<size_t>(it - blocks.begin());
+}
+
+void cppio::encodeMetacacheBlock(std::span<const MetaCacheEntry> entries, std::vector<uint8_t>& out) {
+    std::vector<uint8_t> raw;
+    MsgpWriter w(raw);
+    w.appendArrayHeader(static_cast<uint32_t>(entries.size()));
+    for (const auto& entry : entries) {
+        w.appendString(entry.name);
+        w.appendBytes(entry.metadata);
+    }
+
+    // The raw size leads, the reader inflates with one call.
+    out.clear();
+    MsgpWriter(out).appendUint(raw.size());
+    auto header = out.size();
+    auto bound = ::compressBound(static_cast<uLong>(raw.size()));
+    out.resize(header + bound);
+    ::compress2(out.data() + header, &bound, raw.data(), static_cast<uLong>(raw.size()), metacacheBlockLevel);
+    out.resize(header + bound);
+}
+
+Error cppio::decodeMetacacheBlock(std::span<const uint8_t> data, std::vector<MetaCacheEntry>& entries) {
+    MsgpReader header(data);
+    auto size = header.readUint();
+    if (!header.ok() || size > metacacheMaxBlockSize) {
+        return errFileCorrupt;
+    }
+    std::vector<uint8_t> raw(size);
+    auto rawLen = static_cast<uLongf>(size);
+    auto consumed = static_cast<size_t>(header.position() - data.data());
+    if (::uncompress(raw.data(), &rawLen, header.position(), static_cast<uLong>(data.size() - consumed)) != Z_OK ||
+        rawLen != size) {
+        return errFileCorrupt;
+    }
+
+    MsgpReader r(raw);
+    auto n = r.readArrayHeader();
+    entries.reserve(entries.size() + n);
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        auto name = r.readString();
+        auto metadata = r.readBytes();
+        entries.push_back(MetaCacheEntry{std::string(name), std::vector<uint8_t>(metadata.begin(), metadata.end())});
+    }
+    return r.error();
+}
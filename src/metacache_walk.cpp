@@ -0,0 +1,264 @@
+#include "include/xl_storage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+using namespace cppio;
+
+namespace {
+
+// getdents64 fills this much per call, thousands of entries.
+const size_t readDirBufferSize = 128 * 1024;
+// Entries of a directory whose xl.meta is read with one readMultiple.
+const size_t walkMetaBatch = 64;
+
+// Lists 'dir' with getdents64, directories with a trailing slash. The
+// type comes with the entry, only symlinks and filesystems not reporting
+// types cost a stat. Stops after 'count' entries unless negative, returns
+// 0 or an errno.
+int readDirEntries(const std::string& dir, std::vector<std::string>& entries, std::vector<char>& buf, int count = -1) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    buf.resize(readDirBufferSize);
+
+    int err = 0;
+    while (count < 0 || static_cast<int>(entries.size()) < count) {
+        auto n = ::syscall(SYS_getdents64, fd, buf.data(), buf.size());
+        if (n <= 0) {
+            err = n < 0 ? errno : 0;
+            break;
+        }
+        for (long off = 0; off < n && (count < 0 || static_cast<int>(entries.size()) < count);) {
+            // glibc's dirent64 has the layout of the kernel's records.
+            auto d = reinterpret_cast<const struct dirent64*>(buf.data() + off);
+            off += d->d_reclen;
+            std::string_view name(d->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            auto type = d->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat st;
+                if (::fstatat(fd, d->d_name, &st, 0) < 0) {
+                    continue;   // gone or a dangling link
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+            }
+            if (type == DT_DIR) {
+                entries.emplace_back(name).push_back('/');
+            } else if (type == DT_REG) {
+                entries.emplace_back(name);
+            }
+        }
+    }
+    ::close(fd);
+    return err;
+}
+
+// DirWalker - a walkDir in progress. Every directory is listed, sorted and
+// its entries streamed in order; subdirectories are either objects, read
+// with their xl.meta, or directories that are returned, and walked into
+// when recursive, in between the entries they sort among. Memory is bound
+// by the largest directory times the depth.
+class DirWalker {
+
+public:
+    DirWalker(XLStorage& disk, Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn,
+              std::string volumeDir)
+        : disk(disk), ctx(ctx), opts(opts), fn(fn), volumeDir(std::move(volumeDir)) {}
+
+    Error walk() {
+        auto base = opts.baseDir;
+        if (!base.empty() && base.back() != '/') {
+            // The base may be an object of its own.
+            std::vector<ReadMultipleResp> resp;
+            readMeta(base + "/", {""}, resp);
+            if (!resp[0].error) {
+                emit(MetaCacheEntry{base, std::move(resp[0].data)});
+                return nullptr;
+            }
+            base += "/";
+        }
+        return scanDir(base, true);
+    }
+
+private:
+    // Reads the xl.meta of entries of dir 'current', metadata only.
+    void readMeta(const std::string& current, const std::vector<std::string>& entries,
+                  std::vector<ReadMultipleResp>& resp) {
+        ReadMultipleReq req;
+        req.bucket = opts.bucket;
+        req.prefix = current;
+        req.metadataOnly = true;
+        for (const auto& entry : entries) {
+            req.files.push_back(entry.empty() ? xlStorageFormatFile : entry + "/" + xlStorageFormatFile);
+        }
+        disk.readMultiple(req, resp);
+    }
+
+    // Hands an entry to the caller, entries before forwardTo are dropped.
+    // Returns false once the walk is to stop.
+    bool emit(MetaCacheEntry&& entry) {
+        if (stopped) {
+            return false;
+        }
+        if (!opts.forwardTo.empty() && entry.name < opts.forwardTo) {
+            return true;
+        }
+        auto object = entry.isObject();
+        if (!fn(std::move(entry)) || (object && opts.limit > 0 && ++objects >= opts.limit)) {
+            stopped = true;
+        }
+        return !stopped;
+    }
+
+    // Returns a directory found in the walk, walking it when recursive.
+    bool emitDir(const std::string& dir) {
+        if (opts.recursive) {
+            return !scanDir(dir, false) && !stopped;
+        }
+        // Only directories with something in them are prefixes.
+        std::vector<std::string> entries;
+        readDirEntries(volumeDir + dir, entries, buf, 1);
+        return entries.empty() || emit(MetaCacheEntry{dir, {}});
+    }
+
+    Error scanDir(const std::string& current, bool root) {
+        if (ctx.isCanceled()) {
+            stopped = true;
+            return nullptr;
+        }
+        std::vector<std::string> entries;
+        if (auto errnum = readDirEntries(volumeDir + current, entries, buf)) {
+            // Directories disappearing while being walked are no error.
+            if (!root || (errnum == ENOENT && !opts.reportNotFound)) {
+                return nullptr;
+            }
+            return errnum == ENOENT ? errFileNotFound : osErrToFileErr(errnum);
+        }
+
+        // Entries before forwardTo can be skipped at this level too.
+        std::string_view forward;
+        if (!opts.forwardTo.empty() && opts.forwardTo.starts_with(current)) {
+            forward = std::string_view(opts.forwardTo).substr(current.size());
+            forward = forward.substr(0, forward.find('/'));
+        }
+        auto prefix = root ? std::string_view(opts.filterPrefix) : std::string_view();
+
+        size_t kept = 0;
+        bool isObject = false;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            auto& entry = entries[i];
+            if (entry.back() != '/') {
+                // Files other than xl.meta are parts of objects.
+                isObject = isObject || entry == xlStorageFormatFile;
+                continue;
+            }
+            entry.pop_back();
+            if (!entry.starts_with(prefix) || entry < forward) {
+                continue;
+            }
+            if (kept != i) {
+                entries[kept] = std::move(entry);
+            }
+            kept++;
+        }
+        entries.resize(kept);
+
+        // Walking into an object happens only for a base naming one.
+        if (isObject && root && !current.empty()) {
+            std::vector<ReadMultipleResp> resp;
+            readMeta(current, {""}, resp);
+            if (!resp[0].error) {
+                emit(MetaCacheEntry{current.substr(0, current.size() - 1), std::move(resp[0].data)});
+            }
+            return nullptr;
+        }
+        if (entries.empty()) {
+            return nullptr;
+        }
+        if (!root && opts.recursive && !emit(MetaCacheEntry{current, {}})) {
+            return nullptr;
+        }
+        std::sort(entries.begin(), entries.end());
+
+        // Directories are returned with a slash, which sorts them after
+        // names their name is a prefix of: they wait on the stack until
+        // the first entry sorting after them.
+        std::vector<std::string> dirStack;
+        std::vector<std::string> batch;
+        std::vector<ReadMultipleResp> resp;
+        for (size_t i = 0; i < entries.size(); i += walkMetaBatch) {
+            if (ctx.isCanceled()) {
+                stopped = true;
+                return nullptr;
+            }
+            auto end = std::min(entries.size(), i + walkMetaBatch);
+            batch.assign(entries.begin() + static_cast<ptrdiff_t>(i), entries.begin() + static_cast<ptrdiff_t>(end));
+            readMeta(current, batch, resp);
+
+            for (size_t j = 0; j < batch.size(); ++j) {
+                auto name = current + batch[j];
+                while (!dirStack.empty() && dirStack.back() < name) {
+                    auto dir = std::move(dirStack.back());
+                    dirStack.pop_back();
+                    if (!emitDir(dir)) {
+                        return nullptr;
+                    }
+                }
+
+                auto& r = resp[j];
+                if (!r.error) {
+                    if (!emit(MetaCacheEntry{std::move(name), std::move(r.data)})) {
+                        return nullptr;
+                    }
+                } else if (r.error == errFileNotFound) {
+                    dirStack.push_back(name + "/");
+                }
+            }
+        }
+        while (!dirStack.empty()) {
+            auto dir = std::move(dirStack.back());
+            dirStack.pop_back();
+            if (!emitDir(dir)) {
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    XLStorage&                  disk;
+    Context&                    ctx;
+    const WalkDirOptions&       opts;
+    const MetaCacheEntryFn&     fn;
+    std::string                 volumeDir;      // with a trailing slash
+    std::vector<char>           buf;
+    int                         objects = 0;
+    bool                        stopped = false;
+};
+
+}
+
+Error XLStorage::walkDir(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn) {
+    std::string dir;
+    try {
+        dir = volumeDir(opts.bucket).string() + "/";
+    } catch (const StorageError& e) {
+        return e.error();
+    }
+    struct stat st;
+    if (::stat(dir.c_str(), &st) < 0) {
+        return osErrToVolErr(errno);
+    }
+    DirWalker walker(*this, ctx, opts, fn, std::move(dir));
+    return walker.walk();
+}
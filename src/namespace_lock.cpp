@@ -0,0 +1,328 @@
+#include "include/namespace_lock.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <functional>
+
+using namespace cppio;
+
+const Error cppio::errOperationTimedOut = newError(errCodeOperationTimedOut, "A timeout occurred while trying to lock a resource");
+
+namespace {
+
+// Entries are allocated this many at a time, then recycled.
+const size_t nsLockEntryChunk = 64;
+// A waiter looks at its context this often.
+const auto nsLockCancelPoll = std::chrono::milliseconds(100);
+
+size_t pathHash(std::string_view volume, std::string_view path) {
+    auto h = std::hash<std::string_view>{}(volume);
+    return h ^ (std::hash<std::string_view>{}(path) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+}
+
+uint64_t nanos(std::chrono::steady_clock::duration d) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+}
+
+// Waiter - a lock request waiting in the queue of its entry.
+struct nsLockMap::Waiter {
+    std::condition_variable cv;
+    bool                    write;
+    bool                    granted = false;
+    Waiter*                 next = nullptr;
+};
+
+// Entry - the lock of one path, in use while 'refs' holders and waiters
+// have it.
+struct nsLockMap::Entry {
+    std::string volume;
+    std::string path;
+    size_t      hash = 0;
+    Entry*      next = nullptr;     // in the bucket or the free list
+    int         refs = 0;
+    int         readers = 0;
+    bool        writer = false;
+    Waiter*     head = nullptr;     // waiters in arrival order
+    Waiter*     tail = nullptr;
+
+    bool is(size_t h, std::string_view v, std::string_view p) const {
+        return hash == h && volume == v && path == p;
+    }
+
+    bool grantable(bool write) const {
+        return write ? (!writer && readers == 0) : !writer;
+    }
+
+    void grant(bool write) {
+        if (write) {
+            writer = true;
+        } else {
+            readers++;
+        }
+    }
+
+    // Grants the waiters at the head of the queue that fit.
+    void dispatch() {
+        while (head && grantable(head->write)) {
+            auto w = head;
+            head = w->next;
+            if (!head) {
+                tail = nullptr;
+            }
+            grant(w->write);
+            w->granted = true;
+            w->cv.notify_one();
+        }
+    }
+
+    void remove(Waiter* w) {
+        Waiter* prev = nullptr;
+        for (auto it = head; it; prev = it, it = it->next) {
+            if (it == w) {
+                (prev ? prev->next : head) = w->next;
+                if (tail == w) {
+                    tail = prev;
+                }
+                return;
+            }
+        }
+    }
+};
+
+// Shard - a hash table of the entries in use of some paths. Shards are
+// cache line aligned, the counters of one do not share a line with the
+// mutex of the next.
+struct alignas(64) nsLockMap::Shard {
+    std::mutex                                  mu;
+    std::vector<Entry*>                         buckets;
+    size_t                                      used = 0;
+    Entry*                                      free = nullptr;
+    std::vector<std::unique_ptr<Entry[]>>       chunks;
+    NsLockStats                                 stats;
+
+    Entry* find(size_t h, std::string_view volume, std::string_view path) {
+        if (buckets.empty()) {
+            return nullptr;
+        }
+        for (auto e = buckets[h & (buckets.size() - 1)]; e; e = e->next) {
+            if (e->is(h, volume, path)) {
+                return e;
+            }
+        }
+        return nullptr;
+    }
+
+    Entry* insert(size_t h, std::string_view volume, std::string_view path) {
+        if (used >= buckets.size()) {
+            rehash(std::max<size_t>(16, buckets.size() * 2));
+        }
+        if (!free) {
+            chunks.emplace_back(new Entry[nsLockEntryChunk]);
+            for (size_t i = 0; i < nsLockEntryChunk; ++i) {
+                chunks.back()[i].next = free;
+                free = &chunks.back()[i];
+            }
+        }
+        auto e = free;
+        free = e->next;
+        // Recycled entries keep the capacity of their strings.
+        e->volume.assign(volume);
+        e->path.assign(path);
+        e->hash = h;
+        auto& bucket = buckets[h & (buckets.size() - 1)];
+        e->next = bucket;
+        bucket = e;
+        used++;
+        return e;
+    }
+
+    void recycle(Entry* e) {
+        auto* link = &buckets[e->hash & (buckets.size() - 1)];
+        while (*link != e) {
+            link = &(*link)->next;
+        }
+        *link = e->next;
+        e->next = free;
+        free = e;
+        used--;
+    }
+
+    void rehash(size_t n) {
+        std::vector<Entry*> grown(n);
+        for (auto head : buckets) {
+            while (head) {
+                auto e = head;
+                head = e->next;
+                auto& bucket = grown[e->hash & (n - 1)];
+                e->next = bucket;
+                bucket = e;
+            }
+        }
+        buckets.swap(grown);
+    }
+};
+
+nsLockMap::nsLockMap(const NsLockMapOptions& opts) {
+    size_t n = 1;
+    while (n < std::max(opts.shards, 1u)) {
+        n <<= 1;
+    }
+    shards.reset(new Shard[n]);
+    shardMask = n - 1;
+}
+
+nsLockMap::~nsLockMap() = default;
+
+Error nsLockMap::lock(Context& ctx, std::string_view volume, std::string_view path, std::chrono::milliseconds timeout) {
+    return acquire(ctx, volume, path, true, timeout);
+}
+
+Error nsLockMap::rlock(Context& ctx, std::string_view volume, std::string_view path, std::chrono::milliseconds timeout) {
+    return acquire(ctx, volume, path, false, timeout);
+}
+
+void nsLockMap::unlock(std::string_view volume, std::string_view path) {
+    release(volume, path, true);
+}
+
+void nsLockMap::runlock(std::string_view volume, std::string_view path) {
+    release(volume, path, false);
+}
+
+Error nsLockMap::acquire(Context& ctx, std::string_view volume, std::string_view path, bool write,
+                         std::chrono::milliseconds timeout) {
+    auto h = pathHash(volume, path);
+    // The high bits pick the shard, the low ones the bucket within.
+    auto& shard = shards[(h >> 48) & shardMask];
+    std::unique_lock<std::mutex> lock(shard.mu);
+    auto e = shard.find(h, volume, path);
+    if (!e) {
+        e = shard.insert(h, volume, path);
+    }
+    e->refs++;
+
+    if (!e->head && e->grantable(write)) {
+        e->grant(write);
+        (write ? shard.stats.locks : shard.stats.rlocks)++;
+        return nullptr;
+    }
+
+    Waiter w;
+    w.write = write;
+    (e->tail ? e->tail->next : e->head) = &w;
+    e->tail = &w;
+
+    // Only waiters read the clock.
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + timeout;
+    Error err;
+    while (!w.granted) {
+        auto now = std::chrono::steady_clock::now();
+        if (ctx.isCanceled()) {
+            err = ctx.err();
+            shard.stats.canceled++;
+            break;
+        }
+        if (now >= deadline) {
+            err = errOperationTimedOut;
+            shard.stats.timeouts++;
+            break;
+        }
+        w.cv.wait_until(lock, std::min(deadline, now + nsLockCancelPoll));
+    }
+
+    auto waited = nanos(std::chrono::steady_clock::now() - start);
+    shard.stats.waitTime += waited;
+    shard.stats.maxWaitTime = std::max(shard.stats.maxWaitTime, waited);
+    if (!err) {
+        shard.stats.contended++;
+        (write ? shard.stats.locks : shard.stats.rlocks)++;
+        return nullptr;
+    }
+
+    // A writer leaving the head of the queue may let readers behind it in.
+    e->remove(&w);
+    e->dispatch();
+    if (--e->refs == 0) {
+        shard.recycle(e);
+    }
+    return err;
+}
+
+void nsLockMap::release(std::string_view volume, std::string_view path, bool write) {
+    auto h = pathHash(volume, path);
+    auto& shard = shards[(h >> 48) & shardMask];
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto e = shard.find(h, volume, path);
+    if (!e || (write ? !e->writer : e->readers == 0)) {
+        return;     // not locked, unlocking twice is harmless
+    }
+    if (write) {
+        e->writer = false;
+    } else {
+        e->readers--;
+    }
+    e->dispatch();
+    if (--e->refs == 0) {
+        shard.recycle(e);
+    }
+}
+
+NsLockStats nsLockMap::stats() const {
+    NsLockStats total;
+    for (size_t i = 0; i <= shardMask; ++i) {
+        auto& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mu);
+        total.locks += shard.stats.locks;
+        total.rlocks += shard.stats.rlocks;
+        total.contended += shard.stats.contended;
+        total.timeouts += shard.stats.timeouts;
+        total.canceled += shard.stats.canceled;
+        total.waitTime += shard.stats.waitTime;
+        total.maxWaitTime = std::max(total.maxWaitTime, shard.stats.maxWaitTime);
+        total.held += shard.used;
+    }
+    return total;
+}
+
+NsLock::NsLock(nsLockMap& map, std::string volume, std::vector<std::string> paths)
+    : map(map), volume(std::move(volume)), paths(std::move(paths)) {
+    std::sort(this->paths.begin(), this->paths.end());
+    this->paths.erase(std::unique(this->paths.begin(), this->paths.end()), this->paths.end());
+}
+
+Error NsLock::getLock(Context& ctx, std::chrono::milliseconds timeout) {
+    return take(ctx, timeout, true);
+}
+
+Error NsLock::getRLock(Context& ctx, std::chrono::milliseconds timeout) {
+    return take(ctx, timeout, false);
+}
+
+Error NsLock::take(Context& ctx, std::chrono::milliseconds timeout, bool write) {
+    unlock();
+    this->write = write;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (; held < paths.size(); ++held) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        left = std::max(left, std::chrono::milliseconds(0));
+        auto err = write ? map.lock(ctx, volume, paths[held], left) : map.rlock(ctx, volume, paths[held], left);
+        if (err) {
+            unlock();
+            return err;
+        }
+    }
+    return nullptr;
+}
+
+void NsLock::unlock() {
+    for (; held > 0; --held) {
+        if (write) {
+            map.unlock(volume, paths[held - 1]);
+        } else {
+            map.runlock(volume, paths[held - 1]);
+        }
+    }
+}
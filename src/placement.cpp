@@ -0,0 +1,183 @@
+#include "include/placement.hpp"
+#include "include/globals.hpp"
+
+#include <bit>
+#include <cstring>
+#include <random>
+#include <zlib.h>
+
+using namespace cppio;
+
+namespace {
+
+inline uint64_t loadLE64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big) {
+        v = __builtin_bswap64(v);
+    }
+    return v;
+}
+
+inline void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = std::rotl(v1, 13); v1 ^= v0; v0 = std::rotl(v0, 32);
+    v2 += v3; v3 = std::rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = std::rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = std::rotl(v1, 17); v1 ^= v2; v2 = std::rotl(v2, 32);
+}
+
+// SipHash-2-4 from the keyed state.
+uint64_t sipHashKeyed(uint64_t v0, uint64_t v1, uint64_t v2, uint64_t v3, std::string_view data) {
+    auto p = data.data();
+    auto n = data.size();
+    for (; n >= 8; p += 8, n -= 8) {
+        auto m = loadLE64(p);
+        v3 ^= m;
+        sipRound(v0, v1, v2, v3);
+        sipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    auto b = static_cast<uint64_t>(data.size()) << 56;
+    for (size_t i = 0; i < n; ++i) {
+        b |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+    }
+    v3 ^= b;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i) {
+        sipRound(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+void sipHashKeys(const std::array<uint8_t, 16>& id, uint64_t& k0, uint64_t& k1) {
+    k0 = loadLE64(reinterpret_cast<const char*>(id.data()));
+    k1 = loadLE64(reinterpret_cast<const char*>(id.data() + 8));
+}
+
+}
+
+uint64_t cppio::sipHash24(uint64_t k0, uint64_t k1, std::string_view data) {
+    return sipHashKeyed(k0 ^ 0x736f6d6570736575ULL, k1 ^ 0x646f72616e646f6dULL,
+                        k0 ^ 0x6c7967656e657261ULL, k1 ^ 0x7465646279746573ULL, data);
+}
+
+int cppio::crcHashMod(std::string_view key, int cardinality) {
+    if (cardinality <= 0) {
+        return -1;
+    }
+    auto sum = ::crc32(0L, reinterpret_cast<const Bytef*>(key.data()), static_cast<uInt>(key.size()));
+    return static_cast<int>(sum % static_cast<uint64_t>(cardinality));
+}
+
+int cppio::sipHashMod(std::string_view key, int cardinality, const std::array<uint8_t, 16>& id) {
+    if (cardinality <= 0) {
+        return -1;
+    }
+    uint64_t k0, k1;
+    sipHashKeys(id, k0, k1);
+    return static_cast<int>(sipHash24(k0, k1, key) % static_cast<uint64_t>(cardinality));
+}
+
+SetPlacement::SetPlacement(std::string_view distributionAlgo, const std::array<uint8_t, 16>& deploymentID, int setCount)
+    : crc(distributionAlgo != formatErasureVersionV3DistributionAlgoV2 &&
+          distributionAlgo != formatErasureVersionV3DistributionAlgoV3),
+      sets(setCount > 0 ? static_cast<uint64_t>(setCount) : 0) {
+    uint64_t k0, k1;
+    sipHashKeys(deploymentID, k0, k1);
+    v0 = k0 ^ 0x736f6d6570736575ULL;
+    v1 = k1 ^ 0x646f72616e646f6dULL;
+    v2 = k0 ^ 0x6c7967656e657261ULL;
+    v3 = k1 ^ 0x7465646279746573ULL;
+}
+
+int SetPlacement::setIndex(std::string_view object) const {
+    if (sets == 0) {
+        return -1;
+    }
+    if (sets == 1) {
+        return 0;
+    }
+    if (crc) {
+        auto sum = ::crc32(0L, reinterpret_cast<const Bytef*>(object.data()), static_cast<uInt>(object.size()));
+        return static_cast<int>(sum % sets);
+    }
+    return static_cast<int>(sipHashKeyed(v0, v1, v2, v3, object) % sets);
+}
+
+uint64_t cppio::setAvailableSpace(const std::vector<DiskInfo>& disks, uint64_t size, int dataBlocks) {
+    if (dataBlocks <= 0) {
+        return 0;
+    }
+    uint64_t available = 0;
+    uint64_t total = 0;
+    size_t online = 0;
+    for (const auto& disk : disks) {
+        if (disk.total == 0) {
+            continue;
+        }
+        online++;
+        total += disk.total;
+        available += disk.total > disk.used ? disk.total - disk.used : 0;
+    }
+    if (online == 0 || online < disks.size() / 2) {
+        return 0;
+    }
+    // Every drive holds a shard, a dataBlocks part of the object: parity
+    // drives take as much as data drives.
+    auto perDrive = (size + static_cast<uint64_t>(dataBlocks) - 1) / static_cast<uint64_t>(dataBlocks);
+    auto usage = perDrive * online;
+    for (const auto& disk : disks) {
+        if (disk.total == 0) {
+            continue;
+        }
+        if (disk.freeInodes < static_cast<uint64_t>(diskMinInodes) && disk.usedInodes > 0) {
+            return 0;
+        }
+        if (disk.free <= perDrive) {
+            return 0;
+        }
+    }
+    // Room left after the shards has to stay above the fill fraction.
+    auto reserved = static_cast<uint64_t>(static_cast<double>(total) * (1.0 - diskFillFraction));
+    if (available < usage || available - usage <= reserved) {
+        return 0;
+    }
+    return available;
+}
+
+int cppio::choosePool(std::span<const uint64_t> available, uint64_t random) {
+    uint64_t total = 0;
+    for (auto a : available) {
+        total += a;
+    }
+    if (total == 0) {
+        return -1;
+    }
+    auto choose = random % total;
+    uint64_t at = 0;
+    for (size_t i = 0; i < available.size(); ++i) {
+        at += available[i];
+        if (at > choose) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+PoolPlacement::PoolPlacement(std::string_view distributionAlgo, const std::array<uint8_t, 16>& deploymentID,
+                             const std::vector<int>& setCounts) {
+    tables.reserve(setCounts.size());
+    for (auto sets : setCounts) {
+        tables.emplace_back(distributionAlgo, deploymentID, sets);
+    }
+}
+
+PoolPlacement::PoolPlacement(std::vector<SetPlacement> tables) : tables(std::move(tables)) {}
+
+int PoolPlacement::choosePool(std::span<const uint64_t> available) const {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    return cppio::choosePool(available, rng());
+}
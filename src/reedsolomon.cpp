@@ -0,0 +1,540 @@
+#include "include/reedsolomon.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <immintrin.h>
+
+using namespace cppio;
+
+namespace cppio {
+
+const Error errInvShardNum = newError(errCodeInvShardNum, "cannot create Encoder with less than one data shard or less than zero parity shards");
+const Error errTooFewShards = newError(errCodeTooFewShards, "too few shards given");
+const Error errShortData = newError(errCodeShortData, "not enough data to fill the number of requested shards");
+const Error errShardSize = newError(errCodeShardSize, "shard sizes do not match");
+
+}
+
+namespace {
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 and generator 2,
+// the field of klauspost/reedsolomon.
+struct GaloisTables {
+    uint8_t exp[510] = {};
+    uint8_t log[256] = {};
+
+    constexpr GaloisTables() {
+        int x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = static_cast<uint8_t>(x);
+            exp[i + 255] = static_cast<uint8_t>(x);
+            log[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11d;
+            }
+        }
+    }
+};
+
+constexpr GaloisTables galois;
+
+uint8_t galMultiply(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return galois.exp[galois.log[a] + galois.log[b]];
+}
+
+uint8_t galDivide(uint8_t a, uint8_t b) {
+    if (a == 0) {
+        return 0;
+    }
+    return galois.exp[galois.log[a] + 255 - galois.log[b]];
+}
+
+// galExp returns a to the power of n.
+uint8_t galExp(uint8_t a, int n) {
+    if (n == 0) {
+        return 1;
+    }
+    if (a == 0) {
+        return 0;
+    }
+    return galois.exp[(galois.log[a] * n) % 255];
+}
+
+// Full product table for the scalar kernel and the shard tails.
+const std::array<std::array<uint8_t, 256>, 256> mulTable = []() {
+    std::array<std::array<uint8_t, 256>, 256> t{};
+    for (int a = 0; a < 256; ++a) {
+        for (int b = 0; b < 256; ++b) {
+            t[a][b] = galMultiply(static_cast<uint8_t>(a), static_cast<uint8_t>(b));
+        }
+    }
+    return t;
+}();
+
+GfCoeff makeCoeff(uint8_t c) {
+    GfCoeff coeff;
+    coeff.value = c;
+    for (int i = 0; i < 16; ++i) {
+        coeff.lo[i] = galMultiply(c, static_cast<uint8_t>(i));
+        coeff.hi[i] = galMultiply(c, static_cast<uint8_t>(i << 4));
+    }
+    // Multiplying by c is linear over GF(2): bit j of the input adds
+    // c * 2^j to the product. Row i of the bit matrix, which produces
+    // output bit i, lives in byte 7 - i of the GF2P8AFFINE operand.
+    for (int i = 0; i < 8; ++i) {
+        uint64_t row = 0;
+        for (int j = 0; j < 8; ++j) {
+            row |= static_cast<uint64_t>((galMultiply(c, static_cast<uint8_t>(1 << j)) >> i) & 1) << j;
+        }
+        coeff.affine |= row << (8 * (7 - i));
+    }
+    return coeff;
+}
+
+// Matrices of the codec setup are plain row major byte vectors.
+using Matrix = std::vector<uint8_t>;
+
+Matrix matrixMultiply(const Matrix& a, int aRows, int aCols, const Matrix& b, int bCols) {
+    Matrix r(static_cast<size_t>(aRows) * bCols);
+    for (int i = 0; i < aRows; ++i) {
+        for (int j = 0; j < bCols; ++j) {
+            uint8_t v = 0;
+            for (int k = 0; k < aCols; ++k) {
+                v ^= galMultiply(a[i * aCols + k], b[k * bCols + j]);
+            }
+            r[i * bCols + j] = v;
+        }
+    }
+    return r;
+}
+
+// matrixInvert inverts a square matrix with Gauss-Jordan elimination,
+// returns false when it is singular.
+bool matrixInvert(Matrix& m, int n) {
+    // Work on [m | I], ending up with [I | m^-1].
+    Matrix w(static_cast<size_t>(n) * n * 2);
+    for (int r = 0; r < n; ++r) {
+        std::memcpy(&w[r * 2 * n], &m[r * n], n);
+        w[r * 2 * n + n + r] = 1;
+    }
+
+    auto row = [&w, n](int r) { return &w[r * 2 * n]; };
+    for (int r = 0; r < n; ++r) {
+        if (row(r)[r] == 0) {
+            int below = r + 1;
+            while (below < n && row(below)[r] == 0) {
+                ++below;
+            }
+            if (below == n) {
+                return false;
+            }
+            std::swap_ranges(row(r), row(r) + 2 * n, row(below));
+        }
+        if (row(r)[r] != 1) {
+            auto scale = galDivide(1, row(r)[r]);
+            for (int c = 0; c < 2 * n; ++c) {
+                row(r)[c] = galMultiply(row(r)[c], scale);
+            }
+        }
+        for (int other = 0; other < n; ++other) {
+            auto f = row(other)[r];
+            if (other == r || f == 0) {
+                continue;
+            }
+            for (int c = 0; c < 2 * n; ++c) {
+                row(other)[c] ^= galMultiply(f, row(r)[c]);
+            }
+        }
+    }
+
+    for (int r = 0; r < n; ++r) {
+        std::memcpy(&m[r * n], row(r) + n, n);
+    }
+    return true;
+}
+
+// buildMatrix creates the encoding matrix: a Vandermonde matrix multiplied
+// by the inverse of its top square, so the top rows are the identity and
+// data shards are stored as is.
+Matrix buildMatrix(int dataShards, int totalShards) {
+    Matrix vm(static_cast<size_t>(totalShards) * dataShards);
+    for (int r = 0; r < totalShards; ++r) {
+        for (int c = 0; c < dataShards; ++c) {
+            vm[r * dataShards + c] = galExp(static_cast<uint8_t>(r), c);
+        }
+    }
+
+    Matrix top(vm.begin(), vm.begin() + static_cast<size_t>(dataShards) * dataShards);
+    if (!matrixInvert(top, dataShards)) {
+        throw std::logic_error("reedsolomon: singular vandermonde matrix");
+    }
+    return matrixMultiply(vm, totalShards, dataShards, top, dataShards);
+}
+
+GfMatrix toGfMatrix(const uint8_t* m, int rows, int cols) {
+    GfMatrix g;
+    g.rows = rows;
+    g.cols = cols;
+    g.coeffs.reserve(static_cast<size_t>(rows) * cols);
+    for (int i = 0; i < rows * cols; ++i) {
+        g.coeffs.push_back(makeCoeff(m[i]));
+    }
+    return g;
+}
+
+// Kernels compute out[q] = sum(coeffs[q][j] * in[j]) over [start, end)
+// for G rows at once, so every input vector is loaded once per G outputs.
+// The SIMD kernels expect (end - start) to be a multiple of their width.
+using RowsFunc = void (*)(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                          size_t start, size_t end);
+
+template <int G>
+void mulRowsGeneric(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                    size_t start, size_t end) {
+    for (int q = 0; q < G; ++q) {
+        auto dst = out[q];
+        for (int j = 0; j < cols; ++j) {
+            const auto& t = mulTable[coeffs[q * cols + j].value];
+            auto src = in[j];
+            if (j == 0) {
+                for (size_t pos = start; pos < end; ++pos) {
+                    dst[pos] = t[src[pos]];
+                }
+            } else {
+                for (size_t pos = start; pos < end; ++pos) {
+                    dst[pos] ^= t[src[pos]];
+                }
+            }
+        }
+    }
+}
+
+template <int G>
+__attribute__((target("ssse3")))
+void mulRowsSsse3(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                  size_t start, size_t end) {
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for (size_t pos = start; pos < end; pos += 16) {
+        __m128i acc[G];
+        for (int q = 0; q < G; ++q) {
+            acc[q] = _mm_setzero_si128();
+        }
+        for (int j = 0; j < cols; ++j) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in[j] + pos));
+            __m128i lo = _mm_and_si128(x, mask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+            for (int q = 0; q < G; ++q) {
+                const auto& c = coeffs[q * cols + j];
+                __m128i tlo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.lo));
+                __m128i thi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.hi));
+                acc[q] = _mm_xor_si128(acc[q], _mm_xor_si128(_mm_shuffle_epi8(tlo, lo), _mm_shuffle_epi8(thi, hi)));
+            }
+        }
+        for (int q = 0; q < G; ++q) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[q] + pos), acc[q]);
+        }
+    }
+}
+
+template <int G>
+__attribute__((target("avx2")))
+void mulRowsAvx2(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                 size_t start, size_t end) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    for (size_t pos = start; pos < end; pos += 32) {
+        __m256i acc[G];
+        for (int q = 0; q < G; ++q) {
+            acc[q] = _mm256_setzero_si256();
+        }
+        for (int j = 0; j < cols; ++j) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in[j] + pos));
+            __m256i lo = _mm256_and_si256(x, mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+            for (int q = 0; q < G; ++q) {
+                const auto& c = coeffs[q * cols + j];
+                __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.lo)));
+                __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.hi)));
+                acc[q] = _mm256_xor_si256(acc[q], _mm256_xor_si256(_mm256_shuffle_epi8(tlo, lo), _mm256_shuffle_epi8(thi, hi)));
+            }
+        }
+        for (int q = 0; q < G; ++q) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out[q] + pos), acc[q]);
+        }
+    }
+}
+
+template <int G>
+__attribute__((target("avx2,gfni")))
+void mulRowsGfniAvx2(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                     size_t start, size_t end) {
+    for (size_t pos = start; pos < end; pos += 32) {
+        __m256i acc[G];
+        for (int q = 0; q < G; ++q) {
+            acc[q] = _mm256_setzero_si256();
+        }
+        for (int j = 0; j < cols; ++j) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in[j] + pos));
+            for (int q = 0; q < G; ++q) {
+                __m256i a = _mm256_set1_epi64x(static_cast<long long>(coeffs[q * cols + j].affine));
+                acc[q] = _mm256_xor_si256(acc[q], _mm256_gf2p8affine_epi64_epi8(x, a, 0));
+            }
+        }
+        for (int q = 0; q < G; ++q) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out[q] + pos), acc[q]);
+        }
+    }
+}
+
+template <int G>
+__attribute__((target("avx512f,avx512bw")))
+void mulRowsAvx512(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                   size_t start, size_t end) {
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    for (size_t pos = start; pos < end; pos += 64) {
+        __m512i acc[G];
+        for (int q = 0; q < G; ++q) {
+            acc[q] = _mm512_setzero_si512();
+        }
+        for (int j = 0; j < cols; ++j) {
+            __m512i x = _mm512_loadu_si512(in[j] + pos);
+            __m512i lo = _mm512_and_si512(x, mask);
+            __m512i hi = _mm512_and_si512(_mm512_srli_epi64(x, 4), mask);
+            for (int q = 0; q < G; ++q) {
+                const auto& c = coeffs[q * cols + j];
+                __m512i tlo = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.lo)));
+                __m512i thi = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.hi)));
+                acc[q] = _mm512_xor_si512(acc[q], _mm512_xor_si512(_mm512_shuffle_epi8(tlo, lo), _mm512_shuffle_epi8(thi, hi)));
+            }
+        }
+        for (int q = 0; q < G; ++q) {
+            _mm512_storeu_si512(out[q] + pos, acc[q]);
+        }
+    }
+}
+
+template <int G>
+__attribute__((target("avx512f,avx512bw,gfni")))
+void mulRowsGfniAvx512(const GfCoeff* coeffs, int cols, const uint8_t* const* in, uint8_t* const* out,
+                       size_t start, size_t end) {
+    for (size_t pos = start; pos < end; pos += 64) {
+        __m512i acc[G];
+        for (int q = 0; q < G; ++q) {
+            acc[q] = _mm512_setzero_si512();
+        }
+        for (int j = 0; j < cols; ++j) {
+            __m512i x = _mm512_loadu_si512(in[j] + pos);
+            for (int q = 0; q < G; ++q) {
+                __m512i a = _mm512_set1_epi64(static_cast<long long>(coeffs[q * cols + j].affine));
+                acc[q] = _mm512_xor_si512(acc[q], _mm512_gf2p8affine_epi64_epi8(x, a, 0));
+            }
+        }
+        for (int q = 0; q < G; ++q) {
+            _mm512_storeu_si512(out[q] + pos, acc[q]);
+        }
+    }
+}
+
+// Rows computed per kernel call, bounded by the vector registers of the
+// narrowest SIMD kernel.
+const int maxGroupRows = 4;
+
+struct Kernel {
+    const char* name;
+    size_t      width;
+    RowsFunc    rows[maxGroupRows];
+    bool        (*supported)();
+};
+
+const Kernel kernelTable[] = {
+    {"gfni-avx512", 64,
+     {mulRowsGfniAvx512<1>, mulRowsGfniAvx512<2>, mulRowsGfniAvx512<3>, mulRowsGfniAvx512<4>},
+     []() -> bool {
+         return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+     }},
+    {"avx512", 64,
+     {mulRowsAvx512<1>, mulRowsAvx512<2>, mulRowsAvx512<3>, mulRowsAvx512<4>},
+     []() -> bool { return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"); }},
+    {"gfni-avx2", 32,
+     {mulRowsGfniAvx2<1>, mulRowsGfniAvx2<2>, mulRowsGfniAvx2<3>, mulRowsGfniAvx2<4>},
+     []() -> bool { return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx2"); }},
+    {"avx2", 32,
+     {mulRowsAvx2<1>, mulRowsAvx2<2>, mulRowsAvx2<3>, mulRowsAvx2<4>},
+     []() -> bool { return __builtin_cpu_supports("avx2"); }},
+    {"ssse3", 16,
+     {mulRowsSsse3<1>, mulRowsSsse3<2>, mulRowsSsse3<3>, mulRowsSsse3<4>},
+     []() -> bool { return __builtin_cpu_supports("ssse3"); }},
+    {"generic", 1,
+     {mulRowsGeneric<1>, mulRowsGeneric<2>, mulRowsGeneric<3>, mulRowsGeneric<4>},
+     []() -> bool { return true; }},
+};
+
+const int kernelCount = sizeof(kernelTable) / sizeof(kernelTable[0]);
+const Kernel& genericKernel = kernelTable[kernelCount - 1];
+
+// Shards are coded in slices of this size, so the inputs of a slice stay
+// in L2 while all output rows are computed.
+const size_t sliceSize = 16 * 1024;  // 16 KiB
+
+// mulMatrix computes out = m * in over shardSize bytes.
+void mulMatrix(const Kernel& kernel, const GfMatrix& m, const uint8_t* const* in, uint8_t* const* out, size_t shardSize) {
+    for (size_t start = 0; start < shardSize; start += sliceSize) {
+        auto end = std::min(shardSize, start + sliceSize);
+        auto vecEnd = start + (end - start) / kernel.width * kernel.width;
+        for (int r = 0; r < m.rows; r += maxGroupRows) {
+            auto g = std::min(maxGroupRows, m.rows - r);
+            auto coeffs = &m.coeffs[static_cast<size_t>(r) * m.cols];
+            if (vecEnd > start) {
+                kernel.rows[g - 1](coeffs, m.cols, in, out + r, start, vecEnd);
+            }
+            if (vecEnd < end) {
+                genericKernel.rows[g - 1](coeffs, m.cols, in, out + r, vecEnd, end);
+            }
+        }
+    }
+}
+
+// Picks the rows of 'm' listed in 'rows'.
+GfMatrix subMatrix(const GfMatrix& m, const std::vector<int>& rows) {
+    GfMatrix sub;
+    sub.rows = static_cast<int>(rows.size());
+    sub.cols = m.cols;
+    sub.coeffs.reserve(rows.size() * m.cols);
+    for (auto r : rows) {
+        auto first = m.coeffs.begin() + static_cast<size_t>(r) * m.cols;
+        sub.coeffs.insert(sub.coeffs.end(), first, first + m.cols);
+    }
+    return sub;
+}
+
+// Bound of cached decode matrices, a set has few failure patterns at a time.
+const size_t maxDecodeCache = 256;
+
+}
+
+ReedSolomon::ReedSolomon(int dataShards, int parityShards, const std::string& kernel)
+    : dataShardsCount(dataShards), parityShardsCount(parityShards), kernelIndex(-1) {
+    if (dataShards <= 0 || parityShards < 0 || dataShards + parityShards > 256) {
+        throw std::invalid_argument(errInvShardNum->msg);
+    }
+
+    for (int i = 0; i < kernelCount; ++i) {
+        if ((kernel.empty() || kernel == kernelTable[i].name) && kernelTable[i].supported()) {
+            kernelIndex = i;
+            break;
+        }
+    }
+    if (kernelIndex < 0) {
+        throw std::invalid_argument("reedsolomon: kernel " + kernel + " not supported");
+    }
+
+    encodeMatrix = buildMatrix(dataShards, totalShards());
+    parity = toGfMatrix(&encodeMatrix[static_cast<size_t>(dataShards) * dataShards], parityShards, dataShards);
+}
+
+const char* ReedSolomon::kernel() const {
+    return kernelTable[kernelIndex].name;
+}
+
+std::vector<std::string> ReedSolomon::kernels() {
+    std::vector<std::string> names;
+    for (const auto& k : kernelTable) {
+        if (k.supported()) {
+            names.emplace_back(k.name);
+        }
+    }
+    return names;
+}
+
+void ReedSolomon::encode(uint8_t* const* shards, size_t shardSize) const {
+    if (parityShardsCount == 0 || shardSize == 0) {
+        return;
+    }
+    mulMatrix(kernelTable[kernelIndex], parity, shards, shards + dataShardsCount, shardSize);
+}
+
+std::shared_ptr<const GfMatrix> ReedSolomon::decodeMatrix(const std::vector<int>& rows) const {
+    {
+        std::lock_guard<std::mutex> lock(cacheMu);
+        auto it = decodeCache.find(rows);
+        if (it != decodeCache.end()) {
+            return it->second;
+        }
+    }
+
+    auto k = dataShardsCount;
+    Matrix sub(static_cast<size_t>(k) * k);
+    for (int i = 0; i < k; ++i) {
+        std::memcpy(&sub[i * k], &encodeMatrix[rows[i] * k], k);
+    }
+    if (!matrixInvert(sub, k)) {
+        // Any k rows of the encoding matrix are independent.
+        throw std::logic_error("reedsolomon: singular decode matrix");
+    }
+    auto m = std::make_shared<const GfMatrix>(toGfMatrix(sub.data(), k, k));
+
+    std::lock_guard<std::mutex> lock(cacheMu);
+    if (decodeCache.size() >= maxDecodeCache) {
+        decodeCache.clear();
+    }
+    decodeCache.emplace(rows, m);
+    return m;
+}
+
+Error ReedSolomon::reconstruct(uint8_t* const* shards, const std::vector<bool>& present, size_t shardSize, bool dataOnly) const {
+    auto k = dataShardsCount;
+    if (static_cast<int>(present.size()) != totalShards()) {
+        return errTooFewShards;
+    }
+
+    std::vector<int> valid;
+    std::vector<int> missingData;
+    std::vector<int> missingParity;
+    for (int i = 0; i < totalShards(); ++i) {
+        if (present[i]) {
+            valid.push_back(i);
+        } else if (i < k) {
+            missingData.push_back(i);
+        } else {
+            missingParity.push_back(i);
+        }
+    }
+    if (static_cast<int>(valid.size()) < k) {
+        return errTooFewShards;
+    }
+    if (shardSize == 0) {
+        return nullptr;
+    }
+
+    const auto& kern = kernelTable[kernelIndex];
+    if (!missingData.empty()) {
+        // Decode from the first k shards we have.
+        valid.resize(k);
+        auto dm = decodeMatrix(valid);
+        std::vector<const uint8_t*> in;
+        for (auto i : valid) {
+            in.push_back(shards[i]);
+        }
+        std::vector<uint8_t*> out;
+        for (auto i : missingData) {
+            out.push_back(shards[i]);
+        }
+        mulMatrix(kern, subMatrix(*dm, missingData), in.data(), out.data(), shardSize);
+    }
+
+    if (!dataOnly && !missingParity.empty()) {
+        std::vector<int> rows;
+        std::vector<uint8_t*> out;
+        for (auto i : missingParity) {
+            rows.push_back(i - k);
+            out.push_back(shards[i]);
+        }
+        mulMatrix(kern, subMatrix(parity, rows), shards, out.data(), shardSize);
+    }
+    return nullptr;
+}
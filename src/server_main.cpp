@@ -5,6 +5,14 @@
 #include "include/httpserver.hpp"
 #include "include/globals.hpp"
 #include "include/endpoint.hpp"
+#include "include/ellipses.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <numeric>
+#include <unordered_set>
 
 using namespace cppio;
 
@@ -96,10 +104,14 @@ Error serverMain(cli::Context* ctx) {
     // HttpServer httpServer;
     // httpServer.start();
 
-    buildServerCtxt(ctx, &globalServerCtxt);
+    err = buildServerCtxt(ctx, &globalServerCtxt);
 
     if (globalServerCtxt.layout.pools.empty()) {
-        std::cout << "Pls. provide storage pools" << std::endl;
+        std::cout << "Pls. provide storage pools";
+        if (err) {
+            std::cout << ": " << err;
+        }
+        std::cout << std::endl;
         return err;
     }
 
@@ -119,19 +131,250 @@ Error buildServerCtxt(cli::Context* ctx, ServerCtxt *ctxt)
     return mergeDisksLayoutFromArgs(ctx->args(), ctxt);
 }
 
+// Environment variable overriding the automatic choice of drives per set.
+static const char* envErasureSetDriveCount = "CPPIO_ERASURE_SET_DRIVE_COUNT";
+
+// Supported numbers of drives per erasure set.
+static const std::vector<uint64_t> setSizes = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+// getDivisibleSize - returns the greatest common divisor of all sizes.
+static uint64_t getDivisibleSize(const std::vector<uint64_t>& totalSizes)
+{
+    auto result = totalSizes[0];
+    for (size_t i = 1; i < totalSizes.size(); ++i) {
+        result = std::gcd(result, totalSizes[i]);
+    }
+    return result;
+}
+
+static bool isValidSetSize(uint64_t count)
+{
+    return count >= setSizes.front() && count <= setSizes.back();
+}
+
+// commonSetDriveCount - returns the largest of the sorted setCounts that
+// divides divisibleSize, the fewest sets of the most drives.
+static uint64_t commonSetDriveCount(uint64_t divisibleSize, const std::vector<uint64_t>& setCounts)
+{
+    if (divisibleSize < setCounts.back()) {
+        return divisibleSize;
+    }
+    uint64_t setSize = 0;
+    auto prevD = divisibleSize / setCounts.front();
+    for (auto cnt : setCounts) {
+        if (divisibleSize % cnt == 0) {
+            auto d = divisibleSize / cnt;
+            if (d <= prevD) {
+                prevD = d;
+                setSize = cnt;
+            }
+        }
+    }
+    return setSize;
+}
+
+// possibleSetCountsWithSymmetry - returns the set sizes that spread the
+// drives of every ellipses evenly, a set then takes the same number of
+// drives from each node. Without ellipses the user knows best, all
+// setCounts stay.
+static std::vector<uint64_t>
+possibleSetCountsWithSymmetry(const std::vector<uint64_t>& setCounts,
+                              const std::vector<ellipses::ArgPattern>& argPatterns)
+{
+    std::vector<uint64_t> counts;
+    for (auto ss : setCounts) {
+        bool symmetry = argPatterns.empty();
+        for (const auto& argPattern : argPatterns) {
+            for (const auto& p : argPattern.patterns) {
+                auto n = static_cast<uint64_t>(p.seq.size());
+                symmetry = n > ss ? n % ss == 0 : ss % n == 0;
+            }
+        }
+        if (symmetry && std::find(counts.begin(), counts.end(), ss) == counts.end()) {
+            counts.push_back(ss);
+        }
+    }
+    std::sort(counts.begin(), counts.end());
+    return counts;
+}
+
+static std::string joinArgs(const std::vector<std::string>& args)
+{
+    return "[" + boost::algorithm::join(args, " ") + "]";
+}
+
+// getSetIndexes - returns the drives per set of every argument, one
+// entry per set. The set size is the same for all of them: one of
+// setSizes dividing the drives of every argument, with symmetry across
+// the ellipses, else the largest for the fewest sets. A non zero
+// setDriveCount overrides the choice.
+static Error getSetIndexes(const std::vector<std::string>& args,
+                           const std::vector<uint64_t>& totalSizes,
+                           uint64_t setDriveCount,
+                           const std::vector<ellipses::ArgPattern>& argPatterns,
+                           std::vector<std::vector<uint64_t>>& setIndexes)
+{
+    if (totalSizes.empty() || args.empty()) {
+        return errInvalidArgument;
+    }
+    for (auto totalSize : totalSizes) {
+        if (totalSize < setSizes.front() || totalSize < setDriveCount) {
+            return newError(errCodeInvalidArgument, "Incorrect number of endpoints provided " + joinArgs(args));
+        }
+    }
+
+    auto commonSize = getDivisibleSize(totalSizes);
+    std::vector<uint64_t> setCounts;
+    for (auto ss : setSizes) {
+        if (commonSize % ss == 0) {
+            setCounts.push_back(ss);
+        }
+    }
+    if (setCounts.empty()) {
+        return newError(errCodeInvalidArgument,
+                        "Incorrect number of endpoints provided " + joinArgs(args) + ", number of drives " +
+                            std::to_string(commonSize) + " is not divisible by any supported erasure set sizes");
+    }
+
+    uint64_t setSize;
+    if (setDriveCount > 0) {
+        if (std::find(setCounts.begin(), setCounts.end(), setDriveCount) == setCounts.end()) {
+            std::vector<std::string> acceptable;
+            for (auto ss : setCounts) {
+                acceptable.push_back(std::to_string(ss));
+            }
+            return newError(errCodeInvalidArgument,
+                            "Invalid set drive count. Acceptable values for " + std::to_string(commonSize) +
+                                " number drives are " + joinArgs(acceptable));
+        }
+        // No symmetry calculation, the user is on their own.
+        setSize = setDriveCount;
+    } else {
+        setCounts = possibleSetCountsWithSymmetry(setCounts, argPatterns);
+        if (setCounts.empty()) {
+            return newError(errCodeInvalidArgument,
+                            "No symmetric distribution detected with input endpoints provided " + joinArgs(args) +
+                                ", drives " + std::to_string(commonSize) +
+                                " cannot be spread symmetrically by any supported erasure set sizes");
+        }
+        setSize = commonSetDriveCount(commonSize, setCounts);
+    }
+    if (!isValidSetSize(setSize)) {
+        return newError(errCodeInvalidArgument, "Incorrect number of endpoints provided " + joinArgs(args) +
+                                                    ", erasure set size " + std::to_string(setSize) +
+                                                    " is not supported");
+    }
+
+    setIndexes.assign(totalSizes.size(), {});
+    for (size_t i = 0; i < totalSizes.size(); ++i) {
+        setIndexes[i].assign(totalSizes[i] / setSize, setSize);
+    }
+    return nullptr;
+}
+
+// getAllSets - splits the drives of 'args', with or without ellipses,
+// into erasure sets.
+static Error getAllSets(uint64_t setDriveCount, const std::vector<std::string>& args,
+                        std::vector<std::vector<std::string>>& sets)
+{
+    std::vector<std::string> endpoints;
+    std::vector<std::vector<uint64_t>> setIndexes;
+    if (!ellipses::hasEllipses(args)) {
+        endpoints = args;
+        if (args.size() > 1) {
+            if (auto err = getSetIndexes(args, {args.size()}, setDriveCount, {}, setIndexes)) {
+                return err;
+            }
+        } else {
+            // A single drive.
+            setIndexes = {{args.size()}};
+        }
+    } else {
+        std::vector<ellipses::ArgPattern> argPatterns(args.size());
+        std::vector<uint64_t> totalSizes;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (auto err = ellipses::findEllipsesPatterns(args[i], argPatterns[i])) {
+                return err;
+            }
+            totalSizes.push_back(argPatterns[i].size());
+        }
+        if (auto err = getSetIndexes(args, totalSizes, setDriveCount, argPatterns, setIndexes)) {
+            return err;
+        }
+        for (const auto& argPattern : argPatterns) {
+            auto expanded = argPattern.expand();
+            endpoints.insert(endpoints.end(), std::make_move_iterator(expanded.begin()),
+                             std::make_move_iterator(expanded.end()));
+        }
+    }
+
+    sets.clear();
+    size_t k = 0;
+    for (const auto& sizes : setIndexes) {
+        for (auto size : sizes) {
+            sets.emplace_back(endpoints.begin() + k, endpoints.begin() + k + size);
+            k += size;
+        }
+    }
+
+    std::unordered_set<std::string> unique;
+    for (const auto& set : sets) {
+        for (const auto& arg : set) {
+            if (!unique.insert(arg).second) {
+                return newError(errCodeInvalidArgument, "Input args " + joinArgs(args) + " has duplicate ellipses");
+            }
+        }
+    }
+    return nullptr;
+}
+
 // mergeDisksLayoutFromArgs supports with and without ellipses transparently.
+// Arguments without ellipses are the drives of one legacy pool, with
+// ellipses every argument is a pool.
 Error mergeDisksLayoutFromArgs(std::vector<std::string> args, ServerCtxt *ctxt)
 {
-    ctxt->layout.legacy = true;
+    if (args.empty()) {
+        return errInvalidArgument;
+    }
+
+    uint64_t setDriveCount = 0;
+    if (auto v = std::getenv(envErasureSetDriveCount)) {
+        try {
+            setDriveCount = std::stoull(v);
+        } catch (const std::exception&) {
+            return newError(errCodeInvalidArgument, std::string("Invalid ") + envErasureSetDriveCount + "=" + v);
+        }
+    }
+
+    bool noEllipses = std::none_of(args.begin(), args.end(),
+                                   [](const std::string& arg) { return ellipses::hasEllipses(arg); });
+    if (noEllipses) {
+        PoolDisksLayout pdl;
+        pdl.cmdLine = boost::algorithm::join(args, " ");
+        if (auto err = getAllSets(setDriveCount, args, pdl.layout)) {
+            return err;
+        }
+        ctxt->layout.legacy = true;
+        ctxt->layout.pools = {pdl};
+        return nullptr;
+    }
+
+    std::vector<PoolDisksLayout> pools;
     for (auto& arg : args) {
-        std::cout << "mergeDisksLayoutFromArgs, arg: " << arg << std::endl;
+        if (!ellipses::hasEllipses(arg) && args.size() > 1) {
+            return newError(errCodeInvalidArgument,
+                            "all args must have ellipses for pool expansion (Invalid arguments specified) args: " +
+                                joinArgs(args));
+        }
         PoolDisksLayout pdl;
         pdl.cmdLine = arg;
-        auto disks = std::vector<std::string>();
-        disks.emplace_back(arg);
-        pdl.layout.push_back(disks);
-        ctxt->layout.pools.push_back(pdl);
+        if (auto err = getAllSets(setDriveCount, {arg}, pdl.layout)) {
+            return err;
+        }
+        pools.push_back(std::move(pdl));
     }
+    ctxt->layout.legacy = false;
+    ctxt->layout.pools = std::move(pools);
     return nullptr;
 }
 
@@ -162,16 +405,10 @@ void serverHandleCmdArgs(ServerCtxt *ctxt)
 
 std::vector<PoolEndpoints>
 createPoolEndpoints(std::string serverAddr, std::vector<PoolDisksLayout>& poolsLayout) {
-    std::vector<PoolEndpoints> poolEndpoints(1);
-
-    // For single arg, return single drive EC setup.
-    Endpoint endpoint;
-    endpoint.path = poolsLayout[0].layout[0][0];
-    endpoint.poolIndex = 0;
-    endpoint.setIndex = 0;
-    endpoint.diskIndex = 0;
-
-    poolEndpoints[0].endpoints.push_back(endpoint);
+    std::vector<PoolEndpoints> poolEndpoints;
+    for (size_t i = 0; i < poolsLayout.size(); ++i) {
+        poolEndpoints.emplace_back(serverAddr, poolsLayout[i], static_cast<int>(i));
+    }
     return poolEndpoints;
 }
 
@@ -200,7 +437,8 @@ createServerEndpoints(std::string serverAddr,
                         }();
         eps.cmdLine = poolArgs[i].cmdLine;
         endpointServerPools->add(eps);
-        std::cout << "endpointServerPools Index " << i << ", endpoints ";
+        std::cout << "endpointServerPools Index " << i << ", sets " << eps.setCount << " x " << eps.driversPerSet
+                  << " drives, endpoints ";
         for (auto& ep : eps.endpoints) {
             std::cout << " - path: " << ep.path;
         }
@@ -0,0 +1,82 @@
+#include "include/storage_errors.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+namespace cppio {
+
+const Error errUnexpected = newError(errCodeUnexpected, "unexpected error, please report this issue");
+const Error errNotImplemented = newError(errCodeNotImplemented, "not implemented");
+const Error errInvalidArgument = newError(errCodeInvalidArgument, "invalid argument");
+const Error errCorruptedFormat = newError(errCodeCorruptedFormat, "corrupted format");
+const Error errUnformattedDisk = newError(errCodeUnformattedDisk, "unformatted drive found");
+const Error errDiskNotFound = newError(errCodeDiskNotFound, "drive not found");
+const Error errFaultyDisk = newError(errCodeFaultyDisk, "drive is faulty");
+const Error errDiskFull = newError(errCodeDiskFull, "drive path full");
+const Error errDiskAccessDenied = newError(errCodeDiskAccessDenied, "drive access denied");
+const Error errDiskNotDir = newError(errCodeDiskNotDir, "drive is not directory or mountpoint");
+const Error errVolumeNotFound = newError(errCodeVolumeNotFound, "volume not found");
+const Error errVolumeExists = newError(errCodeVolumeExists, "volume already exists");
+const Error errVolumeNotEmpty = newError(errCodeVolumeNotEmpty, "volume is not empty");
+const Error errVolumeAccessDenied = newError(errCodeVolumeAccessDenied, "volume access denied");
+const Error errFileNotFound = newError(errCodeFileNotFound, "file not found");
+const Error errFileNameTooLong = newError(errCodeFileNameTooLong, "file name too long");
+const Error errFileAccessDenied = newError(errCodeFileAccessDenied, "file access denied");
+const Error errIsNotRegular = newError(errCodeIsNotRegular, "not of regular file type");
+const Error errPathNotFound = newError(errCodePathNotFound, "path not found");
+const Error errLessData = newError(errCodeLessData, "less data available than what was requested");
+const Error errMoreData = newError(errCodeMoreData, "more data was sent than what was advertised");
+const Error errDiskOngoingReq = newError(errCodeDiskOngoingReq, "drive still did not complete the request");
+const Error errFileCorrupt = newError(errCodeFileCorrupt, "file is corrupted");
+const Error errFileVersionNotFound = newError(errCodeFileVersionNotFound, "file version not found");
+
+Error osErrToFileErr(int errnum) {
+    switch (errnum) {
+    case 0:
+        return nullptr;
+    case ENOENT:
+        return errFileNotFound;
+    case EACCES:
+    case EPERM:
+    case EROFS:
+        return errFileAccessDenied;
+    case EISDIR:
+    case ENOTDIR:
+        return errIsNotRegular;
+    case ENAMETOOLONG:
+        return errFileNameTooLong;
+    case ENOSPC:
+    case EDQUOT:
+        return errDiskFull;
+    case EIO:
+        return errFaultyDisk;
+    default:
+        return newError(errCodeUnexpected, std::strerror(errnum));
+    }
+}
+
+Error osErrToVolErr(int errnum) {
+    switch (errnum) {
+    case 0:
+        return nullptr;
+    case ENOENT:
+        return errVolumeNotFound;
+    case EEXIST:
+        return errVolumeExists;
+    case ENOTEMPTY:
+        return errVolumeNotEmpty;
+    case EACCES:
+    case EPERM:
+    case EROFS:
+        return errVolumeAccessDenied;
+    case ENOSPC:
+    case EDQUOT:
+        return errDiskFull;
+    case EIO:
+        return errFaultyDisk;
+    default:
+        return newError(errCodeUnexpected, std::strerror(errnum));
+    }
+}
+
+}
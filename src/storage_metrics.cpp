@@ -0,0 +1,162 @@
+#include "include/storage_metrics.hpp"
+#include "include/storage_datatypes.hpp"
+
+#include <bit>
+
+using namespace cppio;
+
+namespace {
+
+const char* const storageMetricNames[storageMetricLast] = {
+    "MakeVolBulk",
+    "MakeVol",
+    "ListVols",
+    "StatVol",
+    "DeleteVol",
+    "WalkDir",
+    "ListDir",
+    "ReadFile",
+    "AppendFile",
+    "CreateFile",
+    "ReadFileStream",
+    "OpenFileRange",
+    "RenameFile",
+    "RenameData",
+    "CheckParts",
+    "Delete",
+    "DeleteVersions",
+    "VerifyFile",
+    "WriteAll",
+    "DeleteVersion",
+    "WriteMetadata",
+    "UpdateMetadata",
+    "ReadVersion",
+    "ReadXL",
+    "ReadAll",
+    "StatInfoFile",
+    "ReadMultiple",
+    "DeleteAbandonedParts",
+    "DiskInfo",
+};
+
+// Threads are handed shards round robin on their first record.
+std::atomic<unsigned> nextShardSlot{0};
+
+unsigned shardSlot() {
+    thread_local unsigned slot = nextShardSlot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+}
+
+const char* cppio::storageMetricName(StorageMetric metric) {
+    return metric >= 0 && metric < storageMetricLast ? storageMetricNames[metric] : "unknown";
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t i) {
+    if (i == 0) {
+        return 1023;
+    }
+    if (i >= latencyBuckets - 1) {
+        return UINT64_MAX;
+    }
+    auto msb = 10 + (i - 1) / 4;
+    auto sub = (i - 1) % 4;
+    return ((5 + sub) << (msb - 2)) - 1;
+}
+
+void LatencyHistogram::add(std::chrono::nanoseconds latency) {
+    auto nanos = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+    counts[bucket(nanos)]++;
+    n++;
+    total += nanos;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < latencyBuckets; ++i) {
+        counts[i] += other.counts[i];
+    }
+    n += other.n;
+    total += other.total;
+}
+
+std::chrono::nanoseconds LatencyHistogram::quantile(double q) const {
+    uint64_t samples = 0;
+    for (auto c : counts) {
+        samples += c;
+    }
+    if (samples == 0) {
+        return std::chrono::nanoseconds::zero();
+    }
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(samples));
+    rank = std::min(std::max<uint64_t>(rank, 1), samples);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < latencyBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // The open ended bucket reports its lower bound.
+            auto bound = i == latencyBuckets - 1 ? bucketUpperBound(i - 1) + 1 : bucketUpperBound(i);
+            return std::chrono::nanoseconds(bound);
+        }
+    }
+    return std::chrono::nanoseconds::zero();
+}
+
+struct alignas(64) DriveMetrics::Shard {
+    std::atomic<uint64_t>   calls[storageMetricLast][sizeLastElemMarker]{};
+    std::atomic<uint64_t>   nanos[storageMetricLast]{};
+    std::atomic<uint64_t>   buckets[storageMetricLast][latencyBuckets]{};
+    lastMinuteLatency       lastMinute[storageMetricLast];
+};
+
+DriveMetrics::DriveMetrics(const DriveMetricsOptions& opts) {
+    auto n = std::bit_ceil(std::max(opts.shards, 1u));
+    shards = std::make_unique<Shard[]>(n);
+    mask = n - 1;
+}
+
+DriveMetrics::~DriveMetrics() = default;
+
+void DriveMetrics::record(StorageMetric metric, int64_t size, std::chrono::nanoseconds latency) {
+    auto& shard = shards[shardSlot() & mask];
+    auto nanos = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+    shard.calls[metric][sizeToTag(size)].fetch_add(1, std::memory_order_relaxed);
+    shard.nanos[metric].fetch_add(nanos, std::memory_order_relaxed);
+    shard.buckets[metric][LatencyHistogram::bucket(nanos)].fetch_add(1, std::memory_order_relaxed);
+    shard.lastMinute[metric].add(latency, static_cast<uint64_t>(std::max<int64_t>(size, 0)));
+}
+
+AccElem DriveMetrics::lastMinuteOf(StorageMetric metric) const {
+    auto sec = lastMinuteLatency::nowSec();
+    AccElem res;
+    for (size_t s = 0; s <= mask; ++s) {
+        res.merge(shards[s].lastMinute[metric].totalAt(sec));
+    }
+    return res;
+}
+
+void DriveMetrics::snapshot(DiskMetrics& out) const {
+    auto sec = lastMinuteLatency::nowSec();
+    for (size_t m = 0; m < storageMetricLast; ++m) {
+        LatencyHistogram h;
+        AccElem lastMinute;
+        std::array<uint64_t, sizeLastElemMarker> calls{};
+        for (size_t s = 0; s <= mask; ++s) {
+            const auto& shard = shards[s];
+            for (size_t t = 0; t < sizeLastElemMarker; ++t) {
+                calls[t] += shard.calls[m][t].load(std::memory_order_relaxed);
+            }
+            h.total += shard.nanos[m].load(std::memory_order_relaxed);
+            for (size_t b = 0; b < latencyBuckets; ++b) {
+                h.counts[b] += shard.buckets[m][b].load(std::memory_order_relaxed);
+            }
+            lastMinute.merge(shard.lastMinute[m].totalAt(sec));
+        }
+        for (auto c : calls) {
+            h.n += c;
+        }
+        out.apiLatencies[m] = h;
+        out.apiCalls[m] = calls;
+        out.lastMinute[m] = lastMinute;
+    }
+}
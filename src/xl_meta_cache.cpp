@@ -0,0 +1,186 @@
+#include "include/xl_meta_cache.hpp"
+
+using namespace cppio;
+
+namespace {
+
+// Bookkeeping of an entry besides its key and buffer.
+const size_t entryOverhead = 128;
+
+}
+
+XLMetaCache::XLMetaCache(const XLMetaCacheOptions& opts) : ttl(opts.ttl) {
+    if (opts.capacity == 0 || opts.shards == 0) {
+        return;
+    }
+    for (unsigned i = 0; i < opts.shards; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    shardCapacity = opts.capacity / opts.shards;
+    subtreeLog.resize(subtreeLogSize);
+}
+
+std::string XLMetaCache::key(std::string_view volume, std::string_view path) {
+    while (!path.empty() && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+    std::string k;
+    k.reserve(volume.size() + 1 + path.size());
+    k.append(volume).append(1, '/').append(path);
+    return k;
+}
+
+XLMetaCache::Shard& XLMetaCache::shardOf(const std::string& key) const {
+    return *shards[std::hash<std::string>{}(key) % shards.size()];
+}
+
+size_t XLMetaCache::charge(const std::string& key, const Buffer& buf) {
+    return key.size() + buf->size() + entryOverhead;
+}
+
+void XLMetaCache::erase(Shard& shard, std::unordered_map<std::string, Entry>::iterator it) {
+    shard.bytes -= charge(it->first, it->second.buf);
+    shard.lru.erase(it->second.lru);
+    shard.ordered.erase(it->first);
+    shard.entries.erase(it);
+}
+
+XLMetaCache::Buffer XLMetaCache::get(std::string_view volume, std::string_view path) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    auto k = key(volume, path);
+    auto& shard = shardOf(k);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.entries.find(k);
+    if (it == shard.entries.end()) {
+        misses++;
+        return nullptr;
+    }
+    if (std::chrono::steady_clock::now() - it->second.loaded >= ttl) {
+        erase(shard, it);
+        misses++;
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    hits++;
+    return it->second.buf;
+}
+
+XLMetaCache::Ticket XLMetaCache::ticket(std::string_view volume, std::string_view path) const {
+    if (!enabled()) {
+        return Ticket{};
+    }
+    return Ticket{shardOf(key(volume, path)).generation.load(std::memory_order_acquire),
+                  subtreeCount.load(std::memory_order_acquire)};
+}
+
+bool XLMetaCache::subtreeInvalidated(const std::string& key, uint64_t ticket) const {
+    auto count = subtreeCount.load(std::memory_order_acquire);
+    if (count == ticket) {
+        return false;
+    }
+    if (count - ticket > subtreeLogSize) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(subtreeMu);
+    // Read again under the lock, later entries may have overwritten the
+    // oldest ones looked at.
+    count = subtreeCount.load(std::memory_order_acquire);
+    if (count - ticket > subtreeLogSize) {
+        return true;
+    }
+    for (auto i = ticket; i < count; ++i) {
+        const auto& prefix = subtreeLog[i % subtreeLogSize];
+        if (key.starts_with(prefix) || key + "/" == prefix) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void XLMetaCache::put(std::string_view volume, std::string_view path, const Ticket& ticket, Buffer buf) {
+    if (!enabled() || !buf) {
+        return;
+    }
+    auto k = key(volume, path);
+    auto size = charge(k, buf);
+    // Objects with that many versions are better read from the drive than
+    // allowed to flush a shard.
+    if (size > shardCapacity / 4) {
+        return;
+    }
+
+    auto& shard = shardOf(k);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    if (shard.generation.load(std::memory_order_acquire) != ticket.generation ||
+        subtreeInvalidated(k, ticket.subtrees)) {
+        return;
+    }
+    if (auto it = shard.entries.find(k); it != shard.entries.end()) {
+        erase(shard, it);
+    }
+    while (shard.bytes + size > shardCapacity && !shard.lru.empty()) {
+        erase(shard, shard.entries.find(shard.lru.back()));
+        evictions++;
+    }
+    shard.lru.push_front(k);
+    auto it = shard.entries.emplace(std::move(k), Entry{std::move(buf), std::chrono::steady_clock::now(), shard.lru.begin()}).first;
+    shard.ordered.insert(it->first);
+    shard.bytes += size;
+}
+
+void XLMetaCache::invalidate(std::string_view volume, std::string_view path, bool subtree) {
+    if (!enabled()) {
+        return;
+    }
+    auto k = key(volume, path);
+    invalidations++;
+    if (!subtree) {
+        auto& shard = shardOf(k);
+        std::lock_guard<std::mutex> lock(shard.mu);
+        shard.generation.fetch_add(1, std::memory_order_acq_rel);
+        if (auto it = shard.entries.find(k); it != shard.entries.end()) {
+            erase(shard, it);
+        }
+        return;
+    }
+
+    // Logged first: a put() locking a shard after its entries below the
+    // directory are gone sees the entry and refuses the key.
+    auto prefix = k.back() == '/' ? k : k + "/";
+    {
+        std::lock_guard<std::mutex> lock(subtreeMu);
+        auto count = subtreeCount.load(std::memory_order_relaxed);
+        subtreeLog[count % subtreeLogSize] = prefix;
+        subtreeCount.store(count + 1, std::memory_order_release);
+    }
+
+    // Objects below a directory hash anywhere, their keys are a range of
+    // the ordered keys of every shard.
+    std::string_view exact(prefix.data(), prefix.size() - 1);
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mu);
+        if (auto it = shard->entries.find(std::string(exact)); it != shard->entries.end()) {
+            erase(*shard, it);
+        }
+        for (auto it = shard->ordered.lower_bound(prefix); it != shard->ordered.end() && it->starts_with(prefix);) {
+            auto name = *it++;
+            erase(*shard, shard->entries.find(std::string(name)));
+        }
+    }
+}
+
+XLMetaCacheStats XLMetaCache::stats() const {
+    XLMetaCacheStats s;
+    s.hits = hits.load();
+    s.misses = misses.load();
+    s.evictions = evictions.load();
+    s.invalidations = invalidations.load();
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mu);
+        s.entries += shard->entries.size();
+        s.bytes += shard->bytes;
+    }
+    return s;
+}
@@ -0,0 +1,1285 @@
+#include "include/xl_storage.hpp"
+#include "include/log.hpp"
+#include "include/erasure_coding.hpp"
+#include "include/placement.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace cppio {
+
+namespace {
+
+// Largest single read or write handed to the engine.
+const uint32_t maxIoSize = 1 << 30;  // 1 GiB
+// O_DIRECT needs buffers, offsets and lengths aligned to the logical
+// block size of the device, a page covers all of them.
+const size_t directIoAlignment = 4096;
+// readAll reads this much together with the open, which covers xl.meta
+// and config files in one submission.
+const uint32_t readAllInitialSize = 128 * 1024;  // 128 KiB
+// Files of a readMultiple call read with one submission.
+const size_t readMultipleBatch = 64;
+// Shards verifyFile reads and verifies with one submission.
+const int64_t verifyFileShards = 64;
+
+std::chrono::system_clock::time_point toTimePoint(const struct timespec& ts) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+}
+
+void throwIf(const Error& err) {
+    if (err) {
+        throw StorageError(err);
+    }
+}
+
+// Splits [buf, buf+len) into ops of at most maxIoSize.
+void appendIoOps(std::vector<IoOp>& ops, IoOpcode opcode, uint8_t* buf, size_t len, int64_t offset) {
+    do {
+        IoOp op;
+        op.opcode = opcode;
+        op.buf = buf;
+        op.len = static_cast<uint32_t>(std::min<size_t>(len, maxIoSize));
+        op.offset = offset;
+        ops.push_back(op);
+        buf += op.len;
+        len -= op.len;
+        if (offset >= 0) {
+            offset += op.len;
+        }
+    } while (len > 0);
+}
+
+Error ioErr(int64_t result) {
+    return result < 0 ? osErrToFileErr(static_cast<int>(-result)) : nullptr;
+}
+
+// XLMetaInvalidation drops the cached xl.meta a file operation touches once
+// it is done, failed or not: the xl.meta of the object when 'path' is an
+// xl.meta file, the objects below 'path' when a whole tree is affected.
+// Dropping after the change voids the tickets of reads that raced it.
+class XLMetaInvalidation {
+
+public:
+    XLMetaInvalidation(XLMetaCache& cache, const std::string& volume, const std::string& path, bool subtree)
+        : cache(cache), volume(volume), path(path), subtree(subtree) {}
+
+    ~XLMetaInvalidation() {
+        std::string_view object = path;
+        while (!object.empty() && object.back() == '/') {
+            object.remove_suffix(1);
+        }
+        auto slash = object.rfind('/');
+        if (object.substr(slash == std::string_view::npos ? 0 : slash + 1) == xlStorageFormatFile) {
+            cache.invalidate(volume, object.substr(0, slash == std::string_view::npos ? 0 : slash));
+        } else if (subtree) {
+            cache.invalidate(volume, object, true);
+        }
+    }
+
+private:
+    XLMetaCache&        cache;
+    std::string         volume;
+    std::string         path;
+    bool                subtree;
+};
+
+// True for the version of an object with its parts in a data dir.
+bool hasPartFiles(const FileInfo& fi) {
+    return !fi.deleted && !fi.dataDir.empty() && fi.data.empty();
+}
+
+// Returns the erasure geometry of a version, errFileCorrupt when its
+// xl.meta holds none that is valid.
+Erasure erasureOf(const FileInfo& fi) {
+    try {
+        return Erasure(fi.erasure);
+    } catch (const std::invalid_argument&) {
+        throw StorageError(errFileCorrupt);
+    }
+}
+
+// Returns the shard file of part 'number' of a version, relative to the
+// volume.
+std::string partFile(const std::string& path, const FileInfo& fi, int number) {
+    return path + "/" + fi.dataDir + "/part." + std::to_string(number);
+}
+
+// Returns the bitrot algorithm the checksum info of part 'number' names.
+BitrotAlgorithm partBitrotAlgorithm(const FileInfo& fi, int number) {
+    for (const auto& checksum : fi.erasure.checksums) {
+        if (checksum.PartNumber == number) {
+            return checksum.Algorithm;
+        }
+    }
+    return defaultBitrotAlgorithm;
+}
+
+// True for names of data dirs, which are UUIDs.
+bool isDataDirName(const std::string& name) {
+    if (name.size() != 36) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        auto dash = i == 8 || i == 13 || i == 18 || i == 23;
+        if (dash ? name[i] != '-' : !std::isxdigit(static_cast<unsigned char>(name[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Signature of the version renameData wrote, the same on every drive that
+// wrote the same version.
+uint64_t versionSignature(const FileInfo& fi) {
+    auto modTime = std::chrono::duration_cast<std::chrono::nanoseconds>(fi.modTime.time_since_epoch()).count();
+    std::string s = fi.versionID;
+    s += '\0';
+    s += fi.dataDir;
+    s += '\0';
+    s += std::to_string(modTime);
+    s += '\0';
+    s += std::to_string(fi.size);
+    s += fi.deleted ? "\0d" : "\0";
+    return sipHash24(0, 0, s);
+}
+
+struct FreeDeleter {
+    void operator()(uint8_t* p) const { std::free(p); }
+};
+using AlignedBuffer = std::unique_ptr<uint8_t, FreeDeleter>;
+
+}
+
+XLStorage::XLStorage(const Endpoint& ep, const XLStorageOptions& opts)
+    : ep(ep), drivePath(ep.path.string()), odirectThreshold(opts.odirectThreshold),
+      connectedAt(std::chrono::system_clock::now()), metaCache(opts.metaCache),
+      diskInfoCache(drivePath, opts.diskInfo),
+      poolIndex(ep.poolIndex), setIndex(ep.setIndex), diskIndex(ep.diskIndex) {
+    std::error_code ec;
+    if (!fs::is_directory(ep.path, ec)) {
+        throw StorageError(ec ? errDiskNotFound : errDiskNotDir);
+    }
+    engine = IoEngine::create(opts.io);
+
+    odirect = opts.odirect && probeODirect();
+    if (opts.odirect && !odirect) {
+        gLogger->warn("drive {} does not support O_DIRECT, large writes go through the page cache", drivePath);
+    }
+}
+
+bool XLStorage::probeODirect() const {
+    auto probe = (fs::path(drivePath) / ".cppio-odirect-probe").string();
+    int fd = ::open(probe.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_DIRECT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = false;
+    if (void* buf = std::aligned_alloc(directIoAlignment, directIoAlignment)) {
+        std::memset(buf, 0, directIoAlignment);
+        ok = ::pwrite(fd, buf, directIoAlignment, 0) == static_cast<ssize_t>(directIoAlignment);
+        std::free(buf);
+    }
+    ::close(fd);
+    ::unlink(probe.c_str());
+    return ok;
+}
+
+bool XLStorage::isOnline() const {
+    return ::access(drivePath.c_str(), R_OK | W_OK) == 0;
+}
+
+std::string XLStorage::getDiskID() {
+    std::lock_guard<std::mutex> lock(mu);
+    return diskID;
+}
+
+void XLStorage::setDiskID(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mu);
+    diskID = id;
+}
+
+void XLStorage::getDiskLoc(int& poolIdx, int& setIdx, int& diskIdx) {
+    std::lock_guard<std::mutex> lock(mu);
+    poolIdx = poolIndex;
+    setIdx = setIndex;
+    diskIdx = diskIndex;
+}
+
+void XLStorage::setDiskLoc(int poolIdx, int setIdx, int diskIdx) {
+    std::lock_guard<std::mutex> lock(mu);
+    poolIndex = poolIdx;
+    setIndex = setIdx;
+    diskIndex = diskIdx;
+}
+
+void XLStorage::setFormatData(std::vector<uint8_t> b) {
+    std::lock_guard<std::mutex> lock(mu);
+    formatData = std::move(b);
+}
+
+DiskInfo XLStorage::diskInfo(const DiskInfoOptions& opts) {
+    DiskInfo info;
+    throwIf(diskInfoCache.get(info));
+    info.endpoint = drivePath;
+    info.mountPath = drivePath;
+    info.id = getDiskID();
+    return info;
+}
+
+void XLStorage::nsScanner(DataUsageCache& cache, std::vector<dataUsageEntry>& updates, madmin::HealScanMode scanMode, std::function<bool()> shouldSleep) {
+    throw StorageError(errNotImplemented);
+}
+
+fs::path XLStorage::volumeDir(const std::string& volume) const {
+    if (volume.empty() || volume == "." || volume == ".." ||
+        volume.find('/') != std::string::npos) {
+        throw StorageError(errInvalidArgument);
+    }
+    return fs::path(drivePath) / volume;
+}
+
+fs::path XLStorage::filePath(const std::string& volume, const std::string& path) const {
+    auto rel = fs::path(path).lexically_normal();
+    if (path.empty() || rel.is_absolute() || (!rel.empty() && *rel.begin() == "..")) {
+        throw StorageError(errFileAccessDenied);
+    }
+    return volumeDir(volume) / rel;
+}
+
+Error XLStorage::openError(int errnum, const std::string& volume) const {
+    if (errnum == ENOENT) {
+        std::error_code ec;
+        if (!fs::is_directory(volumeDir(volume), ec)) {
+            return errVolumeNotFound;
+        }
+    }
+    return osErrToFileErr(errnum);
+}
+
+Error XLStorage::runOnFile(const fs::path& path, int flags, IoOp* ops, size_t n) {
+    auto name = path.string();
+    std::vector<IoOp> chain;
+    chain.reserve(n + 2);
+
+    IoOp open;
+    open.opcode = IoOpcode::Openat;
+    open.path = name.c_str();
+    open.flags = flags;
+    open.mode = 0644;
+
+    int slot = engine->allocFileSlot();
+    int fd = slot;
+    if (slot >= 0) {
+        open.fd = slot;
+        open.fixedFile = true;
+        open.link = true;
+        chain.push_back(open);
+    } else {
+        engine->submit(&open, 1);
+        if (open.result < 0) {
+            return ioErr(open.result);
+        }
+        fd = static_cast<int>(open.result);
+    }
+
+    // Every op runs whatever the result of the previous one, so that the
+    // file is always closed; errors are picked up from the results.
+    for (size_t i = 0; i < n; ++i) {
+        ops[i].fd = fd;
+        ops[i].fixedFile = slot >= 0;
+        ops[i].link = false;
+        ops[i].hardlink = true;
+        chain.push_back(ops[i]);
+    }
+
+    IoOp close;
+    close.opcode = IoOpcode::Close;
+    close.fd = fd;
+    close.fixedFile = slot >= 0;
+    chain.push_back(close);
+
+    engine->submit(chain);
+    engine->freeFileSlot(slot);
+
+    auto first = slot >= 0 ? 1 : 0;
+    if (slot >= 0 && chain[0].result < 0) {
+        return ioErr(chain[0].result);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        ops[i].result = chain[first + i].result;
+    }
+    return nullptr;
+}
+
+void XLStorage::makeVol(const std::string& volume) {
+    if (::mkdir(volumeDir(volume).c_str(), 0755) < 0) {
+        throw StorageError(osErrToVolErr(errno));
+    }
+}
+
+void XLStorage::makeVolBulk(const std::vector<std::string>& volumes) {
+    for (const auto& volume : volumes) {
+        try {
+            makeVol(volume);
+        } catch (const StorageError& e) {
+            if (e.error() != errVolumeExists) {
+                throw;
+            }
+        }
+    }
+}
+
+std::vector<VolInfo> XLStorage::listVols() {
+    std::vector<VolInfo> vols;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(drivePath, ec)) {
+        struct stat st;
+        if (::stat(entry.path().c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            vols.push_back(VolInfo{entry.path().filename().string(), toTimePoint(st.st_mtim)});
+        }
+    }
+    if (ec) {
+        throw StorageError(errDiskNotFound);
+    }
+    return vols;
+}
+
+VolInfo XLStorage::statVol(const std::string& volume) {
+    struct stat st;
+    if (::stat(volumeDir(volume).c_str(), &st) < 0) {
+        throw StorageError(osErrToVolErr(errno));
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        throw StorageError(errVolumeNotFound);
+    }
+    return VolInfo{volume, toTimePoint(st.st_mtim)};
+}
+
+void XLStorage::deleteVol(const std::string& volume, bool forcedelete) {
+    auto dir = volumeDir(volume);
+    XLMetaInvalidation invalidation(metaCache, volume, "", true);
+    if (forcedelete) {
+        std::error_code ec;
+        if (fs::remove_all(dir, ec) == 0 && !ec) {
+            throw StorageError(errVolumeNotFound);
+        }
+        if (ec) {
+            throw StorageError(osErrToVolErr(ec.value()));
+        }
+        return;
+    }
+    if (::rmdir(dir.c_str()) < 0) {
+        throw StorageError(osErrToVolErr(errno == EEXIST ? ENOTEMPTY : errno));
+    }
+}
+
+Error XLStorage::loadXLMeta(const std::string& volume, const std::string& path, XLMetaV2& meta) {
+    try {
+        auto buf = readAll(volume, path + "/" + xlStorageFormatFile);
+        return meta.load(buf);
+    } catch (const StorageError& e) {
+        return e.error();
+    }
+}
+
+Error XLStorage::saveXLMeta(const std::string& volume, const std::string& path, const XLMetaV2& meta) {
+    try {
+        writeAll(volume, path + "/" + xlStorageFormatFile, meta.marshal());
+    } catch (const StorageError& e) {
+        return e.error();
+    }
+    return nullptr;
+}
+
+Error XLStorage::deleteVersionsOf(const std::string& volume, const std::string& path,
+                                  const std::vector<FileInfo>& versions, bool forceDelMarker) {
+    XLMetaV2 meta;
+    auto err = loadXLMeta(volume, path, meta);
+    auto onlyMarkers = std::all_of(versions.begin(), versions.end(),
+                                   [](const FileInfo& fi) { return fi.deleted; });
+    if (err && !(err == errFileNotFound && onlyMarkers && forceDelMarker)) {
+        return err;
+    }
+
+    std::vector<std::string> dataDirs;
+    bool changed = false;
+    bool missing = false;
+    for (const auto& fi : versions) {
+        // Deleting with a delete marker adds a version.
+        if (fi.deleted) {
+            meta.addVersion(fi);
+            changed = true;
+            continue;
+        }
+        auto it = std::find_if(meta.versions().begin(), meta.versions().end(),
+                               [&](const FileInfo& v) { return v.versionID == fi.versionID; });
+        if (it == meta.versions().end()) {
+            missing = true;
+            continue;
+        }
+        if (!it->dataDir.empty() && !meta.sharedDataDir(*it)) {
+            dataDirs.push_back(it->dataDir);
+        }
+        meta.deleteVersion(fi);
+        changed = true;
+    }
+    if (!changed) {
+        return missing ? errFileVersionNotFound : nullptr;
+    }
+
+    // xl.meta goes first, a crash leaves unreferenced data behind rather
+    // than a version without its data.
+    try {
+        if (meta.versions().empty()) {
+            deletePath(volume, path + "/" + xlStorageFormatFile, DeleteOptions{});
+        } else if (auto serr = saveXLMeta(volume, path, meta)) {
+            return serr;
+        }
+        for (const auto& dataDir : dataDirs) {
+            try {
+                deletePath(volume, path + "/" + dataDir, DeleteOptions{.recursive = true});
+            } catch (const StorageError& e) {
+                if (e.error() != errFileNotFound) {
+                    throw;
+                }
+            }
+        }
+    } catch (const StorageError& e) {
+        if (e.error() != errFileNotFound) {
+            return e.error();
+        }
+    }
+    return missing ? errFileVersionNotFound : nullptr;
+}
+
+Error XLStorage::deleteVersion(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, bool forceDelMarker, const DeleteOptions& opts) {
+    return deleteVersionsOf(volume, path, {fi}, forceDelMarker);
+}
+
+std::vector<Error> XLStorage::deleteVersions(Context& ctx, const std::string& volume, const std::vector<FileInfoVersions>& versions, const DeleteOptions& opts) {
+    std::vector<Error> errs(versions.size());
+    for (size_t i = 0; i < versions.size(); ++i) {
+        errs[i] = deleteVersionsOf(volume, versions[i].name, versions[i].versions, false);
+    }
+    return errs;
+}
+
+Error XLStorage::writeMetadata(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const FileInfo& fi) {
+    XLMetaV2 meta;
+    if (!fi.fresh) {
+        auto err = loadXLMeta(volume, path, meta);
+        if (err && err != errFileNotFound) {
+            return err;
+        }
+    }
+    meta.addVersion(fi);
+    return saveXLMeta(volume, path, meta);
+}
+
+Error XLStorage::updateMetadata(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, const UpdateMetadataOpts& opts) {
+    XLMetaV2 meta;
+    if (auto err = loadXLMeta(volume, path, meta)) {
+        return err;
+    }
+    auto it = std::find_if(meta.versions().begin(), meta.versions().end(),
+                           [&](const FileInfo& v) { return v.versionID == fi.versionID; });
+    if (it == meta.versions().end()) {
+        return errFileVersionNotFound;
+    }
+    auto version = *it;
+    version.metadata = fi.metadata;
+    meta.addVersion(version);
+    return saveXLMeta(volume, path, meta);
+}
+
+XLMetaCache::Buffer XLStorage::readXLMeta(const std::string& volume, const std::string& path) {
+    if (auto buf = metaCache.get(volume, path)) {
+        return buf;
+    }
+    auto ticket = metaCache.ticket(volume, path);
+    auto buf = std::make_shared<const std::vector<uint8_t>>(readAll(volume, path + "/" + xlStorageFormatFile));
+    metaCache.put(volume, path, ticket, buf);
+    return buf;
+}
+
+FileInfo XLStorage::readVersion(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const std::string& versionID, const ReadOptions& opts) {
+    auto buf = readXLMeta(volume, path);
+    FileInfo fi{};
+    if (isXL2(*buf)) {
+        // Only the version asked for is decoded.
+        XLMetaV2View view;
+        throwIf(view.load(*buf));
+        throwIf(view.toFileInfo(volume, path, versionID, fi, opts.readData));
+        return fi;
+    }
+    XLMetaV2 meta;
+    throwIf(meta.load(*buf));
+    throwIf(meta.toFileInfo(volume, path, versionID, fi, opts.readData));
+    return fi;
+}
+
+RawFileInfo XLStorage::readXL(Context& ctx, const std::string& volume, const std::string& path, bool readData) {
+    auto buf = readXLMeta(volume, path);
+    RawFileInfo rf;
+    if (!readData && isXL2(*buf)) {
+        XLMetaV2View view;
+        if (!view.load(*buf)) {
+            rf.buf.assign(buf->begin(), buf->begin() + static_cast<ptrdiff_t>(view.metadataSize()));
+            return rf;
+        }
+    }
+    rf.buf = *buf;
+    return rf;
+}
+
+uint64_t XLStorage::renameData(Context& ctx, const std::string& srcVolume, const std::string& srcPath, const FileInfo& fi, const std::string& dstVolume, const std::string& dstPath, const RenameOptions& opts) {
+    // Both objects are dropped however far the call gets, a data dir moved
+    // without its xl.meta written changes the object all the same.
+    XLMetaInvalidation srcInvalidation(metaCache, srcVolume, srcPath, true);
+    XLMetaInvalidation dstInvalidation(metaCache, dstVolume, dstPath + "/" + xlStorageFormatFile, false);
+    XLMetaV2 meta;
+    auto err = loadXLMeta(dstVolume, dstPath, meta);
+    if (err && err != errFileNotFound) {
+        throw StorageError(err);
+    }
+
+    // The data dir of the version replaced goes once nothing refers to it.
+    std::string oldDataDir;
+    auto it = std::find_if(meta.versions().begin(), meta.versions().end(),
+                           [&](const FileInfo& v) { return v.versionID == fi.versionID; });
+    if (it != meta.versions().end() && it->dataDir != fi.dataDir) {
+        oldDataDir = it->dataDir;
+    }
+
+    if (!fi.deleted && !fi.dataDir.empty() && fi.data.empty()) {
+        auto src = filePath(srcVolume, srcPath + "/" + fi.dataDir);
+        auto dst = filePath(dstVolume, dstPath + "/" + fi.dataDir);
+        struct stat st;
+        if (::stat(src.c_str(), &st) < 0) {
+            throw StorageError(openError(errno, srcVolume));
+        }
+        // A retried call finds what an earlier one moved, rename does not
+        // replace a directory that is not empty.
+        std::error_code ec;
+        fs::remove_all(dst, ec);
+        fs::create_directories(dst.parent_path(), ec);
+        auto srcName = src.string();
+        auto dstName = dst.string();
+
+        IoOp rename;
+        rename.opcode = IoOpcode::Renameat;
+        rename.path = srcName.c_str();
+        rename.path2 = dstName.c_str();
+        engine->submit(&rename, 1);
+        if (rename.result < 0) {
+            throw StorageError(openError(static_cast<int>(-rename.result), srcVolume));
+        }
+    }
+
+    meta.addVersion(fi);
+    throwIf(saveXLMeta(dstVolume, dstPath, meta));
+
+    // Leftovers are cleaned up best effort, the version is in place.
+    auto referenced = std::any_of(meta.versions().begin(), meta.versions().end(),
+                                  [&](const FileInfo& v) { return v.dataDir == oldDataDir; });
+    try {
+        if (!oldDataDir.empty() && !referenced) {
+            deletePath(dstVolume, dstPath + "/" + oldDataDir, DeleteOptions{.recursive = true});
+        }
+    } catch (const StorageError&) {
+    }
+    try {
+        deletePath(srcVolume, srcPath, DeleteOptions{.recursive = true});
+    } catch (const StorageError&) {
+    }
+    return versionSignature(fi);
+}
+
+std::vector<std::string> XLStorage::listDir(const std::string& volume, const std::string& dirpath, int count) {
+    auto dir = dirpath.empty() ? volumeDir(volume) : filePath(volume, dirpath);
+    std::vector<std::string> entries;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (count >= 0 && static_cast<int>(entries.size()) >= count) {
+            break;
+        }
+        auto name = entry.path().filename().string();
+        if (entry.is_directory(ec)) {
+            name += "/";
+        }
+        entries.push_back(std::move(name));
+    }
+    if (ec) {
+        throw StorageError(openError(ec.value(), volume));
+    }
+    return entries;
+}
+
+int64_t XLStorage::readFile(const std::string& volume, const std::string& path, int64_t offset, std::vector<uint8_t>& buf, const BitrotVerifier* verifier) {
+    if (offset < 0) {
+        throw StorageError(errInvalidArgument);
+    }
+    if (buf.empty()) {
+        return 0;
+    }
+    if (verifier) {
+        return readFileVerified(volume, path, offset, buf, *verifier);
+    }
+
+    std::vector<IoOp> ops;
+    appendIoOps(ops, IoOpcode::Read, buf.data(), buf.size(), offset);
+    auto err = runOnFile(filePath(volume, path), O_RDONLY, ops.data(), ops.size());
+    if (err) {
+        throw StorageError(err == errFileNotFound ? openError(ENOENT, volume) : err);
+    }
+
+    // Returns the bytes read, less than buf.size() only at end of file.
+    int64_t total = 0;
+    for (const auto& op : ops) {
+        throwIf(ioErr(op.result));
+        total += op.result;
+        if (op.result < op.len) {
+            break;
+        }
+    }
+    return total;
+}
+
+int64_t XLStorage::readFileVerified(const std::string& volume, const std::string& path, int64_t offset,
+                                    std::vector<uint8_t>& buf, const BitrotVerifier& verifier) {
+    auto hash = newBitrotHash(verifier.algorithm);
+    if (!hash || verifier.shardSize <= 0 || offset % verifier.shardSize != 0) {
+        throw StorageError(errInvalidArgument);
+    }
+
+    // Checksums land in their own buffer and data right in 'buf', all
+    // chunks are read in one submission.
+    auto hashSize = hash->size();
+    auto chunkSize = static_cast<size_t>(verifier.shardSize);
+    auto chunks = (buf.size() + chunkSize - 1) / chunkSize;
+    std::vector<uint8_t> sums(chunks * hashSize);
+    std::vector<IoOp> ops;
+    std::vector<size_t> firstOp(chunks + 1);
+    auto fileOffset = bitrotShardFileOffset(offset, verifier.shardSize, verifier.algorithm);
+    for (size_t c = 0; c < chunks; ++c) {
+        auto len = std::min(chunkSize, buf.size() - c * chunkSize);
+        firstOp[c] = ops.size();
+        appendIoOps(ops, IoOpcode::Read, sums.data() + c * hashSize, hashSize, fileOffset);
+        appendIoOps(ops, IoOpcode::Read, buf.data() + c * chunkSize, len, fileOffset + hashSize);
+        fileOffset += static_cast<int64_t>(hashSize + len);
+    }
+    firstOp[chunks] = ops.size();
+    auto err = runOnFile(filePath(volume, path), O_RDONLY, ops.data(), ops.size());
+    if (err) {
+        throw StorageError(err == errFileNotFound ? openError(ENOENT, volume) : err);
+    }
+
+    // Verify chunk by chunk while the data is still in cache, the last
+    // chunk of a shard file may be short.
+    int64_t total = 0;
+    std::vector<uint8_t> sum(hashSize);
+    for (size_t c = 0; c < chunks; ++c) {
+        const auto& sumOp = ops[firstOp[c]];
+        throwIf(ioErr(sumOp.result));
+        if (sumOp.result == 0) {
+            break;
+        }
+        if (sumOp.result < sumOp.len) {
+            throw StorageError(errFileCorrupt);
+        }
+
+        int64_t n = 0;
+        bool eof = false;
+        for (auto i = firstOp[c] + 1; i < firstOp[c + 1]; ++i) {
+            throwIf(ioErr(ops[i].result));
+            n += ops[i].result;
+            if (ops[i].result < ops[i].len) {
+                eof = true;
+                break;
+            }
+        }
+        if (n == 0) {
+            throw StorageError(errFileCorrupt);
+        }
+
+        auto data = buf.data() + c * chunkSize;
+        hash->reset();
+        hash->update(data, static_cast<size_t>(n));
+        hash->sum(sum.data());
+        if (std::memcmp(sum.data(), sums.data() + c * hashSize, hashSize) != 0) {
+            throw StorageError(errFileCorrupt);
+        }
+        total += n;
+        if (eof) {
+            break;
+        }
+    }
+    return total;
+}
+
+void XLStorage::appendFile(const std::string& volume, const std::string& path, const std::vector<uint8_t>& buf) {
+    auto file = filePath(volume, path);
+    XLMetaInvalidation invalidation(metaCache, volume, path, false);
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+
+    if (odirect && static_cast<int64_t>(buf.size()) >= odirectThreshold) {
+        int fd = ::open(file.c_str(), O_CREAT | O_WRONLY | O_DIRECT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw StorageError(openError(errno, volume));
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            auto errnum = errno;
+            ::close(fd);
+            throw StorageError(osErrToFileErr(errnum));
+        }
+        // Appending past an unaligned tail can not go direct.
+        bool direct = st.st_size % directIoAlignment == 0;
+        if (!direct) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+        }
+
+        size_t pos = 0;
+        auto fill = [&buf, &pos](uint8_t* chunk, size_t size) {
+            auto n = std::min(size, buf.size() - pos);
+            std::memcpy(chunk, buf.data() + pos, n);
+            pos += n;
+            return n;
+        };
+        int64_t written = 0;
+        auto err = writeChunks(fd, false, direct, st.st_size, -1, fill, written);
+        ::close(fd);
+        diskInfoCache.written(written);
+        throwIf(err);
+        return;
+    }
+
+    std::vector<IoOp> ops;
+    appendIoOps(ops, IoOpcode::Write, const_cast<uint8_t*>(buf.data()), buf.size(), -1);
+    auto err = runOnFile(file, O_CREAT | O_APPEND | O_WRONLY, ops.data(), ops.size());
+    throwIf(err == errFileNotFound ? openError(ENOENT, volume) : err);
+
+    for (const auto& op : ops) {
+        throwIf(ioErr(op.result));
+        if (op.result < op.len) {
+            throw StorageError(errDiskFull);
+        }
+    }
+    diskInfoCache.written(static_cast<int64_t>(buf.size()));
+}
+
+Error XLStorage::writeChunks(int fd, bool fixedFile, bool direct, int64_t offset, int64_t limit,
+                             const std::function<size_t(uint8_t*, size_t)>& fill, int64_t& written) {
+    // Registered buffers are page aligned, bring an aligned one of our own
+    // when the pool is exhausted.
+    auto regBuf = engine->acquireBuffer();
+    AlignedBuffer ownBuf;
+    uint8_t* chunk = regBuf.data;
+    size_t chunkSize = regBuf.size;
+    if (!regBuf.valid()) {
+        chunkSize = engine->bufferSize();
+        ownBuf.reset(static_cast<uint8_t*>(std::aligned_alloc(directIoAlignment, chunkSize)));
+        chunk = ownBuf.get();
+        if (chunk == nullptr) {
+            return newError(errCodeUnexpected, "out of memory");
+        }
+    }
+
+    auto write = [&](uint8_t* data, size_t len, int64_t off) -> Error {
+        IoOp op;
+        op.opcode = IoOpcode::Write;
+        op.fd = fd;
+        op.fixedFile = fixedFile;
+        op.buf = data;
+        op.len = static_cast<uint32_t>(len);
+        op.offset = off;
+        op.bufIndex = data == regBuf.data ? regBuf.index : -1;
+        engine->submit(&op, 1);
+        if (op.result < 0) {
+            return ioErr(op.result);
+        }
+        written += op.result;
+        return op.result < static_cast<int64_t>(len) ? errDiskFull : nullptr;
+    };
+
+    Error err;
+    written = 0;
+    while (!err) {
+        auto n = fill(chunk, chunkSize);
+        if (n == 0) {
+            break;
+        }
+        if (limit >= 0 && written + static_cast<int64_t>(n) > limit) {
+            err = errMoreData;
+            break;
+        }
+
+        // Only the last chunk comes short: write its aligned part direct,
+        // then drop O_DIRECT for the remaining bytes.
+        size_t aligned = n;
+        if (direct && n % directIoAlignment != 0) {
+            aligned = n / directIoAlignment * directIoAlignment;
+        }
+        if (aligned > 0) {
+            err = write(chunk, aligned, offset + written);
+        }
+        if (!err && aligned < n) {
+            if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT) < 0) {
+                err = osErrToFileErr(errno);
+                break;
+            }
+            direct = false;
+            err = write(chunk + aligned, n - aligned, offset + written);
+        }
+    }
+
+    engine->releaseBuffer(regBuf);
+    return err;
+}
+
+void XLStorage::createFile(const std::string& volume, const std::string& path, int64_t size, std::istream& reader) {
+    auto file = filePath(volume, path);
+    XLMetaInvalidation invalidation(metaCache, volume, path, false);
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    auto name = file.string();
+
+    // Large shards go around the page cache. O_DIRECT is cleared later on
+    // through fcntl, so these use a plain descriptor instead of a slot.
+    bool direct = odirect && (size < 0 || size >= odirectThreshold);
+
+    // The file stays open over many submissions, one per chunk.
+    IoOp open;
+    open.opcode = IoOpcode::Openat;
+    open.path = name.c_str();
+    open.flags = O_CREAT | O_TRUNC | O_WRONLY | (direct ? O_DIRECT : 0);
+    open.mode = 0644;
+    int slot = direct ? -1 : engine->allocFileSlot();
+    if (slot >= 0) {
+        open.fd = slot;
+        open.fixedFile = true;
+    }
+    engine->submit(&open, 1);
+    if (open.result < 0) {
+        engine->freeFileSlot(slot);
+        throw StorageError(openError(static_cast<int>(-open.result), volume));
+    }
+    int fd = slot >= 0 ? slot : static_cast<int>(open.result);
+
+    auto fill = [&reader](uint8_t* chunk, size_t chunkSize) {
+        reader.read(reinterpret_cast<char*>(chunk), static_cast<std::streamsize>(chunkSize));
+        return static_cast<size_t>(reader.gcount());
+    };
+    int64_t written = 0;
+    auto err = writeChunks(fd, slot >= 0, direct, 0, size, fill, written);
+    diskInfoCache.written(written, 1);
+    if (!err && size >= 0 && written < size) {
+        err = errLessData;
+    }
+
+    IoOp done[2];
+    done[0].opcode = IoOpcode::Fsync;
+    done[0].hardlink = true;
+    done[1].opcode = IoOpcode::Close;
+    for (auto& op : done) {
+        op.fd = fd;
+        op.fixedFile = slot >= 0;
+    }
+    engine->submit(done, 2);
+    engine->freeFileSlot(slot);
+
+    throwIf(err);
+    throwIf(ioErr(done[0].result));
+}
+
+std::unique_ptr<std::istream> XLStorage::readfileStream(const std::string& volume, const std::string& path, int64_t offset, int64_t length) {
+    FileRange range;
+    throwIf(openFileRange(volume, path, offset, length, range));
+    return std::make_unique<FileRangeStream>(std::move(range));
+}
+
+Error XLStorage::openFileRange(const std::string& volume, const std::string& path, int64_t offset, int64_t length, FileRange& range) {
+    if (offset < 0 || length < 0) {
+        return errInvalidArgument;
+    }
+
+    int fd = ::open(filePath(volume, path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return openError(errno, volume);
+    }
+    FileRange r(fd, offset, length);
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        return osErrToFileErr(errno);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return errIsNotRegular;
+    }
+    if (offset + length > st.st_size) {
+        return errLessData;
+    }
+
+    range = std::move(r);
+    return nullptr;
+}
+
+void XLStorage::renameFile(const std::string& srcvolume, const std::string& srcpath, const std::string& dstvolume, const std::string& dstpath) {
+    auto src = filePath(srcvolume, srcpath).string();
+    auto dst = filePath(dstvolume, dstpath);
+    XLMetaInvalidation srcInvalidation(metaCache, srcvolume, srcpath, true);
+    XLMetaInvalidation dstInvalidation(metaCache, dstvolume, dstpath, true);
+    std::error_code ec;
+    fs::create_directories(dst.parent_path(), ec);
+    auto dstName = dst.string();
+
+    IoOp rename;
+    rename.opcode = IoOpcode::Renameat;
+    rename.path = src.c_str();
+    rename.path2 = dstName.c_str();
+    engine->submit(&rename, 1);
+    if (rename.result < 0) {
+        throw StorageError(openError(static_cast<int>(-rename.result), srcvolume));
+    }
+}
+
+void XLStorage::checkParts(const std::string& volume, const std::string& path, const FileInfo& fi) {
+    if (!hasPartFiles(fi)) {
+        return;
+    }
+    auto erasure = erasureOf(fi);
+    for (const auto& part : fi.parts) {
+        auto file = filePath(volume, partFile(path, fi, part.number));
+        struct stat st;
+        if (::stat(file.c_str(), &st) < 0) {
+            throw StorageError(openError(errno, volume));
+        }
+        if (S_ISDIR(st.st_mode)) {
+            throw StorageError(errFileNotFound);
+        }
+        auto size = bitrotShardFileSize(erasure.shardFileSize(part.size), erasure.shardSize(),
+                                        partBitrotAlgorithm(fi, part.number));
+        if (st.st_size < size) {
+            throw StorageError(errFileCorrupt);
+        }
+    }
+}
+
+void XLStorage::deletePath(const std::string& volume, const std::string& path, const DeleteOptions& opts) {
+    auto file = filePath(volume, path);
+    XLMetaInvalidation invalidation(metaCache, volume, path, opts.recursive);
+    std::error_code ec;
+    if (opts.recursive) {
+        if (fs::remove_all(file, ec) == 0 && !ec) {
+            throw StorageError(errFileNotFound);
+        }
+    } else if (!fs::remove(file, ec) && !ec) {
+        throw StorageError(openError(ENOENT, volume));
+    }
+    if (ec) {
+        throw StorageError(osErrToFileErr(ec.value()));
+    }
+
+    // Remove parents left empty, up to the volume.
+    auto vol = volumeDir(volume);
+    for (auto dir = file.parent_path(); dir != vol && dir.has_parent_path(); dir = dir.parent_path()) {
+        if (::rmdir(dir.c_str()) < 0) {
+            break;
+        }
+    }
+}
+
+void XLStorage::verifyFile(const std::string& volume, const std::string& path, const FileInfo& fi) {
+    if (!hasPartFiles(fi)) {
+        return;
+    }
+    auto erasure = erasureOf(fi);
+    BitrotVerifier verifier;
+    verifier.shardSize = erasure.shardSize();
+    auto chunk = verifier.shardSize * verifyFileShards;
+    std::vector<uint8_t> buf;
+    for (const auto& part : fi.parts) {
+        verifier.algorithm = partBitrotAlgorithm(fi, part.number);
+        auto file = partFile(path, fi, part.number);
+        auto size = erasure.shardFileSize(part.size);
+        for (int64_t offset = 0; offset < size; offset += chunk) {
+            buf.resize(static_cast<size_t>(std::min(chunk, size - offset)));
+            if (readFileVerified(volume, file, offset, buf, verifier) < static_cast<int64_t>(buf.size())) {
+                throw StorageError(errFileCorrupt);
+            }
+        }
+    }
+}
+
+std::vector<StatInfo> XLStorage::statInfoFile(const std::string& volume, const std::string& path, bool glob) {
+    struct stat st;
+    if (::stat(filePath(volume, path).c_str(), &st) < 0) {
+        throw StorageError(openError(errno, volume));
+    }
+    StatInfo info;
+    info.name = path;
+    info.size = st.st_size;
+    info.modTime = toTimePoint(st.st_mtim);
+    info.mode = st.st_mode;
+    info.dir = S_ISDIR(st.st_mode);
+    return {info};
+}
+
+void XLStorage::readMultiple(const ReadMultipleReq& req, std::vector<ReadMultipleResp>& resp) {
+    struct File {
+        std::string     volume;
+        std::string     path;
+        std::string     name;
+        Error           err;
+        struct statx    stx;
+        int             slot = -1;
+        size_t          op = 0;         // statx, then open, read and close on a slot
+    };
+
+    // A batch of files is stat'ed, opened, read and closed with a single
+    // submission, whatever fits the first read; batches are small enough
+    // that a request stopped early does not read far ahead.
+    auto readSize = readAllInitialSize;
+    if (req.maxSize > 0 && req.maxSize < readAllInitialSize) {
+        readSize = static_cast<uint32_t>(req.maxSize) + 1;
+    }
+    auto arena = std::make_unique_for_overwrite<uint8_t[]>(std::min(req.files.size(), readMultipleBatch) * readSize);
+
+    resp.clear();
+    int found = 0;
+    for (size_t begin = 0; begin < req.files.size(); begin += readMultipleBatch) {
+        auto n = std::min(req.files.size() - begin, readMultipleBatch);
+        std::vector<File> files(n);
+        std::vector<IoOp> ops;
+        ops.reserve(n * 4);
+        for (size_t i = 0; i < n; ++i) {
+            auto& f = files[i];
+            auto path = req.prefix;
+            if (!path.empty() && path.back() != '/') {
+                path += "/";
+            }
+            path += req.files[begin + i];
+            f.volume = req.bucket;
+            if (f.volume.empty()) {
+                auto slash = path.find('/');
+                f.volume = path.substr(0, slash);
+                path = slash == std::string::npos ? std::string() : path.substr(slash + 1);
+            }
+            f.path = std::move(path);
+            try {
+                f.name = filePath(f.volume, f.path).string();
+            } catch (const StorageError& e) {
+                f.err = e.error();
+                continue;
+            }
+
+            f.op = ops.size();
+            IoOp stat;
+            stat.opcode = IoOpcode::Statx;
+            stat.path = f.name.c_str();
+            stat.len = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+            stat.buf = &f.stx;
+            ops.push_back(stat);
+
+            // Without a free slot the file is read on its own below.
+            f.slot = engine->allocFileSlot();
+            if (f.slot < 0) {
+                continue;
+            }
+            IoOp chain[3];
+            chain[0].opcode = IoOpcode::Openat;
+            chain[0].path = f.name.c_str();
+            chain[0].flags = O_RDONLY;
+            chain[0].link = true;
+            chain[1].opcode = IoOpcode::Read;
+            chain[1].buf = arena.get() + i * readSize;
+            chain[1].len = readSize;
+            chain[1].hardlink = true;
+            chain[2].opcode = IoOpcode::Close;
+            for (auto& op : chain) {
+                op.fd = f.slot;
+                op.fixedFile = true;
+                ops.push_back(op);
+            }
+        }
+        engine->submit(ops);
+        for (const auto& f : files) {
+            engine->freeFileSlot(f.slot);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            const auto& f = files[i];
+            ReadMultipleResp r;
+            r.bucket = req.bucket;
+            r.prefix = req.prefix;
+            r.file = req.files[begin + i];
+            r.error = f.err;
+            if (!r.error && ops[f.op].result < 0) {
+                r.error = openError(static_cast<int>(-ops[f.op].result), f.volume);
+            }
+            if (!r.error) {
+                r.exists = true;
+                r.modTime = toTimePoint(timespec{f.stx.stx_mtime.tv_sec, f.stx.stx_mtime.tv_nsec});
+                if (S_ISDIR(f.stx.stx_mode)) {
+                    r.error = errIsNotRegular;
+                } else if (req.maxSize > 0 && static_cast<int64_t>(f.stx.stx_size) > req.maxSize) {
+                    r.error = errMoreData;
+                }
+            }
+            if (!r.error && f.slot >= 0) {
+                const auto& open = ops[f.op + 1];
+                const auto& read = ops[f.op + 2];
+                r.error = open.result < 0 ? openError(static_cast<int>(-open.result), f.volume) : ioErr(read.result);
+                if (!r.error && read.result < read.len) {
+                    auto data = static_cast<const uint8_t*>(read.buf);
+                    r.data.assign(data, data + read.result);
+                }
+            }
+            if (!r.error && (f.slot < 0 || r.data.size() < f.stx.stx_size)) {
+                // Grown since the stat or larger than the first read.
+                try {
+                    r.data = readAll(f.volume, f.path);
+                    if (req.maxSize > 0 && static_cast<int64_t>(r.data.size()) > req.maxSize) {
+                        r.error = errMoreData;
+                        r.data.clear();
+                    }
+                } catch (const StorageError& e) {
+                    r.error = e.error();
+                }
+            }
+            if (!r.error && req.metadataOnly && isXL2(r.data)) {
+                XLMetaV2View view;
+                if (!view.load(r.data)) {
+                    r.data.resize(view.metadataSize());
+                }
+            }
+            if (r.error) {
+                r.exists = r.exists && r.error != errFileNotFound;
+                r.data.clear();
+            }
+
+            auto notFound = r.error == errFileNotFound || r.error == errVolumeNotFound;
+            found += r.error ? 0 : 1;
+            resp.push_back(std::move(r));
+            if ((notFound && req.abortOn404) || (req.maxResults > 0 && found >= req.maxResults)) {
+                return;
+            }
+        }
+    }
+}
+
+void XLStorage::cleanAbandonedData(const std::string& volume, const std::string& path) {
+    XLMetaV2 meta;
+    auto err = loadXLMeta(volume, path, meta);
+    if (err == errFileNotFound) {
+        // Without xl.meta there is no telling data dirs from prefixes.
+        return;
+    }
+    throwIf(err);
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(filePath(volume, path), ec)) {
+        auto name = entry.path().filename().string();
+        if (!entry.is_directory(ec) || !isDataDirName(name)) {
+            continue;
+        }
+        auto referenced = std::any_of(meta.versions().begin(), meta.versions().end(),
+                                      [&](const FileInfo& v) { return v.dataDir == name; });
+        if (!referenced) {
+            try {
+                deletePath(volume, path + "/" + name, DeleteOptions{.recursive = true});
+            } catch (const StorageError& e) {
+                if (e.error() != errFileNotFound) {
+                    throw;
+                }
+            }
+        }
+    }
+}
+
+void XLStorage::writeAll(const std::string& volume, const std::string& path, const std::vector<uint8_t>& data) {
+    auto file = filePath(volume, path);
+    XLMetaInvalidation invalidation(metaCache, volume, path, false);
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+
+    // open, write, fdatasync and close go down as a single submission.
+    std::vector<IoOp> ops;
+    if (!data.empty()) {
+        appendIoOps(ops, IoOpcode::Write, const_cast<uint8_t*>(data.data()), data.size(), 0);
+    }
+    IoOp sync;
+    sync.opcode = IoOpcode::Fsync;
+    ops.push_back(sync);
+
+    auto err = runOnFile(file, O_CREAT | O_TRUNC | O_WRONLY, ops.data(), ops.size());
+    throwIf(err == errFileNotFound ? openError(ENOENT, volume) : err);
+    for (const auto& op : ops) {
+        throwIf(ioErr(op.result));
+        if (op.opcode == IoOpcode::Write && op.result < op.len) {
+            throw StorageError(errDiskFull);
+        }
+    }
+    diskInfoCache.written(static_cast<int64_t>(data.size()), 1);
+}
+
+std::vector<uint8_t> XLStorage::readAll(const std::string& volume, const std::string& path) {
+    auto file = filePath(volume, path);
+
+    // Small files are opened, read and closed with a single submission.
+    std::vector<uint8_t> data(readAllInitialSize);
+    IoOp read;
+    read.opcode = IoOpcode::Read;
+    read.buf = data.data();
+    read.len = readAllInitialSize;
+    read.offset = 0;
+    auto err = runOnFile(file, O_RDONLY, &read, 1);
+    throwIf(err == errFileNotFound ? openError(ENOENT, volume) : err);
+    throwIf(ioErr(read.result));
+    if (read.result < read.len) {
+        data.resize(static_cast<size_t>(read.result));
+        return data;
+    }
+
+    // Larger files, read the rest according to the current size.
+    struct stat st;
+    if (::stat(file.c_str(), &st) < 0) {
+        throw StorageError(openError(errno, volume));
+    }
+    data.resize(static_cast<size_t>(st.st_size));
+    if (data.size() <= readAllInitialSize) {
+        return data;
+    }
+
+    std::vector<IoOp> ops;
+    appendIoOps(ops, IoOpcode::Read, data.data() + readAllInitialSize,
+                data.size() - readAllInitialSize, readAllInitialSize);
+    throwIf(runOnFile(file, O_RDONLY, ops.data(), ops.size()));
+    size_t total = readAllInitialSize;
+    for (const auto& op : ops) {
+        throwIf(ioErr(op.result));
+        total += static_cast<size_t>(op.result);
+        if (op.result < op.len) {
+            break;
+        }
+    }
+    data.resize(total);
+    return data;
+}
+
+}
@@ -0,0 +1,434 @@
+#include "include/xl_storage_disk_id_check.hpp"
+#include "include/log.hpp"
+#include "include/metacache_stream.hpp"
+#include "include/storage_errors.hpp"
+
+#include <random>
+#include <type_traits>
+
+using namespace cppio;
+
+namespace {
+
+// How often a stopping monitor looks up from a hung probe.
+constexpr auto probePoll = std::chrono::milliseconds(100);
+
+bool isAvailabilityError(const Error& err) {
+    return err == errFaultyDisk || err == errDiskNotFound;
+}
+
+}
+
+// Call - an admitted call, frees its slot when it goes out of scope.
+class XLStorageDiskIDCheck::Call {
+
+public:
+    explicit Call(XLStorageDiskIDCheck& d) : d(d), start(std::chrono::steady_clock::now()) {}
+    ~Call() { d.leave(std::chrono::steady_clock::now() - start, err); }
+
+    Call(const Call&) = delete;
+    Call& operator=(const Call&) = delete;
+
+    Error   err;
+
+private:
+    XLStorageDiskIDCheck&                   d;
+    std::chrono::steady_clock::time_point   start;
+};
+
+// Probe - the outcome of a probe, shared with its thread which may
+// outlive the drive when hung.
+struct XLStorageDiskIDCheck::Probe {
+    std::mutex              mu;
+    std::condition_variable cv;
+    bool                    done = false;
+    bool                    ok = false;
+};
+
+XLStorageDiskIDCheck::XLStorageDiskIDCheck(std::shared_ptr<StorageAPI> storage, const XLStorageDiskIDCheckOptions& opts)
+    : storage(std::move(storage)), opts(opts), metrics(opts.metrics) {
+    if (this->opts.maxConcurrent == 0) {
+        this->opts.maxConcurrent = 1;
+    }
+    lastProgress = now();
+    monitorThread = std::thread([this]() { monitor(); });
+}
+
+XLStorageDiskIDCheck::~XLStorageDiskIDCheck() {
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        stopping = true;
+    }
+    stopCv.notify_all();
+    if (monitorThread.joinable()) {
+        monitorThread.join();
+    }
+}
+
+int64_t XLStorageDiskIDCheck::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Error XLStorageDiskIDCheck::enter() {
+    if (offline.load(std::memory_order_acquire)) {
+        totalErrorsAvailability.fetch_add(1, std::memory_order_relaxed);
+        return errFaultyDisk;
+    }
+    // A free slot is taken without a lock. The first call of an idle
+    // drive restarts the clock of the monitor.
+    auto tryAcquire = [this]() {
+        auto n = inFlight.load(std::memory_order_relaxed);
+        while (n < opts.maxConcurrent) {
+            if (inFlight.compare_exchange_weak(n, n + 1)) {
+                if (n == 0) {
+                    lastProgress.store(now(), std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+        return false;
+    };
+    if (tryAcquire()) {
+        return nullptr;
+    }
+
+    // Registered as waiting before looking at the slots again, a call
+    // leaving after that sees it and wakes it up.
+    waiting.fetch_add(1);
+    bool admitted = false;
+    {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait_for(lock, opts.maxWait, [&]() {
+            admitted = tryAcquire();
+            return admitted || offline.load();
+        });
+    }
+    waiting.fetch_sub(1);
+    if (admitted) {
+        return nullptr;
+    }
+    if (offline.load()) {
+        totalErrorsAvailability.fetch_add(1, std::memory_order_relaxed);
+        return errFaultyDisk;
+    }
+    timedOut();
+    return errDiskOngoingReq;
+}
+
+void XLStorageDiskIDCheck::leave(std::chrono::nanoseconds elapsed, const Error& err) {
+    inFlight.fetch_sub(1);
+    lastProgress.store(now(), std::memory_order_relaxed);
+    if (waiting.load() > 0) {
+        // Taking the lock orders this after a waiter's look at the slots.
+        { std::lock_guard<std::mutex> lock(mu); }
+        cv.notify_one();
+    }
+    if (isAvailabilityError(err)) {
+        totalErrorsAvailability.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (elapsed > opts.maxCallTime) {
+        timedOut();
+    } else {
+        timeouts.store(0, std::memory_order_relaxed);
+    }
+}
+
+void XLStorageDiskIDCheck::timedOut() {
+    totalErrorsTimeout.fetch_add(1, std::memory_order_relaxed);
+    if (timeouts.fetch_add(1, std::memory_order_relaxed) + 1 >= opts.maxTimeouts) {
+        setOffline("too many timeouts");
+    }
+}
+
+void XLStorageDiskIDCheck::setOffline(const char* reason) {
+    if (offline.exchange(true)) {
+        return;
+    }
+    gLogger->warn("drive {} taken offline: {}", storage->string(), reason);
+    // Calls waiting for a slot give up.
+    { std::lock_guard<std::mutex> lock(mu); }
+    cv.notify_all();
+}
+
+void XLStorageDiskIDCheck::monitor() {
+    auto stalled = std::chrono::duration_cast<std::chrono::nanoseconds>(opts.maxCallTime).count();
+    std::unique_lock<std::mutex> lock(mu);
+    while (!stopCv.wait_for(lock, opts.probeInterval, [this]() { return stopping; })) {
+        lock.unlock();
+        if (!offline.load()) {
+            if (inFlight.load() > 0 && now() - lastProgress.load(std::memory_order_relaxed) > stalled) {
+                setOffline("no call completed in time");
+            }
+        } else if (probe()) {
+            timeouts.store(0, std::memory_order_relaxed);
+            lastProgress.store(now(), std::memory_order_relaxed);
+            offline.store(false, std::memory_order_release);
+            gLogger->info("drive {} back online", storage->string());
+        }
+        lock.lock();
+    }
+}
+
+bool XLStorageDiskIDCheck::probe() {
+    // A probe still hanging in the drive keeps it offline, no other one
+    // piles up behind it.
+    if (probing) {
+        std::lock_guard<std::mutex> lock(probing->mu);
+        if (!probing->done) {
+            return false;
+        }
+    }
+    auto p = std::make_shared<Probe>();
+    probing = p;
+
+    std::random_device rd;
+    std::vector<uint8_t> data(64);
+    for (auto& b : data) {
+        b = static_cast<uint8_t>(rd());
+    }
+    std::thread([storage = storage, p, data = std::move(data)]() {
+        static const char digits[] = "0123456789abcdef";
+        std::string path = "tmp/.probe-";
+        for (size_t i = 0; i < 8; i++) {
+            path += digits[data[i] >> 4];
+            path += digits[data[i] & 15];
+        }
+        bool ok = false;
+        try {
+            storage->writeAll(cppioMetaBucket, path, data);
+            ok = storage->readAll(cppioMetaBucket, path) == data;
+            storage->deletePath(cppioMetaBucket, path, DeleteOptions{});
+        } catch (const std::exception&) {
+            ok = false;
+        }
+        std::lock_guard<std::mutex> lock(p->mu);
+        p->done = true;
+        p->ok = ok;
+        p->cv.notify_all();
+    }).detach();
+
+    auto deadline = std::chrono::steady_clock::now() + opts.maxCallTime;
+    std::unique_lock<std::mutex> lock(p->mu);
+    while (!p->done && std::chrono::steady_clock::now() < deadline) {
+        p->cv.wait_for(lock, probePoll);
+        std::lock_guard<std::mutex> stop(mu);
+        if (stopping) {
+            return false;
+        }
+    }
+    return p->done && p->ok;
+}
+
+template<typename F>
+auto XLStorageDiskIDCheck::run(StorageMetric metric, int64_t size, F&& f) -> decltype(f()) {
+    using R = decltype(f());
+    if (auto err = enter()) {
+        if constexpr (std::is_same_v<R, Error>) {
+            return err;
+        } else {
+            throw StorageError(err);
+        }
+    }
+    Call call(*this);
+    auto t = metrics.track(metric, size);
+    try {
+        if constexpr (std::is_same_v<R, Error>) {
+            call.err = f();
+            return call.err;
+        } else {
+            return f();
+        }
+    } catch (const StorageError& e) {
+        call.err = e.error();
+        throw;
+    }
+}
+
+DiskInfo XLStorageDiskIDCheck::diskInfo(const DiskInfoOptions& opts) {
+    auto info = run(storageMetricDiskInfo, 0, [&]() { return storage->diskInfo(opts); });
+    if (opts.metrics) {
+        metrics.snapshot(info.metrics);
+        info.metrics.totalWrites = totalWrites.load(std::memory_order_relaxed);
+        info.metrics.totalDeletes = totalDeletes.load(std::memory_order_relaxed);
+        info.metrics.totalWaiting = waiting.load(std::memory_order_relaxed);
+        info.metrics.totalErrorsTimeout = totalErrorsTimeout.load(std::memory_order_relaxed);
+        info.metrics.totalErrorsAvailability = totalErrorsAvailability.load(std::memory_order_relaxed);
+    }
+    return info;
+}
+
+void XLStorageDiskIDCheck::nsScanner(DataUsageCache& cache, std::vector<dataUsageEntry>& updates, madmin::HealScanMode scanMode, std::function<bool()> shouldSleep) {
+    storage->nsScanner(cache, updates, scanMode, std::move(shouldSleep));
+}
+
+void XLStorageDiskIDCheck::makeVol(const std::string& volume) {
+    run(storageMetricMakeVol, 0, [&]() { storage->makeVol(volume); });
+}
+
+void XLStorageDiskIDCheck::makeVolBulk(const std::vector<std::string>& volumes) {
+    run(storageMetricMakeVolBulk, 0, [&]() { storage->makeVolBulk(volumes); });
+}
+
+std::vector<VolInfo> XLStorageDiskIDCheck::listVols() {
+    return run(storageMetricListVols, 0, [&]() { return storage->listVols(); });
+}
+
+VolInfo XLStorageDiskIDCheck::statVol(const std::string& volume) {
+    return run(storageMetricStatVol, 0, [&]() { return storage->statVol(volume); });
+}
+
+void XLStorageDiskIDCheck::deleteVol(const std::string& volume, bool forcedelete) {
+    run(storageMetricDeleteVol, 0, [&]() {
+        totalDeletes.fetch_add(1, std::memory_order_relaxed);
+        storage->deleteVol(volume, forcedelete);
+    });
+}
+
+// A walk runs as long as its caller consumes entries, it takes no slot
+// and has no deadline.
+Error XLStorageDiskIDCheck::walkDir(Context& ctx, const WalkDirOptions& opts, const MetaCacheEntryFn& fn) {
+    if (offline.load(std::memory_order_acquire)) {
+        totalErrorsAvailability.fetch_add(1, std::memory_order_relaxed);
+        return errFaultyDisk;
+    }
+    auto t = metrics.track(storageMetricWalkDir);
+    return storage->walkDir(ctx, opts, fn);
+}
+
+Error XLStorageDiskIDCheck::deleteVersion(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, bool forceDelMarker, const DeleteOptions& opts) {
+    return run(storageMetricDeleteVersion, 0, [&]() {
+        totalDeletes.fetch_add(1, std::memory_order_relaxed);
+        return storage->deleteVersion(ctx, volume, path, fi, forceDelMarker, opts);
+    });
+}
+
+std::vector<Error> XLStorageDiskIDCheck::deleteVersions(Context& ctx, const std::string& volume, const std::vector<FileInfoVersions>& versions, const DeleteOptions& opts) {
+    if (auto err = enter()) {
+        return std::vector<Error>(versions.size(), err);
+    }
+    Call call(*this);
+    auto t = metrics.track(storageMetricDeleteVersions);
+    totalDeletes.fetch_add(versions.size(), std::memory_order_relaxed);
+    return storage->deleteVersions(ctx, volume, versions, opts);
+}
+
+Error XLStorageDiskIDCheck::writeMetadata(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const FileInfo& fi) {
+    return run(storageMetricWriteMetadata, 0, [&]() {
+        totalWrites.fetch_add(1, std::memory_order_relaxed);
+        return storage->writeMetadata(ctx, origVolume, volume, path, fi);
+    });
+}
+
+Error XLStorageDiskIDCheck::updateMetadata(Context& ctx, const std::string& volume, const std::string& path, const FileInfo& fi, const UpdateMetadataOpts& opts) {
+    return run(storageMetricUpdateMetadata, 0, [&]() {
+        totalWrites.fetch_add(1, std::memory_order_relaxed);
+        return storage->updateMetadata(ctx, volume, path, fi, opts);
+    });
+}
+
+FileInfo XLStorageDiskIDCheck::readVersion(Context& ctx, const std::string& origVolume, const std::string& volume, const std::string& path, const std::string& versionID, const ReadOptions& opts) {
+    return run(storageMetricReadVersion, 0, [&]() { return storage->readVersion(ctx, origVolume, volume, path, versionID, opts); });
+}
+
+RawFileInfo XLStorageDiskIDCheck::readXL(Context& ctx, const std::string& volume, const std::string& path, bool readData) {
+    return run(storageMetricReadXL, 0, [&]() { return storage->readXL(ctx, volume, path, readData); });
+}
+
+uint64_t XLStorageDiskIDCheck::renameData(Context& ctx, const std::string& srcVolume, const std::string& srcPath, const FileInfo& fi, const std::string& dstVolume, const std::string& dstPath, const RenameOptions& opts) {
+    return run(storageMetricRenameData, 0, [&]() {
+        totalWrites.fetch_add(1, std::memory_order_relaxed);
+        return storage->renameData(ctx, srcVolume, srcPath, fi, dstVolume, dstPath, opts);
+    });
+}
+
+std::vector<std::string> XLStorageDiskIDCheck::listDir(const std::string& volume, const std::string& dirpath, int count) {
+    return run(storageMetricListDir, 0, [&]() { return storage->listDir(volume, dirpath, count); });
+}
+
+int64_t XLStorageDiskIDCheck::readFile(const std::string& volume, const std::string& path, int64_t offset, std::vector<uint8_t>& buf, const BitrotVerifier* verifier) {
+    return run(storageMetricReadFile, static_cast<int64_t>(buf.size()), [&]() { return storage->readFile(volume, path, offset, buf, verifier); });
+}
+
+void XLStorageDiskIDCheck::appendFile(const std::string& volume, const std::string& path, const std::vector<uint8_t>& buf) {
+    run(storageMetricAppendFile, static_cast<int64_t>(buf.size()), [&]() {
+        totalWrites.fetch_add(1, std::memory_order_relaxed);
+        storage->appendFile(volume, path, buf);
+    });
+}
+
+// Like a walk, a create runs as fast as its reader delivers, it takes no
+// slot and has no deadline.
+void XLStorageDiskIDCheck::createFile(const std::string& volume, const std::string& path, int64_t size, std::istream& reader) {
+    if (offline.load(std::memory_order_acquire)) {
+        totalErrorsAvailability.fetch_add(1, std::memory_order_relaxed);
+        throw StorageError(errFaultyDisk);
+    }
+    auto t = metrics.track(storageMetricCreateFile, size);
+    totalWrites.fetch_add(1, std::memory_order_relaxed);
+    storage->createFile(volume, path, size, reader);
+}
+
+std::unique_ptr<std::istream> XLStorageDiskIDCheck::readfileStream(const std::string& volume, const std::string& path, int64_t offset, int64_t length) {
+    return run(storageMetricReadFileStream, length, [&]() { return storage->readfileStream(volume, path, offset, length); });
+}
+
+Error XLStorageDiskIDCheck::openFileRange(const std::string& volume, const std::string& path, int64_t offset, int64_t length, FileRange& range) {
+    return run(storageMetricOpenFileRange, length, [&]() { return storage->openFileRange(volume, path, offset, length, range); });
+}
+
+void XLStorageDiskIDCheck::renameFile(const std::string& srcvolume, const std::string& srcpath, const std::string& dstvolume, const std::string& dstpath) {
+    run(storageMetricRenameFile, 0, [&]() {
+        totalWrites.fetch_add(1, std::memory_order_relaxed);
+        storage->renameFile(srcvolume, srcpath, dstvolume, dstpath);
+    });
+}
+
+void XLStorageDiskIDCheck::checkParts(const std::string& volume, const std::string& path, const FileInfo& fi) {
+    run(storageMetricCheckParts, 0, [&]() { storage->checkParts(volume, path, fi); });
+}
+
+void XLStorageDiskIDCheck::deletePath(const std::string& volume, const std::string& path, const DeleteOptions& opts) {
+    run(storageMetricDelete, 0, [&]() {
+        totalDeletes.fetch_add(1, std::memory_order_relaxed);
+        storage->deletePath(volume, path, opts);
+    });
+}
+
+void XLStorageDiskIDCheck::verifyFile(const std::string& volume, const std::string& path, const FileInfo& fi) {
+    run(storageMetricVerifyFile, 0, [&]() { storage->verifyFile(volume, path, fi); });
+}
+
+std::vector<StatInfo> XLStorageDiskIDCheck::statInfoFile(const std::string& volume, const std::string& path, bool glob) {
+    return run(storageMetricStatInfoFile, 0, [&]() { return storage->statInfoFile(volume, path, glob); });
+}
+
+void XLStorageDiskIDCheck::readMultiple(const ReadMultipleReq& req, std::vector<ReadMultipleResp>& resp) {
+    run(storageMetricReadMultiple, 0, [&]() { storage->readMultiple(req, resp); });
+}
+
+void XLStorageDiskIDCheck::cleanAbandonedData(const std::string& volume, const std::string& path) {
+    run(storageMetricDeleteAbandonedParts, 0, [&]() { storage->cleanAbandonedData(volume, path); });
+}
+
+void XLStorageDiskIDCheck::writeAll(const std::string& volume, const std::string& path, const std::vector<uint8_t>& data) {
+    run(storageMetricWriteAll, static_cast<int64_t>(data.size()), [&]() {
+        totalWrites.fetch_add(1, std::memory_order_relaxed);
+        storage->writeAll(volume, path, data);
+    });
+}
+
+std::vector<uint8_t> XLStorageDiskIDCheck::readAll(const std::string& volume, const std::string& path) {
+    if (auto err = enter()) {
+        throw StorageError(err);
+    }
+    Call call(*this);
+    auto t = metrics.track(storageMetricReadAll);
+    try {
+        auto data = storage->readAll(volume, path);
+        t.setSize(static_cast<int64_t>(data.size()));
+        return data;
+    } catch (const StorageError& e) {
+        call.err = e.error();
+        throw;
+    }
+}
@@ -0,0 +1,563 @@
+#include "include/xl_storage_format_v2.hpp"
+#include "include/bitrot.hpp"
+#include "include/storage_errors.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+using namespace cppio;
+
+namespace {
+
+// Size of the header and of the trailing msgp uint32 crc.
+const size_t xlHeaderSize = 8;
+const size_t xlCrcSize = 5;
+
+int64_t unixNanos(std::chrono::system_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point fromUnixNanos(int64_t ns) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+void encodeStringMap(MsgpWriter& w, const std::unordered_map<std::string, std::string>& m) {
+    w.appendMapHeader(static_cast<uint32_t>(m.size()));
+    for (const auto& [k, v] : m) {
+        w.appendString(k);
+        w.appendString(v);
+    }
+}
+
+void decodeStringMap(MsgpReader& r, std::unordered_map<std::string, std::string>& m) {
+    auto n = r.readMapHeader();
+    m.clear();
+    m.reserve(n);
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        auto k = r.readString();
+        auto v = r.readString();
+        m.emplace(k, v);
+    }
+}
+
+std::vector<uint8_t> toBytes(std::span<const uint8_t> b) {
+    return std::vector<uint8_t>(b.begin(), b.end());
+}
+
+}
+
+void cppio::encodeErasureInfo(MsgpWriter& w, const ErasureInfo& e) {
+    w.appendArrayHeader(7);
+    w.appendString(e.algorithm);
+    w.appendInt(e.dataBlocks);
+    w.appendInt(e.parityBlocks);
+    w.appendInt(e.blockSize);
+    w.appendInt(e.index);
+    w.appendArrayHeader(static_cast<uint32_t>(e.distribution.size()));
+    for (auto d : e.distribution) {
+        w.appendInt(d);
+    }
+    w.appendArrayHeader(static_cast<uint32_t>(e.checksums.size()));
+    for (const auto& c : e.checksums) {
+        w.appendArrayHeader(3);
+        w.appendInt(c.PartNumber);
+        w.appendUint(static_cast<uint32_t>(c.Algorithm));
+        w.appendBytes(c.Hash);
+    }
+}
+
+void cppio::decodeErasureInfo(MsgpReader& r, ErasureInfo& e) {
+    auto n = r.readArrayHeader();
+    e = ErasureInfo{};
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        switch (i) {
+        case 0: e.algorithm = r.readString(); break;
+        case 1: e.dataBlocks = static_cast<int>(r.readInt()); break;
+        case 2: e.parityBlocks = static_cast<int>(r.readInt()); break;
+        case 3: e.blockSize = r.readInt(); break;
+        case 4: e.index = static_cast<int>(r.readInt()); break;
+        case 5: {
+            auto m = r.readArrayHeader();
+            e.distribution.resize(m);
+            for (auto& d : e.distribution) {
+                d = static_cast<int>(r.readInt());
+            }
+            break;
+        }
+        case 6: {
+            auto m = r.readArrayHeader();
+            e.checksums.resize(m);
+            for (auto& c : e.checksums) {
+                auto fields = r.readArrayHeader();
+                c = ChecksumInfo{};
+                for (uint32_t f = 0; f < fields && r.ok(); ++f) {
+                    switch (f) {
+                    case 0: c.PartNumber = static_cast<int>(r.readInt()); break;
+                    case 1: c.Algorithm = static_cast<BitrotAlgorithm>(r.readUint()); break;
+                    case 2: c.Hash = toBytes(r.readBytes()); break;
+                    default: r.skip();
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            r.skip();
+        }
+    }
+}
+
+void cppio::encodeObjectPartInfo(MsgpWriter& w, const ObjectPartInfo& part) {
+    w.appendArrayHeader(7);
+    w.appendInt(part.number);
+    w.appendString(part.etag);
+    w.appendInt(part.size);
+    w.appendInt(part.actualSize);
+    w.appendInt(unixNanos(part.modTime));
+    w.appendBytes(part.index);
+    encodeStringMap(w, part.checksums);
+}
+
+void cppio::decodeObjectPartInfo(MsgpReader& r, ObjectPartInfo& part) {
+    auto n = r.readArrayHeader();
+    part = ObjectPartInfo{};
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        switch (i) {
+        case 0: part.number = static_cast<int>(r.readInt()); break;
+        case 1: part.etag = r.readString(); break;
+        case 2: part.size = r.readInt(); break;
+        case 3: part.actualSize = r.readInt(); break;
+        case 4: part.modTime = fromUnixNanos(r.readInt()); break;
+        case 5: part.index = toBytes(r.readBytes()); break;
+        case 6: decodeStringMap(r, part.checksums); break;
+        default: r.skip();
+        }
+    }
+}
+
+void cppio::encodeXLVersion(MsgpWriter& w, const FileInfo& fi) {
+    w.appendArrayHeader(xlVersionFields);
+    w.appendUint(static_cast<uint8_t>(fi.deleted ? XLVersionType::DeleteMarker : XLVersionType::Object));
+    w.appendString(fi.versionID);
+    w.appendString(fi.dataDir);
+    w.appendInt(unixNanos(fi.modTime));
+    w.appendInt(fi.size);
+    w.appendUint(fi.mode);
+    w.appendUint(fi.writtenByVersion);
+    encodeStringMap(w, fi.metadata);
+    w.appendArrayHeader(static_cast<uint32_t>(fi.parts.size()));
+    for (const auto& part : fi.parts) {
+        encodeObjectPartInfo(w, part);
+    }
+    encodeErasureInfo(w, fi.erasure);
+    w.appendBytes(fi.checksum);
+    w.appendString(fi.transitionStatus);
+    w.appendString(fi.transitionedObjName);
+    w.appendString(fi.transitionTier);
+    w.appendString(fi.transitionVersionID);
+    w.appendString(fi.replicationState);
+}
+
+void cppio::decodeXLVersion(MsgpReader& r, FileInfo& fi) {
+    auto n = r.readArrayHeader();
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        switch (i) {
+        case xlFieldType: fi.deleted = r.readUint() == static_cast<uint8_t>(XLVersionType::DeleteMarker); break;
+        case xlFieldVersionID: fi.versionID = r.readString(); break;
+        case xlFieldDataDir: fi.dataDir = r.readString(); break;
+        case xlFieldModTime: fi.modTime = fromUnixNanos(r.readInt()); break;
+        case xlFieldSize: fi.size = r.readInt(); break;
+        case xlFieldMode: fi.mode = static_cast<uint32_t>(r.readUint()); break;
+        case xlFieldWrittenByVersion: fi.writtenByVersion = r.readUint(); break;
+        case xlFieldMetadata: decodeStringMap(r, fi.metadata); break;
+        case xlFieldParts: {
+            auto m = r.readArrayHeader();
+            fi.parts.resize(m);
+            for (auto& part : fi.parts) {
+                decodeObjectPartInfo(r, part);
+            }
+            break;
+        }
+        case xlFieldErasure: decodeErasureInfo(r, fi.erasure); break;
+        case xlFieldChecksum: fi.checksum = toBytes(r.readBytes()); break;
+        case xlFieldTransitionStatus: fi.transitionStatus = r.readString(); break;
+        case xlFieldTransitionedObjName: fi.transitionedObjName = r.readString(); break;
+        case xlFieldTransitionTier: fi.transitionTier = r.readString(); break;
+        case xlFieldTransitionVersionID: fi.transitionVersionID = r.readString(); break;
+        case xlFieldReplicationState: fi.replicationState = r.readString(); break;
+        default: r.skip();
+        }
+    }
+}
+
+bool cppio::isXL2(std::span<const uint8_t> buf) {
+    return buf.size() >= xlHeaderSize && std::memcmp(buf.data(), xlHeader, sizeof(xlHeader)) == 0;
+}
+
+Error cppio::xlMetaV2Versions(std::span<const uint8_t> buf, std::span<const uint8_t>& versions,
+                              std::span<const uint8_t>* data) {
+    if (!isXL2(buf) || buf.size() < xlHeaderSize + xlCrcSize) {
+        return errFileCorrupt;
+    }
+    auto major = static_cast<uint16_t>(buf[4] | buf[5] << 8);
+    if (major != xlVersionMajor) {
+        return errFileCorrupt;
+    }
+
+    // The versions end where the crc starts, skip over them to find it.
+    MsgpReader r(buf.subspan(xlHeaderSize));
+    r.skip();
+    if (!r.ok()) {
+        return r.error();
+    }
+    auto end = static_cast<size_t>(r.position() - buf.data());
+    auto crc = r.readUint();
+    if (!r.ok() || crc != crc32c(0, buf.data(), end)) {
+        return errFileCorrupt;
+    }
+    versions = buf.subspan(xlHeaderSize, end - xlHeaderSize);
+    if (data) {
+        *data = buf.subspan(static_cast<size_t>(r.position() - buf.data()));
+    }
+    return nullptr;
+}
+
+std::span<const uint8_t> cppio::xlMetaV2InlineData(std::span<const uint8_t> data, std::string_view versionID) {
+    MsgpReader r(data);
+    auto n = data.empty() ? 0 : r.readMapHeader();
+    for (uint32_t i = 0; i < n && r.ok(); ++i) {
+        if (r.readString() == versionID) {
+            return r.readBytes();
+        }
+        r.skip();
+    }
+    return {};
+}
+
+Error XLMetaV2::load(std::span<const uint8_t> buf) {
+    versionList.clear();
+    auto first = std::find_if(buf.begin(), buf.end(), [](uint8_t c) { return !std::isspace(c); });
+    if (first != buf.end() && *first == '{') {
+        return loadJSON(buf);
+    }
+
+    std::span<const uint8_t> versions;
+    std::span<const uint8_t> data;
+    if (auto err = xlMetaV2Versions(buf, versions, &data)) {
+        return err;
+    }
+    MsgpReader r(versions);
+    auto n = r.readArrayHeader();
+    versionList.resize(n);
+    for (auto& fi : versionList) {
+        fi = FileInfo{};
+        decodeXLVersion(r, fi);
+    }
+
+    MsgpReader d(data);
+    auto m = data.empty() ? 0 : d.readMapHeader();
+    for (uint32_t i = 0; i < m && d.ok(); ++i) {
+        auto versionID = d.readString();
+        auto bytes = d.readBytes();
+        for (auto& fi : versionList) {
+            if (fi.versionID == versionID) {
+                fi.data.assign(bytes.begin(), bytes.end());
+            }
+        }
+    }
+    if (!r.ok() || !d.ok()) {
+        versionList.clear();
+        return r.ok() ? d.error() : r.error();
+    }
+    return nullptr;
+}
+
+// loadJSON reads the xl.meta of format v1, a single version:
+//
+//   {"version": "1.0.1", "format": "xl", "stat": {"size": ..., "modTime": ...},
+//    "erasure": {...}, "meta": {...}, "parts": [...]}
+//
+// with modTime in unix seconds, and erasure and parts as written by
+// ErasureInfo::to_ptree and ObjectPartInfo::to_ptree.
+Error XLMetaV2::loadJSON(std::span<const uint8_t> buf) {
+    FileInfo fi{};
+    try {
+        pt::ptree tree;
+        std::istringstream in(std::string(buf.begin(), buf.end()));
+        pt::read_json(in, tree);
+        if (tree.get<std::string>("format", "") != "xl") {
+            return errFileCorrupt;
+        }
+
+        fi.xLV1 = true;
+        fi.versionID = tree.get<std::string>("versionID", "");
+        fi.dataDir = tree.get<std::string>("dataDir", "");
+        fi.size = tree.get<int64_t>("stat.size");
+        fi.modTime = std::chrono::system_clock::from_time_t(tree.get<std::time_t>("stat.modTime", 0));
+        fi.erasure = ErasureInfo::from_ptree(tree.get_child("erasure"));
+        for (const auto& kv : tree.get_child("meta", pt::ptree())) {
+            fi.metadata[kv.first] = kv.second.get_value<std::string>();
+        }
+        for (const auto& kv : tree.get_child("parts", pt::ptree())) {
+            fi.parts.push_back(ObjectPartInfo::from_ptree(kv.second));
+        }
+    } catch (const pt::ptree_error&) {
+        return errFileCorrupt;
+    }
+    versionList.push_back(std::move(fi));
+    return nullptr;
+}
+
+void XLMetaV2::appendTo(std::vector<uint8_t>& buf) const {
+    auto start = buf.size();
+    buf.insert(buf.end(), xlHeader, xlHeader + sizeof(xlHeader));
+    buf.push_back(static_cast<uint8_t>(xlVersionMajor));
+    buf.push_back(static_cast<uint8_t>(xlVersionMajor >> 8));
+    buf.push_back(static_cast<uint8_t>(xlVersionMinor));
+    buf.push_back(static_cast<uint8_t>(xlVersionMinor >> 8));
+
+    MsgpWriter w(buf);
+    w.appendArrayHeader(static_cast<uint32_t>(versionList.size()));
+    for (const auto& fi : versionList) {
+        encodeXLVersion(w, fi);
+    }
+    w.appendUint32(crc32c(0, buf.data() + start, buf.size() - start));
+
+    auto inlined = std::count_if(versionList.begin(), versionList.end(),
+                                 [](const FileInfo& fi) { return !fi.data.empty(); });
+    if (inlined == 0) {
+        return;
+    }
+    w.appendMapHeader(static_cast<uint32_t>(inlined));
+    for (const auto& fi : versionList) {
+        if (!fi.data.empty()) {
+            w.appendString(fi.versionID);
+            w.appendBytes(fi.data);
+        }
+    }
+}
+
+std::vector<uint8_t> XLMetaV2::marshal() const {
+    std::vector<uint8_t> buf;
+    appendTo(buf);
+    return buf;
+}
+
+void XLMetaV2::addVersion(const FileInfo& fi) {
+    auto it = std::find_if(versionList.begin(), versionList.end(),
+                           [&](const FileInfo& v) { return v.versionID == fi.versionID; });
+    if (it != versionList.end()) {
+        versionList.erase(it);
+    }
+
+    // Newest first, a version of the same time goes before the older one.
+    auto pos = std::find_if(versionList.begin(), versionList.end(),
+                            [&](const FileInfo& v) { return v.modTime <= fi.modTime; });
+    auto& v = *versionList.insert(pos, fi);
+    // Only object level fields are kept.
+    v.volume.clear();
+    v.name.clear();
+}
+
+Error XLMetaV2::deleteVersion(const FileInfo& fi) {
+    auto it = std::find_if(versionList.begin(), versionList.end(),
+                           [&](const FileInfo& v) { return v.versionID == fi.versionID; });
+    if (it == versionList.end()) {
+        return errFileVersionNotFound;
+    }
+    versionList.erase(it);
+    return nullptr;
+}
+
+Error XLMetaV2::toFileInfo(const std::string& volume, const std::string& path,
+                           const std::string& versionID, FileInfo& fi, bool readData) const {
+    if (versionList.empty()) {
+        return errFileNotFound;
+    }
+    size_t idx = 0;
+    if (!versionID.empty()) {
+        while (idx < versionList.size() && versionList[idx].versionID != versionID) {
+            ++idx;
+        }
+        if (idx == versionList.size()) {
+            return errFileVersionNotFound;
+        }
+    }
+
+    fi = versionList[idx];
+    fi.volume = volume;
+    fi.name = path;
+    fi.isLatest = idx == 0;
+    fi.numVersions = static_cast<int>(versionList.size());
+    fi.successorModTime = idx > 0 ? versionList[idx - 1].modTime : std::chrono::system_clock::time_point{};
+    if (!readData) {
+        fi.data.clear();
+    }
+    return nullptr;
+}
+
+bool XLMetaV2::sharedDataDir(const FileInfo& fi) const {
+    if (fi.dataDir.empty()) {
+        return false;
+    }
+    return std::any_of(versionList.begin(), versionList.end(), [&](const FileInfo& v) {
+        return v.versionID != fi.versionID && v.dataDir == fi.dataDir;
+    });
+}
+
+FileInfoView::FileInfoView(std::span<const uint8_t> tuple) : tuple(tuple) {
+    MsgpReader r(tuple);
+    auto n = r.readArrayHeader();
+    if (r.ok()) {
+        fields = static_cast<int>(n);
+        offsets[0] = static_cast<uint32_t>(r.position() - tuple.data());
+    }
+}
+
+MsgpReader FileInfoView::field(int i) const {
+    if (i >= fields || i >= xlVersionFields) {
+        return MsgpReader(nullptr, 0);
+    }
+    while (located < i) {
+        MsgpReader r(tuple.subspan(offsets[located]));
+        r.skip();
+        if (!r.ok()) {
+            return MsgpReader(nullptr, 0);
+        }
+        offsets[++located] = static_cast<uint32_t>(r.position() - tuple.data());
+    }
+    return MsgpReader(tuple.subspan(offsets[i]));
+}
+
+bool FileInfoView::deleted() const {
+    return field(xlFieldType).readUint() == static_cast<uint8_t>(XLVersionType::DeleteMarker);
+}
+
+std::string_view FileInfoView::versionID() const {
+    return field(xlFieldVersionID).readString();
+}
+
+std::string_view FileInfoView::dataDir() const {
+    return field(xlFieldDataDir).readString();
+}
+
+std::chrono::system_clock::time_point FileInfoView::modTime() const {
+    return fromUnixNanos(field(xlFieldModTime).readInt());
+}
+
+int64_t FileInfoView::size() const {
+    return field(xlFieldSize).readInt();
+}
+
+uint32_t FileInfoView::mode() const {
+    return static_cast<uint32_t>(field(xlFieldMode).readUint());
+}
+
+std::string_view FileInfoView::metadata(std::string_view key) const {
+    std::string_view value;
+    forEachMetadata([&](std::string_view k, std::string_view v) {
+        if (k != key) {
+            return true;
+        }
+        value = v;
+        return false;
+    });
+    return value;
+}
+
+size_t FileInfoView::numParts() const {
+    return field(xlFieldParts).readArrayHeader();
+}
+
+Error FileInfoView::toFileInfo(FileInfo& fi) const {
+    fi = FileInfo{};
+    MsgpReader r(tuple);
+    decodeXLVersion(r, fi);
+    return r.error();
+}
+
+Error XLMetaV2View::load(std::span<const uint8_t> buf) {
+    count = 0;
+    versions = {};
+    data = {};
+    std::span<const uint8_t> all;
+    if (auto err = xlMetaV2Versions(buf, all, &data)) {
+        return err;
+    }
+    metaSize = buf.size() - data.size();
+    MsgpReader r(all);
+    auto n = r.readArrayHeader();
+    if (!r.ok()) {
+        return r.error();
+    }
+    versions = all.subspan(static_cast<size_t>(r.position() - all.data()));
+    count = n;
+    return nullptr;
+}
+
+FileInfoView XLMetaV2View::version(size_t i) const {
+    if (i >= count) {
+        return FileInfoView();
+    }
+    MsgpReader r(versions);
+    for (size_t v = 0; v < i; ++v) {
+        r.skip();
+    }
+    auto start = r.position();
+    r.skip();
+    if (!r.ok()) {
+        return FileInfoView();
+    }
+    return FileInfoView(std::span<const uint8_t>(start, r.position()));
+}
+
+Error XLMetaV2View::find(std::string_view versionID, FileInfoView& view, size_t& idx) const {
+    if (count == 0) {
+        return errFileNotFound;
+    }
+    MsgpReader r(versions);
+    for (idx = 0; idx < count; ++idx) {
+        auto start = r.position();
+        r.skip();
+        if (!r.ok()) {
+            return r.error();
+        }
+        FileInfoView v(std::span<const uint8_t>(start, r.position()));
+        if (versionID.empty() || v.versionID() == versionID) {
+            view = v;
+            return nullptr;
+        }
+    }
+    return errFileVersionNotFound;
+}
+
+std::span<const uint8_t> XLMetaV2View::inlineData(std::string_view versionID) const {
+    return xlMetaV2InlineData(data, versionID);
+}
+
+Error XLMetaV2View::toFileInfo(const std::string& volume, const std::string& path,
+                               const std::string& versionID, FileInfo& fi, bool readData) const {
+    FileInfoView view;
+    size_t idx = 0;
+    if (auto err = find(versionID, view, idx)) {
+        return err;
+    }
+    if (auto err = view.toFileInfo(fi)) {
+        return err;
+    }
+    fi.volume = volume;
+    fi.name = path;
+    fi.isLatest = idx == 0;
+    fi.numVersions = static_cast<int>(count);
+    if (idx > 0) {
+        fi.successorModTime = version(idx - 1).modTime();
+    }
+    if (readData) {
+        auto inlined = inlineData(fi.versionID);
+        fi.data.assign(inlined.begin(), inlined.end());
+    }
+    return nullptr;
+}